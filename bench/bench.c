@@ -0,0 +1,206 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench.c -- microbenchmarks of the syscalls made through libc, run by
+ * bench_run with and without syscall_intercept preloaded.
+ *
+ * Usage: bench_syscalls <benchmark> <iterations>
+ *
+ * A JSON object is printed to stdout, containing the average duration
+ * of an iteration in nanoseconds, and in TSC cycles. The startup
+ * benchmark does nothing, its duration is measured by bench_run.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+static void
+bench_getppid(unsigned long iterations)
+{
+	for (unsigned long i = 0; i < iterations; ++i)
+		syscall(SYS_getppid);
+}
+
+/*
+ * bench_pipe - a write of one byte, and a read of the same byte
+ */
+static void
+bench_pipe(unsigned long iterations)
+{
+	int fds[2];
+	char c = 'x';
+
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	for (unsigned long i = 0; i < iterations; ++i) {
+		if (write(fds[1], &c, 1) != 1 || read(fds[0], &c, 1) != 1) {
+			perror("pipe read/write");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/*
+ * bench_futex - a wait that returns EAGAIN, as the futex does not hold
+ * the expected value, and a wake with no waiters
+ */
+static void
+bench_futex(unsigned long iterations)
+{
+	int futex = 0;
+
+	for (unsigned long i = 0; i < iterations; ++i) {
+		if (syscall(SYS_futex, &futex, FUTEX_WAIT_PRIVATE, 1,
+		    NULL, NULL, 0) != -1 || errno != EAGAIN) {
+			fputs("unexpected futex wait result\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+
+		syscall(SYS_futex, &futex, FUTEX_WAKE_PRIVATE, 1,
+		    NULL, NULL, 0);
+	}
+}
+
+static void *
+thread_func(void *arg)
+{
+	return arg;
+}
+
+/*
+ * bench_clone - creating a thread, and joining it
+ */
+static void
+bench_clone(unsigned long iterations)
+{
+	for (unsigned long i = 0; i < iterations; ++i) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, thread_func, NULL) != 0 ||
+		    pthread_join(thread, NULL) != 0) {
+			fputs("pthread_create/join failed\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void
+bench_startup(unsigned long iterations)
+{
+	(void) iterations;
+}
+
+static const struct benchmark {
+	const char *name;
+	void (*func)(unsigned long iterations);
+} benchmarks[] = {
+	{"getppid", bench_getppid},
+	{"pipe", bench_pipe},
+	{"futex", bench_futex},
+	{"clone", bench_clone},
+	{"startup", bench_startup},
+};
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <benchmark> <iterations>\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const struct benchmark *b = NULL;
+	for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]);
+	    ++i) {
+		if (strcmp(argv[1], benchmarks[i].name) == 0)
+			b = benchmarks + i;
+	}
+
+	if (b == NULL) {
+		fprintf(stderr, "unknown benchmark: %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	unsigned long iterations = strtoul(argv[2], NULL, 10);
+
+	if (b->func == bench_startup)
+		return EXIT_SUCCESS;
+
+	if (iterations == 0)
+		iterations = 1;
+
+	/* warm up, e.g. resolving the libc functions */
+	b->func(iterations / 100 + 1);
+
+	uint64_t start_ns = now_ns();
+	uint64_t start_cycles = __rdtsc();
+
+	b->func(iterations);
+
+	uint64_t cycles = __rdtsc() - start_cycles;
+	uint64_t ns = now_ns() - start_ns;
+
+	printf("{\"benchmark\": \"%s\", \"iterations\": %lu, "
+		"\"ns_per_call\": %.1f, \"cycles_per_call\": %.1f}\n",
+		b->name, iterations,
+		(double)ns / (double)iterations,
+		(double)cycles / (double)iterations);
+
+	return EXIT_SUCCESS;
+}
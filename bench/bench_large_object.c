@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_large_object.c -- a large synthetic shared object, containing
+ * ten thousand functions with a syscall instruction in each, used for
+ * measuring the time spent patching an object at startup.
+ */
+
+#include <syscall.h>
+
+#define FUNC(name) \
+long name(long arg); \
+long \
+name(long arg) \
+{ \
+	long result; \
+	__asm__ volatile("syscall" \
+		: "=a"(result) \
+		: "a"((long)SYS_getppid), "D"(arg) \
+		: "rcx", "r11", "memory"); \
+	return result * 3 + arg; \
+}
+
+#define FUNCS10(p) FUNC(p##0) FUNC(p##1) FUNC(p##2) FUNC(p##3) FUNC(p##4) \
+	FUNC(p##5) FUNC(p##6) FUNC(p##7) FUNC(p##8) FUNC(p##9)
+
+#define FUNCS100(p) FUNCS10(p##0) FUNCS10(p##1) FUNCS10(p##2) \
+	FUNCS10(p##3) FUNCS10(p##4) FUNCS10(p##5) FUNCS10(p##6) \
+	FUNCS10(p##7) FUNCS10(p##8) FUNCS10(p##9)
+
+#define FUNCS1000(p) FUNCS100(p##0) FUNCS100(p##1) FUNCS100(p##2) \
+	FUNCS100(p##3) FUNCS100(p##4) FUNCS100(p##5) FUNCS100(p##6) \
+	FUNCS100(p##7) FUNCS100(p##8) FUNCS100(p##9)
+
+FUNCS1000(bench_func_0)
+FUNCS1000(bench_func_1)
+FUNCS1000(bench_func_2)
+FUNCS1000(bench_func_3)
+FUNCS1000(bench_func_4)
+FUNCS1000(bench_func_5)
+FUNCS1000(bench_func_6)
+FUNCS1000(bench_func_7)
+FUNCS1000(bench_func_8)
+FUNCS1000(bench_func_9)
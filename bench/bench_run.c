@@ -0,0 +1,253 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * bench_run.c -- runs each benchmark of bench_syscalls natively, with
+ * syscall_intercept preloaded without a hook, with a pass-through hook,
+ * and with INTERCEPT_LOG set. The results are printed to stdout as a
+ * JSON array.
+ *
+ * Usage: bench_run <bench_syscalls> <libsyscall_intercept.so>
+ *		<bench_hook.so> <iterations> [log path]
+ *
+ * The log is written to /dev/null by default, so only the cost of
+ * formatting and writing the log lines is measured.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+enum mode { native, intercept, hook, logging, mode_count };
+
+static const char *const mode_names[] = {
+	[native] = "native",
+	[intercept] = "intercept",
+	[hook] = "hook",
+	[logging] = "log",
+};
+
+/*
+ * The number of iterations of each benchmark is the iterations argument
+ * divided by the divisor below.
+ */
+static const struct benchmark {
+	const char *name;
+	unsigned long divisor;
+} benchmarks[] = {
+	{"getppid", 1},
+	{"pipe", 1},
+	{"futex", 1},
+	{"clone", 100},
+	{"startup", 1000},
+};
+
+static const char *bench_path;
+static const char *lib_path;
+static const char *hook_path;
+static const char *log_path = "/dev/null";
+
+/*
+ * run - run the benchmark in a child process, returns the number
+ * of bytes printed by the child into the buffer
+ */
+static size_t
+run(enum mode mode, const char *name, unsigned long iterations,
+	char *buffer, size_t size)
+{
+	char arg[32];
+	int fds[2];
+
+	snprintf(arg, sizeof(arg), "%lu", iterations);
+
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	if (pid == 0) {
+		unsetenv("LD_PRELOAD");
+		unsetenv("INTERCEPT_LOG");
+		unsetenv("INTERCEPT_STATS");
+
+		if (mode == intercept || mode == logging)
+			setenv("LD_PRELOAD", lib_path, 1);
+		else if (mode == hook)
+			setenv("LD_PRELOAD", hook_path, 1);
+
+		if (mode == logging)
+			setenv("INTERCEPT_LOG", log_path, 1);
+
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+
+		execl(bench_path, bench_path, name, arg, (char *)NULL);
+		perror("execl");
+		_exit(EXIT_FAILURE);
+	}
+
+	close(fds[1]);
+
+	size_t len = 0;
+	ssize_t r;
+	while (len < size - 1 &&
+	    (r = read(fds[0], buffer + len, size - 1 - len)) > 0)
+		len += (size_t)r;
+
+	buffer[len] = '\0';
+	close(fds[0]);
+
+	int status;
+	if (waitpid(pid, &status, 0) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "benchmark %s failed in mode %s\n",
+			name, mode_names[mode]);
+		exit(EXIT_FAILURE);
+	}
+
+	return len;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * run_startup - measure the time from fork to the exit of the benchmark
+ * program, which does nothing else in the startup benchmark
+ */
+static void
+run_startup(enum mode mode, const char *name, unsigned long runs)
+{
+	char buffer[0x100];
+	uint64_t start_ns = now_ns();
+	uint64_t start_cycles = __rdtsc();
+
+	for (unsigned long i = 0; i < runs; ++i)
+		run(mode, name, 0, buffer, sizeof(buffer));
+
+	uint64_t cycles = __rdtsc() - start_cycles;
+	uint64_t ns = now_ns() - start_ns;
+
+	printf("{\"mode\": \"%s\", \"benchmark\": \"%s\", "
+		"\"iterations\": %lu, "
+		"\"ns_per_call\": %.1f, \"cycles_per_call\": %.1f}",
+		mode_names[mode], name, runs,
+		(double)ns / (double)runs,
+		(double)cycles / (double)runs);
+}
+
+/*
+ * run_bench - run the benchmark once, and print its result, with the
+ * mode added as the first attribute of the JSON object
+ */
+static void
+run_bench(enum mode mode, const char *name, unsigned long iterations)
+{
+	char buffer[0x400];
+	size_t len = run(mode, name, iterations, buffer, sizeof(buffer));
+
+	while (len > 0 && buffer[len - 1] == '\n')
+		buffer[--len] = '\0';
+
+	if (buffer[0] != '{') {
+		fprintf(stderr, "unexpected output of benchmark %s: %s\n",
+			name, buffer);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("{\"mode\": \"%s\", %s", mode_names[mode], buffer + 1);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 5) {
+		fprintf(stderr, "usage: %s <bench_syscalls> "
+			"<libsyscall_intercept.so> <bench_hook.so> "
+			"<iterations> [log path]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bench_path = argv[1];
+	lib_path = argv[2];
+	hook_path = argv[3];
+
+	unsigned long iterations = strtoul(argv[4], NULL, 10);
+
+	if (argc > 5)
+		log_path = argv[5];
+
+	const char *separator = "[\n";
+
+	for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]);
+	    ++b) {
+		unsigned long count = iterations / benchmarks[b].divisor;
+
+		if (count == 0)
+			count = 1;
+
+		for (int mode = 0; mode < mode_count; ++mode) {
+			fputs(separator, stdout);
+			separator = ",\n";
+
+			if (strcmp(benchmarks[b].name, "startup") == 0)
+				run_startup(mode, benchmarks[b].name, count);
+			else
+				run_bench(mode, benchmarks[b].name, count);
+
+			fflush(stdout);
+		}
+	}
+
+	puts("\n]");
+
+	return EXIT_SUCCESS;
+}
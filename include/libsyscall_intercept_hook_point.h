@@ -33,6 +33,8 @@
 #ifndef LIBSYSCALL_INTERCEPT_HOOK_POINT_H
 #define LIBSYSCALL_INTERCEPT_HOOK_POINT_H
 
+#include <stddef.h>
+
 /*
  * The inteface for using the intercepting library.
  * This callback function should be implemented by
@@ -57,9 +59,316 @@ extern int (*intercept_hook_point)(long syscall_number,
 			long arg4, long arg5,
 			long *result);
 
+/*
+ * intercept_hook_point_post - a hook called after a syscall returns
+ *
+ * A hook function called before a syscall can return
+ * INTERCEPT_HOOK_FORWARD_POST -- instead of another non-zero value -- to
+ * have the syscall forwarded to the kernel, and intercept_hook_point_post
+ * called with its result, if it is set. The post hook receives the same
+ * syscall number and arguments, and can change the result stored at
+ * *result, before it is returned to libc. This allows a hook to observe
+ * the results of the syscalls it is interested in, without making the
+ * syscall itself using syscall_no_intercept.
+ * The post hook is called in both processes after a fork, but it is not
+ * called after a clone syscall creating a thread on a new stack -- see
+ * intercept_hook_point_clone_parent -- nor after vfork, and rt_sigreturn.
+ */
+#define INTERCEPT_HOOK_FORWARD_POST 2
+
+extern void (*intercept_hook_point_post)(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
+/*
+ * intercept_hook_point_register - install a hook for a single syscall number
+ *
+ * Besides the catch-all intercept_hook_point above, a hook can be installed
+ * for each syscall number separately, with the same arguments and the same
+ * return value convention. When a syscall is intercepted, the hook registered
+ * for its number is called if there is one, otherwise intercept_hook_point
+ * is called if it is set, otherwise the syscall is forwarded to the kernel
+ * without calling any hook.
+ * Passing NULL as hook removes the hook registered for syscall_number.
+ * Returns zero on success, or -1 if syscall_number is not less than
+ * INTERCEPT_HOOK_TABLE_SIZE, or is negative.
+ */
+#define INTERCEPT_HOOK_TABLE_SIZE 512
+
+int intercept_hook_point_register(long syscall_number,
+			int (*hook)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result));
+
+/*
+ * intercept_hook_point_chain_add - add a hook to an ordered chain of hooks
+ *
+ * Several libraries loaded into the same process can each add hooks to the
+ * chain, instead of competing for intercept_hook_point. Each hook is
+ * called only for the syscall numbers set in its mask: bit (nr % 64) of
+ * mask[nr / 64] for syscall number nr. A NULL mask means every syscall.
+ * The hooks of a syscall are called in the order of their priority, the
+ * highest priority first -- hooks of equal priority in the order they were
+ * added -- until one of them returns zero, i.e. emulates the syscall. If
+ * none of them does, intercept_hook_point is called last, if it is set.
+ * The syscall is forwarded to the kernel if every hook called returns
+ * non-zero, and intercept_hook_point_post is called after it, if any of
+ * them returned INTERCEPT_HOOK_FORWARD_POST.
+ * A hook registered for a single syscall number with
+ * intercept_hook_point_register is called instead of the chain.
+ * Hooks can be added and removed while other threads are making syscalls.
+ * Returns zero on success, or -1 if hook is NULL, or the chain already
+ * holds INTERCEPT_HOOK_CHAIN_MAX hooks.
+ */
+#define INTERCEPT_HOOK_CHAIN_MAX 16
+#define INTERCEPT_HOOK_MASK_WORDS (INTERCEPT_HOOK_TABLE_SIZE / 64)
+int intercept_hook_point_chain_add(int priority, const unsigned long *mask,
+			int (*hook)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result));
+
+/*
+ * intercept_hook_point_chain_add_post - add a hook to the chain, along with
+ * a post hook of its own
+ *
+ * The same as intercept_hook_point_chain_add, except for the syscalls the
+ * hook returns INTERCEPT_HOOK_FORWARD_POST for: the post hook is called
+ * with their results, instead of intercept_hook_point_post. After such a
+ * syscall, intercept_hook_point_post is called first -- if the catch-all
+ * hook, or a hook in the chain without a post hook asked for it --, then
+ * the post hooks of the chain, in the reverse order of calling the hooks.
+ * Passing NULL as post is the same as calling
+ * intercept_hook_point_chain_add.
+ */
+int intercept_hook_point_chain_add_post(int priority,
+			const unsigned long *mask,
+			int (*hook)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result),
+			void (*post)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result));
+
+/*
+ * intercept_hook_point_chain_remove - remove a hook added to the chain
+ * Returns zero on success, or -1 if the hook is not in the chain.
+ */
+int intercept_hook_point_chain_remove(int (*hook)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result));
+
+/*
+ * intercept_hook_point_general_regs_only - declare whether the hook functions
+ * leave the SIMD registers (XMM, YMM, etc..) intact, e.g. by being compiled
+ * with the -mgeneral-regs-only option, and not calling any code that uses
+ * these registers. If so, libsyscall_intercept does not save and restore
+ * these registers around calling the hooks, which makes intercepting
+ * syscalls somewhat faster.
+ * While enabled, the hooks must not call any libc function, as libc is not
+ * built that way -- not even memcpy, or strlen.
+ * Returns one if the SIMD registers are not saved after the call, zero
+ * otherwise. This is not supported, if libsyscall_intercept itself was not
+ * built with such a compiler option, or when INTERCEPT_DEBUG_DUMP, or
+ * INTERCEPT_PATCH_DLOPEN is set, which make the library call libc while
+ * handling syscalls -- in that case this function always returns zero.
+ */
+int intercept_hook_point_general_regs_only(int enable);
+
+/*
+ * intercept_hook_point_thread_bypass - while enabled, the syscalls made by
+ * the calling thread are forwarded to the kernel directly, without calling
+ * any hook, and without logging them. This is almost as fast as a syscall
+ * made without libsyscall_intercept loaded. The setting only affects the
+ * calling thread, new threads start with it disabled.
+ * Returns the previous setting: one if it was enabled, zero otherwise.
+ */
+int intercept_hook_point_thread_bypass(int enable);
+
+/*
+ * intercept_hook_point_thread_context_setup - set up a per-thread context
+ * for the hooks, of size bytes, zero filled, and passed to init -- if not
+ * NULL -- when it is allocated. The context of a thread is allocated when
+ * the thread is created by an intercepted clone syscall, just before
+ * intercept_hook_point_clone_child is called, or when
+ * intercept_hook_point_thread_context is first called in the thread
+ * otherwise. It is released when the thread exits.
+ * This can only be done once, before any hook asks for its context.
+ * Returns zero on success, -1 if it was already done, or if size is zero,
+ * or larger than a megabyte.
+ */
+int intercept_hook_point_thread_context_setup(size_t size,
+			void (*init)(void *context));
+
+/*
+ * intercept_hook_point_thread_context - the context of the calling thread,
+ * or NULL if intercept_hook_point_thread_context_setup was not called.
+ * This is a cheaper way of keeping per-thread state in a hook, than using
+ * thread local variables in a preloaded library.
+ */
+void *intercept_hook_point_thread_context(void);
+
+/*
+ * intercept_patches_enable - remove the patches from the text of all
+ * objects patched, or write them back. While the patches are removed, the
+ * original code runs, and no syscall is intercepted, making the process
+ * run at native speed -- not even the ones caught due to
+ * INTERCEPT_SYSCALL_DISPATCH. This can be done while other threads are running:
+ * each other thread is stopped while the code is written, by handling a
+ * real-time signal -- SIGRTMAX, unless INTERCEPT_TOGGLE_SIGNAL selects
+ * another one -- thus a syscall blocking in another thread at that time
+ * can return EINTR, if it can not be restarted. That signal must not be
+ * blocked for long in any thread, otherwise toggling fails after a second.
+ * An object loaded by dlopen while the patches are disabled is not patched.
+ * This must not be called from a signal handler.
+ * Returns the previous setting: one if the patches were enabled, zero
+ * otherwise, or -1 on failure -- the setting is not changed then.
+ */
+int intercept_patches_enable(int enable);
+
+/*
+ * intercept_write_batch_setup - coalesce small writes to an fd
+ *
+ * A helper for hooks of applications issuing many small write syscalls.
+ * With batching enabled for an fd, intercept_write_batch_hook copies the
+ * data of write syscalls to this fd into a buffer of size bytes, and
+ * reports them as successful without forwarding them to the kernel.
+ * The buffered data is written out with a single writev syscall when the
+ * buffer is full, when a write does not fit into the buffer, when the
+ * oldest data in the buffer is at least max_delay_ns nanoseconds old at
+ * the time of a later write (zero means no time limit), when
+ * intercept_write_batch_flush is called, and before any other syscall
+ * referring to the fd (fsync, lseek, read, close, etc..) is forwarded to
+ * the kernel. All fds are flushed before syscalls that terminate, or
+ * duplicate the process (exit_group, execve, fork, clone, etc..).
+ * Closing the fd, or replacing it using dup2 or dup3 disables batching.
+ * Errors while writing buffered data can not be reported to the
+ * application, such data is dropped.
+ * A syscall in a signal handler interrupting a thread while it is buffering
+ * data for the same fd is forwarded without a flush, the buffered data is
+ * written after it.
+ *
+ * A size of zero disables batching for the fd, after flushing it.
+ * Batching is only available for fds less than INTERCEPT_WRITE_BATCH_FD_LIMIT.
+ * Returns zero on success, -1 on failure.
+ */
+#define INTERCEPT_WRITE_BATCH_FD_LIMIT 1024
+
+int intercept_write_batch_setup(int fd, size_t size, long max_delay_ns);
+
+/*
+ * intercept_write_batch_hook - the hook function implementing the batching
+ * set up by intercept_write_batch_setup. It can be used directly as
+ * intercept_hook_point, or called from the beginning of another hook,
+ * passing the same arguments -- a zero return value means the syscall was
+ * handled, with its result in *result. It must see all syscalls made
+ * by the application, to notice the syscalls requiring a flush.
+ */
+int intercept_write_batch_hook(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
+/*
+ * intercept_write_batch_flush - write out the data buffered for an fd,
+ * or for all fds if fd is -1. Returns zero on success, -1 on failure,
+ * including a call from a signal handler interrupting a thread while it
+ * is buffering data for the fd. The same applies to disabling batching
+ * using intercept_write_batch_setup.
+ */
+int intercept_write_batch_flush(int fd);
+
+/*
+ * intercept_fd_owner_set - a table of fds owned by the hooks
+ *
+ * A helper for hooks virtualizing some fds, e.g. implementing a filesystem
+ * in user space. An fd can be marked as owned using a non-zero owner
+ * identifier, and the mark can be cleared by setting the owner to zero.
+ * The table can be accessed concurrently by any number of threads, without
+ * locking. The library does not change the table, not even when an owned
+ * fd is closed.
+ * Only fds less than INTERCEPT_FD_OWNER_LIMIT can be marked.
+ * Returns zero on success, -1 if the fd, or the owner is out of range.
+ */
+#define INTERCEPT_FD_OWNER_LIMIT (1 << 20)
+
+int intercept_fd_owner_set(int fd, int owner);
+
+/*
+ * intercept_fd_owner_get - the owner of an fd, zero if it is not owned
+ */
+int intercept_fd_owner_get(long fd);
+
+/*
+ * intercept_fd_owner_filter - while enabled, a syscall with fd arguments is
+ * only passed to the hooks, if one of these fds is owned. E.g. a read
+ * syscall on an fd not owned is forwarded to the kernel without calling
+ * any hook. Syscalls without fd arguments are still passed to the hooks,
+ * so are the *at syscalls, e.g. openat, as their paths might be absolute.
+ * Returns the previous setting: one if it was enabled, zero otherwise.
+ */
+int intercept_fd_owner_filter(int enable);
+
+/*
+ * intercept_path_filter_add - pass only the syscalls on paths under some
+ * prefixes to the hooks
+ *
+ * Once a prefix is added, a syscall with path arguments, all of them
+ * absolute paths not under any of the prefixes added, is forwarded to the
+ * kernel without calling any hook. A prefix is a path it matches, e.g.
+ * /mnt/a matches /mnt/a, /mnt//a/., and /mnt/a/b, but not /mnt/ab, as paths
+ * are compared in normalized form. Syscalls with relative paths, paths
+ * with ".." components, or paths that can not be read are still passed to
+ * the hooks.
+ * Prefixes can also be listed in the INTERCEPT_PATH_FILTER environment
+ * variable, separated by colons. Prefixes can be added while other threads
+ * are making syscalls, but can not be removed.
+ * Returns zero on success, -1 if the prefix is not an absolute path, or
+ * has a ".." component.
+ */
+int intercept_path_filter_add(const char *prefix);
+
 extern void (*intercept_hook_point_clone_child)(void);
 extern void (*intercept_hook_point_clone_parent)(long pid);
 
+/*
+ * intercept_hook_point_vdso - a hook for the functions in the vDSO
+ *
+ * When the INTERCEPT_VDSO environment variable is set, the calls glibc
+ * makes to the clock_gettime, clock_getres, gettimeofday, time, and getcpu
+ * functions in the vDSO are routed through this hook. Such calls are
+ * not syscalls, so intercept_hook_point is not called for them, and they
+ * are not logged. The syscall_number argument is the number of the
+ * syscall the vDSO function implements (e.g. SYS_clock_gettime), and the
+ * rest of the arguments are the arguments of the function. A zero return
+ * value means the value stored to *result is to be returned, otherwise
+ * the vDSO function is called. The hook is called directly from the caller
+ * of the vDSO function, with the usual calling convention.
+ */
+extern int (*intercept_hook_point_vdso)(long syscall_number,
+			long arg0, long arg1, long arg2,
+			long *result);
+
+/*
+ * syscall_vdso_no_intercept - call one of the vDSO functions above, without
+ * calling intercept_hook_point_vdso, or make the corresponding syscall, if
+ * the function is not available in the vDSO.
+ */
+long syscall_vdso_no_intercept(long syscall_number, long arg0, long arg1,
+			long arg2);
+
 /*
  * syscall_no_intercept - syscall without interception
  *
@@ -70,6 +379,47 @@ extern void (*intercept_hook_point_clone_parent)(long pid);
  */
 long syscall_no_intercept(long syscall_number, ...);
 
+/*
+ * syscall_uring_setup - create an io_uring instance for syscall_uring
+ *
+ * The read, write, pread64, pwrite64, and fsync syscalls executed using
+ * syscall_uring are submitted to a single io_uring instance shared by all
+ * threads, instead of being executed directly. The submissions of threads
+ * waiting for their I/O at the same time are batched into a single
+ * io_uring_enter syscall. With sqpoll set to non-zero, a kernel thread
+ * polls the submission queue, and the completions are polled in user
+ * space, in which case a thread often does not have to enter the kernel
+ * at all to perform I/O.
+ * The ring has entries submission queue entries; when it is full, the
+ * syscalls are executed using syscall_no_intercept. The same is done in
+ * child processes created using fork, and in signal handlers interrupting
+ * a thread using the ring.
+ * Can only be called successfully once. Returns zero on success, or a
+ * negative error code, e.g. -ENOSYS if io_uring is not available.
+ */
+int syscall_uring_setup(unsigned entries, int sqpoll);
+
+/*
+ * syscall_uring - execute a syscall using the ring created by
+ * syscall_uring_setup, if it is one of the syscalls supported there,
+ * otherwise use syscall_no_intercept. The return value has the same
+ * format as the return value of syscall_no_intercept.
+ */
+long syscall_uring(long syscall_number, long arg0, long arg1, long arg2,
+		long arg3);
+
+/*
+ * syscall_uring_hook - a hook function executing the syscalls supported
+ * by syscall_uring using the ring. It can be used as intercept_hook_point,
+ * or can be called from another hook function, passing the same arguments.
+ * Returns one, if the syscall is not supported, or the ring is not set up.
+ */
+int syscall_uring_hook(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
 /*
  * syscall_error_code - examines a return value from
  * syscall_no_intercept, and returns an error code if said
@@ -87,7 +437,9 @@ syscall_error_code(long result)
 /*
  * The syscall intercepting library checks for the
  * INTERCEPT_HOOK_CMDLINE_FILTER environment variable, with which one can
- * control in which processes interception should actually happen.
+ * control in which processes interception should actually happen, using a
+ * colon separated list of glob patterns, where patterns prefixed with '!'
+ * are excludes.
  * If the library is loaded in this process, but syscall interception
  * is not allowed, the syscall_hook_in_process_allowed function returns zero,
  * otherwise, it returns one. The user of the library can use it to notice
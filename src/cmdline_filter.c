@@ -30,6 +30,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <fnmatch.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -41,7 +42,42 @@
 #include "intercept.h"
 
 /*
- * cmdline_match - match the last component of the path in cmdline
+ * pattern_match - match one glob pattern against the command line
+ * The pattern is matched against each trailing part of cmdline that
+ * starts after a slash, as well as the whole of cmdline:
+ * "./somewhere/a.out" matches "a.out", "a.*", and "somewhere/a.out"
+ * "./a.out" matches "a.out"
+ * "./xa.out" does not match "a.out"
+ * A '*' in the pattern does not match a slash.
+ */
+static bool
+pattern_match(const char *pattern, size_t len)
+{
+	char buf[0x200];
+
+	if (len == 0 || len >= sizeof(buf))
+		return false;
+
+	memcpy(buf, pattern, len);
+	buf[len] = '\0';
+
+	if (fnmatch(buf, cmdline, FNM_PATHNAME) == 0)
+		return true;
+
+	for (const char *c = strchr(cmdline, '/'); c != NULL;
+	    c = strchr(c + 1, '/')) {
+		if (fnmatch(buf, c + 1, FNM_PATHNAME) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * cmdline_match - match the last component of the path in cmdline against
+ * a colon separated list of glob patterns. Patterns prefixed with '!' are
+ * excludes, and take precedence over the rest. Without any include pattern
+ * in the list, everything not excluded matches.
  */
 static int
 cmdline_match(const char *filter)
@@ -49,25 +85,30 @@ cmdline_match(const char *filter)
 	if (filter == NULL)
 		return 1;
 
-	size_t flen = strlen(filter);
-	size_t clen = strlen(cmdline);
-
-	if (flen > clen)
-		return 0; /* cmdline can't contain filter */
-
-	/*
-	 * If cmdline is longer, it must end with a slash + filter:
-	 * "./somewhere/a.out" matches "a.out"
-	 * "./a.out" matches "a.out"
-	 * "./xa.out" does not match "a.out"
-	 *
-	 * Of course if cmdline is not longer, the slash is not needed:
-	 * "a.out" matches "a.out"
-	 */
-	if (clen > flen && cmdline[clen - flen - 1] != '/')
+	if (*filter == '\0')
 		return 0;
 
-	return strcmp(cmdline + clen - flen, filter) == 0;
+	bool has_includes = false;
+	bool included = false;
+
+	while (*filter != '\0') {
+		size_t len = strcspn(filter, ":");
+
+		if (filter[0] == '!') {
+			if (pattern_match(filter + 1, len - 1))
+				return 0;
+		} else if (len > 0) {
+			has_includes = true;
+			if (!included)
+				included = pattern_match(filter, len);
+		}
+
+		filter += len;
+		if (*filter == ':')
+			++filter;
+	}
+
+	return included || !has_includes;
 }
 
 /*
@@ -54,6 +54,26 @@ syscall_no_intercept(long syscall_number, ...)
 	return 0;
 }
 
+int
+intercept_hook_point_register(long syscall_number,
+			int (*hook)(long syscall_number,
+					long arg0, long arg1,
+					long arg2, long arg3,
+					long arg4, long arg5,
+					long *result))
+{
+	(void) syscall_number;
+	(void) hook;
+	return 0;
+}
+
+int
+intercept_hook_point_general_regs_only(int enable)
+{
+	(void) enable;
+	return 0;
+}
+
 int
 syscall_hook_in_process_allowed(void)
 {
@@ -37,6 +37,8 @@
 int main()
 {
 	intercept_hook_point = nullptr;
+	(void) intercept_hook_point_register(0, nullptr);
+	(void) intercept_hook_point_general_regs_only(0);
 	(void) syscall_no_intercept(0);
 	(void) syscall_hook_in_process_allowed();
 }
@@ -0,0 +1,742 @@
+/*
+ * Copyright 2020, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * disasm_builtin.c -- a small x86-64 instruction length decoder, serving
+ * as an alternative to the capstone based implementation found in
+ * disasm_wrapper.c
+ *
+ * The patching logic only needs to know the length of each instruction,
+ * and a few properties of them: is it a syscall, a jump, a call, a nop,
+ * does it use RIP relative addressing, etc. None of this requires
+ * full disassembling, a table driven decoder of the prefixes, opcode,
+ * ModRM, SIB, displacement and immediate bytes is enough.
+ *
+ * This decoder does not allocate memory, and does not call any libc
+ * routine, thus it can be used from practically any context.
+ */
+
+#include "intercept.h"
+#include "intercept_util.h"
+#include "disasm_wrapper.h"
+
+#include <assert.h>
+#include <string.h>
+
+const char intercept_disasm_name[] = "builtin";
+
+struct intercept_disasm_context {
+	const unsigned char *begin;
+	const unsigned char *end;
+};
+
+/*
+ * The properties of opcodes, as stored in the opcode tables below.
+ * The low four bits describe the immediate operand following the
+ * opcode bytes (and the ModRM, SIB, displacement bytes), the rest
+ * are flags.
+ */
+enum {
+	imm_none = 0,
+	imm_b = 1, /* 8 bit immediate */
+	imm_w = 2, /* 16 bit immediate */
+	imm_z = 3, /* 16 or 32 bit immediate, depending on operand size */
+	imm_v = 4, /* 16, 32 or 64 bit immediate, depending on operand size */
+	imm_d = 5, /* 32 bit immediate (displacement) */
+	imm_a = 6, /* memory offset, depending on address size */
+	imm_wb = 7, /* 16 bit immediate followed by an 8 bit immediate */
+	imm_mask = 0xf,
+
+	op_modrm = 0x10, /* a ModRM byte follows the opcode */
+	op_invalid = 0x20 /* invalid in 64 bit mode, or handled separately */
+};
+
+#define N imm_none
+#define M op_modrm
+#define B imm_b
+#define W imm_w
+#define Z imm_z
+#define V imm_v
+#define D imm_d
+#define A imm_a
+#define E imm_wb
+#define X op_invalid
+
+/* BEGIN CSTYLED */
+
+/* one byte opcodes */
+static const unsigned char map_primary[0x100] = {
+/*	  0    1    2    3    4    5    6    7    8    9    a    b    c    d    e    f */
+/* 0 */	  M,   M,   M,   M,   B,   Z,   X,   X,   M,   M,   M,   M,   B,   Z,   X,   X,
+/* 1 */	  M,   M,   M,   M,   B,   Z,   X,   X,   M,   M,   M,   M,   B,   Z,   X,   X,
+/* 2 */	  M,   M,   M,   M,   B,   Z,   X,   X,   M,   M,   M,   M,   B,   Z,   X,   X,
+/* 3 */	  M,   M,   M,   M,   B,   Z,   X,   X,   M,   M,   M,   M,   B,   Z,   X,   X,
+/* 4 */	  X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,   X,
+/* 5 */	  N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   N,
+/* 6 */	  X,   X,   X,   M,   X,   X,   X,   X,   Z, M|Z,   B, M|B,   N,   N,   N,   N,
+/* 7 */	  B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,   B,
+/* 8 */	M|B, M|Z,   X, M|B,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 9 */	  N,   N,   N,   N,   N,   N,   N,   N,   N,   N,   X,   N,   N,   N,   N,   N,
+/* a */	  A,   A,   A,   A,   N,   N,   N,   N,   B,   Z,   N,   N,   N,   N,   N,   N,
+/* b */	  B,   B,   B,   B,   B,   B,   B,   B,   V,   V,   V,   V,   V,   V,   V,   V,
+/* c */	M|B, M|B,   W,   N,   X,   X, M|B, M|Z,   E,   N,   W,   N,   N,   B,   X,   N,
+/* d */	  M,   M,   M,   M,   X,   X,   X,   N,   M,   M,   M,   M,   M,   M,   M,   M,
+/* e */	  B,   B,   B,   B,   B,   B,   B,   B,   D,   D,   X,   B,   N,   N,   N,   N,
+/* f */	  X,   N,   X,   X,   N,   N,   M,   M,   N,   N,   N,   N,   N,   N,   M,   M,
+};
+
+/* two byte opcodes, following a 0x0f byte */
+static const unsigned char map_0f[0x100] = {
+/*	  0    1    2    3    4    5    6    7    8    9    a    b    c    d    e    f */
+/* 0 */	  M,   M,   M,   M,   X,   N,   N,   N,   N,   N,   X,   N,   X,   M,   N, M|B,
+/* 1 */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 2 */	  M,   M,   M,   M,   X,   X,   X,   X,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 3 */	  N,   N,   N,   N,   N,   N,   X,   N,   X,   X,   X,   X,   X,   X,   X,   X,
+/* 4 */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 5 */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 6 */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* 7 */	M|B, M|B, M|B, M|B,   M,   M,   M,   N,   M,   M,   X,   X,   M,   M,   M,   M,
+/* 8 */	  D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,   D,
+/* 9 */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* a */	  N,   N,   N,   M, M|B,   M,   X,   X,   N,   N,   N,   M, M|B,   M,   M,   M,
+/* b */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M, M|B,   M,   M,   M,   M,   M,
+/* c */	  M,   M, M|B,   M, M|B, M|B, M|B,   M,   N,   N,   N,   N,   N,   N,   N,   N,
+/* d */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* e */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+/* f */	  M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,   M,
+};
+
+/* END CSTYLED */
+
+#undef N
+#undef M
+#undef B
+#undef W
+#undef Z
+#undef V
+#undef D
+#undef A
+#undef E
+#undef X
+
+/*
+ * The opcode maps an instruction can refer to, either using
+ * escape bytes ( 0x0f, 0x0f 0x38, 0x0f 0x3a ), or using the map
+ * select field of a VEX/EVEX/XOP prefix.
+ */
+enum opcode_map {
+	map_id_primary,
+	map_id_0f,
+	map_id_0f38,
+	map_id_0f3a,
+	map_id_xop8,
+	map_id_xop9,
+	map_id_xopa,
+	map_id_other
+};
+
+/*
+ * The state of decoding a single instruction.
+ */
+struct decoder {
+	const unsigned char *code;
+	const unsigned char *end; /* one past the last usable byte */
+	const unsigned char *cursor;
+
+	bool opsize_prefix; /* 0x66 */
+	bool addrsize_prefix; /* 0x67 */
+	bool rep_prefix; /* 0xf3 */
+	bool rex_w;
+	bool rex_r;
+	bool rex_b;
+	bool has_rex;
+	bool has_vex; /* VEX, EVEX or XOP */
+
+	enum opcode_map map;
+	unsigned char opcode;
+
+	bool has_modrm;
+	unsigned char modrm;
+	bool rip_relative;
+	int32_t disp;
+};
+
+/*
+ * fetch - get the next byte of the instruction, returns false if no
+ * more bytes are available
+ */
+static bool
+fetch(struct decoder *dec, unsigned char *byte)
+{
+	if (dec->cursor >= dec->end)
+		return false;
+
+	if (dec->cursor - dec->code >= 15) /* too long for an instruction */
+		return false;
+
+	*byte = *dec->cursor++;
+	return true;
+}
+
+static bool
+skip(struct decoder *dec, size_t count)
+{
+	if ((size_t)(dec->end - dec->cursor) < count)
+		return false;
+
+	dec->cursor += count;
+
+	return dec->cursor - dec->code <= 15;
+}
+
+static int32_t
+read_disp32(const unsigned char *bytes)
+{
+	uint32_t value;
+
+	memcpy(&value, bytes, sizeof(value));
+
+	return (int32_t)value;
+}
+
+/*
+ * decode_prefixes - consume the legacy prefixes, and the REX prefix
+ * if present. Returns false if the instruction is truncated.
+ */
+static bool
+decode_prefixes(struct decoder *dec)
+{
+	while (dec->cursor < dec->end) {
+		switch (*dec->cursor) {
+			case 0x66:
+				dec->opsize_prefix = true;
+				break;
+			case 0x67:
+				dec->addrsize_prefix = true;
+				break;
+			case 0xf3:
+				dec->rep_prefix = true;
+				break;
+			case 0xf0: case 0xf2:
+			case 0x26: case 0x2e: case 0x36: case 0x3e:
+			case 0x64: case 0x65:
+				break;
+			default:
+				if ((*dec->cursor & 0xf0) == 0x40) {
+					unsigned char rex = *dec->cursor++;
+
+					dec->has_rex = true;
+					dec->rex_w = (rex & 8) != 0;
+					dec->rex_r = (rex & 4) != 0;
+					dec->rex_b = (rex & 1) != 0;
+				}
+				return dec->cursor < dec->end;
+		}
+
+		++dec->cursor;
+	}
+
+	return false;
+}
+
+/*
+ * decode_vex - decode a VEX, EVEX or XOP prefix, the cursor
+ * points to the byte following the first prefix byte.
+ */
+static bool
+decode_vex(struct decoder *dec, unsigned char first)
+{
+	unsigned char p0;
+	unsigned char p1;
+	unsigned map_select;
+
+	dec->has_vex = true;
+
+	if (!fetch(dec, &p0))
+		return false;
+
+	/* the R bit is stored inverted in all of these prefixes */
+	dec->rex_r = (p0 & 0x80) == 0;
+
+	if (first == 0xc5) {
+		/* two byte VEX prefix, implies the 0x0f map */
+		dec->map = map_id_0f;
+		return true;
+	}
+
+	if (!fetch(dec, &p1))
+		return false;
+
+	dec->rex_w = (p1 & 0x80) != 0;
+
+	if (first == 0x62) {
+		/* EVEX, one more payload byte */
+		if (!skip(dec, 1))
+			return false;
+		map_select = p0 & 7;
+	} else {
+		map_select = p0 & 0x1f;
+	}
+
+	if (first == 0x8f) {
+		switch (map_select) {
+			case 8:
+				dec->map = map_id_xop8;
+				break;
+			case 9:
+				dec->map = map_id_xop9;
+				break;
+			case 0xa:
+				dec->map = map_id_xopa;
+				break;
+			default:
+				return false;
+		}
+		return true;
+	}
+
+	switch (map_select) {
+		case 1:
+			dec->map = map_id_0f;
+			break;
+		case 2:
+			dec->map = map_id_0f38;
+			break;
+		case 3:
+			dec->map = map_id_0f3a;
+			break;
+		default:
+			dec->map = map_id_other;
+			break;
+	}
+
+	return true;
+}
+
+/*
+ * decode_modrm - consume the ModRM byte, and the SIB, displacement
+ * bytes if present.
+ */
+static bool
+decode_modrm(struct decoder *dec, bool register_only)
+{
+	if (!fetch(dec, &dec->modrm))
+		return false;
+
+	dec->has_modrm = true;
+
+	unsigned mod = dec->modrm >> 6;
+	unsigned rm = dec->modrm & 7;
+
+	if (register_only || mod == 3)
+		return true;
+
+	if (rm == 4) {
+		unsigned char sib;
+
+		if (!fetch(dec, &sib))
+			return false;
+
+		if (mod == 0 && (sib & 7) == 5)
+			mod = 2; /* no base register, disp32 follows */
+	} else if (mod == 0 && rm == 5) {
+		dec->rip_relative = true;
+		mod = 2;
+	}
+
+	if (mod == 1) {
+		dec->disp = (int8_t)*dec->cursor;
+		return skip(dec, 1);
+	}
+
+	if (mod == 2) {
+		if (!skip(dec, 4))
+			return false;
+		dec->disp = read_disp32(dec->cursor - 4);
+	}
+
+	return true;
+}
+
+/*
+ * opcode_properties - look up the properties of the opcode in
+ * the current opcode map, in the format of map_primary and map_0f
+ */
+static unsigned char
+opcode_properties(const struct decoder *dec)
+{
+	unsigned char op = dec->opcode;
+
+	switch (dec->map) {
+		case map_id_primary:
+			return map_primary[op];
+		case map_id_0f:
+			if (dec->has_vex) {
+				/* vzeroupper and vzeroall lack a ModRM */
+				if (op == 0x77)
+					return imm_none;
+				if ((op >= 0x70 && op <= 0x73) ||
+				    op == 0xc2 || (op >= 0xc4 && op <= 0xc6))
+					return op_modrm | imm_b;
+				return op_modrm;
+			}
+			/* extrq, insertq with two immediate bytes */
+			if (op == 0x78 && !dec->rep_prefix &&
+			    dec->opsize_prefix)
+				return op_modrm | imm_w;
+			return map_0f[op];
+		case map_id_0f38:
+		case map_id_xop9:
+		case map_id_other:
+			return op_modrm;
+		case map_id_0f3a:
+		case map_id_xop8:
+			return op_modrm | imm_b;
+		case map_id_xopa:
+			return op_modrm | imm_d;
+	}
+
+	return op_invalid;
+}
+
+/*
+ * immediate_size - the number of immediate operand bytes
+ */
+static unsigned
+immediate_size(const struct decoder *dec, unsigned char properties)
+{
+	switch (properties & imm_mask) {
+		case imm_b:
+			return 1;
+		case imm_w:
+			return 2;
+		case imm_z:
+			return (dec->opsize_prefix && !dec->rex_w) ? 2 : 4;
+		case imm_v:
+			if (dec->rex_w)
+				return 8;
+			return dec->opsize_prefix ? 2 : 4;
+		case imm_d:
+			return 4;
+		case imm_a:
+			return dec->addrsize_prefix ? 4 : 8;
+		case imm_wb:
+			return 3;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * decode_opcode - consume opcode bytes, including escape bytes
+ * and VEX/EVEX/XOP prefixes.
+ */
+static bool
+decode_opcode(struct decoder *dec)
+{
+	unsigned char byte;
+
+	if (!fetch(dec, &byte))
+		return false;
+
+	dec->map = map_id_primary;
+
+	if (!dec->has_rex && (byte == 0xc4 || byte == 0xc5 || byte == 0x62 ||
+	    (byte == 0x8f && dec->cursor < dec->end &&
+	    (*dec->cursor & 0x1f) >= 8))) {
+		if (!decode_vex(dec, byte))
+			return false;
+		return fetch(dec, &dec->opcode);
+	}
+
+	if (byte != 0x0f) {
+		dec->opcode = byte;
+		return true;
+	}
+
+	if (!fetch(dec, &byte))
+		return false;
+
+	if (byte == 0x38 || byte == 0x3a) {
+		dec->map = (byte == 0x38) ? map_id_0f38 : map_id_0f3a;
+		return fetch(dec, &dec->opcode);
+	}
+
+	dec->map = map_id_0f;
+	dec->opcode = byte;
+
+	return true;
+}
+
+/*
+ * modrm_reg - the reg field of the ModRM byte, without the REX.R bit
+ */
+static unsigned
+modrm_reg(const struct decoder *dec)
+{
+	return (dec->modrm >> 3) & 7;
+}
+
+/*
+ * classify - fill in the properties of the successfully decoded
+ * instruction, used by the patching logic.
+ */
+static void
+classify(const struct decoder *dec, struct intercept_disasm_result *result)
+{
+	const unsigned char *rip = dec->code + result->length;
+	const unsigned char *imm = dec->cursor;
+	unsigned char op = dec->opcode;
+
+	if (dec->map == map_id_primary) {
+		switch (op) {
+			case 0x70: case 0x71: case 0x72: case 0x73:
+			case 0x74: case 0x75: case 0x76: case 0x77:
+			case 0x78: case 0x79: case 0x7a: case 0x7b:
+			case 0x7c: case 0x7d: case 0x7e: case 0x7f:
+			case 0xe0: case 0xe1: case 0xe2: case 0xe3:
+			case 0xeb:
+				/* jcc, loop, jrcxz, jmp with 8 bit disp. */
+				result->is_jump = true;
+				result->is_rel_jump = true;
+				result->rip_disp = (int8_t)imm[-1];
+				break;
+			case 0xe8:
+			case 0xe9:
+				result->is_jump = true;
+				result->is_rel_jump = true;
+				result->is_call = (op == 0xe8);
+				result->rip_disp = read_disp32(imm - 4);
+				break;
+			case 0xc2:
+			case 0xc3:
+				result->is_ret = true;
+				break;
+			case 0x90:
+				if (!dec->rex_b && !dec->rep_prefix)
+					result->is_nop = true;
+				break;
+			case 0xb8:
+				/* mov $imm, %eax ; movabs $imm, %rax */
+				if (dec->rex_b || dec->opsize_prefix)
+					break;
+				result->is_mov_imm_eax = true;
+				if (dec->rex_w)
+					memcpy(&result->mov_imm, imm - 8, 8);
+				else
+					result->mov_imm =
+					    (uint32_t)read_disp32(imm - 4);
+				break;
+			case 0xc7:
+				/* xbegin */
+				if (dec->modrm == 0xf8) {
+					result->has_ip_relative_opr = true;
+					result->rip_disp = read_disp32(imm - 4);
+				}
+				/* mov $imm, %eax ; mov $imm, %rax */
+				if (dec->modrm == 0xc0 && !dec->rex_b &&
+				    !dec->opsize_prefix) {
+					result->is_mov_imm_eax = true;
+					result->mov_imm = read_disp32(imm - 4);
+					if (!dec->rex_w)
+						result->mov_imm = (uint32_t)
+						    result->mov_imm;
+				}
+				break;
+			case 0xff:
+				switch (modrm_reg(dec)) {
+					case 2: /* call */
+					case 3: /* far call */
+						result->is_call = true;
+						result->is_jump = true;
+						break;
+					case 4: /* jmp */
+					case 5: /* far jmp */
+						result->is_jump = true;
+						break;
+				}
+				if (result->is_jump && (dec->modrm >> 6) == 3)
+					result->is_indirect_jump = true;
+				break;
+		}
+	} else if (dec->map == map_id_0f && !dec->has_vex) {
+		if (op >= 0x80 && op <= 0x8f) {
+			/* jcc with 32 bit displacement */
+			result->is_jump = true;
+			result->is_rel_jump = true;
+			result->rip_disp = read_disp32(imm - 4);
+		} else if (op == 0x05) {
+			result->is_syscall = true;
+		} else if (op == 0x1f) {
+			result->is_nop = true;
+		}
+	}
+
+	if (result->is_rel_jump)
+		result->has_ip_relative_opr = true;
+
+	if (dec->rip_relative) {
+		result->has_ip_relative_opr = true;
+		result->rip_disp = dec->disp;
+	}
+
+	if (result->has_ip_relative_opr)
+		result->rip_ref_addr = rip + result->rip_disp;
+
+	/*
+	 * Only a lea instruction setting a 64 bit register can be
+	 * replaced by a movabs instruction loading the same value.
+	 */
+	if (dec->map == map_id_primary && op == 0x8d && dec->rip_relative &&
+	    dec->rex_w && !dec->opsize_prefix && !dec->addrsize_prefix) {
+		result->is_lea_rip = true;
+		result->arg_register_bits =
+		    (unsigned char)((dec->rex_r ? 8 : 0) | modrm_reg(dec));
+	}
+
+#ifndef NDEBUG
+	if (result->is_syscall)
+		result->mnemonic = "syscall";
+	else if (result->is_call)
+		result->mnemonic = "call";
+	else if (result->is_jump)
+		result->mnemonic = "jmp";
+	else if (result->is_ret)
+		result->mnemonic = "ret";
+	else if (result->is_nop)
+		result->mnemonic = "nop";
+	else if (result->is_lea_rip)
+		result->mnemonic = "lea";
+	else
+		result->mnemonic = "(bad)";
+#endif
+}
+
+/*
+ * intercept_disasm_init -- should be called before disassembling a region of
+ * code. The context created contains the boundaries of the code region,
+ * and must be passed to intercept_disasm_destroy following a
+ * disassembling loop.
+ */
+struct intercept_disasm_context *
+intercept_disasm_init(const unsigned char *begin, const unsigned char *end)
+{
+	struct intercept_disasm_context *context;
+
+	context = xmmap_anon(sizeof(*context));
+	context->begin = begin;
+	context->end = end;
+
+	return context;
+}
+
+/*
+ * intercept_disasm_destroy -- see comments for above routine
+ */
+void
+intercept_disasm_destroy(struct intercept_disasm_context *context)
+{
+	xmunmap(context, sizeof(*context));
+}
+
+/*
+ * intercept_disasm_next_instruction - Examines a single instruction
+ * in a text section.
+ */
+struct intercept_disasm_result
+intercept_disasm_next_instruction(struct intercept_disasm_context *context,
+					const unsigned char *code)
+{
+	static const unsigned char endbr64[] = {0xf3, 0x0f, 0x1e, 0xfa};
+
+	struct intercept_disasm_result result = {.address = code, 0, };
+	struct decoder dec = {.code = code, .cursor = code, };
+
+	if (code > context->end)
+		return result;
+
+	/* context->end points to the last byte of the region */
+	dec.end = context->end + 1;
+
+	if (dec.end - code >= (ptrdiff_t)sizeof(endbr64) &&
+	    memcmp(code, endbr64, sizeof(endbr64)) == 0) {
+		result.is_set = true;
+		result.is_endbr = true;
+		result.length = 4;
+#ifndef NDEBUG
+		result.mnemonic = "endbr64";
+#endif
+		return result;
+	}
+
+	if (!decode_prefixes(&dec))
+		return result;
+
+	if (!decode_opcode(&dec))
+		return result;
+
+	unsigned char properties = opcode_properties(&dec);
+
+	if (properties & op_invalid)
+		return result;
+
+	if (properties & op_modrm) {
+		/*
+		 * The mov to/from control/debug register instructions
+		 * ignore the mod field, they always refer to registers.
+		 */
+		bool register_only = dec.map == map_id_0f && !dec.has_vex &&
+			dec.opcode >= 0x20 && dec.opcode <= 0x23;
+
+		if (!decode_modrm(&dec, register_only))
+			return result;
+	}
+
+	unsigned imm_size = immediate_size(&dec, properties);
+
+	/* test instructions in the unary groups have an immediate */
+	if (dec.map == map_id_primary && modrm_reg(&dec) < 2) {
+		if (dec.opcode == 0xf6)
+			imm_size = 1;
+		else if (dec.opcode == 0xf7)
+			imm_size = immediate_size(&dec, imm_z);
+	}
+
+	if (!skip(&dec, imm_size))
+		return result;
+
+	result.length = (unsigned)(dec.cursor - code);
+	classify(&dec, &result);
+	result.is_set = true;
+
+	return result;
+}
@@ -0,0 +1,463 @@
+/*
+ * Copyright 2016-2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * disasm_cache.c -- an on-disk cache of the results of disassembling
+ * text sections. Used when the INTERCEPT_DISASM_CACHE environment variable
+ * is set to the path of a directory.
+ *
+ * The results of find_syscalls -- the patch descriptions, the jump
+ * bitmap, and the table of overwritable NOP instructions -- only depend
+ * on the contents of the object file, so they can be reused by later
+ * processes loading the same object. Objects are identified by their
+ * GNU build-id, objects without a build-id are never cached.
+ *
+ * The cache file of an object starts with a struct disasm_cache_header,
+ * followed by the arrays of patch descriptions, and NOP table entries,
+ * and the jump bitmap. The addresses in these are stored relative to
+ * the address where the object file would start in memory (see
+ * file_base below), so they can be used regardless of where the object
+ * is loaded. A cache file is created under a temporary name, and renamed
+ * once it is complete, so a process never reads a partially written
+ * file. Any problem with the cache is silently ignored, the object is
+ * disassembled in that case, as it would be without a cache.
+ *
+ * The records read from a cache file decide which code is overwritten,
+ * and which bytes are copied into the wrapper stubs, so a stale, corrupt,
+ * or planted file must not be used. The directory, and the file must be
+ * owned by the effective user, and not writable by others. Each record is
+ * checked against the text loaded, see is_valid_patch, and is_valid_nop.
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syscall.h>
+
+#include "intercept.h"
+#include "intercept_util.h"
+#include "disasm_wrapper.h"
+
+#define DISASM_CACHE_MAGIC "sci disasm v2"
+
+struct disasm_cache_header {
+	char magic[16];
+	char disassembler[16];
+	uint32_t patch_desc_size;
+	uint32_t disasm_result_size;
+	uint64_t text_offset;
+	uint64_t text_size;
+	uint64_t patch_count;
+	uint64_t nop_count;
+	uint64_t jump_table_size;
+};
+
+static const char *cache_dir;
+
+/*
+ * init_disasm_cache - turn on caching, if requested via the
+ * INTERCEPT_DISASM_CACHE environment variable
+ */
+/*
+ * is_trusted - is a file, or directory owned by the effective user, and not
+ * writable by anyone else
+ */
+static bool
+is_trusted(const struct stat *st)
+{
+	return st->st_uid == (uid_t)syscall_no_intercept(SYS_geteuid) &&
+	    (st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+void
+init_disasm_cache(const char *dir)
+{
+	struct stat st;
+
+	if (dir == NULL || dir[0] == '\0')
+		return;
+
+	if (syscall_no_intercept(SYS_stat, dir, &st) != 0 ||
+	    !S_ISDIR(st.st_mode) || !is_trusted(&st)) {
+		debug_dump("disasm cache directory %s not used\n", dir);
+		return;
+	}
+
+	cache_dir = dir;
+}
+
+/*
+ * file_base - the address corresponding to the start of the object file,
+ * as in: the text section is at text_offset in the file
+ */
+static uintptr_t
+file_base(const struct intercept_desc *desc)
+{
+	return (uintptr_t)(desc->text_start - desc->text_offset);
+}
+
+static size_t
+text_size(const struct intercept_desc *desc)
+{
+	return (size_t)(desc->text_end - desc->text_start + 1);
+}
+
+/*
+ * relocate - add delta to an address, unless it is NULL
+ */
+static const unsigned char *
+relocate(const unsigned char *address, uintptr_t delta)
+{
+	if (address == NULL)
+		return NULL;
+
+	return (const unsigned char *)((uintptr_t)address + delta);
+}
+
+static void
+relocate_ins(struct intercept_disasm_result *ins, uintptr_t delta)
+{
+	ins->address = relocate(ins->address, delta);
+	ins->rip_ref_addr = relocate(ins->rip_ref_addr, delta);
+#ifndef NDEBUG
+	ins->mnemonic = NULL;
+#endif
+}
+
+static void
+relocate_patch(struct patch_desc *patch, uintptr_t delta)
+{
+	patch->syscall_addr =
+	    (unsigned char *)relocate(patch->syscall_addr, delta);
+	relocate_ins(&patch->preceding_ins_2, delta);
+	relocate_ins(&patch->preceding_ins, delta);
+	relocate_ins(&patch->following_ins, delta);
+}
+
+/*
+ * get_cache_path - the path of the cache file of an object, formed from
+ * its build-id, e.g.: "/cache_dir/0123abcd.disasm"
+ */
+static bool
+get_cache_path(char *path, const struct intercept_desc *desc)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t dir_len = strlen(cache_dir);
+
+	if (desc->build_id_size == 0 ||
+	    dir_len + 2 * desc->build_id_size + sizeof("/.disasm") > PATH_MAX)
+		return false;
+
+	char *c = path;
+	memcpy(c, cache_dir, dir_len);
+	c += dir_len;
+	*c++ = '/';
+
+	for (size_t i = 0; i < desc->build_id_size; ++i) {
+		*c++ = hex[desc->build_id[i] >> 4];
+		*c++ = hex[desc->build_id[i] & 0xf];
+	}
+
+	strcpy(c, ".disasm");
+
+	return true;
+}
+
+static bool
+read_all(long fd, void *buffer, size_t size)
+{
+	char *c = buffer;
+
+	while (size > 0) {
+		long r = syscall_no_intercept(SYS_read, fd, c, size);
+		if (r <= 0)
+			return false;
+
+		c += r;
+		size -= (size_t)r;
+	}
+
+	return true;
+}
+
+static bool
+write_all(long fd, const void *buffer, size_t size)
+{
+	const char *c = buffer;
+
+	while (size > 0) {
+		long r = syscall_no_intercept(SYS_write, fd, c, size);
+		if (r <= 0)
+			return false;
+
+		c += r;
+		size -= (size_t)r;
+	}
+
+	return true;
+}
+
+/*
+ * The longest instruction on x86_64
+ */
+#define MAX_INS_SIZE 15
+
+/*
+ * is_in_text - is the range of size bytes at address in the text section
+ */
+static bool
+is_in_text(const struct intercept_desc *desc, const unsigned char *address,
+		size_t size)
+{
+	return address >= desc->text_start && address <= desc->text_end &&
+	    size <= (size_t)(desc->text_end - address) + 1;
+}
+
+/*
+ * is_valid_neighbour - an instruction next to a syscall, read from a cache
+ * file, is either not set at all, or decoded right at address, in the text
+ */
+static bool
+is_valid_neighbour(const struct intercept_desc *desc,
+		const struct intercept_disasm_result *ins,
+		const unsigned char *address)
+{
+	if (!ins->is_set)
+		return ins->length == 0 && !ins->is_lea_rip;
+
+	return ins->length > 0 && ins->length <= MAX_INS_SIZE &&
+	    ins->address == address && is_in_text(desc, address, ins->length);
+}
+
+/*
+ * is_valid_patch - check a relocated patch description read from a cache
+ * file against the text loaded
+ */
+static bool
+is_valid_patch(const struct intercept_desc *desc,
+		const struct patch_desc *patch)
+{
+	const unsigned char *syscall_addr = patch->syscall_addr;
+	const struct intercept_disasm_result *prev = &patch->preceding_ins;
+	const struct intercept_disasm_result *prev_2 = &patch->preceding_ins_2;
+
+	if (!is_in_text(desc, syscall_addr, SYSCALL_INS_SIZE) ||
+	    syscall_addr[0] != 0x0f || syscall_addr[1] != 0x05 ||
+	    patch->syscall_offset != (uintptr_t)syscall_addr - file_base(desc))
+		return false;
+
+	if (!is_valid_neighbour(desc, prev, syscall_addr - prev->length) ||
+	    !is_valid_neighbour(desc, &patch->following_ins,
+		syscall_addr + SYSCALL_INS_SIZE))
+		return false;
+
+	if (!prev->is_set)
+		return !prev_2->is_set && !prev_2->is_lea_rip;
+
+	return is_valid_neighbour(desc, prev_2,
+			prev->address - prev_2->length);
+}
+
+/*
+ * is_valid_nop - check a relocated NOP table entry read from a cache file
+ */
+static bool
+is_valid_nop(const struct intercept_desc *desc, const struct range *nop)
+{
+	return nop->size >= 2 + JUMP_INS_SIZE && nop->size <= MAX_INS_SIZE &&
+	    is_in_text(desc, nop->address, nop->size);
+}
+
+/*
+ * load_disasm_cache - fill the patch descriptions, jump bitmap, and NOP table
+ * of an object from its cache file. The jump bitmap and NOP table are
+ * expected to be allocated already. Returns false, if no usable cache file
+ * is found.
+ */
+bool
+load_disasm_cache(struct intercept_desc *desc)
+{
+	char path[PATH_MAX];
+	struct disasm_cache_header header;
+
+	if (cache_dir == NULL || !get_cache_path(path, desc))
+		return false;
+
+	long fd = syscall_no_intercept(SYS_open, path, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0) {
+		debug_dump("no disasm cache for %s at %s\n", desc->path, path);
+		return false;
+	}
+
+	struct stat st;
+
+	bool is_valid = syscall_no_intercept(SYS_fstat, fd, &st) == 0 &&
+	    S_ISREG(st.st_mode) && is_trusted(&st) &&
+	    read_all(fd, &header, sizeof(header)) &&
+	    strncmp(header.magic, DISASM_CACHE_MAGIC,
+		sizeof(header.magic)) == 0 &&
+	    strncmp(header.disassembler, intercept_disasm_name,
+		sizeof(header.disassembler)) == 0 &&
+	    header.patch_desc_size == sizeof(struct patch_desc) &&
+	    header.disasm_result_size ==
+		sizeof(struct intercept_disasm_result) &&
+	    header.text_offset == desc->text_offset &&
+	    header.text_size == text_size(desc) &&
+	    header.nop_count <= desc->max_nop_count &&
+	    header.jump_table_size == jump_table_size(desc) &&
+	    header.patch_count <= text_size(desc) / SYSCALL_INS_SIZE;
+
+	struct patch_desc *items = NULL;
+	size_t items_size = header.patch_count * sizeof(items[0]);
+
+	if (is_valid && header.patch_count > 0) {
+		items = xmmap_anon(items_size);
+		is_valid = read_all(fd, items, items_size);
+	}
+
+	is_valid = is_valid &&
+	    read_all(fd, desc->nop_table,
+		header.nop_count * sizeof(desc->nop_table[0])) &&
+	    read_all(fd, desc->jump_table, header.jump_table_size);
+
+	syscall_no_intercept(SYS_close, fd);
+
+	uintptr_t base = file_base(desc);
+
+	for (size_t i = 0; is_valid && i < header.patch_count; ++i) {
+		relocate_patch(items + i, base);
+		items[i].containing_lib_path = desc->path;
+		is_valid = is_valid_patch(desc, items + i);
+	}
+
+	for (size_t i = 0; is_valid && i < header.nop_count; ++i) {
+		desc->nop_table[i].address = (unsigned char *)
+		    relocate(desc->nop_table[i].address, base);
+		is_valid = is_valid_nop(desc, desc->nop_table + i);
+	}
+
+	if (!is_valid) {
+		debug_dump("invalid disasm cache for %s at %s\n",
+		    desc->path, path);
+		if (items != NULL)
+			xmunmap(items, items_size);
+		memset(desc->jump_table, 0, jump_table_size(desc));
+		return false;
+	}
+
+	desc->items = items;
+	desc->count = (unsigned)header.patch_count;
+	desc->nop_count = header.nop_count;
+
+	debug_dump("loaded disasm cache for %s from %s\n", desc->path, path);
+
+	return true;
+}
+
+/*
+ * store_disasm_cache - create the cache file of an object, after it was
+ * disassembled
+ */
+void
+store_disasm_cache(const struct intercept_desc *desc)
+{
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX + 0x20];
+
+	if (cache_dir == NULL || !get_cache_path(path, desc))
+		return;
+
+	struct disasm_cache_header header = {
+		.patch_desc_size = sizeof(struct patch_desc),
+		.disasm_result_size = sizeof(struct intercept_disasm_result),
+		.text_offset = desc->text_offset,
+		.text_size = text_size(desc),
+		.patch_count = desc->count,
+		.nop_count = desc->nop_count,
+		.jump_table_size = jump_table_size(desc),
+	};
+	strcpy(header.magic, DISASM_CACHE_MAGIC);
+	strncpy(header.disassembler, intercept_disasm_name,
+	    sizeof(header.disassembler) - 1);
+
+	/* a unique temporary name, e.g.: "/cache_dir/0123abcd.disasm.4321" */
+	char *c = tmp_path;
+	c += strlen(strcpy(c, path));
+	*c++ = '.';
+	long pid = syscall_no_intercept(SYS_getpid);
+	char digits[0x20];
+	char *d = digits + sizeof(digits);
+	*--d = '\0';
+	do {
+		*--d = (char)('0' + pid % 10);
+		pid /= 10;
+	} while (pid > 0);
+	strcpy(c, d);
+
+	long fd = syscall_no_intercept(SYS_open, tmp_path,
+				O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW, 0600);
+	if (fd < 0)
+		return;
+
+	uintptr_t delta = (uintptr_t)0 - file_base(desc);
+	bool ok = write_all(fd, &header, sizeof(header));
+
+	for (unsigned i = 0; ok && i < desc->count; ++i) {
+		struct patch_desc patch = desc->items[i];
+
+		relocate_patch(&patch, delta);
+		patch.containing_lib_path = NULL;
+		ok = write_all(fd, &patch, sizeof(patch));
+	}
+
+	for (size_t i = 0; ok && i < desc->nop_count; ++i) {
+		struct range nop = desc->nop_table[i];
+
+		nop.address = (unsigned char *)relocate(nop.address, delta);
+		ok = write_all(fd, &nop, sizeof(nop));
+	}
+
+	ok = ok && write_all(fd, desc->jump_table, header.jump_table_size);
+
+	syscall_no_intercept(SYS_close, fd);
+
+	if (ok)
+		ok = syscall_no_intercept(SYS_rename, tmp_path, path) == 0;
+
+	if (!ok)
+		syscall_no_intercept(SYS_unlink, tmp_path);
+
+	debug_dump("%s disasm cache for %s at %s\n",
+	    ok ? "created" : "failed to create", desc->path, path);
+}
@@ -47,6 +47,8 @@
 #include <syscall.h>
 #include "capstone_wrapper.h"
 
+const char intercept_disasm_name[] = "capstone";
+
 struct intercept_disasm_context {
 	csh handle;
 	cs_insn *insn;
@@ -314,6 +316,16 @@ intercept_disasm_next_instruction(struct intercept_disasm_context *context,
 		result.arg_register_bits |= ((code[2] >> 3) & 7);
 	}
 
+	result.is_mov_imm_eax = (context->insn->id == X86_INS_MOV &&
+	    context->insn->detail->x86.op_count == 2 &&
+	    context->insn->detail->x86.operands[0].type == X86_OP_REG &&
+	    (context->insn->detail->x86.operands[0].reg == X86_REG_EAX ||
+	    context->insn->detail->x86.operands[0].reg == X86_REG_RAX) &&
+	    context->insn->detail->x86.operands[1].type == X86_OP_IMM);
+
+	if (result.is_mov_imm_eax)
+		result.mov_imm = context->insn->detail->x86.operands[1].imm;
+
 	result.is_set = true;
 
 	return result;
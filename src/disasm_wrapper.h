@@ -79,6 +79,16 @@ struct intercept_disasm_result {
 	 */
 	unsigned char arg_register_bits;
 
+	/*
+	 * Flag marking mov instructions loading a constant into EAX, or RAX,
+	 * e.g.: mov $0xe7, %eax
+	 * Such an instruction right before a syscall instruction is
+	 * usually the one setting the syscall number, available in
+	 * the mov_imm field.
+	 */
+	bool is_mov_imm_eax;
+	int64_t mov_imm;
+
 	/* call instruction */
 	bool is_call;
 
@@ -113,6 +123,13 @@ struct intercept_disasm_result {
 #endif
 };
 
+/*
+ * The name of the disassembler implementation, e.g.: "capstone". The
+ * results of different implementations are not necessarily the same, this
+ * name is stored in the disasm cache files.
+ */
+extern const char intercept_disasm_name[];
+
 struct intercept_disasm_context;
 
 struct intercept_disasm_context *
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fd_owner.c -- a table of the fds owned by hooks, e.g. virtual fds of
+ * a filesystem implemented in user space, and a filter passing only the
+ * syscalls referring to such fds to the hooks.
+ *
+ * The table is a flat array of owner identifiers, indexed by the fd
+ * number, accessed with atomic loads and stores, without any lock. It is
+ * mapped once, with space for INTERCEPT_FD_OWNER_LIMIT fds, but the
+ * kernel only allocates the pages actually written to -- the table grows
+ * on demand, without ever moving.
+ *
+ * The filter uses the formats in syscall_formats.c to find the fd
+ * arguments of each syscall, these are collected into a bitmask per
+ * syscall number when the filter is first enabled.
+ */
+
+#include "fd_owner.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+#include "syscall_formats.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <syscall.h>
+
+bool intercept_fd_filter_on;
+
+static int *owners;
+
+/* The fd arguments of each syscall, bit i is set for argument i */
+static unsigned char fd_args[INTERCEPT_HOOK_TABLE_SIZE];
+
+/* The syscalls with a dirfd argument, i.e. the *at syscalls */
+static bool is_at_syscall[INTERCEPT_HOOK_TABLE_SIZE];
+
+static bool are_fd_args_collected;
+
+static int *
+get_table(void)
+{
+	int *table = __atomic_load_n(&owners, __ATOMIC_ACQUIRE);
+
+	if (table != NULL)
+		return table;
+
+	long addr = syscall_no_intercept(SYS_mmap, NULL,
+			INTERCEPT_FD_OWNER_LIMIT * sizeof(table[0]),
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+	xabort_on_syserror(addr, "mmap fd owner table");
+
+	int *expected = NULL;
+
+	table = (int *)addr;
+
+	/* lost the race against another thread, use its table */
+	if (!__atomic_compare_exchange_n(&owners, &expected, table,
+	    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		xmunmap(table, INTERCEPT_FD_OWNER_LIMIT * sizeof(table[0]));
+		table = __atomic_load_n(&owners, __ATOMIC_ACQUIRE);
+	}
+
+	return table;
+}
+
+/*
+ * intercept_fd_owner_set - mark an fd as owned by a hook, or clear the mark
+ */
+__attribute__((visibility("default")))
+int
+intercept_fd_owner_set(int fd, int owner)
+{
+	if (fd < 0 || fd >= INTERCEPT_FD_OWNER_LIMIT || owner < 0)
+		return -1;
+
+	int *table = get_table();
+
+	__atomic_store_n(&table[fd], owner, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * intercept_fd_owner_get - the owner of an fd, zero if none
+ */
+__attribute__((visibility("default")))
+int
+intercept_fd_owner_get(long fd)
+{
+	int *table = __atomic_load_n(&owners, __ATOMIC_ACQUIRE);
+
+	if (table == NULL || fd < 0 || fd >= INTERCEPT_FD_OWNER_LIMIT)
+		return 0;
+
+	return __atomic_load_n(&table[fd], __ATOMIC_ACQUIRE);
+}
+
+static void
+collect_fd_args(void)
+{
+	for (int nr = 0; nr < INTERCEPT_HOOK_TABLE_SIZE; ++nr) {
+		struct syscall_desc desc = { .nr = nr };
+		const struct syscall_format *format = get_syscall_format(&desc);
+
+		for (unsigned i = 0; i < ARRAY_SIZE(desc.args); ++i) {
+			if (format->args[i] == arg_none)
+				break;
+
+			if (format->args[i] == arg_fd)
+				fd_args[nr] |= (unsigned char)(1 << i);
+
+			if (format->args[i] == arg_atfd) {
+				fd_args[nr] |= (unsigned char)(1 << i);
+				is_at_syscall[nr] = true;
+			}
+		}
+	}
+
+	__atomic_store_n(&are_fd_args_collected, true, __ATOMIC_RELEASE);
+}
+
+/*
+ * intercept_fd_owner_filter - enable, or disable passing only the syscalls
+ * referring to owned fds to the hooks, among the syscalls with fd arguments
+ */
+__attribute__((visibility("default")))
+int
+intercept_fd_owner_filter(int enable)
+{
+	if (enable && !__atomic_load_n(&are_fd_args_collected,
+	    __ATOMIC_ACQUIRE))
+		collect_fd_args();
+
+	return __atomic_exchange_n(&intercept_fd_filter_on, enable != 0,
+				__ATOMIC_RELEASE);
+}
+
+bool
+intercept_fd_filter_rejects(const struct syscall_desc *desc)
+{
+	if (desc->nr < 0 || desc->nr >= INTERCEPT_HOOK_TABLE_SIZE)
+		return false;
+
+	unsigned mask = fd_args[desc->nr];
+
+	if (mask == 0)
+		return false;
+
+	/*
+	 * An *at syscall might look up an absolute path, which the hooks
+	 * might want to resolve themselves, whatever its dirfd is. The path
+	 * is not read here, as it can be an invalid pointer, which the kernel
+	 * reports as EFAULT -- all such syscalls are passed to the hooks.
+	 */
+	if (is_at_syscall[desc->nr])
+		return false;
+
+	for (unsigned i = 0; i < ARRAY_SIZE(desc->args); ++i) {
+		if ((mask & (1u << i)) == 0)
+			continue;
+
+		if (intercept_fd_owner_get(desc->args[i]) != 0)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hook_chain.c -- an ordered chain of hooks registered by different users
+ * of the library, e.g. a tracer and a file system shim preloaded into the
+ * same process.
+ *
+ * The chain is an array of entries sorted by priority, along with the union
+ * of the syscall masks of the entries, for a quick check when intercepting a
+ * syscall. A new copy of the array is published using an atomic store each
+ * time a hook is added or removed, so the chain is read without locking.
+ * The old copies are never unmapped, as other threads might still be
+ * calling the hooks found in them. Changes to the chain are expected to be
+ * rare -- e.g. once per library at startup -- so this leaks little memory.
+ *
+ * An entry can have a post hook of its own, called with the result of a
+ * syscall, if the entry's hook asked for it. Which entries asked for it is
+ * recorded in a struct hook_chain_call on the stack of intercept_routine,
+ * along with the chain the hooks were found in -- another copy might be
+ * published while the syscall is executed.
+ */
+
+#include "hook_chain.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+
+#include <stdint.h>
+
+bool intercept_hook_chain_on;
+
+#define MASK_WORD_BITS (8 * sizeof(unsigned long))
+
+typedef int (*chain_hook_t)(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
+typedef void (*chain_post_t)(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
+struct chain_entry {
+	chain_hook_t hook;
+	chain_post_t post;
+	int priority;
+	bool wants_all; /* the hook was added without a mask */
+	unsigned long mask[INTERCEPT_HOOK_MASK_WORDS];
+};
+
+struct hook_chain {
+	bool wants_all; /* any entry was added without a mask */
+	unsigned long mask[INTERCEPT_HOOK_MASK_WORDS];
+	unsigned count;
+	struct chain_entry entries[INTERCEPT_HOOK_CHAIN_MAX];
+};
+
+static struct hook_chain *chain;
+
+/* serializes changes to the chain */
+static int chain_lock;
+
+static bool
+mask_has(const unsigned long *mask, bool wants_all, long syscall_number)
+{
+	if (wants_all)
+		return true;
+
+	if (syscall_number < 0 || syscall_number >= INTERCEPT_HOOK_TABLE_SIZE)
+		return false;
+
+	unsigned long bit = 1UL << (syscall_number % MASK_WORD_BITS);
+
+	return (mask[syscall_number / MASK_WORD_BITS] & bit) != 0;
+}
+
+bool
+intercept_hook_chain_wants(long syscall_number)
+{
+	const struct hook_chain *c = __atomic_load_n(&chain, __ATOMIC_ACQUIRE);
+
+	return c != NULL && mask_has(c->mask, c->wants_all, syscall_number);
+}
+
+int
+intercept_hook_chain_call(struct hook_chain_call *call,
+			const struct syscall_desc *desc, long *result)
+{
+	const struct hook_chain *c = __atomic_load_n(&chain, __ATOMIC_ACQUIRE);
+	const long *args = desc->args;
+
+	call->chain = c;
+	call->post_mask = 0;
+	call->wants_global_post = false;
+
+	for (unsigned i = 0; c != NULL && i < c->count; ++i) {
+		const struct chain_entry *entry = c->entries + i;
+
+		if (!mask_has(entry->mask, entry->wants_all, desc->nr))
+			continue;
+
+		int ret = entry->hook(desc->nr, args[0], args[1], args[2],
+				args[3], args[4], args[5], result);
+
+		if (ret == 0)
+			return 0;
+
+		if (ret != INTERCEPT_HOOK_FORWARD_POST)
+			continue;
+
+		if (entry->post != NULL)
+			call->post_mask |= 1u << i;
+		else
+			call->wants_global_post = true;
+	}
+
+	if (intercept_hook_point != NULL) {
+		int ret = intercept_hook_point(desc->nr, args[0], args[1],
+				args[2], args[3], args[4], args[5], result);
+
+		if (ret == 0)
+			return 0;
+
+		if (ret == INTERCEPT_HOOK_FORWARD_POST)
+			call->wants_global_post = true;
+	}
+
+	if (call->post_mask != 0 || call->wants_global_post)
+		return INTERCEPT_HOOK_FORWARD_POST;
+
+	return 1;
+}
+
+void
+intercept_hook_chain_post(const struct hook_chain_call *call,
+			const struct syscall_desc *desc, long *result)
+{
+	const long *args = desc->args;
+
+	if (call->wants_global_post) {
+		void (*post)(long, long, long, long, long, long, long, long *) =
+		    __atomic_load_n(&intercept_hook_point_post,
+				__ATOMIC_RELAXED);
+
+		if (post != NULL)
+			post(desc->nr, args[0], args[1], args[2],
+			    args[3], args[4], args[5], result);
+	}
+
+	for (unsigned i = INTERCEPT_HOOK_CHAIN_MAX; i > 0; --i) {
+		if ((call->post_mask & (1u << (i - 1))) == 0)
+			continue;
+
+		const struct chain_entry *entry = call->chain->entries + i - 1;
+
+		entry->post(desc->nr, args[0], args[1], args[2],
+		    args[3], args[4], args[5], result);
+	}
+}
+
+/*
+ * copy_chain - a new copy of the current chain, to be modified before it
+ * is published
+ */
+static struct hook_chain *
+copy_chain(void)
+{
+	struct hook_chain *copy = xmmap_anon(sizeof(*copy));
+
+	if (chain != NULL)
+		*copy = *chain;
+
+	return copy;
+}
+
+/*
+ * publish_chain - replace the chain with a modified copy, recomputing the
+ * union of the masks
+ */
+static void
+publish_chain(struct hook_chain *copy)
+{
+	copy->wants_all = false;
+	for (unsigned w = 0; w < INTERCEPT_HOOK_MASK_WORDS; ++w)
+		copy->mask[w] = 0;
+
+	for (unsigned i = 0; i < copy->count; ++i) {
+		copy->wants_all |= copy->entries[i].wants_all;
+		for (unsigned w = 0; w < INTERCEPT_HOOK_MASK_WORDS; ++w)
+			copy->mask[w] |= copy->entries[i].mask[w];
+	}
+
+	__atomic_store_n(&chain, copy, __ATOMIC_RELEASE);
+	__atomic_store_n(&intercept_hook_chain_on, copy->count > 0,
+			__ATOMIC_RELEASE);
+}
+
+static void
+lock_chain(void)
+{
+	while (__atomic_exchange_n(&chain_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+}
+
+static void
+unlock_chain(void)
+{
+	__atomic_store_n(&chain_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * intercept_hook_point_chain_add_post - insert a hook into the chain, after
+ * the hooks of higher or equal priority, with its optional post hook
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_chain_add_post(int priority, const unsigned long *mask,
+				chain_hook_t hook, chain_post_t post)
+{
+	if (hook == NULL)
+		return -1;
+
+	lock_chain();
+
+	if (chain != NULL && chain->count == INTERCEPT_HOOK_CHAIN_MAX) {
+		unlock_chain();
+		return -1;
+	}
+
+	struct hook_chain *copy = copy_chain();
+	unsigned i = copy->count;
+
+	while (i > 0 && copy->entries[i - 1].priority < priority) {
+		copy->entries[i] = copy->entries[i - 1];
+		--i;
+	}
+
+	struct chain_entry *entry = copy->entries + i;
+
+	entry->hook = hook;
+	entry->post = post;
+	entry->priority = priority;
+	entry->wants_all = (mask == NULL);
+	for (unsigned w = 0; w < INTERCEPT_HOOK_MASK_WORDS; ++w)
+		entry->mask[w] = (mask == NULL) ? 0 : mask[w];
+
+	copy->count++;
+	publish_chain(copy);
+	unlock_chain();
+
+	return 0;
+}
+
+/*
+ * intercept_hook_point_chain_add - insert a hook without a post hook
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_chain_add(int priority, const unsigned long *mask,
+				chain_hook_t hook)
+{
+	return intercept_hook_point_chain_add_post(priority, mask, hook, NULL);
+}
+
+/*
+ * intercept_hook_point_chain_remove - remove the first entry of a hook
+ * from the chain
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_chain_remove(chain_hook_t hook)
+{
+	lock_chain();
+
+	unsigned i = 0;
+	while (chain != NULL && i < chain->count &&
+	    chain->entries[i].hook != hook)
+		++i;
+
+	if (chain == NULL || i == chain->count) {
+		unlock_chain();
+		return -1;
+	}
+
+	struct hook_chain *copy = copy_chain();
+
+	copy->count--;
+	for (; i < copy->count; ++i)
+		copy->entries[i] = copy->entries[i + 1];
+
+	publish_chain(copy);
+	unlock_chain();
+
+	return 0;
+}
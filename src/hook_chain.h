@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hook_chain.h -- an ordered chain of hooks, each one called only for the
+ * syscalls it asked for, see intercept_hook_point_chain_add in
+ * libsyscall_intercept_hook_point.h
+ */
+
+#ifndef INTERCEPT_HOOK_CHAIN_H
+#define INTERCEPT_HOOK_CHAIN_H
+
+#include <stdbool.h>
+
+struct hook_chain;
+struct syscall_desc;
+
+extern bool intercept_hook_chain_on;
+
+/*
+ * The post hooks to call after a syscall, filled in by
+ * intercept_hook_chain_call. Bit i of post_mask marks entry i of the
+ * chain -- there are at most INTERCEPT_HOOK_CHAIN_MAX entries.
+ */
+struct hook_chain_call {
+	const struct hook_chain *chain;
+	unsigned post_mask;
+	bool wants_global_post; /* for intercept_hook_point_post */
+};
+
+/*
+ * intercept_hook_chain_wants - is there a hook in the chain asking for
+ * this syscall number
+ */
+bool intercept_hook_chain_wants(long syscall_number);
+
+/*
+ * intercept_hook_chain_call - call the hooks in the chain asking for the
+ * syscall, and intercept_hook_point after them, until one of them returns
+ * zero. Has the same return value as a single hook, returning
+ * INTERCEPT_HOOK_FORWARD_POST if any post hook is to be called.
+ */
+int intercept_hook_chain_call(struct hook_chain_call *call,
+			const struct syscall_desc *desc, long *result);
+
+/*
+ * intercept_hook_chain_post - call the post hooks asked for by the hooks
+ * called in intercept_hook_chain_call: intercept_hook_point_post first,
+ * then the post hooks of the entries, in reverse order.
+ */
+void intercept_hook_chain_post(const struct hook_chain_call *call,
+			const struct syscall_desc *desc, long *result);
+
+#endif
@@ -41,6 +41,7 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <elf.h>
+#include <errno.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -51,6 +52,7 @@
 #include <syscall.h>
 #include <sys/mman.h>
 #include <stdarg.h>
+#include <sched.h>
 #include <sys/auxv.h>
 
 #include "intercept.h"
@@ -58,7 +60,16 @@
 #include "intercept_util.h"
 #include "libsyscall_intercept_hook_point.h"
 #include "disasm_wrapper.h"
+#include "fd_owner.h"
+#include "hook_chain.h"
 #include "magic_syscalls.h"
+#include "path_filter.h"
+#include "patch_coverage.h"
+#include "syscall_formats.h"
+#include "startup_times.h"
+#include "syscall_dispatch.h"
+#include "syscall_stats.h"
+#include "thread_context.h"
 
 int (*intercept_hook_point)(long syscall_number,
 			long arg0, long arg1,
@@ -67,11 +78,42 @@ int (*intercept_hook_point)(long syscall_number,
 			long *result)
 	__attribute__((visibility("default")));
 
+typedef int (*syscall_hook_t)(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result);
+
+/*
+ * The hooks registered for individual syscall numbers, indexed by
+ * the syscall number.
+ */
+static syscall_hook_t hook_table[INTERCEPT_HOOK_TABLE_SIZE];
+
+void (*intercept_hook_point_post)(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result)
+	__attribute__((visibility("default")));
+
 void (*intercept_hook_point_clone_child)(void)
 	__attribute__((visibility("default")));
 void (*intercept_hook_point_clone_parent)(long)
 	__attribute__((visibility("default")));
 
+/*
+ * intercept_clone_child_lean - allows the asm wrapper to call
+ * intercept_routine_post_clone_child in a new thread without saving the SIMD
+ * registers. Only code of this library built with -mgeneral-regs-only runs
+ * there, unless a thread context init function is set -- see thread_context.c
+ */
+#ifdef HAS_GENERAL_REGS_ONLY
+bool intercept_clone_child_lean = true;
+#else
+bool intercept_clone_child_lean;
+#endif
+
 bool debug_dumps_on;
 
 void
@@ -100,6 +142,148 @@ debug_dump(const char *fmt, ...)
 }
 
 static void log_header(void);
+static bool is_libc_called_while_intercepting(void);
+
+/*
+ * intercept_hook_point_register - install, or remove a hook for a single
+ * syscall number. The table entries are accessed atomically, so a hook
+ * can be registered while other threads are making syscalls.
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_register(long syscall_number, syscall_hook_t hook)
+{
+	if (syscall_number < 0 || syscall_number >= INTERCEPT_HOOK_TABLE_SIZE)
+		return -1;
+
+	__atomic_store_n(&hook_table[syscall_number], hook, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * intercept_hook_point_general_regs_only - allows the asm wrapper to skip
+ * saving and restoring the SIMD registers. This is only possible if no code
+ * called while handling a syscall uses those registers: the hook functions
+ * must be built with -mgeneral-regs-only, and so must be the library itself.
+ * Libc is not built that way, thus the SIMD registers are still saved, when
+ * the library calls libc while handling syscalls -- see
+ * is_libc_called_while_intercepting.
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_general_regs_only(int enable)
+{
+#ifdef HAS_GENERAL_REGS_ONLY
+	extern bool intercept_routine_skip_simd_save;
+	bool skip = enable != 0 && !is_libc_called_while_intercepting();
+
+	__atomic_store_n(&intercept_routine_skip_simd_save, skip,
+			__ATOMIC_RELAXED);
+
+	return skip;
+#else
+	(void) enable;
+
+	return 0;
+#endif
+}
+
+/*
+ * intercept_thread_bypass - set in threads whose syscalls are not to be
+ * intercepted. This flag is checked by intercept_asm_wrapper, before
+ * calling any C code.
+ */
+__thread bool intercept_thread_bypass
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * intercept_hook_point_thread_bypass - enable, or disable executing
+ * the syscalls of the calling thread without intercepting them.
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_thread_bypass(int enable)
+{
+	bool previous = intercept_thread_bypass;
+
+	intercept_thread_bypass = (enable != 0);
+
+	return previous;
+}
+
+/*
+ * clone3_args - the struct clone_args passed to a clone3 syscall, as an
+ * array of 64 bit fields: flags, pidfd, child_tid, parent_tid, exit_signal,
+ * stack, ... Returns NULL for any other syscall, or if the struct is too
+ * small to contain the stack field, the kernel rejects such a clone3 anyways.
+ */
+static const uint64_t *
+clone3_args(const struct syscall_desc *desc)
+{
+#ifdef SYS_clone3
+	if (desc->nr == SYS_clone3 && desc->args[0] != 0 &&
+	    (size_t)desc->args[1] >= 6 * sizeof(uint64_t))
+		return (const uint64_t *)desc->args[0];
+#else
+	(void) desc;
+#endif
+
+	return NULL;
+}
+
+/*
+ * is_clone3_with_stack - is the syscall a clone3 asking for a new stack?
+ */
+static bool
+is_clone3_with_stack(const struct syscall_desc *desc)
+{
+	const uint64_t *args = clone3_args(desc);
+
+	return args != NULL && args[5] != 0;
+}
+
+/*
+ * is_fork - see intercept.h
+ */
+bool
+is_fork(const struct syscall_desc *desc)
+{
+	const uint64_t *clone3 = clone3_args(desc);
+
+	return desc->nr == SYS_fork ||
+		(desc->nr == SYS_clone && (desc->args[0] & CLONE_VM) == 0) ||
+		(clone3 != NULL && (clone3[0] & CLONE_VM) == 0);
+}
+
+/*
+ * find_hook - the hook to call for a syscall: the one registered for
+ * its number if any, the chain of hooks if any of them asked for the
+ * syscall -- setting *use_chain, and returning NULL --, the catch-all
+ * intercept_hook_point otherwise.
+ */
+static syscall_hook_t
+find_hook(long syscall_number, bool *use_chain)
+{
+	syscall_hook_t hook = NULL;
+
+	*use_chain = false;
+
+	if (syscall_number >= 0 && syscall_number < INTERCEPT_HOOK_TABLE_SIZE)
+		hook = __atomic_load_n(&hook_table[syscall_number],
+				__ATOMIC_ACQUIRE);
+
+	if (hook == NULL && intercept_hook_chain_on &&
+	    intercept_hook_chain_wants(syscall_number)) {
+		*use_chain = true;
+		return NULL;
+	}
+
+	if (hook == NULL)
+		hook = intercept_hook_point;
+
+	return hook;
+}
 
 void __attribute__((noreturn)) xlongjmp(long rip, long rsp, long rax);
 
@@ -127,7 +311,8 @@ struct context {
 	long rbx;
 	long rdx;
 	long rax;
-	char padd[0x200 - 0x168]; /* see: stack layout in intercept_wrapper.s */
+	char simd_save_skipped;
+	char padd[0x200 - 0x169]; /* see: stack layout in intercept_wrapper.s */
 	long SIMD[16][8]; /* 8 SSE, 8 AVX, or 16 AVX512 registers */
 };
 
@@ -139,6 +324,27 @@ struct wrapper_ret {
 /* Should all objects be patched, or only libc and libpthread? */
 static bool patch_all_objs;
 
+/* Should the objects loaded after startup be patched? */
+static bool patch_dlopen;
+
+/*
+ * is_libc_called_while_intercepting - printing the debug dumps, and looking
+ * for the objects loaded by dlopen call libc functions from intercept_routine
+ */
+static bool
+is_libc_called_while_intercepting(void)
+{
+	return debug_dumps_on || patch_dlopen;
+}
+
+/*
+ * Colon separated lists of object names, from the INTERCEPT_PATCH_OBJS and
+ * INTERCEPT_SKIP_OBJS environment variables: objects to patch besides libc
+ * and libpthread, and objects never to patch.
+ */
+static const char *patch_objs;
+static const char *skip_objs;
+
 /*
  * Information collected during disassemble phase, and anything else
  * needed for hotpatching are stored in this dynamically allocated
@@ -200,6 +406,34 @@ str_match(const char *name, size_t name_len,
 		strncmp(name, expected, name_len) == 0;
 }
 
+/*
+ * is_name_listed - is the short name of an object in a colon separated list
+ * of names? An entry in the list matches either the whole name, or its part
+ * before the first '-' or '.' character, e.g. both "libfoo.so.1" and
+ * "libfoo" match "libfoo.so.1".
+ */
+static bool
+is_name_listed(const char *list, const char *name, size_t len)
+{
+	if (list == NULL)
+		return false;
+
+	while (*list != '\0') {
+		size_t entry_len = strcspn(list, ":");
+
+		if (entry_len > 0 && (entry_len == len ||
+		    entry_len == strlen(name)) &&
+		    strncmp(list, name, entry_len) == 0)
+			return true;
+
+		list += entry_len;
+		if (*list == ':')
+			++list;
+	}
+
+	return false;
+}
+
 /*
  * get_name_from_proc_maps
  * Tries to find the path of an object file loaded at a specific
@@ -319,6 +553,18 @@ is_vdso(uintptr_t addr, const char *path)
 	return addr == (uintptr_t)vdso_addr || strstr(path, "vdso") != NULL;
 }
 
+/*
+ * is_dynamic_loader - does the path refer to the dynamic loader, e.g.:
+ * "/lib64/ld-linux-x86-64.so.2"
+ */
+static bool
+is_dynamic_loader(const char *path)
+{
+	const char *name = get_lib_short_name(path);
+
+	return str_match(name, strcspn(name, "-."), "ld");
+}
+
 /*
  * should_patch_object
  * Decides whether a particular loaded object should should be targeted for
@@ -327,15 +573,19 @@ is_vdso(uintptr_t addr, const char *path)
  * Besides these two, if patch_all_objs is true, everything object is
  * a target. When patch_all_objs is false, only libraries that are parts of
  * the glibc implementation are targeted, i.e.: libc and libpthread.
+ * When patch_dlopen is true, the dynamic loader is targeted as well, and
+ * so is every object loaded after startup ( is_new ).
+ * The objects listed in INTERCEPT_PATCH_OBJS are targeted as well, while
+ * the objects listed in INTERCEPT_SKIP_OBJS are always skipped.
  */
 static bool
-should_patch_object(uintptr_t addr, const char *path)
+should_patch_object(uintptr_t addr, const char *path, bool is_new)
 {
 	static uintptr_t self_addr;
 	if (self_addr == 0) {
-		extern unsigned char intercept_asm_wrapper_tmpl[];
+		extern unsigned char intercept_asm_wrapper;
 		Dl_info self;
-		if (!dladdr((void *)&intercept_asm_wrapper_tmpl, &self))
+		if (!dladdr((void *)&intercept_asm_wrapper, &self))
 			xabort("self dladdr failure");
 		self_addr = (uintptr_t)self.dli_fbase;
 	}
@@ -365,14 +615,29 @@ should_patch_object(uintptr_t addr, const char *path)
 		return false;
 	}
 
+	if (is_name_listed(skip_objs, name, len)) {
+		debug_dump(" - skipping: listed in INTERCEPT_SKIP_OBJS\n");
+		return false;
+	}
+
 	if (str_match(name, len, libc)) {
 		debug_dump(" - libc found\n");
 		libc_found = true;
 		return true;
 	}
 
-	if (patch_all_objs)
+	if (patch_all_objs || is_new)
+		return true;
+
+	if (is_name_listed(patch_objs, name, len)) {
+		debug_dump(" - listed in INTERCEPT_PATCH_OBJS\n");
+		return true;
+	}
+
+	if (patch_dlopen && is_dynamic_loader(path)) {
+		debug_dump(" - dynamic loader found\n");
 		return true;
+	}
 
 	if (str_match(name, len, pthr)) {
 		debug_dump(" - libpthread found\n");
@@ -383,13 +648,49 @@ should_patch_object(uintptr_t addr, const char *path)
 	return false;
 }
 
+/*
+ * The base addresses of all the objects seen by analyze_object, whether
+ * they were patched or not. An object not in this array is one loaded
+ * after the last call to dl_iterate_phdr.
+ */
+static uintptr_t *seen_objs;
+static unsigned seen_objs_count;
+
+/* The path of the dynamic loader, if it is patched */
+static const char *dynamic_loader_path;
+
+static bool
+is_object_seen(uintptr_t base_addr)
+{
+	for (unsigned i = 0; i < seen_objs_count; ++i) {
+		if (seen_objs[i] == base_addr)
+			return true;
+	}
+
+	return false;
+}
+
+static void
+mark_object_seen(uintptr_t base_addr)
+{
+	if (seen_objs_count == 0)
+		seen_objs = xmmap_anon(PAGE_SIZE);
+	else if ((seen_objs_count * sizeof(seen_objs[0])) % PAGE_SIZE == 0)
+		seen_objs = xmremap(seen_objs,
+			seen_objs_count * sizeof(seen_objs[0]),
+			seen_objs_count * sizeof(seen_objs[0]) + PAGE_SIZE);
+
+	seen_objs[seen_objs_count++] = base_addr;
+}
+
 /*
  * analyze_object
  * Look at a library loaded into the current process, and determine as much as
  * possible about it. The disassembling, allocations are initiated here.
  *
  * This is a callback function, passed to dl_iterate_phdr(3).
- * data and size are just unused callback arguments.
+ * The size argument is unused, data is non-NULL when looking for objects
+ * loaded after startup -- see patch_new_objects.
  *
  *
  * From dl_iterate_phdr(3) man page:
@@ -407,21 +708,28 @@ should_patch_object(uintptr_t addr, const char *path)
 static int
 analyze_object(struct dl_phdr_info *info, size_t size, void *data)
 {
-	(void) data;
 	(void) size;
 	const char *path;
 
+	if (data != NULL && is_object_seen(info->dlpi_addr))
+		return 0;
+
 	debug_dump("analyze_object called on \"%s\" at 0x%016" PRIxPTR "\n",
 	    info->dlpi_name, info->dlpi_addr);
 
+	mark_object_seen(info->dlpi_addr);
+
 	if ((path = get_object_path(info)) == NULL)
 		return 0;
 
 	debug_dump("analyze %s\n", path);
 
-	if (!should_patch_object(info->dlpi_addr, path))
+	if (!should_patch_object(info->dlpi_addr, path, data != NULL))
 		return 0;
 
+	if (is_dynamic_loader(path))
+		dynamic_loader_path = path;
+
 	struct intercept_desc *patches = allocate_next_obj_desc();
 
 	patches->base_addr = (unsigned char *)info->dlpi_addr;
@@ -433,31 +741,229 @@ analyze_object(struct dl_phdr_info *info, size_t size, void *data)
 
 const char *cmdline;
 
-static unsigned char asm_wrapper_space[0x100000];
-static unsigned char *next_asm_wrapper_space = asm_wrapper_space + PAGE_SIZE;
+/*
+ * get_patched_objects - the array of objects analyzed, used when dumping
+ * the statistics of patched syscalls
+ */
+const struct intercept_desc *
+get_patched_objects(unsigned *count)
+{
+	*count = __atomic_load_n(&objs_count, __ATOMIC_ACQUIRE);
+
+	return objs;
+}
 
-static bool
-is_asm_wrapper_space_full(void)
+/*
+ * create_wrappers - prepare the patches of an object, by generating
+ * the asm wrappers, and the trampoline table if any patch needs it
+ */
+static void
+create_wrappers(struct intercept_desc *obj)
 {
-	return next_asm_wrapper_space + asm_wrapper_tmpl_size + 256 >
-			asm_wrapper_space + sizeof(asm_wrapper_space);
+	uint64_t start = startup_phase_start();
+
+	create_patch_wrappers(obj);
+	startup_phase_end(obj, PHASE_PATCH_WRAPPERS, start);
+
+	start = startup_phase_start();
+	allocate_trampoline_table(obj);
+	startup_phase_end(obj, PHASE_TRAMPOLINE_TABLE, start);
+
+	start = startup_phase_start();
+	mprotect_asm_wrappers(obj);
+	startup_phase_end(obj, PHASE_MPROTECT_WRAPPERS, start);
 }
 
 /*
- * mprotect_asm_wrappers
- * The code generated into the data segment at the asm_wrapper_space
- * array is not executable by default. This routine sets that memory region
- * to be executable, must called before attempting to execute any patched
- * syscall.
+ * Patching objects loaded after startup, when the INTERCEPT_PATCH_DLOPEN
+ * environment variable is set.
+ *
+ * The dynamic loader is patched at startup in this case, so the syscalls
+ * it uses while loading an object pass through intercept_routine. A mmap
+ * syscall mapping a file as executable, issued by the dynamic loader
+ * means a new object is being loaded. Such an object is on the list
+ * iterated by dl_iterate_phdr by the time the dynamic loader calls mprotect
+ * to make its relocated data read-only, so that mprotect syscall is used
+ * as a signal to look for new objects. While the new objects are being
+ * patched, the syscalls made by the current thread -- e.g. to open the
+ * object file -- are not intercepted.
+ *
+ * No libc lock is held by the dynamic loader when it issues these syscalls,
+ * thus arbitrary libc calls can be made while patching, as during startup.
+ * The text of a new object is patched before any code in it is executed.
+ * An object without a RELRO segment is only patched at the next mprotect
+ * syscall made by the dynamic loader, possibly after its constructors ran.
+ * While the patches are disabled, the patches of new objects are only
+ * prepared, and written when the patches are enabled again. The dynamic
+ * loader itself is not patched meanwhile, thus the objects it loads then
+ * are looked for when the patches are enabled.
  */
-void
-mprotect_asm_wrappers(void)
+static bool is_new_object_pending;
+static bool is_patching_new_objects;
+static bool are_patches_enabled = true;
+
+/* The number of threads in intercept_patches_enable */
+static int toggling_thread_count;
+static __thread bool is_patching_thread
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * patch_objects_found - analyze and patch all objects that were not seen
+ * before, with is_patching_new_objects held by the calling thread
+ */
+static void
+patch_objects_found(void)
+{
+	is_patching_thread = true;
+	__atomic_store_n(&is_new_object_pending, false, __ATOMIC_RELAXED);
+
+	unsigned first_new = objs_count;
+
+	dl_iterate_phdr(analyze_object, &first_new);
+
+	for (unsigned i = first_new; i < objs_count; ++i) {
+		create_wrappers(objs + i);
+		if (are_patches_enabled)
+			activate_patches(objs + i);
+		else
+			prepare_patches(objs + i);
+	}
+
+	if (patch_coverage_on)
+		intercept_patch_coverage_report(objs + first_new,
+				objs_count - first_new);
+
+	replace_new_vdso_pointers();
+
+	is_patching_thread = false;
+}
+
+/*
+ * patch_new_objects - analyze and patch all objects that were not seen
+ * before. Only one thread can do this at a time, any other thread calling
+ * this routine in the meantime returns without waiting -- leaving the
+ * new objects pending, to be found at the next dynamic loader syscall.
+ * It only waits for threads toggling the patches, which hold the lock
+ * for a short while.
+ */
+static void
+patch_new_objects(void)
+{
+	bool is_busy = false;
+
+	while (!__atomic_compare_exchange_n(&is_patching_new_objects,
+	    &is_busy, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		if (__atomic_load_n(&toggling_thread_count,
+		    __ATOMIC_ACQUIRE) == 0)
+			return;
+
+		is_busy = false;
+		syscall_no_intercept(SYS_sched_yield);
+	}
+
+	patch_objects_found();
+
+	__atomic_store_n(&is_patching_new_objects, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * intercept_patches_enable - see libsyscall_intercept_hook_point.h
+ * Waits for any thread patching new objects, and for other threads
+ * calling this function.
+ */
+__attribute__((visibility("default")))
+int
+intercept_patches_enable(int enable)
+{
+	bool is_busy = false;
+	bool activate = (enable != 0);
+
+	__atomic_add_fetch(&toggling_thread_count, 1, __ATOMIC_RELEASE);
+
+	while (!__atomic_compare_exchange_n(&is_patching_new_objects, &is_busy,
+	    true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		is_busy = false;
+		syscall_no_intercept(SYS_sched_yield);
+	}
+
+	int result = are_patches_enabled ? 1 : 0;
+
+	if (activate != are_patches_enabled) {
+		bool was_bypassed = intercept_thread_bypass;
+
+		intercept_thread_bypass = true;
+
+		if (toggle_patches(objs, objs_count, activate))
+			are_patches_enabled = activate;
+		else
+			result = -1;
+
+		/* objects loaded using dlopen while the patches were off */
+		if (patch_dlopen && are_patches_enabled)
+			patch_objects_found();
+
+		intercept_thread_bypass = was_bypassed;
+	}
+
+	__atomic_store_n(&is_patching_new_objects, false, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&toggling_thread_count, 1, __ATOMIC_RELEASE);
+
+	return result;
+}
+
+/*
+ * check_loader_syscall - look at a syscall issued by the dynamic loader
+ */
+static void
+check_loader_syscall(const struct syscall_desc *desc)
+{
+	if (desc->nr == SYS_mmap && (desc->args[2] & PROT_EXEC) != 0 &&
+	    (desc->args[3] & MAP_ANONYMOUS) == 0)
+		__atomic_store_n(&is_new_object_pending, true,
+				__ATOMIC_RELAXED);
+
+	if (desc->nr == SYS_mprotect &&
+	    __atomic_load_n(&is_new_object_pending, __ATOMIC_RELAXED))
+		patch_new_objects();
+}
+
+/*
+ * select_syscalls_to_patch - parse the value of the INTERCEPT_PATCH_SYSCALLS
+ * environment variable: a comma separated list of syscall names or numbers.
+ * The syscalls listed are the only ones intercepted at those syscall
+ * instructions, where the syscall number can be found out in advance.
+ */
+static void
+select_syscalls_to_patch(const char *list)
 {
-	mprotect_no_intercept(
-	    round_down_address(asm_wrapper_space + PAGE_SIZE),
-	    sizeof(asm_wrapper_space) - PAGE_SIZE,
-	    PROT_READ | PROT_EXEC,
-	    "mprotect_asm_wrappers PROT_READ | PROT_EXEC");
+	if (list == NULL)
+		return;
+
+	while (*list != '\0') {
+		size_t len = strcspn(list, ",");
+		long nr;
+
+		if (len == 0) {
+			++list;
+			continue;
+		}
+
+		if (*list >= '0' && *list <= '9') {
+			char *end;
+
+			nr = strtol(list, &end, 10);
+			if (end != list + len)
+				nr = -1;
+		} else {
+			nr = get_syscall_number(list, len);
+		}
+
+		if (nr < 0)
+			xabort("invalid syscall in INTERCEPT_PATCH_SYSCALLS");
+
+		select_syscall_to_patch(nr);
+		list += len;
+	}
 }
 
 /*
@@ -480,27 +986,76 @@ intercept(int argc, char **argv)
 	if (!syscall_hook_in_process_allowed())
 		return;
 
+	intercept_setup_startup_times(getenv("INTERCEPT_STARTUP_TIMES"));
+	uint64_t start = startup_phase_start();
+
 	vdso_addr = (void *)(uintptr_t)getauxval(AT_SYSINFO_EHDR);
 	debug_dumps_on = getenv("INTERCEPT_DEBUG_DUMP") != NULL;
 	patch_all_objs = (getenv("INTERCEPT_ALL_OBJS") != NULL);
-	intercept_setup_log(getenv("INTERCEPT_LOG"),
-			getenv("INTERCEPT_LOG_TRUNC"));
+	patch_dlopen = (getenv("INTERCEPT_PATCH_DLOPEN") != NULL);
+	patch_objs = getenv("INTERCEPT_PATCH_OBJS");
+	skip_objs = getenv("INTERCEPT_SKIP_OBJS");
+	init_code_placement(getenv("INTERCEPT_HUGE_PAGES"));
+	intercept_setup_patch_coverage(getenv("INTERCEPT_PATCH_COVERAGE"));
+	intercept_setup_log_buffering(getenv("INTERCEPT_LOG_BUFFERED"));
+	intercept_setup_log_format(getenv("INTERCEPT_LOG_FORMAT"));
+	intercept_setup_log_buffers(getenv("INTERCEPT_LOG_BUFFERS"));
+	if (getenv("INTERCEPT_LOG_SHM") != NULL)
+		intercept_setup_log_shm(getenv("INTERCEPT_LOG_SHM"));
+	else
+		intercept_setup_log(getenv("INTERCEPT_LOG"),
+				getenv("INTERCEPT_LOG_TRUNC"));
 	log_header();
 	init_patcher();
+	select_syscalls_to_patch(getenv("INTERCEPT_PATCH_SYSCALLS"));
+	init_crawl_threads(getenv("INTERCEPT_DISASM_THREADS"));
+	init_disasm_cache(getenv("INTERCEPT_DISASM_CACHE"));
+	intercept_setup_stats(getenv("INTERCEPT_STATS"),
+				getenv("INTERCEPT_STATS_SIGNAL"),
+				getenv("INTERCEPT_STATS_SITES"));
+	intercept_setup_path_filter(getenv("INTERCEPT_PATH_FILTER"));
+	intercept_setup_toggle_signal(getenv("INTERCEPT_TOGGLE_SIGNAL"));
+	intercept_setup_dispatch(getenv("INTERCEPT_SYSCALL_DISPATCH"));
+
+	/* in case a constructor called this earlier */
+	if (is_libc_called_while_intercepting())
+		(void) intercept_hook_point_general_regs_only(0);
+
+	uint64_t iterate_start = startup_phase_start();
 
 	dl_iterate_phdr(analyze_object, NULL);
-	if (!libc_found)
+
+	/*
+	 * A program not using libc for its syscalls, e.g. a Go program, or
+	 * one linked with musl, can still be intercepted, as long as the
+	 * objects to patch are named explicitly.
+	 */
+	if (!libc_found && !patch_all_objs && patch_objs == NULL)
 		xabort("libc not found");
 
-	for (unsigned i = 0; i < objs_count; ++i) {
-		if (objs[i].count > 0 && is_asm_wrapper_space_full())
-			xabort("not enough space in asm_wrapper_space");
-		allocate_trampoline_table(objs + i);
-		create_patch_wrappers(objs + i, &next_asm_wrapper_space);
-	}
-	mprotect_asm_wrappers();
+	uint64_t iterate_ns = startup_phase_start() - iterate_start;
+
 	for (unsigned i = 0; i < objs_count; ++i)
+		create_wrappers(objs + i);
+	for (unsigned i = 0; i < objs_count; ++i) {
+		uint64_t phase_start = startup_phase_start();
+
 		activate_patches(objs + i);
+		startup_phase_end(objs + i, PHASE_ACTIVATE_PATCHES,
+				phase_start);
+	}
+
+	if (getenv("INTERCEPT_VDSO") != NULL)
+		init_vdso_hooks();
+
+	intercept_dispatch_thread_start();
+
+	if (startup_times_on)
+		intercept_startup_times_report(objs, objs_count, iterate_ns,
+				startup_phase_start() - start);
+
+	if (patch_coverage_on)
+		intercept_patch_coverage_report(objs, objs_count);
 }
 
 /*
@@ -601,6 +1156,27 @@ get_syscall_in_context(struct context *context, struct syscall_desc *sys)
 	sys->args[5] = context->r9;
 }
 
+/*
+ * call_post_hook - pass the result of a syscall forwarded to the kernel to
+ * intercept_hook_point_post, as requested by the hook called before
+ */
+static void
+call_post_hook(const struct syscall_desc *desc, long *result)
+{
+	void (*post)(long, long, long, long, long, long, long, long *) =
+	    __atomic_load_n(&intercept_hook_point_post, __ATOMIC_RELAXED);
+
+	if (post != NULL)
+		post(desc->nr,
+		    desc->args[0],
+		    desc->args[1],
+		    desc->args[2],
+		    desc->args[3],
+		    desc->args[4],
+		    desc->args[5],
+		    result);
+}
+
 /*
  * intercept_routine(...)
  * This is the function called from the asm wrappers,
@@ -639,16 +1215,50 @@ intercept_routine(struct context *context)
 	int forward_to_kernel = true;
 	struct syscall_desc desc;
 	struct patch_desc *patch = context->patch_desc;
+	syscall_hook_t hook;
+	bool use_chain;
+	struct hook_chain_call chain_call;
+	uint64_t start_time;
+
+	if (is_patching_thread) {
+		/* a syscall made while patching objects loaded via dlopen */
+		return (struct wrapper_ret){.rax = context->rax, .rdx = 0 };
+	}
 
 	get_syscall_in_context(context, &desc);
 
+	if (patch_dlopen && patch->containing_lib_path == dynamic_loader_path)
+		check_loader_syscall(&desc);
+
 	if (handle_magic_syscalls(&desc, &result) == 0)
 		return (struct wrapper_ret){.rax = result, .rdx = 1 };
 
 	intercept_log_syscall(patch, &desc, UNKNOWN, 0);
 
-	if (intercept_hook_point != NULL)
-		forward_to_kernel = intercept_hook_point(desc.nr,
+	if (desc.nr == SYS_exit_group)
+		intercept_stats_dump();
+
+	start_time = intercept_stats_timestamp();
+
+	hook = find_hook(desc.nr, &use_chain);
+
+	bool has_hook = (hook != NULL || use_chain);
+
+	if (has_hook && intercept_fd_filter_on &&
+	    intercept_fd_filter_rejects(&desc))
+		has_hook = false;
+
+	if (has_hook && intercept_path_filter_on &&
+	    intercept_path_filter_rejects(&desc))
+		has_hook = false;
+
+	if (!has_hook)
+		use_chain = false;
+	else if (use_chain)
+		forward_to_kernel = intercept_hook_chain_call(&chain_call,
+					&desc, &result);
+	else
+		forward_to_kernel = hook(desc.nr,
 		    desc.args[0],
 		    desc.args[1],
 		    desc.args[2],
@@ -678,7 +1288,26 @@ intercept_routine(struct context *context)
 		if (desc.nr == SYS_clone && desc.args[1] != 0)
 			return (struct wrapper_ret){
 				.rax = context->rax, .rdx = 2 };
-		else
+
+		if (desc.nr == SYS_exit) {
+			intercept_thread_context_release();
+			if (intercept_stats_on)
+				intercept_stats_thread_exit();
+		}
+
+		if (is_clone3_with_stack(&desc)) {
+			/*
+			 * Such a clone3 can not be executed here either, and
+			 * the code executing clone in its original context
+			 * can't find the clone flags in the child thread.
+			 * Pretend it is not supported, libc falls back to
+			 * using clone.
+			 */
+			result = -ENOSYS;
+		} else if (desc.nr == SYS_rt_sigaction &&
+		    intercept_dispatch_on) {
+			result = dispatch_rt_sigaction(desc.args);
+		} else {
 			result = syscall_no_intercept(desc.nr,
 					desc.args[0],
 					desc.args[1],
@@ -686,6 +1315,28 @@ intercept_routine(struct context *context)
 					desc.args[3],
 					desc.args[4],
 					desc.args[5]);
+		}
+	}
+
+	if (forward_to_kernel == INTERCEPT_HOOK_FORWARD_POST) {
+		if (use_chain)
+			intercept_hook_chain_post(&chain_call, &desc, &result);
+		else
+			call_post_hook(&desc, &result);
+	}
+
+	if (result == 0 && is_fork(&desc))
+		intercept_dispatch_thread_start();
+
+	if (desc.nr == SYS_rt_sigprocmask)
+		intercept_dispatch_unblock();
+
+	if (intercept_stats_on) {
+		if (result == 0 && is_fork(&desc))
+			intercept_stats_reset();
+		else
+			intercept_stats_record(patch, desc.nr,
+			    intercept_stats_timestamp() - start_time);
 	}
 
 	intercept_log_syscall(patch, &desc, KNOWN, result);
@@ -693,15 +1344,98 @@ intercept_routine(struct context *context)
 	return (struct wrapper_ret){ .rax = result, .rdx = 1 };
 }
 
+/*
+ * intercept_routine_dispatched
+ * The routine called by the SIGSYS handler in syscall_dispatch.c, for a
+ * syscall made outside of the patched code. Returns false when the
+ * syscall must be executed at its original place, e.g. a vfork, or a
+ * clone with a new stack.
+ */
+bool
+intercept_routine_dispatched(struct patch_desc *patch, long nr,
+			const long args[6], long *result)
+{
+	struct context context;
+	struct wrapper_ret ret;
+
+	if (!__atomic_load_n(&are_patches_enabled, __ATOMIC_RELAXED)) {
+		/*
+		 * E.g. a thread created after removing the patches. The
+		 * syscall is executed at its original place, and the thread
+		 * is left to allow syscalls, as no wrapper stub sets the
+		 * selector back.
+		 */
+		return false;
+	}
+
+	if (intercept_thread_bypass) {
+		/* the syscalls at patched places are not intercepted either */
+		ret.rdx = 0;
+	} else {
+		context.patch_desc = patch;
+		context.rax = nr;
+		context.rdi = args[0];
+		context.rsi = args[1];
+		context.rdx = args[2];
+		context.r10 = args[3];
+		context.r8 = args[4];
+		context.r9 = args[5];
+
+		ret = intercept_routine(&context);
+	}
+
+	if (ret.rdx == 1) {
+		*result = ret.rax;
+		return true;
+	}
+
+	if (ret.rdx == 2 || nr == SYS_vfork || nr == SYS_rt_sigreturn ||
+	    (nr == SYS_clone && args[1] != 0))
+		return false;
+
+#ifdef SYS_clone3
+	if (nr == SYS_clone3)
+		return false;
+#endif
+
+	*result = syscall_no_intercept(nr, args[0], args[1], args[2],
+				args[3], args[4], args[5]);
+
+	return true;
+}
+
+/*
+ * intercept_routine_post_clone_child
+ * The work done by the library itself in the child thread right after a clone
+ * syscall with a new stack pointer. Called from intercept_routine_post_clone,
+ * or straight from intercept_template.S with only the syscall argument
+ * registers saved, when intercept_clone_child_lean is set, and there is no
+ * intercept_hook_point_clone_child to call.
+ */
+void
+intercept_routine_post_clone_child(long clone_flags)
+{
+	intercept_thread_context_child(clone_flags);
+	intercept_dispatch_thread_start();
+
+	if ((clone_flags & CLONE_VM) == 0)
+		intercept_log_new_process();
+}
+
 /*
  * intercept_routine_post_clone
- * The routine called by an assembly wrapper when a clone syscall returns zero,
- * and a new stack pointer is used in the child thread.
+ * The routine called by an assembly wrapper after a clone syscall with a new
+ * stack pointer, both in the parent, and in the child thread. The assembly
+ * wrapper only calls it, if there is a clone hook point to call -- see
+ * intercept_template.S
  */
 struct wrapper_ret
 intercept_routine_post_clone(struct context *context)
 {
 	if (context->rax == 0) {
+		/* rdi still holds the flags passed to clone */
+		intercept_routine_post_clone_child(context->rdi);
+
 		if (intercept_hook_point_clone_child != NULL)
 			intercept_hook_point_clone_child();
 	} else {
@@ -66,6 +66,21 @@ struct range {
 	size_t size;
 };
 
+/*
+ * Why an instruction next to a syscall instruction could not be overwritten
+ * by the jump to the asm wrapper, reported for each syscall instruction that
+ * could not be patched, when the INTERCEPT_PATCH_COVERAGE environment
+ * variable is set.
+ */
+enum neighbour_status {
+	NEIGHBOUR_USABLE,
+	NEIGHBOUR_MISSING, /* not decoded, e.g. the start of the text */
+	NEIGHBOUR_NOT_RELOCATABLE, /* e.g. a jump, or RIP relative operand */
+	NEIGHBOUR_NOP, /* a nop, with its first bytes reserved */
+	NEIGHBOUR_JUMP_TARGET, /* a jump lands between it and the syscall */
+	NEIGHBOUR_STATUS_COUNT
+};
+
 /*
  * The patch_list array stores some information on
  * whereabouts of patches made to glibc.
@@ -81,6 +96,12 @@ struct patch_desc {
 	/* the original syscall instruction */
 	unsigned char *syscall_addr;
 
+	/*
+	 * the syscall instruction in the asm wrapper stub, the offset of
+	 * this field is used in intercept_template.S
+	 */
+	unsigned char *wrapper_syscall;
+
 	const char *containing_lib_path;
 
 	/* the offset of the original syscall instruction */
@@ -112,6 +133,53 @@ struct patch_desc {
 	bool uses_nop_trampoline;
 
 	struct range nop_trampoline;
+
+	/*
+	 * The syscall number, if it is loaded into EAX by a mov
+	 * instruction right before the syscall instruction. It is only
+	 * known to be used by the syscall, if there is no jump to the
+	 * syscall instruction itself -- see is_patch_needed in patcher.c
+	 */
+	bool has_constant_nr;
+	int constant_nr;
+
+	/* the syscall was not among the ones selected for patching */
+	bool is_skipped;
+
+	/*
+	 * There was not enough space around the syscall for a jump, see
+	 * create_patch_wrappers. The syscall is left unpatched, and
+	 * is_skipped is set as well. The status of the preceding_ins_2,
+	 * preceding_ins, and following_ins instructions tell why.
+	 */
+	bool is_unpatchable;
+	enum neighbour_status neighbour_status[3];
+
+	/*
+	 * The number of syscalls made at this address, and the TSC cycles
+	 * they took -- only counted when INTERCEPT_STATS_SITES is set.
+	 */
+	uint64_t call_count;
+	uint64_t call_cycles;
+};
+
+/* The most bytes overwritten by a patch at one place in the text */
+#define CODE_REGION_MAX_SIZE 48
+
+/*
+ * A range of bytes in the text section overwritten by a patch, with
+ * copies of the original code, and the patched code -- used for
+ * unpatching and repatching at runtime, see patch_toggle.c
+ * A patch using a nop trampoline overwrites two such regions: the syscall
+ * instruction, and the nop instruction.
+ */
+struct code_region {
+	unsigned char *address;
+	const struct patch_desc *patch;
+	unsigned size;
+	bool is_nop;
+	unsigned char original[CODE_REGION_MAX_SIZE];
+	unsigned char patched[CODE_REGION_MAX_SIZE];
 };
 
 /*
@@ -128,13 +196,31 @@ struct section_list {
 	Elf64_Shdr headers[0x10];
 };
 
+/*
+ * The phases of processing an object at startup, measured when the
+ * INTERCEPT_STARTUP_TIMES environment variable is set.
+ */
+enum startup_phase {
+	PHASE_FIND_SYSCALLS, /* all of find_syscalls, for each object */
+	PHASE_FIND_SECTIONS,
+	PHASE_FIND_JUMPS_SYMS,
+	PHASE_FIND_JUMPS_RELA,
+	PHASE_CRAWL_TEXT,
+	PHASE_DISASM_CACHE,
+	PHASE_TRAMPOLINE_TABLE,
+	PHASE_PATCH_WRAPPERS,
+	PHASE_MPROTECT_WRAPPERS,
+	PHASE_ACTIVATE_PATCHES,
+	STARTUP_PHASE_COUNT
+};
+
 struct intercept_desc {
 
 	/*
-	 * uses_trampoline_table - For now this is decided runtime
-	 * to make it easy to compare the operation of the library
-	 * with and without it. If it is OK, we can remove this
-	 * flag, and just always use the trampoline table.
+	 * uses_trampoline_table - Set by allocate_trampoline_table,
+	 * only if some patch can not jump directly to its asm wrapper.
+	 * In that case every patch of the object jumps through the
+	 * trampoline table.
 	 */
 	bool uses_trampoline_table;
 
@@ -162,6 +248,10 @@ struct intercept_desc {
 	struct section_list symbol_tables;
 	struct section_list rela_tables;
 
+	/* The GNU build-id of the object, if it has one */
+	unsigned char build_id[0x40];
+	size_t build_id_size;
+
 	/* Where the text starts inside the shared object */
 	unsigned long text_offset;
 
@@ -175,7 +265,7 @@ struct intercept_desc {
 
 	struct patch_desc *items;
 	unsigned count;
-	unsigned char *jump_table;
+	uint64_t *jump_table;
 
 	size_t nop_count;
 	size_t max_nop_count;
@@ -185,23 +275,102 @@ struct intercept_desc {
 	size_t trampoline_table_size;
 
 	unsigned char *next_trampoline;
+
+	/*
+	 * The memory where the asm wrappers of the patches are generated,
+	 * reachable from the text section with 32 bit displacements.
+	 */
+	unsigned char *wrapper_space;
+	size_t wrapper_space_size;
+
+	/* The number of instructions decoded while crawling the text */
+	unsigned long instruction_count;
+
+	/* The number of mprotect syscalls used by activate_patches */
+	unsigned long activation_mprotect_count;
+
+	/* The code overwritten by activate_patches, see patch_toggle.c */
+	struct code_region *code_regions;
+	unsigned code_region_count;
+	bool are_patches_active;
+
+	/* The time spent in each startup_phase, in nanoseconds */
+	uint64_t phase_ns[STARTUP_PHASE_COUNT];
+
+	/* The bytes of the wrapper space used by the asm wrappers */
+	size_t wrapper_space_used;
 };
 
 bool has_jump(const struct intercept_desc *desc, unsigned char *addr);
+unsigned char *find_jump(const struct intercept_desc *desc,
+			unsigned char *begin, unsigned char *end);
+size_t jump_table_size(const struct intercept_desc *desc);
 void mark_jump(const struct intercept_desc *desc, const unsigned char *addr);
 
+/*
+ * The code generated near text sections (the asm wrappers, and the
+ * trampoline tables) is placed in units of code_placement_size bytes,
+ * which is PAGE_SIZE by default, or HUGE_PAGE_SIZE when requested via the
+ * INTERCEPT_HUGE_PAGES environment variable. See map_near_text.
+ */
+#define HUGE_PAGE_SIZE ((size_t)0x200000)
+extern size_t code_placement_size;
+void init_code_placement(const char *huge_pages);
+
+static inline size_t
+round_up_code_size(size_t size)
+{
+	return (size + code_placement_size - 1) & ~(code_placement_size - 1);
+}
+
+unsigned char *map_near_text(const struct intercept_desc *desc,
+				size_t size, int prot);
 void allocate_trampoline_table(struct intercept_desc *desc);
 void find_syscalls(struct intercept_desc *desc);
 
+void init_crawl_threads(const char *count);
+
+void init_disasm_cache(const char *dir);
+bool load_disasm_cache(struct intercept_desc *desc);
+void store_disasm_cache(const struct intercept_desc *desc);
+
 void init_patcher(void);
-void create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst);
-void mprotect_asm_wrappers(void);
+void select_syscall_to_patch(long syscall_number);
+void create_patch_wrappers(struct intercept_desc *desc);
+void mprotect_asm_wrappers(const struct intercept_desc *desc);
 
 /*
  * Actually overwrite instructions in glibc.
  */
 void activate_patches(struct intercept_desc *desc);
 
+/*
+ * Prepare the patches of an object loaded while the patches are disabled,
+ * leaving the original instructions in place.
+ */
+void prepare_patches(struct intercept_desc *desc);
+
+/*
+ * The range of pages in a text section, overwritten while activating
+ * the patches.
+ */
+struct page_range {
+	unsigned char *begin;
+	unsigned char *end;
+};
+
+struct page_range collect_patch_pages(const struct intercept_desc *desc);
+
+void save_original_code(struct intercept_desc *desc);
+void save_patched_code(struct intercept_desc *desc);
+void restore_original_code(struct intercept_desc *desc);
+bool toggle_patches(struct intercept_desc *objs, unsigned count,
+			bool activate);
+
+/* The signal stopping the other threads while toggling, see patch_toggle.c */
+extern int intercept_toggle_signal;
+void intercept_setup_toggle_signal(const char *signal);
+
 #define SYSCALL_INS_SIZE 2
 #define JUMP_INS_SIZE 5
 #define CALL_OPCODE 0xe8
@@ -211,11 +380,29 @@ void activate_patches(struct intercept_desc *desc);
 #define NOP_OPCODE 0x90
 #define INT3_OPCODE 0xCC
 
+/* The size of a trampoline jump, jmp instruction + pointer */
+#define TRAMPOLINE_SIZE (6 + 8)
+
 bool is_overwritable_nop(const struct intercept_disasm_result *ins);
 
 void create_jump(unsigned char opcode, unsigned char *from, void *to);
 
-const char *cmdline;
+extern const char *cmdline;
+
+const struct intercept_desc *get_patched_objects(unsigned *count);
+
+/*
+ * is_fork - does the syscall create a new process, instead of a thread?
+ * I.e. a fork, or a clone or clone3 syscall without CLONE_VM.
+ */
+bool is_fork(const struct syscall_desc *desc);
+
+/* see intercept_routine_post_clone_child in intercept.c */
+extern bool intercept_clone_child_lean;
+void intercept_routine_post_clone_child(long clone_flags);
+
+void init_vdso_hooks(void);
+void replace_new_vdso_pointers(void);
 
 #define PAGE_SIZE ((size_t)0x1000)
 
@@ -225,7 +412,4 @@ round_down_address(unsigned char *address)
 	return (unsigned char *)(((uintptr_t)address) & ~(PAGE_SIZE - 1));
 }
 
-/* The size of an asm wrapper instance */
-extern size_t asm_wrapper_tmpl_size;
-
 #endif
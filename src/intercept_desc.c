@@ -31,19 +31,24 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <syscall.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 
 #include "intercept.h"
 #include "intercept_util.h"
 #include "disasm_wrapper.h"
+#include "startup_times.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
 
 /*
  * open_orig_file
@@ -96,6 +101,45 @@ add_text_info(struct intercept_desc *desc, const Elf64_Shdr *header,
 	desc->text_section_index = index;
 }
 
+/*
+ * read_build_id -- read the build-id from a .note.gnu.build-id section,
+ * which contains a single note, as in:
+ *
+ * typedef struct
+ * {
+ *   Elf64_Word n_namesz;      Length of the note's name ( 4 )
+ *   Elf64_Word n_descsz;      Length of the note's descriptor
+ *   Elf64_Word n_type;        Type of the note ( NT_GNU_BUILD_ID )
+ * } Elf64_Nhdr;
+ *
+ * followed by the name "GNU", and the build-id itself.
+ */
+static void
+read_build_id(struct intercept_desc *desc, const Elf64_Shdr *section, int fd)
+{
+	Elf64_Nhdr note;
+	char name[4];
+
+	if (section->sh_size < sizeof(note) + sizeof(name))
+		return;
+
+	xlseek(fd, section->sh_offset, SEEK_SET);
+	xread(fd, &note, sizeof(note));
+
+	if (note.n_type != NT_GNU_BUILD_ID ||
+	    note.n_namesz != sizeof(name) ||
+	    note.n_descsz > sizeof(desc->build_id) ||
+	    sizeof(note) + sizeof(name) + note.n_descsz > section->sh_size)
+		return;
+
+	xread(fd, name, sizeof(name));
+	if (memcmp(name, "GNU", sizeof(name)) != 0)
+		return;
+
+	xread(fd, desc->build_id, note.n_descsz);
+	desc->build_id_size = note.n_descsz;
+}
+
 /*
  * find_sections
  *
@@ -108,6 +152,7 @@ find_sections(struct intercept_desc *desc, int fd)
 
 	desc->symbol_tables.count = 0;
 	desc->rela_tables.count = 0;
+	desc->build_id_size = 0;
 
 	xread(fd, &elf_header, sizeof(elf_header));
 
@@ -140,6 +185,9 @@ find_sections(struct intercept_desc *desc, int fd)
 		} else if (section->sh_type == SHT_RELA) {
 			debug_dump("found relocation table: %s\n", name);
 			add_table_info(&desc->rela_tables, section);
+		} else if (section->sh_type == SHT_NOTE &&
+		    strcmp(name, ".note.gnu.build-id") == 0) {
+			read_build_id(desc, section, fd);
 		}
 	}
 
@@ -147,6 +195,20 @@ find_sections(struct intercept_desc *desc, int fd)
 		xabort("text section not found");
 }
 
+/*
+ * jump_table_size - the size of the jump table in bytes, a bitmap
+ * with a bit for each byte of the text section, stored in 64 bit words
+ */
+size_t
+jump_table_size(const struct intercept_desc *desc)
+{
+	assert(desc->text_start < desc->text_end);
+	size_t bytes = (size_t)(desc->text_end - desc->text_start + 1);
+
+	/* Plus one -- integer division can result a number too low */
+	return (bytes / 64 + 1) * sizeof(desc->jump_table[0]);
+}
+
 /*
  * allocate_jump_table
  *
@@ -156,13 +218,7 @@ find_sections(struct intercept_desc *desc, int fd)
 static void
 allocate_jump_table(struct intercept_desc *desc)
 {
-	/* How many bytes need to be addressed? */
-	assert(desc->text_start < desc->text_end);
-	size_t bytes = (size_t)(desc->text_end - desc->text_start + 1);
-
-	/* Allocate 1 bit for each addressable byte */
-	/* Plus one -- integer division can result a number too low */
-	desc->jump_table = xmmap_anon(bytes / 8 + 1);
+	desc->jump_table = xmmap_anon(jump_table_size(desc));
 }
 
 /*
@@ -222,19 +278,19 @@ mark_nop(struct intercept_desc *desc, unsigned char *address, size_t size)
  * is_bit_set - check a bit in a bitmap
  */
 static bool
-is_bit_set(const unsigned char *table, uint64_t offset)
+is_bit_set(const uint64_t *table, uint64_t offset)
 {
-	return table[offset / 8] & (1 << (offset % 8));
+	return (table[offset / 64] >> (offset % 64)) & 1;
 }
 
 /*
  * set_bit - set a bit in a bitmap
  */
 static void
-set_bit(unsigned char *table, uint64_t offset)
+set_bit(uint64_t *table, uint64_t offset)
 {
-	unsigned char tmp = (unsigned char)(1 << (offset % 8));
-	table[offset / 8] |= tmp;
+	uint64_t tmp = UINT64_C(1) << (offset % 64);
+	__atomic_fetch_or(table + offset / 64, tmp, __ATOMIC_RELAXED);
 }
 
 /*
@@ -253,6 +309,41 @@ has_jump(const struct intercept_desc *desc, unsigned char *addr)
 		return false;
 }
 
+/*
+ * find_jump - look for the lowest address in the [begin, end) range, that
+ * is known to be a jump destination, see has_jump above. The bitmap is
+ * scanned a 64 bit word at a time. Returns NULL if there is no such address.
+ */
+unsigned char *
+find_jump(const struct intercept_desc *desc,
+		unsigned char *begin, unsigned char *end)
+{
+	if (begin < desc->text_start)
+		begin = desc->text_start;
+	if (end > desc->text_end + 1)
+		end = desc->text_end + 1;
+	if (begin >= end)
+		return NULL;
+
+	uint64_t offset = (uint64_t)(begin - desc->text_start);
+	uint64_t limit = (uint64_t)(end - desc->text_start);
+	uint64_t word = offset / 64;
+	uint64_t bits = desc->jump_table[word];
+
+	bits &= ~UINT64_C(0) << (offset % 64);
+
+	while (bits == 0) {
+		if (++word * 64 >= limit)
+			return NULL;
+
+		bits = desc->jump_table[word];
+	}
+
+	offset = word * 64 + (uint64_t)__builtin_ctzll(bits);
+
+	return (offset < limit) ? desc->text_start + offset : NULL;
+}
+
 /*
  * mark_jump - Mark an address as a jump destination, see has_jump above.
  */
@@ -263,6 +354,129 @@ mark_jump(const struct intercept_desc *desc, const unsigned char *addr)
 		set_bit(desc->jump_table, (uint64_t)(addr - desc->text_start));
 }
 
+/*
+ * A list of jump destinations, as offsets from the start of the
+ * text section, collected from the symbol tables and relocation entries,
+ * before marking them in the jump table.
+ */
+struct jump_list {
+	uint64_t *offsets;
+	size_t count;
+	size_t max_count;
+};
+
+static void
+jump_list_add(const struct intercept_desc *desc, struct jump_list *list,
+		const unsigned char *addr)
+{
+	if (addr < desc->text_start || addr > desc->text_end)
+		return;
+
+	assert(list->count < list->max_count);
+	list->offsets[list->count++] = (uint64_t)(addr - desc->text_start);
+}
+
+/*
+ * sort_offsets - LSD radix sort of the offsets, one byte at a time,
+ * using the tmp array of the same size
+ */
+static void
+sort_offsets(uint64_t *offsets, uint64_t *tmp, size_t count)
+{
+	uint64_t *src = offsets;
+	uint64_t *dst = tmp;
+	uint64_t max = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (offsets[i] > max)
+			max = offsets[i];
+	}
+
+	for (unsigned shift = 0; shift < 64 && (max >> shift) != 0;
+	    shift += 8) {
+		size_t counts[0x100] = {0};
+
+		for (size_t i = 0; i < count; ++i)
+			++counts[(src[i] >> shift) & 0xff];
+
+		size_t sum = 0;
+		for (unsigned d = 0; d < 0x100; ++d) {
+			size_t c = counts[d];
+			counts[d] = sum;
+			sum += c;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			dst[counts[(src[i] >> shift) & 0xff]++] = src[i];
+
+		uint64_t *swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if (src != offsets)
+		memcpy(offsets, src, count * sizeof(offsets[0]));
+}
+
+/*
+ * mark_jump_list - sort the jump destinations collected, and mark them
+ * in the jump table, setting all the bits needed in a word of the
+ * bitmap at once -- duplicates end up next to each other, and cost no
+ * extra memory access. This is only used while no other thread is using
+ * the jump table, the words are not updated atomically.
+ */
+static void
+mark_jump_list(struct intercept_desc *desc, struct jump_list *list)
+{
+	if (list->count == 0)
+		return;
+
+	uint64_t *tmp = xmmap_anon(list->max_count * sizeof(tmp[0]));
+	sort_offsets(list->offsets, tmp, list->count);
+	xmunmap(tmp, list->max_count * sizeof(tmp[0]));
+
+	uint64_t word = list->offsets[0] / 64;
+	uint64_t bits = 0;
+
+	for (size_t i = 0; i < list->count; ++i) {
+		uint64_t offset = list->offsets[i];
+
+		if (offset / 64 != word) {
+			desc->jump_table[word] |= bits;
+			word = offset / 64;
+			bits = 0;
+		}
+
+		bits |= UINT64_C(1) << (offset % 64);
+	}
+
+	desc->jump_table[word] |= bits;
+}
+
+/*
+ * map_section - map the contents of a section of the object file
+ * readonly, the mapping is described by *map_addr and *map_size, for
+ * unmapping it later
+ */
+static const void *
+map_section(int fd, const Elf64_Shdr *section,
+		void **map_addr, size_t *map_size)
+{
+	size_t delta = section->sh_offset % PAGE_SIZE;
+
+	*map_size = section->sh_size + delta;
+
+	long addr = syscall_no_intercept(SYS_mmap, NULL, *map_size,
+				PROT_READ, MAP_PRIVATE, fd,
+				(off_t)(section->sh_offset - delta));
+
+	xabort_on_syserror(addr, __func__);
+
+	*map_addr = (void *)addr;
+
+	return (const unsigned char *)addr + delta;
+}
+
 /*
  * find_jumps_in_section_syms
  *
@@ -289,17 +503,19 @@ mark_jump(const struct intercept_desc *desc, const unsigned char *addr)
  */
 static void
 find_jumps_in_section_syms(struct intercept_desc *desc, Elf64_Shdr *section,
-				int fd)
+				int fd, struct jump_list *list)
 {
 	assert(section->sh_type == SHT_SYMTAB ||
 		section->sh_type == SHT_DYNSYM);
 
 	size_t sym_count = section->sh_size / sizeof(Elf64_Sym);
+	void *map_addr;
+	size_t map_size;
 
-	Elf64_Sym syms[sym_count];
+	if (sym_count == 0)
+		return;
 
-	xlseek(fd, section->sh_offset, SEEK_SET);
-	xread(fd, &syms, section->sh_size);
+	const Elf64_Sym *syms = map_section(fd, section, &map_addr, &map_size);
 
 	for (size_t i = 0; i < sym_count; ++i) {
 		if (ELF64_ST_TYPE(syms[i].st_info) != STT_FUNC)
@@ -314,12 +530,14 @@ find_jumps_in_section_syms(struct intercept_desc *desc, Elf64_Shdr *section,
 		unsigned char *address = desc->base_addr + syms[i].st_value;
 
 		/* a function entry point in .text, mark it */
-		mark_jump(desc, address);
+		jump_list_add(desc, list, address);
 
 		/* a function's end in .text, mark it */
 		if (syms[i].st_size != 0)
-			mark_jump(desc, address + syms[i].st_size);
+			jump_list_add(desc, list, address + syms[i].st_size);
 	}
+
+	xmunmap(map_addr, map_size);
 }
 
 /*
@@ -340,16 +558,18 @@ find_jumps_in_section_syms(struct intercept_desc *desc, Elf64_Shdr *section,
  */
 static void
 find_jumps_in_section_rela(struct intercept_desc *desc, Elf64_Shdr *section,
-				int fd)
+				int fd, struct jump_list *list)
 {
 	assert(section->sh_type == SHT_RELA);
 
 	size_t sym_count = section->sh_size / sizeof(Elf64_Rela);
+	void *map_addr;
+	size_t map_size;
 
-	Elf64_Rela syms[sym_count];
+	if (sym_count == 0)
+		return;
 
-	xlseek(fd, section->sh_offset, SEEK_SET);
-	xread(fd, &syms, section->sh_size);
+	const Elf64_Rela *syms = map_section(fd, section, &map_addr, &map_size);
 
 	for (size_t i = 0; i < sym_count; ++i) {
 		switch (ELF64_R_TYPE(syms[i].r_info)) {
@@ -363,11 +583,13 @@ find_jumps_in_section_rela(struct intercept_desc *desc, Elf64_Shdr *section,
 				unsigned char *address =
 				    desc->base_addr + syms[i].r_addend;
 
-				mark_jump(desc, address);
+				jump_list_add(desc, list, address);
 
 				break;
 		}
 	}
+
+	xmunmap(map_addr, map_size);
 }
 
 /*
@@ -435,8 +657,179 @@ is_overwritable_nop(const struct intercept_disasm_result *ins)
 }
 
 /*
- * crawl_text
- * Crawl the text section, disassembling it all.
+ * The state of crawling a range of code, i.e.: the previous three
+ * instructions, see crawl_step.
+ */
+struct crawl_state {
+	/*
+	 * Remember the previous three instructions, while
+	 * disassembling the code instruction by instruction.
+	 */
+	struct intercept_disasm_result prevs[3];
+
+	/*
+	 * How many previous instructions were decoded before this one,
+	 * and stored in the prevs array. Usually three, except for the
+	 * beginning of the text section -- the first instruction naturally
+	 * has no previous instruction.
+	 */
+	unsigned has_prevs;
+};
+
+/*
+ * crawl_step
+ * Process an instruction decoded while crawling the text section, after the
+ * ones described by state.
+ *
+ * Generate a new patch description, if:
+ * - Information is available about a syscalls place
+ * - one following instruction
+ * - two preceding instructions
+ *
+ * So this is done only if instruction in the previous
+ * step was a syscall. Which means the currently
+ * decoded instruction is the 'following' instruction -- as
+ * in following the syscall.
+ * The two instructions from two steps ago, and three
+ * steps ago are going to be the two 'preceding'
+ * instructions stored in the patch description. Other fields
+ * of the struct patch_desc are not filled at this point yet.
+ *
+ * prevs[0]      ->     patch->preceding_ins_2
+ * prevs[1]      ->     patch->preceding_ins
+ * prevs[2]      ->     [syscall]
+ * current ins.  ->     patch->following_ins
+ *
+ *
+ * XXX -- this ignores the cases where the text section
+ * starts, or ends with a syscall instruction, or indeed, if
+ * the second instruction in the text section is a syscall.
+ * These implausible edge cases don't seem to be very important
+ * right now.
+ */
+static void
+crawl_step(struct intercept_desc *desc, struct crawl_state *state,
+		const struct intercept_disasm_result *result,
+		bool creates_patches)
+{
+	struct intercept_disasm_result *prevs = state->prevs;
+
+	if (creates_patches && state->has_prevs >= 1 && prevs[2].is_syscall) {
+		struct patch_desc *patch = add_new_patch(desc);
+
+		patch->containing_lib_path = desc->path;
+		patch->preceding_ins_2 = prevs[0];
+		patch->preceding_ins = prevs[1];
+		patch->following_ins = *result;
+		patch->syscall_addr = (unsigned char *)prevs[2].address;
+
+		if (prevs[1].is_mov_imm_eax &&
+		    prevs[1].address + prevs[1].length ==
+		    patch->syscall_addr) {
+			patch->has_constant_nr = true;
+			patch->constant_nr = (int)prevs[1].mov_imm;
+		}
+
+		ptrdiff_t syscall_offset = patch->syscall_addr -
+		    (desc->text_start - desc->text_offset);
+
+		assert(syscall_offset >= 0);
+
+		patch->syscall_offset = (unsigned long)syscall_offset;
+	}
+
+	prevs[0] = prevs[1];
+	prevs[1] = prevs[2];
+	prevs[2] = *result;
+	if (state->has_prevs < 2)
+		++state->has_prevs;
+}
+
+/*
+ * A chunk of the text section, crawled on its own, possibly in parallel with
+ * other chunks. Each chunk has its own list of patches and nops, and its
+ * own bitmap of the jump destinations found while crawling it. These are
+ * merged in order once all chunks are crawled, only from the crawl of a
+ * chunk that is kept -- a chunk crawled again first discards them.
+ *
+ * The instructions crawled in a chunk are only the same as the ones seen
+ * when crawling the text section sequentially, if the decoding of the
+ * preceding chunk stops exactly at the beginning of this chunk. This is
+ * checked when merging the chunks, and a chunk is crawled again from the
+ * right address if needed.
+ *
+ * The first three instructions in a chunk can not be used for creating
+ * patches before the state at the end of the previous chunk is known (the
+ * syscall, and instructions preceding it might be in the previous chunk).
+ * These are stored in the head array, and processed while merging.
+ */
+struct crawl_chunk {
+	struct intercept_desc desc;
+	struct intercept_disasm_context *context;
+
+	unsigned char *begin;
+	unsigned char *end;
+
+	/* the address following the last instruction crawled */
+	unsigned char *stop;
+
+	struct crawl_state state;
+
+	struct intercept_disasm_result head[3];
+	unsigned head_count;
+
+	unsigned long instruction_count;
+
+	struct helper_thread thread;
+};
+
+/* The maximum number of chunks the text section is split into */
+#define MAX_CRAWL_CHUNKS 0x20
+
+/* The minimum size of a chunk */
+#define MIN_CRAWL_CHUNK_SIZE ((size_t)0x40000)
+
+static unsigned crawl_thread_count = 1;
+
+/*
+ * init_crawl_threads - set the number of threads used for crawling a text
+ * section, which is either specified in the value of the
+ * INTERCEPT_DISASM_THREADS environment variable, or the number of CPUs
+ * available.
+ */
+void
+init_crawl_threads(const char *count)
+{
+	if (count == NULL) {
+		unsigned char cpus[0x80];
+		long size = syscall_no_intercept(SYS_sched_getaffinity, 0,
+				sizeof(cpus), cpus);
+
+		crawl_thread_count = 0;
+		for (long i = 0; i < size; ++i)
+			crawl_thread_count +=
+			    (unsigned)__builtin_popcount(cpus[i]);
+	} else {
+		char *end;
+		unsigned long value = strtoul(count, &end, 10);
+
+		if (*count == '\0' || *end != '\0' || value == 0)
+			xabort("invalid INTERCEPT_DISASM_THREADS value");
+
+		crawl_thread_count = value > MAX_CRAWL_CHUNKS ?
+					MAX_CRAWL_CHUNKS : (unsigned)value;
+		return;
+	}
+
+	if (crawl_thread_count == 0)
+		crawl_thread_count = 1;
+	else if (crawl_thread_count > MAX_CRAWL_CHUNKS)
+		crawl_thread_count = MAX_CRAWL_CHUNKS;
+}
+
+/*
+ * crawl_chunk
+ * Crawl the code in a chunk, disassembling it all.
  * This routine collects information about potential addresses to patch.
  *
  * The addresses of all syscall instructions are stored, together with
@@ -450,99 +843,234 @@ is_overwritable_nop(const struct intercept_disasm_result *ins)
  *
  * Note: The actual patching can not yet be done in this disassembling phase,
  * as it is not known in advance, which addresses are jump destinations.
+ *
+ * When the state at the beginning of the chunk is not known, the first
+ * three instructions are not processed by crawl_step, only stored in the
+ * head array.
+ *
+ * This routine can run in a helper thread, it does not call libc.
  */
 static void
-crawl_text(struct intercept_desc *desc)
+crawl_chunk(struct crawl_chunk *chunk, unsigned char *code, bool is_synced)
 {
-	unsigned char *code = desc->text_start;
-
-	/*
-	 * Remember the previous three instructions, while
-	 * disassembling the code instruction by instruction in the
-	 * while loop below.
-	 */
-	struct intercept_disasm_result prevs[3] = {{0, }};
-
-	/*
-	 * How many previous instructions were decoded before this one,
-	 * and stored in the prevs array. Usually three, except for the
-	 * beginning of the text section -- the first instruction naturally
-	 * has no previous instruction.
-	 */
-	unsigned has_prevs = 0;
-	struct intercept_disasm_context *context =
-	    intercept_disasm_init(desc->text_start, desc->text_end);
+	struct intercept_desc *desc = &chunk->desc;
 
-	while (code <= desc->text_end) {
+	while (code < chunk->end) {
 		struct intercept_disasm_result result;
 
-		result = intercept_disasm_next_instruction(context, code);
+		result = intercept_disasm_next_instruction(chunk->context,
+								code);
 
 		if (result.length == 0) {
 			++code;
 			continue;
 		}
 
+		++chunk->instruction_count;
+
 		if (result.has_ip_relative_opr)
 			mark_jump(desc, result.rip_ref_addr);
 
 		if (is_overwritable_nop(&result))
 			mark_nop(desc, code, result.length);
 
-		/*
-		 * Generate a new patch description, if:
-		 * - Information is available about a syscalls place
-		 * - one following instruction
-		 * - two preceding instructions
-		 *
-		 * So this is done only if instruction in the previous
-		 * loop iteration was a syscall. Which means the currently
-		 * decoded instruction is the 'following' instruction -- as
-		 * in following the syscall.
-		 * The two instructions from two iterations ago, and three
-		 * iterations ago are going to be the two 'preceding'
-		 * instructions stored in the patch description. Other fields
-		 * of the struct patch_desc are not filled at this point yet.
-		 *
-		 * prevs[0]      ->     patch->preceding_ins_2
-		 * prevs[1]      ->     patch->preceding_ins
-		 * prevs[2]      ->     [syscall]
-		 * current ins.  ->     patch->following_ins
-		 *
-		 *
-		 * XXX -- this ignores the cases where the text section
-		 * starts, or ends with a syscall instruction, or indeed, if
-		 * the second instruction in the text section is a syscall.
-		 * These implausible edge cases don't seem to be very important
-		 * right now.
-		 */
-		if (has_prevs >= 1 && prevs[2].is_syscall) {
-			struct patch_desc *patch = add_new_patch(desc);
+		bool creates_patches = is_synced ||
+			chunk->head_count == ARRAY_SIZE(chunk->head);
+
+		if (!creates_patches)
+			chunk->head[chunk->head_count++] = result;
+
+		crawl_step(desc, &chunk->state, &result, creates_patches);
+
+		code += result.length;
+	}
+
+	chunk->stop = code;
+}
+
+/*
+ * crawl_chunk_thread - the entry point of helper threads crawling a chunk
+ */
+static void
+crawl_chunk_thread(void *chunk)
+{
+	struct crawl_chunk *c = chunk;
+
+	crawl_chunk(c, c->begin, false);
+}
+
+/*
+ * set_chunk_borders
+ * Split the text section into count chunks of roughly equal size. The
+ * beginning of each chunk is moved to the next address known to be a jump
+ * destination -- these are most often addresses where a function starts,
+ * making it likely that the chunk is decoded the same way as it would be
+ * decoded when crawling all the text section from the start.
+ */
+static void
+set_chunk_borders(const struct intercept_desc *desc,
+		struct crawl_chunk *chunks, unsigned count)
+{
+	size_t text_size = (size_t)(desc->text_end - desc->text_start) + 1;
+	size_t chunk_size = text_size / count;
+
+	chunks[0].begin = desc->text_start;
+	for (unsigned i = 1; i < count; ++i) {
+		unsigned char *begin = desc->text_start + i * chunk_size;
+		unsigned char *limit = begin + chunk_size / 2;
+
+		if (begin <= chunks[i - 1].begin)
+			begin = chunks[i - 1].begin + 1;
+
+		unsigned char *jump = find_jump(desc, begin, limit);
+
+		if (jump != NULL)
+			begin = jump;
+
+		chunks[i].begin = begin;
+		chunks[i - 1].end = begin;
+	}
+	chunks[count - 1].end = desc->text_end + 1;
+}
+
+/*
+ * reset_chunk - discard the patches, nops, and jumps collected in chunk
+ */
+static void
+reset_chunk(struct crawl_chunk *chunk)
+{
+	struct intercept_desc *desc = &chunk->desc;
+
+	zero_bytes(desc->jump_table, jump_table_size(desc));
+
+	if (desc->count > 0) {
+		unsigned size = 1;
+
+		while (size < desc->count)
+			size *= 2;
+
+		xmunmap(desc->items, size * sizeof(desc->items[0]));
+		desc->items = NULL;
+	}
+
+	desc->count = 0;
+	desc->nop_count = 0;
+	chunk->instruction_count = 0;
+}
+
+/*
+ * merge_chunk - append the patches and nops found in a chunk to desc, and
+ * add the jumps found in it to the bitmap of desc
+ */
+static void
+merge_chunk(struct intercept_desc *desc, struct crawl_chunk *chunk)
+{
+	size_t jump_words = jump_table_size(desc) / sizeof(desc->jump_table[0]);
+
+	for (size_t i = 0; i < jump_words; ++i)
+		desc->jump_table[i] |= chunk->desc.jump_table[i];
+
+	for (unsigned i = 0; i < chunk->desc.count; ++i)
+		*add_new_patch(desc) = chunk->desc.items[i];
 
-			patch->containing_lib_path = desc->path;
-			patch->preceding_ins_2 = prevs[0];
-			patch->preceding_ins = prevs[1];
-			patch->following_ins = result;
-			patch->syscall_addr = code - SYSCALL_INS_SIZE;
+	for (size_t i = 0; i < chunk->desc.nop_count; ++i)
+		mark_nop(desc, chunk->desc.nop_table[i].address,
+		    chunk->desc.nop_table[i].size);
 
-			ptrdiff_t syscall_offset = patch->syscall_addr -
-			    (desc->text_start - desc->text_offset);
+	desc->instruction_count += chunk->instruction_count;
 
-			assert(syscall_offset >= 0);
+	reset_chunk(chunk);
+	xmunmap(chunk->desc.nop_table,
+	    chunk->desc.max_nop_count * sizeof(chunk->desc.nop_table[0]));
+	xmunmap(chunk->desc.jump_table, jump_table_size(desc));
+}
+
+/*
+ * crawl_text
+ * Crawl the text section, either in one go, or split into chunks crawled
+ * in parallel by helper threads. The patches, nops, and jumps are only
+ * taken from crawling the instructions a sequential crawl would see, and
+ * each chunk can hold all the nops allowed in desc, thus the results do
+ * not depend on the number of threads.
+ */
+static void
+crawl_text(struct intercept_desc *desc)
+{
+	size_t text_size = (size_t)(desc->text_end - desc->text_start) + 1;
+	unsigned count = crawl_thread_count;
+
+	if (count > text_size / MIN_CRAWL_CHUNK_SIZE)
+		count = (unsigned)(text_size / MIN_CRAWL_CHUNK_SIZE);
+	if (count == 0)
+		count = 1;
+
+	struct crawl_chunk *chunks = xmmap_anon(count * sizeof(chunks[0]));
+
+	set_chunk_borders(desc, chunks, count);
+
+	for (unsigned i = 0; i < count; ++i) {
+		struct intercept_desc *chunk_desc = &chunks[i].desc;
+
+		*chunk_desc = *desc;
+		chunk_desc->count = 0;
+		chunk_desc->items = NULL;
+		chunk_desc->nop_count = 0;
+		chunk_desc->nop_table = xmmap_anon(chunk_desc->max_nop_count *
+					sizeof(chunk_desc->nop_table[0]));
+		chunk_desc->jump_table = xmmap_anon(jump_table_size(desc));
+		chunks[i].context =
+		    intercept_disasm_init(desc->text_start, desc->text_end);
+	}
 
-			patch->syscall_offset = (unsigned long)syscall_offset;
+	for (unsigned i = 1; i < count; ++i)
+		start_helper_thread(&chunks[i].thread,
+		    crawl_chunk_thread, chunks + i);
+
+	crawl_chunk(chunks, chunks[0].begin, true);
+
+	for (unsigned i = 1; i < count; ++i)
+		join_helper_thread(&chunks[i].thread);
+
+	for (unsigned i = 1; i < count; ++i) {
+		struct crawl_chunk *prev = chunks + i - 1;
+		struct crawl_chunk *chunk = chunks + i;
+
+		if (prev->stop != chunk->begin) {
+			/*
+			 * The previous chunk ended in the middle of an
+			 * instruction decoded in this chunk, crawl it again
+			 * starting from the right address.
+			 */
+			debug_dump("crawling chunk %u again at 0x%016" PRIxPTR
+			    "\n", i, (uintptr_t)prev->stop);
+			reset_chunk(chunk);
+			chunk->state = prev->state;
+			crawl_chunk(chunk, prev->stop, true);
+			continue;
 		}
 
-		prevs[0] = prevs[1];
-		prevs[1] = prevs[2];
-		prevs[2] = result;
-		if (has_prevs < 2)
-			++has_prevs;
+		/*
+		 * Process the first few instructions of this chunk now
+		 * that the state preceding them is known. The patches
+		 * created here belong to, and are appended to the previous
+		 * chunk, as the syscalls they describe precede the patches
+		 * found in this chunk.
+		 */
+		struct crawl_state state = prev->state;
+
+		for (unsigned j = 0; j < chunk->head_count; ++j)
+			crawl_step(&prev->desc, &state, chunk->head + j, true);
 
-		code += result.length;
+		if (chunk->head_count < ARRAY_SIZE(chunk->head))
+			chunk->state = state;
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		intercept_disasm_destroy(chunks[i].context);
+		merge_chunk(desc, chunks + i);
 	}
 
-	intercept_disasm_destroy(context);
+	xmunmap(chunks, count * sizeof(chunks[0]));
 }
 
 /*
@@ -580,30 +1108,191 @@ get_min_address(void)
 }
 
 /*
- * allocate_trampoline_table
- * Allocates memory close to a text section (close enough
- * to be reachable with 32 bit displacements in jmp instructions).
- * Using mmap syscall with MAP_FIXED flag.
+ * struct maps_reader - a minimal reader of /proc/self/maps, which does
+ * not use stdio, and performs only a few large read syscalls.
+ */
+struct maps_reader {
+	long fd;
+	size_t pos;
+	size_t len;
+	char buf[0x1000];
+};
+
+/*
+ * maps_getc - the next character from /proc/self/maps, or -1 at the end
+ */
+static int
+maps_getc(struct maps_reader *reader)
+{
+	if (reader->pos == reader->len) {
+		long len = syscall_no_intercept(SYS_read, reader->fd,
+					reader->buf, sizeof(reader->buf));
+
+		xabort_on_syserror(len, "read /proc/self/maps");
+
+		if (len == 0)
+			return -1;
+
+		reader->pos = 0;
+		reader->len = (size_t)len;
+	}
+
+	return (unsigned char)reader->buf[reader->pos++];
+}
+
+/*
+ * maps_read_address - parse a hexadecimal address terminated by delim,
+ * starting with the character c
+ */
+static unsigned char *
+maps_read_address(struct maps_reader *reader, int c, int delim)
+{
+	uintptr_t value = 0;
+
+	for (; c != delim; c = maps_getc(reader)) {
+		if (c >= '0' && c <= '9')
+			value = value * 16 + (uintptr_t)(c - '0');
+		else if (c >= 'a' && c <= 'f')
+			value = value * 16 + (uintptr_t)(c - 'a' + 10);
+		else
+			xabort("unexpected format in /proc/self/maps");
+	}
+
+	return (unsigned char *)value;
+}
+
+/*
+ * maps_next_range - read the address range of the next mapping,
+ * skipping the rest of the line. Returns false at the end of the file.
+ */
+static bool
+maps_next_range(struct maps_reader *reader,
+		unsigned char **start, unsigned char **end)
+{
+	int c = maps_getc(reader);
+
+	if (c < 0)
+		return false;
+
+	*start = maps_read_address(reader, c, '-');
+	*end = maps_read_address(reader, maps_getc(reader), ' ');
+
+	while ((c = maps_getc(reader)) != '\n' && c >= 0)
+		;
+
+	return true;
+}
+
+/*
+ * is_near_text
+ * Checks if the memory between begin and end is reachable from anywhere
+ * in the text section using 32 bit displacements.
+ */
+static bool
+is_near_text(const struct intercept_desc *desc,
+		const unsigned char *begin, const unsigned char *end)
+{
+	uintptr_t low = (uintptr_t)begin;
+	uintptr_t high = (uintptr_t)end;
+
+	if ((uintptr_t)desc->text_start < low)
+		low = (uintptr_t)desc->text_start;
+	if ((uintptr_t)desc->text_end > high)
+		high = (uintptr_t)desc->text_end;
+
+	return high - low < INT32_MAX;
+}
+
+size_t code_placement_size = PAGE_SIZE;
+
+/*
+ * init_code_placement - place code on huge pages, if requested via the
+ * INTERCEPT_HUGE_PAGES environment variable
  */
 void
-allocate_trampoline_table(struct intercept_desc *desc)
+init_code_placement(const char *huge_pages)
 {
-	char *e = getenv("INTERCEPT_NO_TRAMPOLINE");
+	if (huge_pages != NULL && huge_pages[0] != '0')
+		code_placement_size = HUGE_PAGE_SIZE;
+}
 
-	/* Use the extra trampoline table by default */
-	desc->uses_trampoline_table = (e == NULL) || (e[0] == '0');
+static unsigned char *
+round_up_placement(unsigned char *address)
+{
+	uintptr_t mask = (uintptr_t)code_placement_size - 1;
 
-	if (!desc->uses_trampoline_table) {
-		desc->trampoline_table = NULL;
-		desc->trampoline_table_size = 0;
-		desc->trampoline_table = NULL;
-		return;
+	return (unsigned char *)(((uintptr_t)address + mask) & ~mask);
+}
+
+/*
+ * find_gap_near_text
+ * Looks for a gap of size bytes between the existing mappings, at or above
+ * the address guess, that is close enough to the text section.
+ */
+static unsigned char *
+find_gap_near_text(const struct intercept_desc *desc, unsigned char *guess,
+			size_t size)
+{
+	struct maps_reader reader;
+	unsigned char *start;
+	unsigned char *end;
+
+	reader.fd = syscall_no_intercept(SYS_open, "/proc/self/maps",
+					O_RDONLY);
+	xabort_on_syserror(reader.fd, "open /proc/self/maps");
+	reader.pos = reader.len = 0;
+
+	while (maps_next_range(&reader, &start, &end)) {
+		/*
+		 * Let's see if an existing mapping overlaps
+		 * with the guess!
+		 */
+		if (end < guess)
+			continue; /* No overlap, let's see the next mapping */
+
+		if (start >= guess + size) {
+			/* The rest of the mappings can't possibly overlap */
+			break;
+		}
+
+		/*
+		 * The next guess is the page following the mapping seen
+		 * just now.
+		 */
+		guess = round_up_placement(end);
+
+		if (guess + size >= desc->text_start + INT32_MAX)
+			break;
+	}
+
+	syscall_no_intercept(SYS_close, reader.fd);
+
+	if (guess + size >= desc->text_start + INT32_MAX) {
+		/* Too far away */
+		xabort("unable to find place near text section");
 	}
 
-	FILE *maps;
-	char line[0x100];
+	return guess;
+}
+
+/*
+ * map_near_text
+ * Allocates memory close to a text section (close enough
+ * to be reachable with 32 bit displacements in jmp instructions).
+ * Using mmap syscall with MAP_FIXED_NOREPLACE flag: other threads might
+ * create mappings while objects are patched, so the gap found in
+ * /proc/self/maps might be taken by the time of the mmap syscall. In that
+ * case the next gap is looked for. Kernels older than 4.17 ignore this
+ * flag, and take the address only as a hint, so the result is checked.
+ * The address is aligned to code_placement_size. With huge pages, the
+ * kernel is asked to back the memory using transparent huge pages -- this
+ * is just advice, if that is not supported, regular pages are used.
+ */
+unsigned char *
+map_near_text(const struct intercept_desc *desc, size_t size, int prot)
+{
 	unsigned char *guess; /* Where we would like to allocate the table */
-	size_t size;
+	long result;
 
 	if ((uintptr_t)desc->text_end < INT32_MAX) {
 		/* start from the bottom of memory */
@@ -623,55 +1312,110 @@ allocate_trampoline_table(struct intercept_desc *desc)
 	if ((uintptr_t)guess < get_min_address())
 		guess = (void *)get_min_address();
 
-	size = 64 * 0x1000; /* XXX: don't just guess */
+	guess = round_up_placement(guess);
 
-	if ((maps = fopen("/proc/self/maps", "r")) == NULL)
-		xabort("fopen /proc/self/maps");
+	for (;;) {
+		guess = find_gap_near_text(desc, guess, size);
 
-	while ((fgets(line, sizeof(line), maps)) != NULL) {
-		unsigned char *start;
-		unsigned char *end;
+		result = syscall_no_intercept(SYS_mmap, guess, size, prot,
+				MAP_FIXED_NOREPLACE | MAP_PRIVATE | MAP_ANON,
+				-1, (off_t)0);
 
-		if (sscanf(line, "%p-%p", (void **)&start, (void **)&end) != 2)
-			xabort("sscanf from /proc/self/maps");
+		if (result == (long)(uintptr_t)guess)
+			break;
 
-		/*
-		 * Let's see if an existing mapping overlaps
-		 * with the guess!
-		 */
-		if (end < guess)
-			continue; /* No overlap, let's see the next mapping */
+		if (result != -EEXIST) {
+			xabort_on_syserror(result,
+				"unable to allocate space near text section");
 
-		if (start >= guess + size) {
-			/* The rest of the mappings can't possibly overlap */
-			break;
+			/* An old kernel placed it elsewhere */
+			xmunmap((void *)result, size);
 		}
 
-		/*
-		 * The next guess is the page following the mapping seen
-		 * just now.
-		 */
-		guess = end;
+		/* The gap was taken meanwhile, try the next one */
+		guess += code_placement_size;
+	}
 
-		if (guess + size >= desc->text_start + INT32_MAX) {
-			/* Too far away */
-			xabort("unable to find place for trampoline table");
-		}
+	if (code_placement_size == HUGE_PAGE_SIZE)
+		syscall_no_intercept(SYS_madvise, result, size,
+					MADV_HUGEPAGE);
+
+	return (unsigned char *)result;
+}
+
+/*
+ * The unused end of the most recently allocated trampoline table. Objects
+ * allocating their tables later can take their part from this space, if
+ * it is close enough to their text sections.
+ */
+static unsigned char *shared_trampolines;
+static unsigned char *shared_trampolines_end;
+
+/*
+ * is_wrapper_in_reach - can the jump written in place of the syscall reach
+ * the asm wrapper of the patch using a 32 bit displacement
+ */
+static bool
+is_wrapper_in_reach(const struct patch_desc *patch)
+{
+	intptr_t delta = (intptr_t)patch->asm_wrapper;
+	delta -= (intptr_t)(patch->dst_jmp_patch + JUMP_INS_SIZE);
+
+	return delta <= INT32_MAX && delta >= INT32_MIN;
+}
+
+/*
+ * allocate_trampoline_table
+ * Allocates the trampoline table close to the text section, with room
+ * for a trampoline for each syscall found in the text -- but only if some
+ * patch can not jump directly to its asm wrapper. The wrapper space is
+ * mapped near the text, so normally no table is needed.
+ * The table can share its memory pages with the tables of other objects,
+ * it is mapped read+exec, and made writable only while activate_patches
+ * fills it in.
+ * This must be called after create_patch_wrappers.
+ */
+void
+allocate_trampoline_table(struct intercept_desc *desc)
+{
+	char *e = getenv("INTERCEPT_NO_TRAMPOLINE");
+
+	desc->uses_trampoline_table = false;
+	desc->trampoline_table = NULL;
+	desc->trampoline_table_size = 0;
+	desc->next_trampoline = NULL;
+
+	/* Never use the extra trampoline table, if asked so */
+	if (e != NULL && e[0] != '0')
+		return;
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct patch_desc *patch = desc->items + i;
+
+		if (!patch->is_skipped && !is_wrapper_in_reach(patch))
+			desc->uses_trampoline_table = true;
 	}
 
-	fclose(maps);
+	if (!desc->uses_trampoline_table)
+		return;
 
-	desc->trampoline_table = mmap(guess, size,
-					PROT_READ | PROT_WRITE | PROT_EXEC,
-					MAP_FIXED | MAP_PRIVATE | MAP_ANON,
-					-1, 0);
+	size_t size = (size_t)desc->count * TRAMPOLINE_SIZE;
 
-	if (desc->trampoline_table == MAP_FAILED)
-		xabort("unable to allocate space for trampoline table");
+	if ((size_t)(shared_trampolines_end - shared_trampolines) < size ||
+	    !is_near_text(desc, shared_trampolines,
+			shared_trampolines + size)) {
+		size_t map_size = round_up_code_size(size);
 
-	desc->trampoline_table_size = size;
+		shared_trampolines = map_near_text(desc, map_size,
+					PROT_READ | PROT_EXEC);
+		shared_trampolines_end = shared_trampolines + map_size;
+	}
 
+	desc->trampoline_table = shared_trampolines;
+	desc->trampoline_table_size = size;
 	desc->next_trampoline = desc->trampoline_table;
+
+	shared_trampolines += size;
 }
 
 /*
@@ -691,11 +1435,14 @@ find_syscalls(struct intercept_desc *desc)
 	    desc->path,
 	    (uintptr_t)desc->base_addr);
 
+	uint64_t start = startup_phase_start();
+
 	desc->count = 0;
 
 	int fd = open_orig_file(desc);
 
 	find_sections(desc, fd);
+	startup_phase_end(desc, PHASE_FIND_SECTIONS, start);
 	debug_dump(
 	    "%s .text mapped at 0x%016" PRIxPTR " - 0x%016" PRIxPTR " \n",
 	    desc->path,
@@ -704,15 +1451,56 @@ find_syscalls(struct intercept_desc *desc)
 	allocate_jump_table(desc);
 	allocate_nop_table(desc);
 
+	uint64_t phase_start = startup_phase_start();
+
+	if (load_disasm_cache(desc)) {
+		syscall_no_intercept(SYS_close, fd);
+		startup_phase_end(desc, PHASE_DISASM_CACHE, phase_start);
+		startup_phase_end(desc, PHASE_FIND_SYSCALLS, start);
+		return;
+	}
+
+	startup_phase_end(desc, PHASE_DISASM_CACHE, phase_start);
+
+	struct jump_list jumps = {.count = 0, .max_count = 0};
+
+	for (Elf64_Half i = 0; i < desc->symbol_tables.count; ++i)
+		jumps.max_count += 2 * (desc->symbol_tables.headers[i].sh_size /
+					sizeof(Elf64_Sym));
+	for (Elf64_Half i = 0; i < desc->rela_tables.count; ++i)
+		jumps.max_count += desc->rela_tables.headers[i].sh_size /
+					sizeof(Elf64_Rela);
+	if (jumps.max_count != 0)
+		jumps.offsets = xmmap_anon(jumps.max_count *
+					sizeof(jumps.offsets[0]));
+
+	phase_start = startup_phase_start();
 	for (Elf64_Half i = 0; i < desc->symbol_tables.count; ++i)
 		find_jumps_in_section_syms(desc,
-		    desc->symbol_tables.headers + i, fd);
+		    desc->symbol_tables.headers + i, fd, &jumps);
+	startup_phase_end(desc, PHASE_FIND_JUMPS_SYMS, phase_start);
 
+	phase_start = startup_phase_start();
 	for (Elf64_Half i = 0; i < desc->rela_tables.count; ++i)
 		find_jumps_in_section_rela(desc,
-		    desc->rela_tables.headers + i, fd);
+		    desc->rela_tables.headers + i, fd, &jumps);
+	startup_phase_end(desc, PHASE_FIND_JUMPS_RELA, phase_start);
 
 	syscall_no_intercept(SYS_close, fd);
 
+	if (jumps.max_count != 0) {
+		mark_jump_list(desc, &jumps);
+		xmunmap(jumps.offsets,
+		    jumps.max_count * sizeof(jumps.offsets[0]));
+	}
+
+	phase_start = startup_phase_start();
 	crawl_text(desc);
+	startup_phase_end(desc, PHASE_CRAWL_TEXT, phase_start);
+
+	phase_start = startup_phase_start();
+	store_disasm_cache(desc);
+	startup_phase_end(desc, PHASE_DISASM_CACHE, phase_start);
+
+	startup_phase_end(desc, PHASE_FIND_SYSCALLS, start);
 }
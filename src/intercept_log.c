@@ -42,6 +42,9 @@
 #include <sched.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
@@ -72,7 +75,7 @@ print_cstr(char *dst, const char *src)
  * A minimum number of digits can requested in the width argument.
  * Returns a pointer to end of the destination string.
  */
-static char *
+char *
 print_number(char *dst, unsigned long n, int base, unsigned width)
 {
 	static const char digit_chars[] = "0123456789abcdef";
@@ -512,6 +515,91 @@ arg_print_cstr(char *buffer, const struct syscall_desc *desc, int i,
 	return xprint_escape(buffer, str, 0x80, true, 0);
 }
 
+static size_t
+min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+/*
+ * How the contents of buffers (e.g. the data given to write) are logged,
+ * as selected via the INTERCEPT_LOG_BUFFERS environment variable.
+ * The default is to print at most 0x80 characters of escaped text.
+ */
+enum buffer_policy { buffer_escape, buffer_hex, buffer_ref };
+
+static enum buffer_policy buffer_policy = buffer_escape;
+
+/* The number of bytes captured from a buffer, zero means the default */
+static size_t buffer_capture_max;
+
+/* The most bytes of a buffer printed in a single line of the text log */
+enum { LOG_BUFFER_CAPTURE_LIMIT = 0x300 };
+
+/*
+ * The capture sizes of the binary log record being printed, if
+ * any - see intercept_log_print_binary_syscall.
+ */
+static const uint8_t *decoded_capture_sizes;
+
+/*
+ * print_hex_bytes - prints a buffer as a quoted sequence of hexadecimal
+ * digits, two for each byte, e.g.: x"0a1b"
+ */
+static char *
+print_hex_bytes(char *dst, const char *src, size_t size)
+{
+	*dst++ = 'x';
+	*dst++ = '"';
+	for (size_t i = 0; i < size; ++i)
+		dst = print_number(dst, (unsigned char)src[i], 16, 2);
+	*dst++ = '"';
+	*dst = '\0';
+
+	return dst;
+}
+
+/*
+ * print_buffer - prints the buffer pointed to by the i-th argument of a
+ * syscall, with the length of the buffer being size. When printing a
+ * record from the binary log, only the bytes captured in the record are
+ * available, and a buffer not captured at all is printed as a pointer.
+ */
+static char *
+print_buffer(char *dst, const char *src, size_t size, int i)
+{
+	size_t available = SIZE_MAX;
+
+	if (decoded_capture_sizes != NULL) {
+		available = decoded_capture_sizes[i];
+		if (available == 0 && size != 0)
+			return print_pointer(dst, (long)(uintptr_t)src);
+	}
+
+	if (buffer_policy == buffer_ref)
+		return print_pointer(dst, (long)(uintptr_t)src);
+
+	if (buffer_policy == buffer_escape && buffer_capture_max == 0)
+		return xprint_escape(dst, src, 0x80, false,
+					min_size(size, available));
+
+	size_t len = min_size(size, available);
+	if (buffer_capture_max != 0)
+		len = min_size(len, buffer_capture_max);
+	else
+		len = min_size(len, BINARY_LOG_CAPTURE_MAX);
+
+	if (buffer_policy == buffer_hex)
+		dst = print_hex_bytes(dst, src, len);
+	else
+		dst = xprint_escape(dst, src, 4 * len + 6, false, len);
+
+	if (len < size)
+		dst = print_cstr(dst - 1, "...\"");
+
+	return dst;
+}
+
 static char *
 arg_print_input_buf(char *buffer, const struct syscall_desc *desc, int i,
 				enum intercept_log_result result_status,
@@ -525,7 +613,7 @@ arg_print_input_buf(char *buffer, const struct syscall_desc *desc, int i,
 
 	const char *output = (const char *)(uintptr_t)(desc->args[i]);
 	size_t size = (size_t)desc->args[i + 1];
-	return xprint_escape(buffer, output, 0x80, false, size);
+	return print_buffer(buffer, output, size, i);
 }
 
 static char *
@@ -538,7 +626,7 @@ arg_print_output_buf(char *buffer, const struct syscall_desc *desc, int i,
 
 	const char *input = (const char *)(uintptr_t)(desc->args[i]);
 	size_t size = (size_t)result;
-	return xprint_escape(buffer, input, 0x80, false, size);
+	return print_buffer(buffer, input, size, i);
 }
 
 static const struct flag_desc pipe2_flags[] = {
@@ -795,44 +883,72 @@ static const return_value_printer_func return_value_printer_table[] = {
 
 static int log_fd = -1;
 
+/* The maximum length of a single line in the log */
+enum { LOG_LINE_MAX = 0x1000 };
+
 /*
- * intercept_setup_log
- * Open (create) a log file. If requested, the current processes pid
- * number is attached to the path.
+ * The shared memory ring buffer, see the description in intercept_log.h.
+ * Used when the INTERCEPT_LOG_SHM environment variable is set, in which case
+ * no write syscall is issued for logging, all the data written to the log
+ * is published in the ring buffer instead. The log_fd file descriptor refers
+ * to the mapped file in this case.
  */
-void
-intercept_setup_log(const char *path, const char *trunc)
+static struct shm_log_ring *log_ring;
+
+enum { SHM_LOG_RING_SIZE = 0x1000000 };
+
+static void
+copy_to_ring(struct shm_log_ring *ring, uint64_t position,
+		const char *src, size_t size)
 {
-	char full_path[PATH_MAX];
+	size_t offset = (size_t)(position & (ring->size - 1));
+	size_t first = min_size(size, (size_t)ring->size - offset);
 
-	if (path == NULL || path[0] == '\0')
-		return;
+	copy_bytes(ring->data + offset, src, first);
+	copy_bytes(ring->data, src + first, size - first);
+}
 
-	char *c = full_path;
-	while ((*c = *path) != '\0') {
-		c++;
-		path++;
-	}
+/*
+ * shm_log_publish - copy some data to a new record in the ring buffer,
+ * or drop it, if there is not enough free space in the buffer.
+ */
+static void
+shm_log_publish(struct shm_log_ring *ring, const char *buffer, size_t len)
+{
+	uint64_t record_size = (sizeof(struct shm_log_record) + len + 7) & ~7;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
 
-	/* c points to the terminating null */
-	if (c[-1] == '-') {
-		/* if the last char was '-', append the pid to the path */
-		long pid = syscall_no_intercept(SYS_getpid);
-		if (pid < 0)
-			return;
+	do {
+		uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
 
-		print_number(c, pid, 10, 0);
-	}
+		if (head + record_size - tail > ring->size) {
+			__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while (!__atomic_compare_exchange_n(&ring->head, &head,
+	    head + record_size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
-	int flags = O_CREAT | O_RDWR | O_APPEND | O_TRUNC;
-	if (trunc && trunc[0] == '0')
-		flags &= ~O_TRUNC;
+	struct shm_log_record *record = (struct shm_log_record *)
+	    (ring->data + (head & (ring->size - 1)));
 
-	intercept_log_close(); /* in case a log was already open */
+	copy_to_ring(ring, head + sizeof(*record), buffer, len);
+	record->size = (uint32_t)len;
+	__atomic_store_n(&record->is_committed, 1, __ATOMIC_RELEASE);
+}
 
-	log_fd = (int)syscall_no_intercept(SYS_open, full_path, flags, 0700);
+/*
+ * write_log - write some data to the log file, or the ring buffer
+ */
+static void
+write_log(const char *buffer, size_t len)
+{
+	struct shm_log_ring *ring = __atomic_load_n(&log_ring,
+						__ATOMIC_ACQUIRE);
 
-	xabort_on_syserror(log_fd, "opening log");
+	if (ring != NULL)
+		shm_log_publish(ring, buffer, len);
+	else
+		syscall_no_intercept(SYS_write, log_fd, buffer, len);
 }
 
 static char *
@@ -847,8 +963,101 @@ print_return_value(char *c, enum return_type type, long value)
 	return return_value_printer_table[type](c, value);
 }
 
+/*
+ * print_syscall - print the name, arguments, and result of a syscall.
+ * The buffers pointed to by the arguments are read using the pointers in
+ * the captured argument, which is the same as desc, except when printing
+ * a syscall from a binary log, where these point to copies of the
+ * original buffers.
+ */
+/*
+ * print_arg - print the i-th argument of a syscall, preceded by a comma
+ * unless it is the first one. When the format is known at compile time,
+ * the function pointer is read from the constant arg_printer_func_table
+ * while compiling, leaving a direct call.
+ */
+static inline __attribute__((always_inline)) char *
+print_arg(char *c, enum arg_format format, int i,
+		const struct syscall_desc *desc,
+		const struct syscall_desc *captured,
+		enum intercept_log_result result_known, long result)
+{
+	if (format == arg_none)
+		return c;
+
+	if (i != 0)
+		c = print_cstr(c, ", ");
+
+	if (captured != desc && format == arg_flock) {
+		/* the original address, with the copied contents */
+		c = print_pointer(c, desc->args[i]);
+		return print_fcntl_flock(c, captured->args[i]);
+	}
+
+	return arg_printer_func_table[format](c, captured, i,
+						result_known, result);
+}
+
+typedef char *(*args_printer_func)(char *c, const struct syscall_desc *desc,
+				const struct syscall_desc *captured,
+				enum intercept_log_result result_known,
+				long result);
+
+/*
+ * A printer of all arguments of a syscall is generated for each format in
+ * syscall_format_list.h, the list of arguments is padded with arg_none,
+ * for which print_arg prints nothing.
+ */
+#define ARGS_PRINTER(id, a0, a1, a2, a3, a4, a5, ...) \
+static char * \
+print_args_##id(char *c, const struct syscall_desc *desc, \
+		const struct syscall_desc *captured, \
+		enum intercept_log_result rk, long result) \
+{ \
+	c = print_arg(c, a0, 0, desc, captured, rk, result); \
+	c = print_arg(c, a1, 1, desc, captured, rk, result); \
+	c = print_arg(c, a2, 2, desc, captured, rk, result); \
+	c = print_arg(c, a3, 3, desc, captured, rk, result); \
+	c = print_arg(c, a4, 4, desc, captured, rk, result); \
+	return print_arg(c, a5, 5, desc, captured, rk, result); \
+}
+
+#define ARGS_PADDING \
+	arg_none, arg_none, arg_none, arg_none, arg_none, arg_none, arg_none
+
+/* expands ARGS_PADDING before the arguments of ARGS_PRINTER are matched */
+#define ARGS_PRINTER_PADDED(...) ARGS_PRINTER(__VA_ARGS__)
+
+#define SYSCALL_FORMAT(name, r, ...) \
+	ARGS_PRINTER_PADDED(name, __VA_ARGS__, ARGS_PADDING)
+#define SYSCALL_FORMAT_VARIANT(variant, name, r, ...) \
+	ARGS_PRINTER_PADDED(variant, __VA_ARGS__, ARGS_PADDING)
+
+#include "syscall_format_list.h"
+
+#undef SYSCALL_FORMAT
+#undef SYSCALL_FORMAT_VARIANT
+
+/* The printers, indexed the same way as syscall_format.index */
+#define SYSCALL_FORMAT(name, r, ...) \
+	[SYS_##name] = print_args_##name,
+#define SYSCALL_FORMAT_VARIANT(variant, name, r, ...) \
+	[SYSCALL_NR_LIMIT + variant_##variant] = print_args_##variant,
+
+static const args_printer_func args_printer_func_table[
+		SYSCALL_NR_LIMIT + syscall_format_variant_count] = {
+#include "syscall_format_list.h"
+};
+
+#undef SYSCALL_FORMAT
+#undef SYSCALL_FORMAT_VARIANT
+#undef ARGS_PRINTER
+#undef ARGS_PRINTER_PADDED
+#undef ARGS_PADDING
+
 static char *
 print_syscall(char *c, const struct syscall_desc *desc,
+			const struct syscall_desc *captured,
 			enum intercept_log_result result_known, long result)
 {
 	const struct syscall_format *format = get_syscall_format(desc);
@@ -864,12 +1073,13 @@ print_syscall(char *c, const struct syscall_desc *desc,
 		c = print_cstr(c, ", ");
 	}
 
-	for (int i = 0; format->args[i] != arg_none; ++i) {
-		if (i != 0)
-			c = print_cstr(c, ", ");
-
-		arg_printer_func func = arg_printer_func_table[format->args[i]];
-		c = func(c, desc, i, result_known, result);
+	if (format->index >= 0) {
+		args_printer_func func = args_printer_func_table[format->index];
+		c = func(c, desc, captured, result_known, result);
+	} else {
+		for (int i = 0; format->args[i] != arg_none; ++i)
+			c = print_arg(c, format->args[i], i, desc, captured,
+					result_known, result);
 	}
 	c = print_cstr(c, ")");
 
@@ -884,6 +1094,751 @@ print_syscall(char *c, const struct syscall_desc *desc,
 	return c;
 }
 
+/*
+ * print_log_line - format a complete line of the log, as described at
+ * intercept_log_syscall. At most LOG_LINE_MAX bytes are used in the
+ * destination buffer, and a pointer to the end of the line is returned.
+ */
+static char *
+print_log_line(char *c, const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			const struct syscall_desc *captured,
+			enum intercept_log_result result_known, long result)
+{
+	/* prefix: "/lib/libc.so 0x1234 -- " */
+	c = print_cstr(c, patch->containing_lib_path);
+	c = print_cstr(c, " ");
+	c = print_hex(c, patch->syscall_offset);
+	c = print_cstr(c, " -- ");
+
+	c = print_syscall(c, desc, captured, result_known, result);
+
+	*c++ = '\n';
+
+	return c;
+}
+
+/*
+ * The binary log format, see the description in intercept_log.h.
+ * Used when the INTERCEPT_LOG_FORMAT environment variable is set to "binary".
+ * The records are formatted into the same buffers as the text lines,
+ * except for the blog_object records, which are written directly to the
+ * log, the first time a syscall from a specific object is logged. This
+ * way a record referring to an object always follows the record
+ * describing that object in the log.
+ */
+static bool log_binary;
+
+enum { BINARY_LOG_MAX_OBJECTS = 0x100, BINARY_LOG_UNKNOWN_OBJECT = 0xffff };
+
+static const char *binary_log_objects[BINARY_LOG_MAX_OBJECTS];
+
+/*
+ * Set once the blog_object record of an id is written. Before that, other
+ * threads log the syscalls of the object using BINARY_LOG_UNKNOWN_OBJECT,
+ * waiting for it could deadlock in a signal handler.
+ */
+static bool binary_log_object_ready[BINARY_LOG_MAX_OBJECTS];
+
+static __thread int32_t thread_tid
+	__attribute__((tls_model("initial-exec")));
+
+static char *
+pad_record(char *start, char *c)
+{
+	while ((c - start) % 8 != 0)
+		*c++ = '\0';
+
+	return c;
+}
+
+static void
+write_binary_object_record(uint16_t id, const char *path)
+{
+	char buffer[LOG_LINE_MAX] __attribute__((aligned(8)));
+	struct binary_log_header *header = (struct binary_log_header *)buffer;
+	char *c = buffer + sizeof(*header);
+
+	while (*path != '\0' && c < buffer + sizeof(buffer) - 8)
+		*c++ = *path++;
+	*c++ = '\0';
+	c = pad_record(buffer, c);
+
+	header->size = (uint32_t)(c - buffer);
+	header->type = blog_object;
+	header->object_id = id;
+
+	write_log(buffer, (size_t)(c - buffer));
+}
+
+/*
+ * get_binary_log_object_id - find the id assigned to an object, or assign
+ * an id to a new object, and write a blog_object record about it. The id is
+ * only used once that record is written.
+ */
+static uint16_t
+get_binary_log_object_id(const char *path)
+{
+	for (uint16_t id = 0; id < BINARY_LOG_MAX_OBJECTS; ++id) {
+		const char *p = __atomic_load_n(&binary_log_objects[id],
+						__ATOMIC_ACQUIRE);
+
+		if (p == NULL) {
+			if (__atomic_compare_exchange_n(&binary_log_objects[id],
+			    &p, path, false,
+			    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				write_binary_object_record(id, path);
+				__atomic_store_n(&binary_log_object_ready[id],
+						true, __ATOMIC_RELEASE);
+				return id;
+			}
+		}
+
+		if (p == path) {
+			if (!__atomic_load_n(&binary_log_object_ready[id],
+			    __ATOMIC_ACQUIRE))
+				return BINARY_LOG_UNKNOWN_OBJECT;
+
+			return id;
+		}
+	}
+
+	return BINARY_LOG_UNKNOWN_OBJECT;
+}
+
+static int32_t
+get_tid(void)
+{
+	if (thread_tid == 0)
+		thread_tid = (int32_t)syscall_no_intercept(SYS_gettid);
+
+	return thread_tid;
+}
+
+/*
+ * cstr_capture_size - the length of a string, including the terminating
+ * null character, at most BINARY_LOG_CAPTURE_MAX. Thus even an empty string
+ * is captured using a non-zero number of bytes.
+ */
+static size_t
+cstr_capture_size(const char *str)
+{
+	size_t len = 0;
+
+	while (len < BINARY_LOG_CAPTURE_MAX && str[len] != '\0')
+		++len;
+
+	if (len < BINARY_LOG_CAPTURE_MAX)
+		++len;
+
+	return len;
+}
+
+/*
+ * buffer_capture_size - the number of bytes to copy to the log from a buffer
+ * of the given size. With the "ref" policy nothing is copied, only the
+ * address and the length of the buffer are recorded in the arguments.
+ * The bytes are copied raw, the escaping or the hexadecimal formatting
+ * is left to the decoder.
+ */
+static size_t
+buffer_capture_size(size_t size)
+{
+	if (buffer_policy == buffer_ref)
+		return 0;
+
+	if (buffer_capture_max == 0)
+		return min_size(size, BINARY_LOG_CAPTURE_MAX);
+
+	return min_size(size,
+		min_size(buffer_capture_max, BINARY_LOG_CAPTURE_LIMIT));
+}
+
+/*
+ * capture_size - the number of bytes to copy to the log from the buffer
+ * pointed to by the i-th argument of a syscall.
+ */
+static size_t
+capture_size(enum arg_format type, const struct syscall_desc *desc, int i,
+		enum intercept_log_result result_known, long result)
+{
+	if (desc->args[i] == 0)
+		return 0;
+
+	switch (type) {
+		case arg_cstr:
+			return cstr_capture_size(
+				(const char *)(uintptr_t)desc->args[i]);
+		case arg_buf_in:
+			return buffer_capture_size((size_t)desc->args[i + 1]);
+		case arg_buf_out:
+			if (result_known == UNKNOWN || result < 0)
+				return 0;
+			return buffer_capture_size((size_t)result);
+		case arg_2fds:
+			if (result_known == UNKNOWN || result < 0)
+				return 0;
+			return 2 * sizeof(int);
+		case arg_flock:
+			return sizeof(struct flock);
+		default:
+			return 0;
+	}
+}
+
+/*
+ * print_binary_syscall - format a blog_syscall record, the binary
+ * counterpart of print_log_line.
+ */
+static char *
+print_binary_syscall(char *dst, const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			enum intercept_log_result result_known, long result)
+{
+	const struct syscall_format *format = get_syscall_format(desc);
+	struct binary_log_syscall *record = (struct binary_log_syscall *)dst;
+	char *c = dst + sizeof(*record);
+	bool has_arg = true;
+
+	record->header.type = blog_syscall;
+	record->header.object_id =
+	    get_binary_log_object_id(patch->containing_lib_path);
+	record->timestamp = __builtin_ia32_rdtsc();
+	record->syscall_offset = patch->syscall_offset;
+	record->tid = get_tid();
+	record->nr = (int32_t)desc->nr;
+	record->result = result;
+	record->result_known = (result_known == KNOWN);
+	record->reserved = 0;
+
+	for (int i = 0; i < 6; ++i) {
+		size_t size = 0;
+
+		if (format->args[i] == arg_none)
+			has_arg = false;
+
+		if (has_arg)
+			size = capture_size(format->args[i], desc, i,
+					result_known, result);
+
+		record->args[i] = desc->args[i];
+		record->capture_sizes[i] = (uint8_t)size;
+		c = copy_bytes(c, (const void *)(uintptr_t)desc->args[i], size);
+	}
+
+	c = pad_record(dst, c);
+	record->header.size = (uint32_t)(c - dst);
+
+	return c;
+}
+
+/*
+ * intercept_log_print_binary_syscall - print a line of the text log,
+ * using the information in a blog_syscall record. The line looks
+ * the same as the one logged with INTERCEPT_LOG_FORMAT set to "text", as
+ * long as the same INTERCEPT_LOG_BUFFERS setting is used for decoding, and
+ * the captured bytes suffice. Buffers not captured in the record are
+ * printed as pointers. The size of the record is expected to be verified
+ * by the caller.
+ */
+char *
+intercept_log_print_binary_syscall(char *dst,
+				const struct binary_log_syscall *record,
+				const char *path)
+{
+	struct syscall_desc desc = { .nr = record->nr, };
+	struct syscall_desc captured;
+	struct patch_desc patch = {
+		.containing_lib_path = path,
+		.syscall_offset = (unsigned long)record->syscall_offset,
+	};
+	char copies[6][BINARY_LOG_CAPTURE_LIMIT + 1];
+	const char *data = (const char *)(record + 1);
+	enum intercept_log_result result_known =
+	    record->result_known ? KNOWN : UNKNOWN;
+
+	for (int i = 0; i < 6; ++i) {
+		size_t size = record->capture_sizes[i];
+
+		desc.args[i] = record->args[i];
+		captured.args[i] = record->args[i];
+
+		if (size > 0) {
+			char *end = copy_bytes(copies[i], data, size);
+			*end = '\0';
+			captured.args[i] = (long)copies[i];
+			data += size;
+		}
+	}
+	captured.nr = desc.nr;
+
+	decoded_capture_sizes = record->capture_sizes;
+	char *end = print_log_line(dst, &patch, &desc, &captured,
+				result_known, record->result);
+	decoded_capture_sizes = NULL;
+
+	return end;
+}
+
+/*
+ * print_log_record - format a line of the text log, or a binary record,
+ * whichever is used.
+ */
+static char *
+print_log_record(char *c, const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			enum intercept_log_result result_known, long result)
+{
+	if (log_binary)
+		return print_binary_syscall(c, patch, desc,
+					result_known, result);
+	else
+		return print_log_line(c, patch, desc, desc,
+					result_known, result);
+}
+
+/*
+ * intercept_setup_log_format - select the format of the log, as requested
+ * via the INTERCEPT_LOG_FORMAT environment variable
+ */
+void
+intercept_setup_log_format(const char *format)
+{
+	if (format == NULL || strcmp(format, "text") == 0)
+		log_binary = false;
+	else if (strcmp(format, "binary") == 0)
+		log_binary = true;
+	else
+		xabort("invalid INTERCEPT_LOG_FORMAT");
+}
+
+/*
+ * intercept_setup_log_buffers - select how the contents of buffers are
+ * logged, as requested via the INTERCEPT_LOG_BUFFERS environment variable.
+ * The format is a policy, optionally followed by a colon, and the maximum
+ * number of bytes to capture, e.g.: "hex:32"
+ */
+void
+intercept_setup_log_buffers(const char *policy)
+{
+	if (policy == NULL)
+		return;
+
+	const char *max = strchr(policy, ':');
+	size_t len = (max == NULL) ? strlen(policy) : (size_t)(max - policy);
+
+	if (len == strlen("escape") && strncmp(policy, "escape", len) == 0)
+		buffer_policy = buffer_escape;
+	else if (len == strlen("hex") && strncmp(policy, "hex", len) == 0)
+		buffer_policy = buffer_hex;
+	else if (len == strlen("ref") && strncmp(policy, "ref", len) == 0)
+		buffer_policy = buffer_ref;
+	else
+		xabort("invalid INTERCEPT_LOG_BUFFERS");
+
+	if (max == NULL)
+		return;
+
+	char *end;
+	unsigned long value = strtoul(max + 1, &end, 0);
+	if (max[1] == '\0' || *end != '\0' || value == 0)
+		xabort("invalid INTERCEPT_LOG_BUFFERS");
+
+	buffer_capture_max = min_size(value, LOG_BUFFER_CAPTURE_LIMIT);
+}
+
+static void
+write_binary_file_record(void)
+{
+	char buffer[sizeof(struct binary_log_header) +
+			sizeof(BINARY_LOG_MAGIC) + 8]
+			__attribute__((aligned(8)));
+	struct binary_log_header *header = (struct binary_log_header *)buffer;
+	char *c = print_cstr(buffer + sizeof(*header), BINARY_LOG_MAGIC);
+
+	c = pad_record(buffer, c + 1);
+
+	header->size = (uint32_t)(c - buffer);
+	header->type = blog_file;
+	header->object_id = 0;
+
+	write_log(buffer, (size_t)(c - buffer));
+}
+
+/*
+ * print_log_path - copy the path of the log, with the current processes pid
+ * number attached, if the path ends with a '-' character.
+ * Returns false if the pid can't be queried.
+ */
+bool
+print_log_path(char *full_path, const char *path)
+{
+	char *c = full_path;
+	while ((*c = *path) != '\0') {
+		c++;
+		path++;
+	}
+
+	/* c points to the terminating null */
+	if (c[-1] == '-') {
+		/* if the last char was '-', append the pid to the path */
+		long pid = syscall_no_intercept(SYS_getpid);
+		if (pid < 0)
+			return false;
+
+		*print_number(c, pid, 10, 0) = '\0';
+	}
+
+	return true;
+}
+
+/*
+ * The path of the log as it was given, if it ends with a '-' character, thus
+ * each process is meant to log to a file (or ring buffer) of its own. A new
+ * child process switches to a log of its own using the same path, see
+ * intercept_log_new_process.
+ */
+static char log_path_template[PATH_MAX];
+static bool log_path_is_shm;
+static bool log_truncate;
+
+/*
+ * remember_log_path - save the path used while opening a log, unless it is
+ * the saved path being used again
+ */
+static void
+remember_log_path(const char *path, bool is_shm, bool truncate)
+{
+	log_path_is_shm = is_shm;
+	log_truncate = truncate;
+
+	if (path == log_path_template)
+		return;
+
+	size_t len = 0;
+	while (path[len] != '\0' && len < sizeof(log_path_template) - 1) {
+		log_path_template[len] = path[len];
+		++len;
+	}
+
+	if (path[len] != '\0' || log_path_template[len - 1] != '-')
+		len = 0;
+
+	log_path_template[len] = '\0';
+}
+
+/*
+ * start_log - write what is needed at the start of a new log
+ */
+static void
+start_log(void)
+{
+	if (log_binary) {
+		for (size_t i = 0; i < BINARY_LOG_MAX_OBJECTS; ++i) {
+			binary_log_objects[i] = NULL;
+			binary_log_object_ready[i] = false;
+		}
+
+		write_binary_file_record();
+	}
+}
+
+/*
+ * intercept_setup_log
+ * Open (create) a log file. If requested, the current processes pid
+ * number is attached to the path.
+ */
+void
+intercept_setup_log(const char *path, const char *trunc)
+{
+	char full_path[PATH_MAX];
+
+	if (path == NULL || path[0] == '\0')
+		return;
+
+	if (!print_log_path(full_path, path))
+		return;
+
+	int flags = O_CREAT | O_RDWR | O_APPEND | O_TRUNC;
+	if (trunc && trunc[0] == '0')
+		flags &= ~O_TRUNC;
+
+	intercept_log_close(); /* in case a log was already open */
+
+	log_fd = (int)syscall_no_intercept(SYS_open, full_path, flags, 0700);
+
+	xabort_on_syserror(log_fd, "opening log");
+
+	remember_log_path(path, false, (flags & O_TRUNC) != 0);
+	start_log();
+}
+
+/*
+ * intercept_setup_log_shm
+ * Create a file containing a ring buffer, and map it to memory, to be used
+ * instead of a log file. If requested, the current processes pid number is
+ * attached to the path. The SHM_LOG_MAGIC string is written to the file
+ * last, after the ring buffer is ready to be used.
+ */
+void
+intercept_setup_log_shm(const char *path)
+{
+	char full_path[PATH_MAX];
+	size_t map_size = sizeof(struct shm_log_ring) + SHM_LOG_RING_SIZE;
+
+	if (path == NULL || path[0] == '\0')
+		return;
+
+	if (!print_log_path(full_path, path))
+		return;
+
+	intercept_log_close(); /* in case a log was already open */
+
+	int fd = (int)syscall_no_intercept(SYS_open, full_path,
+					O_CREAT | O_RDWR | O_TRUNC, 0700);
+	xabort_on_syserror(fd, "opening shm log");
+
+	xabort_on_syserror(syscall_no_intercept(SYS_ftruncate, fd, map_size),
+				"resizing shm log");
+
+	long addr = syscall_no_intercept(SYS_mmap, NULL, map_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	xabort_on_syserror(addr, "mapping shm log");
+
+	struct shm_log_ring *ring = (struct shm_log_ring *)addr;
+	ring->size = SHM_LOG_RING_SIZE;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	print_cstr(ring->magic, SHM_LOG_MAGIC);
+
+	__atomic_store_n(&log_ring, ring, __ATOMIC_RELEASE);
+	log_fd = fd;
+
+	remember_log_path(path, true, true);
+	start_log();
+}
+
+/*
+ * Per-thread log buffers, used when the INTERCEPT_LOG_BUFFERED environment
+ * variable is set. Each thread appends its log lines to a buffer of its own,
+ * which is written to the log file using a single write syscall when it is
+ * almost full, or when the thread is about to do something after which the
+ * buffer might never be flushed otherwise (e.g. exit, execve, fork).
+ *
+ * The buffers are never freed. A buffer released by a thread that exited
+ * is reused by the next thread asking for a buffer. Every buffer is on the
+ * singly linked list starting at log_buffers, so all of them can be flushed
+ * before exiting the process.
+ *
+ * The is_busy flag guards the contents of a buffer, it is set while a
+ * thread appends to the buffer, or while a buffer is written to the file.
+ * A thread never waits for this flag to be cleared: when the buffer of the
+ * current thread is busy -- e.g. a signal handler interrupted the thread
+ * while logging -- the log line is written directly to the file instead.
+ */
+struct log_buffer {
+	struct log_buffer *next;
+	bool is_owned;
+	bool is_busy;
+	size_t used;
+	char data[];
+};
+
+enum { LOG_BUFFER_SIZE = 0x10000 };
+
+#define LOG_BUFFER_CAPACITY (LOG_BUFFER_SIZE - sizeof(struct log_buffer))
+
+static bool log_buffered;
+static struct log_buffer *log_buffers;
+static __thread struct log_buffer *thread_log_buffer
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * acquire_log_buffer - find a buffer not owned by any thread, or allocate
+ * a new one.
+ */
+static struct log_buffer *
+acquire_log_buffer(void)
+{
+	struct log_buffer *buf;
+
+	for (buf = __atomic_load_n(&log_buffers, __ATOMIC_ACQUIRE);
+	    buf != NULL; buf = buf->next) {
+		bool owned = false;
+
+		if (__atomic_compare_exchange_n(&buf->is_owned, &owned, true,
+		    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return buf;
+	}
+
+	buf = xmmap_anon(LOG_BUFFER_SIZE);
+	buf->is_owned = true;
+	buf->next = __atomic_load_n(&log_buffers, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(&log_buffers, &buf->next, buf,
+	    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+
+	return buf;
+}
+
+static bool
+lock_log_buffer(struct log_buffer *buf)
+{
+	return !__atomic_exchange_n(&buf->is_busy, true, __ATOMIC_ACQUIRE);
+}
+
+static void
+unlock_log_buffer(struct log_buffer *buf)
+{
+	__atomic_store_n(&buf->is_busy, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * flush_log_buffer - write the contents of a locked buffer to the log file
+ */
+static void
+flush_log_buffer(struct log_buffer *buf)
+{
+	if (buf->used > 0 && log_fd >= 0)
+		write_log(buf->data, buf->used);
+
+	buf->used = 0;
+}
+
+/*
+ * flush_all_log_buffers - flush the buffers of every thread, except
+ * those being used at the moment.
+ */
+static void
+flush_all_log_buffers(void)
+{
+	struct log_buffer *buf;
+
+	for (buf = __atomic_load_n(&log_buffers, __ATOMIC_ACQUIRE);
+	    buf != NULL; buf = buf->next) {
+		if (lock_log_buffer(buf)) {
+			flush_log_buffer(buf);
+			unlock_log_buffer(buf);
+		}
+	}
+}
+
+/*
+ * reset_other_log_buffers - called in a new child process, which has a copy
+ * of the buffers of all the threads of its parent. The lines in these copies
+ * are going to be written to the log by the parent process, and the threads
+ * owning them don't exist in the child process.
+ */
+static void
+reset_other_log_buffers(void)
+{
+	struct log_buffer *buf;
+
+	for (buf = log_buffers; buf != NULL; buf = buf->next) {
+		if (buf != thread_log_buffer) {
+			buf->used = 0;
+			buf->is_busy = false;
+			buf->is_owned = false;
+		}
+	}
+}
+
+/*
+ * may_not_return - is this a syscall after which the buffers must be
+ * flushed, to make sure no line gets lost, or logged twice?
+ */
+static bool
+may_not_return(const struct syscall_desc *desc)
+{
+	switch (desc->nr) {
+		case SYS_exit:
+		case SYS_exit_group:
+		case SYS_execve:
+#ifdef SYS_execveat
+		case SYS_execveat:
+#endif
+		case SYS_fork:
+		case SYS_vfork:
+		case SYS_clone:
+#ifdef SYS_clone3
+		case SYS_clone3:
+#endif
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * is_new_process - checks if the syscall just executed was a fork,
+ * returning in the child process
+ */
+static bool
+is_new_process(const struct syscall_desc *desc, long result)
+{
+	return result == 0 && is_fork(desc);
+}
+
+/*
+ * log_syscall_buffered - the buffered version of intercept_log_syscall.
+ * The syscalls are only logged after they return, in a single line containing
+ * the result. The exceptions are the syscalls that might not return,
+ * these are logged before they are executed as well.
+ */
+static void
+log_syscall_buffered(const struct patch_desc *patch,
+			const struct syscall_desc *desc,
+			enum intercept_log_result result_known, long result)
+{
+	if (result_known == UNKNOWN && !may_not_return(desc))
+		return;
+
+	if (thread_log_buffer == NULL)
+		thread_log_buffer = acquire_log_buffer();
+
+	struct log_buffer *buf = thread_log_buffer;
+
+	if (!lock_log_buffer(buf)) {
+		char buffer[LOG_LINE_MAX] __attribute__((aligned(8)));
+		char *c = print_log_record(buffer, patch, desc,
+					result_known, result);
+
+		write_log(buffer, (size_t)(c - buffer));
+		return;
+	}
+
+	if (LOG_BUFFER_CAPACITY - buf->used < LOG_LINE_MAX)
+		flush_log_buffer(buf);
+
+	char *c = print_log_record(buf->data + buf->used, patch, desc,
+				result_known, result);
+	buf->used = (size_t)(c - buf->data);
+
+	if (result_known == UNKNOWN)
+		flush_log_buffer(buf);
+
+	if (result_known == UNKNOWN && desc->nr == SYS_exit) {
+		/* this thread is about to exit, the buffer can be reused */
+		thread_log_buffer = NULL;
+		__atomic_store_n(&buf->is_owned, false, __ATOMIC_RELEASE);
+	}
+
+	unlock_log_buffer(buf);
+
+	if (result_known == UNKNOWN && desc->nr == SYS_exit_group)
+		flush_all_log_buffers();
+}
+
+/*
+ * intercept_setup_log_buffering - turn on buffering, if requested via
+ * the INTERCEPT_LOG_BUFFERED environment variable
+ */
+void
+intercept_setup_log_buffering(const char *buffered)
+{
+	log_buffered = (buffered != NULL && buffered[0] != '0');
+}
+
 /*
  * Log syscalls after intercepting, in a human readable ( as much as possible )
  * format. The format is either:
@@ -914,20 +1869,49 @@ intercept_log_syscall(const struct patch_desc *patch,
 	if (log_fd < 0)
 		return;
 
-	char buffer[0x1000];
-	char *c = buffer;
+	if (result_known == KNOWN && is_new_process(desc, result))
+		intercept_log_new_process();
 
-	/* prefix: "/lib/libc.so 0x1234 -- " */
-	c = print_cstr(c, patch->containing_lib_path);
-	c = print_cstr(c, " ");
-	c = print_hex(c, patch->syscall_offset);
-	c = print_cstr(c, " -- ");
+	if (log_buffered) {
+		log_syscall_buffered(patch, desc, result_known, result);
+		return;
+	}
 
-	c = print_syscall(c, desc, result_known, result);
+	char buffer[LOG_LINE_MAX] __attribute__((aligned(8)));
+	char *c = print_log_record(buffer, patch, desc, result_known, result);
 
-	*c++ = '\n';
+	write_log(buffer, (size_t)(c - buffer));
+}
 
-	syscall_no_intercept(SYS_write, log_fd, buffer, c - buffer);
+/*
+ * intercept_log_new_process
+ * Called in a new child process, right after fork. If the path of the log
+ * ends with a '-' character, the child process switches to a log of its own,
+ * with its own pid number attached to the path. Otherwise the child keeps
+ * logging to the same file as its parent.
+ *
+ * Lines still in the buffers of the parents threads are not written by the
+ * child, those are written by the parent. The buffer of the thread calling
+ * fork is flushed before the fork syscall.
+ */
+void
+intercept_log_new_process(void)
+{
+	if (log_fd < 0)
+		return;
+
+	thread_tid = 0;
+	if (log_buffered)
+		reset_other_log_buffers();
+
+	if (log_path_template[0] == '\0')
+		return;
+
+	if (log_path_is_shm)
+		intercept_setup_log_shm(log_path_template);
+	else
+		intercept_setup_log(log_path_template,
+					log_truncate ? "1" : "0");
 }
 
 /*
@@ -938,8 +1922,8 @@ intercept_log_syscall(const struct patch_desc *patch,
 void
 intercept_log(const char *buffer, size_t len)
 {
-	if (log_fd >= 0)
-		syscall_no_intercept(SYS_write, log_fd, buffer, len);
+	if (log_fd >= 0 && !log_binary)
+		write_log(buffer, len);
 }
 
 /*
@@ -949,6 +1933,14 @@ intercept_log(const char *buffer, size_t len)
 void
 intercept_log_close(void)
 {
+	flush_all_log_buffers();
+
+	/*
+	 * The ring buffer is not unmapped, as other threads might still be
+	 * writing to it.
+	 */
+	__atomic_store_n(&log_ring, NULL, __ATOMIC_RELEASE);
+
 	if (log_fd >= 0) {
 		syscall_no_intercept(SYS_close, log_fd);
 		log_fd = -1;
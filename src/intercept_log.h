@@ -33,13 +33,19 @@
 #ifndef INTERCEPT_LOG_H
 #define INTERCEPT_LOG_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 struct patch_desc;
 struct syscall_desc;
 
 void intercept_setup_log(const char *path_base, const char *trunc);
+void intercept_setup_log_buffering(const char *buffered);
+void intercept_setup_log_format(const char *format);
+void intercept_setup_log_buffers(const char *policy);
 void intercept_log(const char *buffer, size_t len);
+void intercept_log_new_process(void);
 
 enum intercept_log_result { KNOWN, UNKNOWN };
 
@@ -50,4 +56,107 @@ void intercept_log_syscall(const struct patch_desc *,
 
 void intercept_log_close(void);
 
+char *print_number(char *dst, unsigned long n, int base, unsigned width);
+bool print_log_path(char *full_path, const char *path);
+
+/*
+ * The binary log format, used when INTERCEPT_LOG_FORMAT is set to "binary".
+ *
+ * The log is a sequence of records, each starting with a struct
+ * binary_log_header, and each occupying a multiple of eight bytes.
+ * The first record is of type blog_file, containing the
+ * BINARY_LOG_MAGIC string. A record of type blog_object assigns an id
+ * to the path of an object, the id is used in the records describing
+ * syscalls that follow it -- or 0xffff is used, when the object is not
+ * known, e.g. while another thread is still writing that record.
+ * These are of type blog_syscall, a struct binary_log_syscall
+ * followed by the bytes captured from the buffers pointed to by syscall
+ * arguments, e.g. the path given to open, or the data given to write.
+ * The number of bytes captured for each argument is stored in the
+ * capture_sizes array, the captured bytes of the arguments directly follow
+ * each other, in the order of the arguments.
+ *
+ * The records are written in the byte order of the machine, no attempt is
+ * made to make the log portable.
+ */
+#define BINARY_LOG_MAGIC "syscall_intercept binary log v1"
+
+/* The default number of bytes captured from a single argument */
+#define BINARY_LOG_CAPTURE_MAX 0x80
+
+/*
+ * The maximum number of bytes captured from a single buffer, when a larger
+ * size is requested via INTERCEPT_LOG_BUFFERS
+ */
+#define BINARY_LOG_CAPTURE_LIMIT 0xff
+
+enum binary_log_record_type {
+	blog_file = 1,
+	blog_object = 2,
+	blog_syscall = 3
+};
+
+struct binary_log_header {
+	uint32_t size; /* the size of the whole record */
+	uint16_t type;
+	uint16_t object_id;
+};
+
+struct binary_log_syscall {
+	struct binary_log_header header;
+	uint64_t timestamp; /* value of the TSC */
+	uint64_t syscall_offset;
+	int32_t tid;
+	int32_t nr;
+	int64_t args[6];
+	int64_t result;
+	uint8_t result_known;
+	uint8_t capture_sizes[6];
+	uint8_t reserved;
+};
+
+char *intercept_log_print_binary_syscall(char *dst,
+				const struct binary_log_syscall *record,
+				const char *path);
+
+/*
+ * The shared memory ring buffer, used when INTERCEPT_LOG_SHM is set.
+ *
+ * The file mapped by every process writing to the log, and by the reader,
+ * starts with a struct shm_log_ring, followed by the ring buffer itself,
+ * which is of size bytes. The head and tail fields are byte offsets, that
+ * are only ever incremented, the position in the buffer is the offset modulo
+ * the size of the buffer, which is a power of two.
+ *
+ * A producer reserves space for a record by advancing the head, unless
+ * that would overwrite data not yet consumed, in which case the record
+ * is dropped, and the dropped counter is incremented. Each record starts
+ * with a struct shm_log_record, followed by the data, padded to eight
+ * bytes. The data is the same as what would be written to a log file.
+ * The is_committed field is set after the data is copied, the reader
+ * stops at the first record that is not committed yet. After consuming
+ * a record, the reader clears all the bytes used by the record, before
+ * advancing the tail.
+ */
+#define SHM_LOG_MAGIC "syscall_intercept shm log v1"
+
+struct shm_log_ring {
+	char magic[32];
+	uint64_t size;
+	uint64_t dropped;
+	char padding0[16];
+	uint64_t head; /* on a separate cache line */
+	char padding1[56];
+	uint64_t tail; /* on a separate cache line */
+	char padding2[56];
+	char data[];
+};
+
+struct shm_log_record {
+	uint32_t size; /* the size of the data in the record */
+	uint32_t is_committed;
+};
+
+void intercept_setup_log_shm(const char *path);
+
 #endif
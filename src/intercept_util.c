@@ -48,6 +48,10 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <linux/futex.h>
 #include <linux/limits.h>
 
 void
@@ -91,6 +95,45 @@ xmunmap(void *addr, size_t len)
 	xabort_on_syserror(result, __func__);
 }
 
+#define HELPER_THREAD_STACK_SIZE ((size_t)0x40000)
+
+void
+start_helper_thread(struct helper_thread *thread,
+			void (*func)(void *), void *arg)
+{
+	uint64_t all_signals = ~UINT64_C(0);
+	uint64_t old_mask;
+	long result;
+
+	thread->stack = xmmap_anon(HELPER_THREAD_STACK_SIZE);
+
+	/* The new thread inherits the signal mask */
+	result = syscall_no_intercept(SYS_rt_sigprocmask, SIG_SETMASK,
+			&all_signals, &old_mask, sizeof(old_mask));
+	xabort_on_syserror(result, "rt_sigprocmask");
+
+	result = clone_helper_thread(
+			(char *)thread->stack + HELPER_THREAD_STACK_SIZE,
+			&thread->tid, func, arg);
+
+	syscall_no_intercept(SYS_rt_sigprocmask, SIG_SETMASK,
+			&old_mask, NULL, sizeof(old_mask));
+
+	xabort_on_syserror(result, "clone");
+}
+
+void
+join_helper_thread(struct helper_thread *thread)
+{
+	int tid;
+
+	while ((tid = __atomic_load_n(&thread->tid, __ATOMIC_ACQUIRE)) != 0)
+		syscall_no_intercept(SYS_futex, &thread->tid, FUTEX_WAIT,
+				tid, NULL);
+
+	xmunmap(thread->stack, HELPER_THREAD_STACK_SIZE);
+}
+
 long
 xlseek(long fd, unsigned long off, int whence)
 {
@@ -110,6 +153,16 @@ xread(long fd, void *buffer, size_t size)
 		xabort_errno(syscall_error_code(result), __func__);
 }
 
+long
+now_ns(void)
+{
+	struct timespec ts;
+
+	syscall_no_intercept(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 /* BEGIN CSTYLED */
 static const char *const error_strings[] = {
 #ifdef EPERM
@@ -37,6 +37,35 @@
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+/*
+ * zero_bytes - memset without calling libc, and without using
+ * SIMD registers
+ */
+static inline void
+zero_bytes(void *dst, size_t size)
+{
+	__asm__ volatile("rep stosb"
+		: "+D" (dst), "+c" (size)
+		: "a" (0)
+		: "memory");
+}
+
+/*
+ * copy_bytes - similar to memcpy, but returns a pointer to the end of the
+ * destination buffer. The rep movsb instruction is used to avoid calling
+ * into libc, and to avoid using SIMD registers.
+ */
+static inline void *
+copy_bytes(void *dst, const void *src, size_t size)
+{
+	__asm__ volatile("rep movsb"
+		: "+D" (dst), "+S" (src), "+c" (size)
+		:
+		: "memory");
+
+	return dst;
+}
+
 /*
  * syscall_no_intercept - syscall without interception
  *
@@ -83,6 +112,36 @@ long xlseek(long fd, unsigned long off, int whence);
  */
 void xread(long fd, void *buffer, size_t size);
 
+/*
+ * now_ns - the CLOCK_MONOTONIC time in nanoseconds
+ *
+ * Not intercepted - does not call libc.
+ */
+long now_ns(void);
+
+/*
+ * A thread created without libc, used for running some of the work done
+ * at startup in parallel. Such a thread has no TLS of its own, thus it
+ * must not call libc routines, and it must not use TLS variables.
+ * All signals are blocked in these threads.
+ */
+struct helper_thread {
+	int tid;
+	void *stack;
+};
+
+long clone_helper_thread(void *stack_top, int *tid,
+			void (*func)(void *), void *arg);
+
+void start_helper_thread(struct helper_thread *thread,
+			void (*func)(void *), void *arg);
+
+/*
+ * join_helper_thread - wait for a helper thread to exit, and release
+ * its stack.
+ */
+void join_helper_thread(struct helper_thread *thread);
+
 /*
  * strerror_no_intercept - returns a pointer to a C string associated with
  * an errno value.
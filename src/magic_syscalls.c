@@ -32,13 +32,31 @@
 
 #ifndef SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS
 
+#include <stdbool.h>
 #include <stdint.h>
-#include <string.h>
 
 #include "magic_syscalls.h"
 #include "intercept.h"
 #include "intercept_util.h"
 #include "intercept_log.h"
+#include "syscall_stats.h"
+
+/*
+ * is_message - strncmp without calling libc, the SIMD registers might not be
+ * saved, see intercept_hook_point_general_regs_only
+ */
+static bool
+is_message(const char *message, size_t len, const char *expected)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (message[i] != expected[i])
+			return false;
+		if (expected[i] == '\0')
+			break;
+	}
+
+	return true;
+}
 
 /*
  * handle_magic_syscalls - this routine performs two tasks:
@@ -59,7 +77,7 @@ handle_magic_syscalls(struct syscall_desc *desc, long *result)
 	const char *message = (void *)(uintptr_t)desc->args[1];
 	size_t len = (size_t)desc->args[2];
 
-	if (strncmp(message, start_log_message, len) == 0) {
+	if (is_message(message, len, start_log_message)) {
 		const char *path = (const void *)(uintptr_t)desc->args[3];
 		const char *trunc = (const void *)(uintptr_t)desc->args[4];
 		intercept_setup_log(path, trunc);
@@ -67,12 +85,18 @@ handle_magic_syscalls(struct syscall_desc *desc, long *result)
 		return 0;
 	}
 
-	if (strncmp(message, stop_log_message, len) == 0) {
+	if (is_message(message, len, stop_log_message)) {
 		intercept_log_close();
 		*result = (long)len;
 		return 0;
 	}
 
+	if (is_message(message, len, dump_stats_message)) {
+		intercept_stats_dump();
+		*result = (long)len;
+		return 0;
+	}
+
 	return -1;
 }
 
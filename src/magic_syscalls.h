@@ -39,13 +39,14 @@
  * If the need arises, this can be disabled by defining the
  * SYSCALL_INTERCEPT_WITHOUT_MAGIC_SYSCALLS macro during compilation.
  *
- * At the moment there are only two 'magic' syscalls which trigger
+ * At the moment there are only three 'magic' syscalls which trigger
  * this feature:
  *
  * write(123, start_log_message, sizeof(start_log_message))
  * write(123, stop_log_message, sizeof(stop_log_message))
+ * write(123, dump_stats_message, sizeof(dump_stats_message))
  *
- * These two syscalls are not handled as regular syscalls i.e.:
+ * These syscalls are not handled as regular syscalls i.e.:
  * they are not forwarded to the kernel, neither to a hook routine.
  *
  * Notice: the arguments of the syscall must match exactly. Thus, if
@@ -70,6 +71,7 @@ enum { SYSCALL_INT_MAGIC_WRITE_FD = 123 };
 
 static const char start_log_message[] = "SYSCALL_INTERCEPT_TEST_START_LOG";
 static const char stop_log_message[] = "SYSCALL_INTERCEPT_TEST_STOP_LOG";
+static const char dump_stats_message[] = "SYSCALL_INTERCEPT_DUMP_STATS";
 
 static inline void
 magic_syscall_start_log(const char *path, const char *trunc)
@@ -86,6 +88,13 @@ magic_syscall_stop_log(void)
 	    stop_log_message, sizeof(stop_log_message));
 }
 
+static inline void
+magic_syscall_dump_stats(void)
+{
+	syscall(SYS_write, SYSCALL_INT_MAGIC_WRITE_FD,
+	    dump_stats_message, sizeof(dump_stats_message));
+}
+
 int handle_magic_syscalls(struct syscall_desc *desc, long *result);
 
 
@@ -103,6 +112,11 @@ magic_syscall_stop_log(void)
 {
 }
 
+static inline void
+magic_syscall_dump_stats(void)
+{
+}
+
 static inline int
 handle_magic_syscalls(struct syscall_desc *desc, long *result);
 {
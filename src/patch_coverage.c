@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * patch_coverage.c -- reporting how the syscalls found in each object
+ * were patched, enabled by the INTERCEPT_PATCH_COVERAGE environment
+ * variable.
+ *
+ * When the variable is set to "log", the report is written to the log
+ * set up via INTERCEPT_LOG, with any other value it is written to
+ * stderr. A line is printed for each object patched, containing the
+ * number of syscalls found, the number of those not selected for
+ * patching, the number of those patched using a nop trampoline, the
+ * number of those patched by overwriting the surrounding instructions,
+ * the number of those which could not be patched, and the bytes of code
+ * overwritten, the bytes of asm wrappers generated, and the bytes of
+ * trampolines used:
+ *
+ * patch_coverage /lib/libc.so.6 syscalls 500 unselected 0 nop 120 ...
+ *
+ * The number of syscalls patched by overwriting the preceding
+ * instruction, the one before that, and the following instruction are
+ * also counted, a syscall can count towards more than one of these.
+ * Each syscall that could not be patched is listed on a line of its own,
+ * with the status of each instruction around it:
+ *
+ * patch_coverage unpatchable /lib/libc.so.6 0x1234 prev_ins_2 usable ...
+ *
+ * Without the report, the library aborts when it finds such a syscall.
+ */
+
+#include "patch_coverage.h"
+#include "intercept_log.h"
+#include "intercept_util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+bool patch_coverage_on;
+
+static bool patch_coverage_to_log;
+
+static const char *const neighbour_status_names[NEIGHBOUR_STATUS_COUNT] = {
+	[NEIGHBOUR_USABLE] = "usable",
+	[NEIGHBOUR_MISSING] = "missing",
+	[NEIGHBOUR_NOT_RELOCATABLE] = "not_relocatable",
+	[NEIGHBOUR_NOP] = "nop",
+	[NEIGHBOUR_JUMP_TARGET] = "jump_target",
+};
+
+void
+intercept_setup_patch_coverage(const char *where)
+{
+	if (where == NULL || where[0] == '\0')
+		return;
+
+	patch_coverage_on = true;
+	patch_coverage_to_log = (strcmp(where, "log") == 0);
+}
+
+static void
+print_line(const char *line, int len)
+{
+	if (len >= 0x1000)
+		len = 0x1000 - 1;
+
+	if (patch_coverage_to_log)
+		intercept_log(line, (size_t)len);
+	else
+		syscall_no_intercept(SYS_write, 2, line, (size_t)len);
+}
+
+/*
+ * print_unpatchable - print the line describing a syscall which could
+ * not be patched
+ */
+static void
+print_unpatchable(const struct intercept_desc *obj,
+		const struct patch_desc *patch)
+{
+	char line[0x1000];
+
+	int len = snprintf(line, sizeof(line),
+		"patch_coverage unpatchable %s 0x%lx prev_ins_2 %s "
+		"prev_ins %s next_ins %s\n",
+		obj->path, patch->syscall_offset,
+		neighbour_status_names[patch->neighbour_status[0]],
+		neighbour_status_names[patch->neighbour_status[1]],
+		neighbour_status_names[patch->neighbour_status[2]]);
+
+	print_line(line, len);
+}
+
+/*
+ * print_object - print the line describing an object, followed by the
+ * lines describing its syscalls which could not be patched
+ */
+static void
+print_object(const struct intercept_desc *obj)
+{
+	unsigned unselected = 0;
+	unsigned nop = 0;
+	unsigned surrounding = 0;
+	unsigned prev_ins = 0;
+	unsigned prev_ins_2 = 0;
+	unsigned next_ins = 0;
+	unsigned unpatchable = 0;
+	unsigned long code_bytes = 0;
+
+	for (unsigned i = 0; i < obj->count; ++i) {
+		const struct patch_desc *patch = obj->items + i;
+
+		if (patch->is_unpatchable) {
+			++unpatchable;
+		} else if (patch->is_skipped) {
+			++unselected;
+		} else if (patch->uses_nop_trampoline) {
+			++nop;
+			code_bytes += SYSCALL_INS_SIZE + JUMP_INS_SIZE;
+		} else {
+			++surrounding;
+			prev_ins += patch->uses_prev_ins;
+			prev_ins_2 += patch->uses_prev_ins_2;
+			next_ins += patch->uses_next_ins;
+			code_bytes += (unsigned long)
+			    (patch->return_address - patch->dst_jmp_patch);
+		}
+	}
+
+	size_t trampoline_bytes = 0;
+	if (obj->uses_trampoline_table && obj->next_trampoline != NULL)
+		trampoline_bytes = (size_t)
+		    (obj->next_trampoline - obj->trampoline_table);
+
+	char line[0x1000];
+
+	int len = snprintf(line, sizeof(line),
+		"patch_coverage %s syscalls %u unselected %u nop %u "
+		"surrounding %u prev_ins %u prev_ins_2 %u next_ins %u "
+		"unpatchable %u code_bytes %lu wrapper_bytes %zu "
+		"trampoline_bytes %zu\n",
+		obj->path, obj->count, unselected, nop,
+		surrounding, prev_ins, prev_ins_2, next_ins,
+		unpatchable, code_bytes, obj->wrapper_space_used,
+		trampoline_bytes);
+
+	print_line(line, len);
+
+	for (unsigned i = 0; i < obj->count; ++i) {
+		if (obj->items[i].is_unpatchable)
+			print_unpatchable(obj, obj->items + i);
+	}
+}
+
+void
+intercept_patch_coverage_report(const struct intercept_desc *objs,
+			unsigned count)
+{
+	for (unsigned i = 0; i < count; ++i)
+		print_object(objs + i);
+}
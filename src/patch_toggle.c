@@ -0,0 +1,707 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * patch_toggle.c -- removing the patches from the text sections at runtime,
+ * and writing them back later, see intercept_patches_enable in
+ * libsyscall_intercept_hook_point.h
+ *
+ * Other threads can execute the code being overwritten at any time, thus
+ * they are stopped first: each other thread is sent a real-time signal,
+ * SIGRTMAX by default, or the one set in INTERCEPT_TOGGLE_SIGNAL, and waits
+ * in the signal handler until all code is written. The common technique of
+ * writing an int3 instruction first is not used, as a thread executing one
+ * while blocking SIGTRAP would be killed -- and glibc blocks all signals
+ * around creating a thread, while making syscalls. SIGTRAP itself is left
+ * alone, for debuggers, and for the application.
+ *
+ * A thread can be stopped in the middle of a region, e.g. a thread blocked
+ * in a syscall returns to the instruction following the syscall. Such a
+ * thread could not continue in the middle of the code written, the signal
+ * handler moves it to the equivalent place in the wrapper stub of the
+ * patch, see get_resume_address. A blocking syscall interrupted by the
+ * signal is restarted if possible, otherwise it returns EINTR, as it would
+ * with any other signal handled.
+ *
+ * If not all threads handle the signal in time -- e.g. because they block
+ * it -- no code is changed, and toggling fails.
+ */
+
+#include "intercept.h"
+#include "intercept_util.h"
+#include "syscall_dispatch.h"
+
+#include <fcntl.h>
+#include <linux/membarrier.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/ucontext.h>
+#include <syscall.h>
+
+/*
+ * Incremented by release_threads, the other threads wait in sweep_handler
+ * until it changes
+ */
+static unsigned long toggle_generation;
+
+/* The state the objects are being switched to */
+static bool is_activating;
+
+/*
+ * Set before releasing the threads, once the patches are removed: the
+ * threads stop catching syscalls with Syscall User Dispatch as well
+ */
+static bool is_dispatch_allowed;
+
+static struct intercept_desc *toggle_objs;
+static unsigned toggle_obj_count;
+
+/*
+ * The range of real-time signals that can be used for stopping threads,
+ * without asking libc: glibc uses the first two for itself.
+ */
+#define TOGGLE_SIGNAL_MIN 34
+#define TOGGLE_SIGNAL_MAX 64
+
+int intercept_toggle_signal = TOGGLE_SIGNAL_MAX;
+
+static struct sigaction previous_signal_action;
+
+static int membarrier_cmd = -1;
+
+/*
+ * The threads signaled by sweep_threads, is_done is set once the thread is
+ * stopped in sweep_handler, or exited. The generation is the value of
+ * toggle_generation the thread is expected to wait for, a signal delivered
+ * late from an earlier sweep does not mark the thread.
+ */
+struct sweep_thread {
+	long tid;
+	unsigned long generation;
+	bool is_done;
+};
+
+#define SWEEP_MAX_THREADS 0x4000
+#define SWEEP_TIMEOUT_NS 1000000000L
+
+/* Tells the signals sent by sweep_threads apart from any other ones */
+#define SWEEP_SIGNAL_VALUE 0x5157eeb
+
+/*
+ * Allocated at the first sweep, and never unmapped: a signal handler
+ * delivered late might still access it.
+ */
+static struct sweep_thread *sweep_list;
+static unsigned sweep_count;
+static bool is_sweeping;
+
+/*
+ * get_patch_regions - the regions overwritten by a patch, see write_patch
+ * in patcher.c. Returns the number of regions, one or two.
+ */
+static unsigned
+get_patch_regions(const struct patch_desc *patch, struct code_region *r)
+{
+	if (patch->uses_nop_trampoline) {
+		r[0].address = patch->syscall_addr;
+		r[0].size = SYSCALL_INS_SIZE;
+		r[0].is_nop = false;
+		r[1].address = patch->nop_trampoline.address;
+		r[1].size = 2 + JUMP_INS_SIZE;
+		r[1].is_nop = true;
+		return 2;
+	}
+
+	r[0].address = patch->dst_jmp_patch;
+	r[0].size = (unsigned)(patch->return_address - patch->dst_jmp_patch);
+	r[0].is_nop = false;
+	return 1;
+}
+
+/*
+ * save_original_code - called by activate_patches before overwriting
+ * any code
+ */
+void
+save_original_code(struct intercept_desc *desc)
+{
+	desc->code_regions =
+	    xmmap_anon(2 * desc->count * sizeof(desc->code_regions[0]));
+	desc->code_region_count = 0;
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		const struct patch_desc *patch = desc->items + i;
+
+		if (patch->is_skipped)
+			continue;
+
+		struct code_region *r =
+		    desc->code_regions + desc->code_region_count;
+		unsigned count = get_patch_regions(patch, r);
+
+		for (unsigned j = 0; j < count; ++j) {
+			if (r[j].size > CODE_REGION_MAX_SIZE)
+				xabort("patched code region too large");
+
+			r[j].patch = patch;
+			copy_bytes(r[j].original, r[j].address, r[j].size);
+		}
+
+		desc->code_region_count += count;
+	}
+}
+
+/*
+ * save_patched_code - called by activate_patches after all patches
+ * are written
+ */
+void
+save_patched_code(struct intercept_desc *desc)
+{
+	for (unsigned i = 0; i < desc->code_region_count; ++i) {
+		struct code_region *r = desc->code_regions + i;
+
+		copy_bytes(r->patched, r->address, r->size);
+	}
+}
+
+/*
+ * restore_original_code - called by prepare_patches after the patched
+ * code is saved, while the text is still writable
+ */
+void
+restore_original_code(struct intercept_desc *desc)
+{
+	for (unsigned i = 0; i < desc->code_region_count; ++i) {
+		struct code_region *r = desc->code_regions + i;
+
+		copy_bytes(r->address, r->original, r->size);
+	}
+}
+
+/*
+ * is_boundary - is there an instruction of the original code of the
+ * region at addr
+ */
+static bool
+is_boundary(const struct code_region *r, const unsigned char *addr)
+{
+	const struct patch_desc *patch = r->patch;
+
+	if (addr == r->address)
+		return true;
+
+	if (patch->uses_nop_trampoline)
+		return false;
+
+	if (patch->uses_prev_ins_2 &&
+	    addr == r->address + patch->preceding_ins_2.length)
+		return true;
+	if (patch->uses_prev_ins && addr == patch->syscall_addr)
+		return true;
+	if (patch->uses_next_ins &&
+	    addr == patch->syscall_addr + SYSCALL_INS_SIZE)
+		return true;
+
+	return false;
+}
+
+/*
+ * find_region - look for the region containing addr
+ */
+static const struct code_region *
+find_region(const unsigned char *addr, const struct intercept_desc **obj)
+{
+	for (unsigned i = 0; i < toggle_obj_count; ++i) {
+		const struct intercept_desc *desc = toggle_objs + i;
+
+		if (addr < desc->text_start || addr > desc->text_end)
+			continue;
+
+		for (unsigned j = 0; j < desc->code_region_count; ++j) {
+			const struct code_region *r = desc->code_regions + j;
+
+			if (addr >= r->address && addr < r->address + r->size) {
+				*obj = desc;
+				return r;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static size_t
+relocated_size(const struct intercept_disasm_result *ins)
+{
+	return ins->is_lea_rip ? 10 : ins->length;
+}
+
+/*
+ * get_resume_address - where a thread stopped at addr continues after
+ * toggling, when addr is not the first byte of a region.
+ *
+ * With the original code written, such a thread could be about to
+ * execute an instruction in the middle of the region. The wrapper stub
+ * of the patch contains copies of the same instructions, it continues
+ * there.
+ * With the patches written, such a thread could have just taken the short
+ * jump from a syscall to a nop trampoline, to the jump at dst_jmp_patch.
+ * It continues at the target of that jump.
+ */
+static unsigned char *
+get_resume_address(const struct intercept_desc *obj,
+			const struct code_region *r, unsigned char *addr)
+{
+	const struct patch_desc *patch = r->patch;
+	bool is_active =
+	    __atomic_load_n(&obj->are_patches_active, __ATOMIC_ACQUIRE);
+
+	if (addr == r->address)
+		return addr;
+
+	if (!is_active) {
+		if (r->is_nop && addr == patch->dst_jmp_patch)
+			return patch->asm_wrapper;
+		return addr;
+	}
+
+	if (r->is_nop || !is_boundary(r, addr))
+		return addr;
+
+	if (addr == patch->syscall_addr + SYSCALL_INS_SIZE)
+		return patch->wrapper_syscall + SYSCALL_INS_SIZE;
+
+	if (addr == patch->syscall_addr)
+		return patch->wrapper_syscall;
+
+	return patch->asm_wrapper + relocated_size(&patch->preceding_ins_2);
+}
+
+static void
+mark_thread_swept(unsigned long generation)
+{
+	long tid = syscall_no_intercept(SYS_gettid);
+	unsigned count = __atomic_load_n(&sweep_count, __ATOMIC_ACQUIRE);
+
+	for (unsigned i = 0; i < count; ++i) {
+		if (sweep_list[i].tid == tid &&
+		    __atomic_load_n(&sweep_list[i].generation,
+			__ATOMIC_ACQUIRE) == generation)
+			__atomic_store_n(&sweep_list[i].is_done, true,
+					__ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * forward_signal - pass a signal not sent by sweep_threads to the handler
+ * installed before
+ */
+static void
+forward_signal(int sig, siginfo_t *info, void *context)
+{
+	if (previous_signal_action.sa_flags & SA_SIGINFO) {
+		previous_signal_action.sa_sigaction(sig, info, context);
+	} else if (previous_signal_action.sa_handler != SIG_DFL &&
+	    previous_signal_action.sa_handler != SIG_IGN) {
+		previous_signal_action.sa_handler(sig);
+	} else if (previous_signal_action.sa_handler == SIG_DFL) {
+		struct sigaction dfl;
+
+		zero_bytes(&dfl, sizeof(dfl));
+		dfl.sa_handler = SIG_DFL;
+		sigaction(sig, &dfl, NULL);
+		syscall_no_intercept(SYS_tgkill,
+		    syscall_no_intercept(SYS_getpid),
+		    syscall_no_intercept(SYS_gettid), sig);
+	}
+}
+
+/*
+ * sweep_handler - stops the thread while the code is written, see the top
+ * of this file
+ */
+static void
+sweep_handler(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	greg_t *rip = &uc->uc_mcontext.gregs[REG_RIP];
+
+	if (info->si_code != SI_QUEUE ||
+	    info->si_pid != syscall_no_intercept(SYS_getpid) ||
+	    info->si_value.sival_int != SWEEP_SIGNAL_VALUE) {
+		forward_signal(sig, info, context);
+		return;
+	}
+
+	unsigned long generation =
+	    __atomic_load_n(&toggle_generation, __ATOMIC_ACQUIRE);
+
+	/* delivered late, after sweep_threads gave up */
+	if (!__atomic_load_n(&is_sweeping, __ATOMIC_ACQUIRE))
+		return;
+
+	mark_thread_swept(generation);
+
+	while (__atomic_load_n(&toggle_generation, __ATOMIC_ACQUIRE) ==
+	    generation)
+		syscall_no_intercept(SYS_sched_yield);
+
+	if (__atomic_load_n(&is_dispatch_allowed, __ATOMIC_RELAXED))
+		intercept_dispatch_allow();
+
+	const struct intercept_desc *obj;
+	unsigned char *addr = (unsigned char *)*rip;
+	const struct code_region *r = find_region(addr, &obj);
+
+	if (r != NULL)
+		*rip = (greg_t)get_resume_address(obj, r, addr);
+}
+
+/*
+ * install_sweep_handler - the handler is left installed after toggling,
+ * as a signal sent by sweep_threads might be delivered later
+ */
+static void
+install_sweep_handler(void)
+{
+	struct sigaction current;
+
+	sigaction(intercept_toggle_signal, NULL, &current);
+
+	if ((current.sa_flags & SA_SIGINFO) &&
+	    current.sa_sigaction == sweep_handler)
+		return;
+
+	struct sigaction action;
+
+	zero_bytes(&action, sizeof(action));
+	sigemptyset(&action.sa_mask);
+	action.sa_sigaction = sweep_handler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART;
+
+	previous_signal_action = current;
+	sigaction(intercept_toggle_signal, &action, NULL);
+}
+
+/*
+ * intercept_setup_toggle_signal - select the signal used for stopping the
+ * threads, from the value of INTERCEPT_TOGGLE_SIGNAL
+ */
+void
+intercept_setup_toggle_signal(const char *signal)
+{
+	if (signal == NULL)
+		return;
+
+	char *end;
+	long signo = strtol(signal, &end, 10);
+
+	if (*signal == '\0' || *end != '\0' ||
+	    signo < TOGGLE_SIGNAL_MIN || signo > TOGGLE_SIGNAL_MAX)
+		xabort("invalid INTERCEPT_TOGGLE_SIGNAL value");
+
+	intercept_toggle_signal = (int)signo;
+}
+
+/*
+ * sync_cores - make every thread serialize its instruction stream, so the
+ * code written is seen by all of them
+ */
+static void
+sync_cores(void)
+{
+	if (membarrier_cmd < 0) {
+		membarrier_cmd = 0;
+
+		if (syscall_no_intercept(SYS_membarrier,
+		    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE,
+		    0) == 0)
+			membarrier_cmd =
+			    MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE;
+		else if (syscall_no_intercept(SYS_membarrier,
+		    MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+			membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+	}
+
+	if (membarrier_cmd != 0)
+		syscall_no_intercept(SYS_membarrier, membarrier_cmd, 0);
+}
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static bool
+is_listed(long tid)
+{
+	for (unsigned i = 0; i < sweep_count; ++i) {
+		if (sweep_list[i].tid == tid)
+			return true;
+	}
+
+	return false;
+}
+
+static long
+parse_tid(const char *name)
+{
+	long tid = 0;
+
+	if (*name == '\0')
+		return -1;
+
+	for (; *name != '\0'; ++name) {
+		if (*name < '0' || *name > '9')
+			return -1;
+		tid = tid * 10 + (*name - '0');
+	}
+
+	return tid;
+}
+
+static long
+send_sweep_signal(long pid, long tid)
+{
+	siginfo_t info;
+
+	zero_bytes(&info, sizeof(info));
+	info.si_signo = intercept_toggle_signal;
+	info.si_code = SI_QUEUE;
+	info.si_pid = (pid_t)pid;
+	info.si_uid = (uid_t)syscall_no_intercept(SYS_getuid);
+	info.si_value.sival_int = SWEEP_SIGNAL_VALUE;
+
+	return syscall_no_intercept(SYS_rt_tgsigqueueinfo, pid, tid,
+					intercept_toggle_signal, &info);
+}
+
+/*
+ * signal_new_threads - send the signal to each thread not signaled yet.
+ * Returns the number of threads signaled, or -1 on error.
+ */
+static int
+signal_new_threads(long pid, long self)
+{
+	char buffer[0x1000];
+	int found = 0;
+	long fd = syscall_no_intercept(SYS_open, "/proc/self/task",
+				O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+		return -1;
+
+	long size;
+	while ((size = syscall_no_intercept(SYS_getdents64, fd,
+	    buffer, sizeof(buffer))) > 0) {
+		for (long offset = 0; offset < size; ) {
+			struct linux_dirent64 *d =
+			    (struct linux_dirent64 *)(buffer + offset);
+			long tid = parse_tid(d->d_name);
+
+			offset += d->d_reclen;
+
+			if (tid <= 0 || tid == self || is_listed(tid))
+				continue;
+
+			if (sweep_count == SWEEP_MAX_THREADS) {
+				syscall_no_intercept(SYS_close, fd);
+				return -1;
+			}
+
+			sweep_list[sweep_count].tid = tid;
+			sweep_list[sweep_count].is_done = false;
+			__atomic_store_n(&sweep_list[sweep_count].generation,
+			    __atomic_load_n(&toggle_generation,
+				__ATOMIC_RELAXED), __ATOMIC_RELEASE);
+			__atomic_store_n(&sweep_count, sweep_count + 1,
+					__ATOMIC_RELEASE);
+
+			if (send_sweep_signal(pid, tid) != 0)
+				sweep_list[sweep_count - 1].is_done = true;
+
+			++found;
+		}
+	}
+
+	syscall_no_intercept(SYS_close, fd);
+
+	return (size < 0) ? -1 : found;
+}
+
+/*
+ * wait_for_threads - wait until each thread signaled handles the signal,
+ * or exits
+ */
+static bool
+wait_for_threads(long pid, long deadline)
+{
+	for (;;) {
+		bool is_done = true;
+
+		for (unsigned i = 0; i < sweep_count; ++i) {
+			struct sweep_thread *t = sweep_list + i;
+
+			if (__atomic_load_n(&t->is_done, __ATOMIC_ACQUIRE))
+				continue;
+
+			if (syscall_no_intercept(SYS_tgkill, pid, t->tid, 0)
+			    != 0)
+				t->is_done = true;
+			else
+				is_done = false;
+		}
+
+		if (is_done)
+			return true;
+
+		if (now_ns() > deadline)
+			return false;
+
+		syscall_no_intercept(SYS_sched_yield);
+	}
+}
+
+/*
+ * sweep_threads - stop each other thread in sweep_handler, until
+ * release_threads is called. The threads are listed again after the
+ * signals are handled, to catch the threads created in the meantime.
+ */
+static bool
+sweep_threads(void)
+{
+	long pid = syscall_no_intercept(SYS_getpid);
+	long self = syscall_no_intercept(SYS_gettid);
+	long deadline = now_ns() + SWEEP_TIMEOUT_NS;
+	bool ok = true;
+	int found;
+
+	if (sweep_list == NULL)
+		sweep_list =
+		    xmmap_anon(SWEEP_MAX_THREADS * sizeof(sweep_list[0]));
+	sweep_count = 0;
+	__atomic_store_n(&is_sweeping, true, __ATOMIC_RELEASE);
+
+	while (ok && (found = signal_new_threads(pid, self)) != 0) {
+		if (found < 0)
+			ok = false;
+		else
+			ok = wait_for_threads(pid, deadline);
+	}
+
+	return ok;
+}
+
+static void
+release_threads(void)
+{
+	__atomic_store_n(&is_sweeping, false, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&toggle_generation, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&sweep_count, 0, __ATOMIC_RELEASE);
+}
+
+static void
+protect_object(const struct intercept_desc *desc, int prot)
+{
+	struct page_range pages = collect_patch_pages(desc);
+
+	if (pages.end != pages.begin)
+		mprotect_no_intercept(pages.begin,
+		    (size_t)(pages.end - pages.begin), prot,
+		    "mprotect while toggling patches");
+}
+
+static bool
+is_changing(const struct intercept_desc *desc)
+{
+	return desc->code_region_count != 0 &&
+		desc->are_patches_active != is_activating;
+}
+
+/*
+ * toggle_patches - write the original code, or the patches, into all
+ * regions of the objects. Must be called by one thread at a time, with no
+ * other thread patching new objects. The calling thread must not execute
+ * any patched code while the other threads are stopped, thus libc is not
+ * called then -- even memcpy could contain a nop used as a trampoline.
+ * Returns false, if the other threads could not be stopped.
+ */
+bool
+toggle_patches(struct intercept_desc *objs, unsigned count, bool activate)
+{
+	install_sweep_handler();
+
+	toggle_objs = objs;
+	toggle_obj_count = count;
+	is_activating = activate;
+	is_dispatch_allowed = false;
+
+	if (!sweep_threads()) {
+		release_threads();
+		return false;
+	}
+
+	for (unsigned i = 0; i < count; ++i) {
+		struct intercept_desc *desc = objs + i;
+
+		if (!is_changing(desc))
+			continue;
+
+		protect_object(desc, PROT_READ | PROT_WRITE | PROT_EXEC);
+
+		for (unsigned j = 0; j < desc->code_region_count; ++j) {
+			struct code_region *r = desc->code_regions + j;
+
+			copy_bytes(r->address,
+			    activate ? r->patched : r->original, r->size);
+		}
+
+		protect_object(desc, PROT_READ | PROT_EXEC);
+		__atomic_store_n(&desc->are_patches_active, activate,
+				__ATOMIC_RELEASE);
+	}
+
+	sync_cores();
+	is_dispatch_allowed = !activate;
+	release_threads();
+
+	if (!activate)
+		intercept_dispatch_allow();
+
+	return true;
+}
@@ -38,31 +38,27 @@
  *     /--------------------------\
  *     |               subject.so |
  *     |                          |
- *     |  jmp to_trampoline_table |  patched by activate_patches()
+ *     |  jmp to_wrapper_stub     |  patched by activate_patches()
  *  /->|   |                      |
  *  |  \___|______________________/
  *  |      |
  *  |  /---|--------------------------\
- *  |  | movabs %r11, wrapper_address | jmp generated by activate_patches()
- *  |  | jmp *%r11                    | This allows subject.so and
- *  |  |   |                          | libsyscall_intercept.so to be farther
- *  |  \___|__________________________/ than 2 gigabytes from each other
+ *  |  | movabs %r11, wrapper_address | Only when some stub is out of rel32
+ *  |  | jmp *%r11                    | reach: an optional trampoline table,
+ *  |  |   |                          | filled in by activate_patches(), to
+ *  |  \___|__________________________/ jump farther than 2 gigabytes
  *  |      |
- *  |  /---|-----------------------------\
- *  |  |   |  libsyscall_intercept.so    |
- *  |  |   |                             |
- *  |  | /-|--------------------------\  |
- *  |  | | |  static unsigned char    |  |
- *  |  | | |  asm_wrapper_space[]     |  |
- *  |  | | |    in BSS                |  | wrapper routine
- *  |  | | |                          |  | generated into asm_wrapper_space
- *  |  | | |                          |  | by create_wrapper()
- *  |  | |wrapper routine             |  |
- *  |  | |calls C hook function  ----------> intercept_routine in intercept.c
- *  |  | |movabs %r11, return_address |  |
- *  |  | |jmp *%r11                   |  |
- *  |  | \_|__________________________/  |
- *  |  \___|_____________________________/
+ *  |  /---|--------------------------\
+ *  |  |   |  wrapper_space           |
+ *  |  |   |  mmap-ed near subject.so | wrapper stub
+ *  |  |   |                          | generated into wrapper_space
+ *  |  |   |                          | by create_wrapper()
+ *  |  |movabs %r11, patch_desc       |
+ *  |  |jmp intercept_asm_wrapper ---------> code shared by all stubs, in
+ *  |  |                              |     intercept_template.S, calls
+ *  |  |syscall  <-------------------------  intercept_routine, then jumps
+ *  |  |jmp return_address            |     back to the stub
+ *  |  \___|__________________________/
  *  |      |
  *  \______/
  *
@@ -71,8 +67,12 @@
 #include "intercept.h"
 #include "intercept_util.h"
 #include "intercept_log.h"
+#include "patch_coverage.h"
+#include "syscall_dispatch.h"
+#include "libsyscall_intercept_hook_point.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <syscall.h>
 #include <sys/mman.h>
@@ -80,10 +80,13 @@
 
 #include <stdio.h>
 
-/* The size of a trampoline jump, jmp instruction + pointer */
-enum { TRAMPOLINE_SIZE = 6 + 8 };
+/* The jumps at the beginning of a wrapper space */
+enum { WRAPPER_SPACE_JUMPS_SIZE = 2 * TRAMPOLINE_SIZE };
 
-static void create_wrapper(struct patch_desc *patch, unsigned char **dst);
+static void create_wrapper(const struct intercept_desc *desc,
+			struct patch_desc *patch, unsigned char **dst);
+static unsigned char *create_wrapper_space_jumps(unsigned char *dst);
+static size_t max_wrapper_size(void);
 
 /*
  * create_absolute_jump(from, to)
@@ -167,7 +170,7 @@ check_trampoline_usage(const struct intercept_desc *desc)
 
 	size_t used = (size_t)(desc->next_trampoline - desc->trampoline_table);
 
-	if (used + TRAMPOLINE_SIZE >= desc->trampoline_table_size)
+	if (used + TRAMPOLINE_SIZE > desc->trampoline_table_size)
 		xabort("trampoline space not enough");
 }
 
@@ -329,6 +332,171 @@ check_surrounding_instructions(struct intercept_desc *desc,
 	    !has_jump(desc, patch->syscall_addr + SYSCALL_INS_SIZE));
 }
 
+/*
+ * get_neighbour_status - tells why the instruction ins, next to a syscall
+ * instruction, can not be overwritten. The address jump_addr is the
+ * boundary between the instruction and the syscall, no jump can land there.
+ */
+static enum neighbour_status
+get_neighbour_status(const struct intercept_desc *desc,
+			const struct intercept_disasm_result *ins,
+			bool is_copiable, unsigned char *jump_addr)
+{
+	if (ins->is_lea_rip)
+		return NEIGHBOUR_USABLE;
+
+	if (!ins->is_set)
+		return NEIGHBOUR_MISSING;
+
+	if (!is_copiable)
+		return NEIGHBOUR_NOT_RELOCATABLE;
+
+	if (is_overwritable_nop(ins))
+		return NEIGHBOUR_NOP;
+
+	if (has_jump(desc, jump_addr))
+		return NEIGHBOUR_JUMP_TARGET;
+
+	return NEIGHBOUR_USABLE;
+}
+
+/*
+ * explain_unpatchable - records the status of each instruction around a
+ * syscall instruction, which could not be patched
+ */
+static void
+explain_unpatchable(const struct intercept_desc *desc,
+			struct patch_desc *patch)
+{
+	patch->neighbour_status[0] = get_neighbour_status(desc,
+	    &patch->preceding_ins_2,
+	    is_copiable_before_syscall(patch->preceding_ins_2),
+	    patch->syscall_addr - patch->preceding_ins.length);
+
+	patch->neighbour_status[1] = get_neighbour_status(desc,
+	    &patch->preceding_ins,
+	    is_copiable_before_syscall(patch->preceding_ins),
+	    patch->syscall_addr);
+
+	patch->neighbour_status[2] = get_neighbour_status(desc,
+	    &patch->following_ins,
+	    is_copiable_after_syscall(patch->following_ins),
+	    patch->syscall_addr + SYSCALL_INS_SIZE);
+}
+
+/*
+ * The syscalls selected for patching, see the INTERCEPT_PATCH_SYSCALLS
+ * environment variable. If none are selected, every syscall is patched.
+ */
+static bool syscall_selection_used;
+static bool selected_syscalls[INTERCEPT_HOOK_TABLE_SIZE];
+
+/*
+ * select_syscall_to_patch - add a syscall number to the set of syscalls
+ * to be patched. Once this is called, syscall instructions known to be
+ * used for other syscalls are left unpatched.
+ */
+void
+select_syscall_to_patch(long syscall_number)
+{
+	if (syscall_number < 0 || syscall_number >= INTERCEPT_HOOK_TABLE_SIZE)
+		xabort("syscall number selected for patching out of range");
+
+	syscall_selection_used = true;
+	selected_syscalls[syscall_number] = true;
+}
+
+/*
+ * is_patch_needed - checks if a syscall instruction must be patched.
+ * The syscall numbers of most syscall instructions are not known, these
+ * are always patched. The syscall number is known, if it is loaded
+ * by a mov instruction right before the syscall instruction, and there is
+ * no jump to the syscall instruction, that would skip that mov instruction.
+ */
+static bool
+is_patch_needed(const struct intercept_desc *desc,
+		const struct patch_desc *patch)
+{
+	if (!syscall_selection_used)
+		return true;
+
+	if (!patch->has_constant_nr)
+		return true;
+
+	if (has_jump(desc, patch->syscall_addr))
+		return true;
+
+	if (patch->constant_nr < 0 ||
+	    patch->constant_nr >= INTERCEPT_HOOK_TABLE_SIZE)
+		return true;
+
+	return selected_syscalls[patch->constant_nr];
+}
+
+/*
+ * allocate_wrapper_space
+ * Maps enough memory near the text section for the asm wrappers of all
+ * patches in desc, so both the jumps to the wrappers, and the jumps back
+ * to the text section use 32 bit displacements.
+ */
+static void
+allocate_wrapper_space(struct intercept_desc *desc)
+{
+	size_t size = WRAPPER_SPACE_JUMPS_SIZE +
+			desc->count * max_wrapper_size();
+
+	size = round_up_code_size(size);
+
+	desc->wrapper_space = map_near_text(desc, size,
+					PROT_READ | PROT_WRITE);
+	desc->wrapper_space_size = size;
+}
+
+/*
+ * release_unused_wrapper_space
+ * Unmaps the pages following the last wrapper generated, e.g. the space
+ * reserved for the wrappers of patches skipped. With huge pages, only
+ * whole huge pages are unmapped, not to split the one in use.
+ */
+static void
+release_unused_wrapper_space(struct intercept_desc *desc, unsigned char *end)
+{
+	size_t used = (size_t)(end - desc->wrapper_space);
+
+	if (used == WRAPPER_SPACE_JUMPS_SIZE)
+		used = 0; /* all patches were skipped */
+
+	desc->wrapper_space_used = used;
+
+	used = round_up_code_size(used);
+
+	if (used < desc->wrapper_space_size)
+		xmunmap(desc->wrapper_space + used,
+		    desc->wrapper_space_size - used);
+
+	desc->wrapper_space_size = used;
+	if (used == 0)
+		desc->wrapper_space = NULL;
+}
+
+/*
+ * mprotect_asm_wrappers
+ * The code generated into the wrapper space of an object is not
+ * executable at first. This routine sets that memory region
+ * to be executable, must called before attempting to execute any patched
+ * syscall.
+ */
+void
+mprotect_asm_wrappers(const struct intercept_desc *desc)
+{
+	if (desc->wrapper_space_size == 0)
+		return;
+
+	mprotect_no_intercept(desc->wrapper_space, desc->wrapper_space_size,
+	    PROT_READ | PROT_EXEC,
+	    "mprotect_asm_wrappers PROT_READ | PROT_EXEC");
+}
+
 /*
  * create_patch_wrappers - create the custom assembly wrappers
  * around each syscall to be intercepted. Well, actually, the
@@ -345,12 +513,32 @@ check_surrounding_instructions(struct intercept_desc *desc,
  * finding padding bytes, etc..
  */
 void
-create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst)
+create_patch_wrappers(struct intercept_desc *desc)
 {
 	size_t next_nop_i = 0;
+	unsigned char *dst;
+
+	desc->wrapper_space = NULL;
+	desc->wrapper_space_size = 0;
+
+	if (desc->count == 0)
+		return;
+
+	allocate_wrapper_space(desc);
+	dst = create_wrapper_space_jumps(desc->wrapper_space);
 
 	for (unsigned patch_i = 0; patch_i < desc->count; ++patch_i) {
 		struct patch_desc *patch = desc->items + patch_i;
+
+		if (!is_patch_needed(desc, patch)) {
+			debug_dump("skipping %s:0x%lx - syscall %d\n",
+				desc->path,
+				patch->syscall_addr - desc->base_addr,
+				patch->constant_nr);
+			patch->is_skipped = true;
+			continue;
+		}
+
 		debug_dump("patching %s:0x%lx\n", desc->path,
 				patch->syscall_addr - desc->base_addr);
 
@@ -480,31 +668,39 @@ create_patch_wrappers(struct intercept_desc *desc, unsigned char **dst)
 					patch->syscall_offset);
 
 				intercept_log(buffer, (size_t)l);
-				xabort("not enough space for patching"
-				    " around syscal");
+
+				/*
+				 * When asked for a coverage report, leave
+				 * the syscall in place, and report why it
+				 * could not be patched.
+				 */
+				if (!patch_coverage_on)
+					xabort("not enough space for patching"
+					    " around syscal");
+
+				explain_unpatchable(desc, patch);
+				patch->is_unpatchable = true;
+				patch->is_skipped = true;
+				continue;
 			}
 		}
 
 		mark_jump(desc, patch->return_address);
 
-		create_wrapper(patch, dst);
+		create_wrapper(desc, patch, &dst);
 	}
+
+	release_unused_wrapper_space(desc, dst);
 }
 
 /*
- * Referencing symbols defined in intercept_template.s
+ * Referencing symbols defined in intercept_template.S
  */
-extern unsigned char intercept_asm_wrapper_tmpl[];
-extern unsigned char intercept_asm_wrapper_tmpl_end;
-extern unsigned char intercept_asm_wrapper_patch_desc_addr;
-extern unsigned char intercept_asm_wrapper_wrapper_level1_addr;
-extern unsigned char intercept_wrapper;
-
-size_t asm_wrapper_tmpl_size;
-static ptrdiff_t o_patch_desc_addr;
-static ptrdiff_t o_wrapper_level1_addr;
+extern unsigned char intercept_asm_wrapper;
+extern unsigned char intercept_asm_wrapper_post_clone;
 
 bool intercept_routine_must_save_ymm;
+bool intercept_routine_skip_simd_save;
 
 /*
  * init_patcher
@@ -514,21 +710,8 @@ bool intercept_routine_must_save_ymm;
 void
 init_patcher(void)
 {
-	unsigned char *begin = &intercept_asm_wrapper_tmpl[0];
-
-	assert(&intercept_asm_wrapper_tmpl_end > begin);
-	assert(&intercept_asm_wrapper_patch_desc_addr > begin);
-	assert(&intercept_asm_wrapper_wrapper_level1_addr > begin);
-	assert(&intercept_asm_wrapper_patch_desc_addr <
-		&intercept_asm_wrapper_tmpl_end);
-	assert(&intercept_asm_wrapper_wrapper_level1_addr <
-		&intercept_asm_wrapper_tmpl_end);
-
-	asm_wrapper_tmpl_size =
-		(size_t)(&intercept_asm_wrapper_tmpl_end - begin);
-	o_patch_desc_addr = &intercept_asm_wrapper_patch_desc_addr - begin;
-	o_wrapper_level1_addr =
-		&intercept_asm_wrapper_wrapper_level1_addr - begin;
+	/* The offset used in intercept_template.S */
+	assert(offsetof(struct patch_desc, wrapper_syscall) == 8);
 
 	/*
 	 * has_ymm_registers -- checks if AVX instructions are supported,
@@ -606,19 +789,70 @@ relocate_instruction(unsigned char *dst,
 	}
 }
 
+/*
+ * The size of the code in a wrapper stub between the clone label,
+ * and the syscall label -- see intercept_template.S
+ * A syscall instruction, a movabs instruction, and a jump.
+ */
+enum { WRAPPER_CLONE_SIZE = SYSCALL_INS_SIZE + 10 + JUMP_INS_SIZE };
+
+/* The size of the instruction generated by create_dispatch_block */
+enum { DISPATCH_BLOCK_SIZE = 9 };
+
+/*
+ * create_wrapper_space_jumps
+ * Generates the two absolute jumps at the beginning of a wrapper space,
+ * used by the stubs jump to the shared code in intercept_template.S. The
+ * wrapper space is close to a text section, but the shared code is not
+ * necessarily in the 2 gigabyte range of it.
+ */
+static unsigned char *
+create_wrapper_space_jumps(unsigned char *dst)
+{
+	dst = create_absolute_jump(dst, &intercept_asm_wrapper);
+	dst = create_absolute_jump(dst, &intercept_asm_wrapper_post_clone);
+
+	return dst;
+}
+
+/*
+ * create_dispatch_block
+ * Generates a "movb $SYSCALL_DISPATCH_FILTER_BLOCK, %fs:offset" instruction,
+ * setting the selector of the thread back to block syscalls after the syscall
+ * in the stub -- see syscall_dispatch.c
+ */
+static unsigned char *
+create_dispatch_block(unsigned char *code)
+{
+	int32_t offset = intercept_dispatch_selector_offset;
+
+	*code++ = 0x64; /* %fs segment override */
+	*code++ = 0xc6; /* movb $imm8, r/m8 */
+	*code++ = 0x04; /* ModRM: SIB follows */
+	*code++ = 0x25; /* SIB: no base, no index, disp32 */
+	memcpy(code, &offset, sizeof(offset));
+	code += sizeof(offset);
+	*code++ = 0x01; /* SYSCALL_DISPATCH_FILTER_BLOCK */
+
+	return code;
+}
+
 /*
  * create_wrapper
- * Generates an assembly wrapper. Copies the template written in
- * intercept_template.s, and generates the instructions specific
- * to a particular syscall into the new copy.
+ * Generates an assembly wrapper stub, as described in intercept_template.S
+ * Only the instructions specific to a particular syscall are generated
+ * here, the rest of the wrapper code is shared by all stubs.
  * After this wrapper is created, a syscall can be replaced with a
  * jump to this wrapper, and wrapper is going to call dest_routine
  * (actually only after a call to mprotect_asm_wrappers).
  */
 static void
-create_wrapper(struct patch_desc *patch, unsigned char **dst)
+create_wrapper(const struct intercept_desc *desc,
+		struct patch_desc *patch, unsigned char **dst)
 {
-	/* Create a new copy of the template */
+	unsigned char *entry_jump = desc->wrapper_space;
+	unsigned char *post_clone_jump = entry_jump + TRAMPOLINE_SIZE;
+
 	patch->asm_wrapper = *dst;
 
 	/* Copy the previous instruction(s) */
@@ -629,17 +863,48 @@ create_wrapper(struct patch_desc *patch, unsigned char **dst)
 		*dst = relocate_instruction(*dst, &patch->preceding_ins);
 	}
 
-	memcpy(*dst, intercept_asm_wrapper_tmpl, asm_wrapper_tmpl_size);
-	create_movabs_r11(*dst + o_patch_desc_addr, (uintptr_t)patch);
-	create_movabs_r11(*dst + o_wrapper_level1_addr,
-				(uintptr_t)&intercept_wrapper);
-	*dst += asm_wrapper_tmpl_size;
+	*dst = create_movabs_r11(*dst, (uintptr_t)patch);
+	create_jump(JMP_OPCODE, *dst, entry_jump);
+	*dst += JUMP_INS_SIZE;
+
+	/* clone: */
+	unsigned char *clone = *dst;
+
+	*(*dst)++ = 0x0f; /* syscall */
+	*(*dst)++ = 0x05;
+	*dst = create_movabs_r11(*dst, (uintptr_t)patch);
+	create_jump(JMP_OPCODE, *dst, post_clone_jump);
+	*dst += JUMP_INS_SIZE;
+
+	/* syscall: */
+	assert(*dst == clone + WRAPPER_CLONE_SIZE);
+	(void) clone;
+	patch->wrapper_syscall = *dst;
+	*(*dst)++ = 0x0f; /* syscall */
+	*(*dst)++ = 0x05;
+
+	if (intercept_dispatch_on)
+		*dst = create_dispatch_block(*dst);
 
-	/* Copy the following instruction */
+	/* return: copy the following instruction */
 	if (patch->uses_next_ins)
 		*dst = relocate_instruction(*dst, &patch->following_ins);
 
-	*dst = create_absolute_jump(*dst, patch->return_address);
+	create_jump(JMP_OPCODE, *dst, patch->return_address);
+	*dst += JUMP_INS_SIZE;
+}
+
+/*
+ * max_wrapper_size
+ * The most bytes create_wrapper can use: three relocated instructions
+ * (each at most 15 bytes, or a 10 byte movabs), and the code generated
+ * between them.
+ */
+static size_t
+max_wrapper_size(void)
+{
+	return 3 * 15 + 10 + JUMP_INS_SIZE + WRAPPER_CLONE_SIZE +
+		SYSCALL_INS_SIZE + DISPATCH_BLOCK_SIZE + JUMP_INS_SIZE;
 }
 
 /*
@@ -670,98 +935,232 @@ after_nop(const struct range *nop)
 }
 
 /*
- * activate_patches()
- * Loop over all the patches, and and overwrite each syscall.
+ * get_patch_pages - the pages containing all the bytes overwritten by
+ * a patch, see write_patch below
  */
-void
-activate_patches(struct intercept_desc *desc)
+static struct page_range
+get_patch_pages(const struct patch_desc *patch)
 {
-	unsigned char *first_page;
-	size_t size;
+	unsigned char *begin = patch->syscall_addr;
+	unsigned char *end = patch->return_address;
 
-	if (desc->count == 0)
-		return;
+	if (patch->dst_jmp_patch < begin)
+		begin = patch->dst_jmp_patch;
+	if (patch->dst_jmp_patch + JUMP_INS_SIZE > end)
+		end = patch->dst_jmp_patch + JUMP_INS_SIZE;
+
+	if (patch->uses_nop_trampoline) {
+		unsigned char *nop = patch->nop_trampoline.address;
+
+		if (nop < begin)
+			begin = nop;
+		if (nop + 2 > end)
+			end = nop + 2;
+	}
+
+	struct page_range pages = {
+		.begin = round_down_address(begin),
+		.end = round_down_address(end - 1) + PAGE_SIZE
+	};
 
-	first_page = round_down_address(desc->text_start);
-	size = (size_t)(desc->text_end - first_page);
+	return pages;
+}
 
-	mprotect_no_intercept(first_page, size,
-	    PROT_READ | PROT_WRITE | PROT_EXEC,
-	    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+/*
+ * collect_patch_pages - the pages overwritten while activating the patches
+ * of an object, as a single range from the first page to the last one
+ * overwritten -- much like the whole text section made writable before.
+ * The range is empty, if no patch is written.
+ */
+struct page_range
+collect_patch_pages(const struct intercept_desc *desc)
+{
+	struct page_range pages = {NULL, NULL};
 
 	for (unsigned i = 0; i < desc->count; ++i) {
 		const struct patch_desc *patch = desc->items + i;
 
+		if (patch->is_skipped)
+			continue;
+
 		if (patch->dst_jmp_patch < desc->text_start ||
 		    patch->dst_jmp_patch > desc->text_end)
 			xabort("dst_jmp_patch outside text");
 
+		struct page_range r = get_patch_pages(patch);
+
+		if (pages.begin == NULL || r.begin < pages.begin)
+			pages.begin = r.begin;
+		if (pages.end == NULL || r.end > pages.end)
+			pages.end = r.end;
+	}
+
+	return pages;
+}
+
+/*
+ * write_patch - overwrite the syscall instruction, and the instructions
+ * around it, with the jump to the asm wrapper
+ */
+static void
+write_patch(struct intercept_desc *desc, const struct patch_desc *patch)
+{
+	/*
+	 * The dst_jmp_patch pointer contains the address where
+	 * the actual jump instruction escaping the patched text
+	 * segment should be written.
+	 * This is either at the place of the original syscall
+	 * instruction, or at some usable padding space close to
+	 * it (an overwritable NOP instruction).
+	 */
+
+	if (desc->uses_trampoline_table) {
 		/*
-		 * The dst_jmp_patch pointer contains the address where
-		 * the actual jump instruction escaping the patched text
-		 * segment should be written.
-		 * This is either at the place of the original syscall
-		 * instruction, or at some usable padding space close to
-		 * it (an overwritable NOP instruction).
+		 * First jump to the trampoline table, which
+		 * should be in a 2 gigabyte range. From there,
+		 * jump to the asm_wrapper.
 		 */
+		check_trampoline_usage(desc);
 
-		if (desc->uses_trampoline_table) {
-			/*
-			 * First jump to the trampoline table, which
-			 * should be in a 2 gigabyte range. From there,
-			 * jump to the asm_wrapper.
-			 */
-			check_trampoline_usage(desc);
+		/* jump - escape the text segment */
+		create_jump(JMP_OPCODE,
+			patch->dst_jmp_patch, desc->next_trampoline);
 
-			/* jump - escape the text segment */
-			create_jump(JMP_OPCODE,
-				patch->dst_jmp_patch, desc->next_trampoline);
+		/* jump - escape the 2 GB range of the text segment */
+		desc->next_trampoline = create_absolute_jump(
+			desc->next_trampoline, patch->asm_wrapper);
+	} else {
+		create_jump(JMP_OPCODE,
+			patch->dst_jmp_patch, patch->asm_wrapper);
+	}
 
-			/* jump - escape the 2 GB range of the text segment */
-			desc->next_trampoline = create_absolute_jump(
-				desc->next_trampoline, patch->asm_wrapper);
-		} else {
-			create_jump(JMP_OPCODE,
-				patch->dst_jmp_patch, patch->asm_wrapper);
+	if (patch->uses_nop_trampoline) {
+		/*
+		 * Create a mini trampoline jump.
+		 * The first two bytes of the NOP instruction are
+		 * overwritten by a short jump instruction
+		 * (with 8 bit displacement), to make sure whenever
+		 * this the execution reaches the address where this
+		 * NOP resided originally, it continues uninterrupted.
+		 * The rest of the bytes occupied by this instruction
+		 * are used as an mini extra trampoline table.
+		 *
+		 * See also: the is_overwritable_nop function in
+		 * the intercept_desc.c source file.
+		 */
+
+		/* jump from syscall to mini trampoline */
+		create_short_jump(patch->syscall_addr,
+		    patch->dst_jmp_patch);
+
+		/*
+		 * Short jump to next instruction, skipping the newly
+		 * created trampoline jump.
+		 */
+		create_short_jump(patch->nop_trampoline.address,
+		    after_nop(&patch->nop_trampoline));
+	} else {
+		unsigned char *byte;
+
+		for (byte = patch->dst_jmp_patch + JUMP_INS_SIZE;
+			byte < patch->return_address;
+			++byte) {
+			*byte = INT3_OPCODE;
 		}
+	}
+}
 
-		if (patch->uses_nop_trampoline) {
-			/*
-			 * Create a mini trampoline jump.
-			 * The first two bytes of the NOP instruction are
-			 * overwritten by a short jump instruction
-			 * (with 8 bit displacement), to make sure whenever
-			 * this the execution reaches the address where this
-			 * NOP resided originally, it continues uninterrupted.
-			 * The rest of the bytes occupied by this instruction
-			 * are used as an mini extra trampoline table.
-			 *
-			 * See also: the is_overwritable_nop function in
-			 * the intercept_desc.c source file.
-			 */
+/*
+ * protect_trampoline_table - change the protection of the pages holding the
+ * trampoline table of an object. The pages can be shared with the tables of
+ * other objects, so these are never made non-executable.
+ */
+static void
+protect_trampoline_table(const struct intercept_desc *desc, int prot,
+			const char *msg_on_error)
+{
+	unsigned char *begin = round_down_address(desc->trampoline_table);
+	unsigned char *end = round_down_address(desc->trampoline_table +
+				desc->trampoline_table_size - 1) + PAGE_SIZE;
 
-			/* jump from syscall to mini trampoline */
-			create_short_jump(patch->syscall_addr,
-			    patch->dst_jmp_patch);
+	mprotect_no_intercept(begin, (size_t)(end - begin), prot,
+				msg_on_error);
+}
 
-			/*
-			 * Short jump to next instruction, skipping the newly
-			 * created trampoline jump.
-			 */
-			create_short_jump(patch->nop_trampoline.address,
-			    after_nop(&patch->nop_trampoline));
-		} else {
-			unsigned char *byte;
+/*
+ * write_patches()
+ * Loop over all the patches, and and overwrite each syscall.
+ * The pages from the first to the last one overwritten are made writable
+ * with a single mprotect syscall (see collect_patch_pages), and made
+ * read-only again after all patches are written.
+ * Unless activate is set, the original code is written back right after
+ * the patched code is saved.
+ */
+static void
+write_patches(struct intercept_desc *desc, bool activate)
+{
+	if (desc->count == 0)
+		return;
 
-			for (byte = patch->dst_jmp_patch + JUMP_INS_SIZE;
-				byte < patch->return_address;
-				++byte) {
-				*byte = INT3_OPCODE;
-			}
-		}
+	struct page_range pages = collect_patch_pages(desc);
+	size_t size = (size_t)(pages.end - pages.begin);
+	unsigned mprotect_count = 0;
+
+	if (size != 0) {
+		mprotect_no_intercept(pages.begin, size,
+		    PROT_READ | PROT_WRITE | PROT_EXEC,
+		    "mprotect PROT_READ | PROT_WRITE | PROT_EXEC");
+		mprotect_count = 2;
 	}
 
-	mprotect_no_intercept(first_page, size,
-	    PROT_READ | PROT_EXEC,
-	    "mprotect PROT_READ | PROT_EXEC");
+	if (desc->uses_trampoline_table)
+		protect_trampoline_table(desc,
+		    PROT_READ | PROT_WRITE | PROT_EXEC,
+		    "mprotect trampoline table PROT_READ | PROT_WRITE | PROT_EXEC");
+
+	save_original_code(desc);
+
+	for (unsigned i = 0; i < desc->count; ++i) {
+		if (!desc->items[i].is_skipped)
+			write_patch(desc, desc->items + i);
+	}
+
+	save_patched_code(desc);
+
+	if (activate)
+		desc->are_patches_active = true;
+	else
+		restore_original_code(desc);
+
+	if (desc->uses_trampoline_table)
+		protect_trampoline_table(desc, PROT_READ | PROT_EXEC,
+		    "mprotect trampoline table PROT_READ | PROT_EXEC");
+
+	if (size != 0)
+		mprotect_no_intercept(pages.begin, size,
+		    PROT_READ | PROT_EXEC,
+		    "mprotect PROT_READ | PROT_EXEC");
+
+	desc->activation_mprotect_count += mprotect_count;
+
+	debug_dump("%s patched, using %u mprotect syscalls\n",
+	    desc->path, mprotect_count);
+}
+
+void
+activate_patches(struct intercept_desc *desc)
+{
+	write_patches(desc, true);
+}
+
+/*
+ * prepare_patches - save the patched code of an object, which is written
+ * to the text by toggle_patches, when the patches are enabled. The text
+ * holds the patches for a moment, jumping to wrappers that are already
+ * usable, thus code executed meanwhile in the object is not harmed.
+ */
+void
+prepare_patches(struct intercept_desc *desc)
+{
+	write_patches(desc, false);
 }
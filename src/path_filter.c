@@ -0,0 +1,367 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * path_filter.c -- a filter passing only the syscalls referring to paths
+ * under some prefixes to the hooks, e.g. the paths under a few mount
+ * points.
+ *
+ * The prefixes are stored in a trie, with a node for each byte. The trie
+ * only grows, new nodes are linked into it using atomic stores, thus it
+ * can be searched without locking, while another prefix is being added.
+ * A prefix matches a path, if the path is the same, or continues with a
+ * slash after the prefix: /mnt/a matches /mnt/a/b, but not /mnt/ab.
+ * Both are compared in a normalized form, without repeated or trailing
+ * slashes, and without "." components: /mnt//a/./b/ is the same as
+ * /mnt/a/b. A path with a ".." component can not be judged without
+ * resolving it, thus a syscall with such a path is passed to the hooks.
+ *
+ * The paths are copied using the process_vm_readv syscall, instead of
+ * reading them directly, as the path arguments might be invalid pointers
+ * -- the kernel reports these to the application as EFAULT. A syscall
+ * with a path that can not be copied is passed to the hooks as well.
+ *
+ * The filter uses the formats in syscall_formats.c to find the path
+ * arguments of each syscall -- the arguments of type arg_cstr.
+ * Relative paths can not be checked without knowing the directory they
+ * are relative to, thus a syscall with a relative path is always passed
+ * to the hooks. So is a syscall with any other string argument not
+ * starting with a slash, e.g. the name of an extended attribute.
+ */
+
+#include "path_filter.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+#include "syscall_formats.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <syscall.h>
+
+bool intercept_path_filter_on;
+
+struct trie_node {
+	struct trie_node *child; /* the first child */
+	struct trie_node *sibling; /* the next child of the parent */
+	unsigned char byte;
+	bool is_prefix_end;
+};
+
+#define NODE_CHUNK_SIZE (16 * PAGE_SIZE)
+
+static struct trie_node root;
+
+/* the nodes are allocated from chunks of this size */
+static struct trie_node *free_nodes;
+static size_t free_node_count;
+
+/* serializes adding prefixes */
+static int trie_lock;
+
+/* The path arguments of each syscall, bit i is set for argument i */
+static unsigned char path_args[INTERCEPT_HOOK_TABLE_SIZE];
+
+static struct trie_node *
+allocate_node(unsigned char byte)
+{
+	if (free_node_count == 0) {
+		free_nodes = xmmap_anon(NODE_CHUNK_SIZE);
+		free_node_count = NODE_CHUNK_SIZE / sizeof(free_nodes[0]);
+	}
+
+	struct trie_node *node = free_nodes++;
+
+	--free_node_count;
+	node->byte = byte;
+
+	return node;
+}
+
+static struct trie_node *
+find_child(const struct trie_node *node, unsigned char byte)
+{
+	struct trie_node *child = __atomic_load_n(&node->child,
+						__ATOMIC_ACQUIRE);
+
+	while (child != NULL && child->byte != byte)
+		child = __atomic_load_n(&child->sibling, __ATOMIC_ACQUIRE);
+
+	return child;
+}
+
+static void
+collect_path_args(void)
+{
+	for (int nr = 0; nr < INTERCEPT_HOOK_TABLE_SIZE; ++nr) {
+		struct syscall_desc desc = { .nr = nr };
+		const struct syscall_format *format = get_syscall_format(&desc);
+
+		for (unsigned i = 0; i < ARRAY_SIZE(desc.args); ++i) {
+			if (format->args[i] == arg_none)
+				break;
+
+			if (format->args[i] == arg_cstr)
+				path_args[nr] |= (unsigned char)(1 << i);
+		}
+	}
+}
+
+/*
+ * normalize_path - rewrite an absolute path in place, collapsing repeated
+ * slashes, removing "." components, and the trailing slash. Returns false
+ * if the path has a ".." component.
+ */
+static bool
+normalize_path(char *path)
+{
+	char *dst = path;
+	const char *src = path;
+
+	while (*src != '\0') {
+		while (*src == '/')
+			++src;
+
+		const char *end = src;
+
+		while (*end != '\0' && *end != '/')
+			++end;
+
+		size_t len = (size_t)(end - src);
+
+		if (len == 0 || (len == 1 && src[0] == '.')) {
+			src = end;
+			continue;
+		}
+
+		if (len == 2 && src[0] == '.' && src[1] == '.')
+			return false;
+
+		/* dst is behind src, at least by the slash skipped */
+		*dst++ = '/';
+		while (src != end)
+			*dst++ = *src++;
+	}
+
+	if (dst == path)
+		*dst++ = '/';
+	*dst = '\0';
+
+	return true;
+}
+
+/*
+ * add_prefix - add len bytes at prefix to the trie, in normalized form,
+ * without a trailing slash
+ */
+static int
+add_prefix(const char *prefix, size_t len)
+{
+	char copy[PATH_MAX];
+
+	if (len == 0 || len >= sizeof(copy) || prefix[0] != '/')
+		return -1;
+
+	for (size_t i = 0; i < len; ++i)
+		copy[i] = prefix[i];
+	copy[len] = '\0';
+
+	if (!normalize_path(copy))
+		return -1;
+
+	prefix = copy;
+	len = strlen(copy);
+
+	/* the root directory is matched at the root of the trie */
+	if (len == 1)
+		len = 0;
+
+	while (__atomic_exchange_n(&trie_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		__builtin_ia32_pause();
+
+	struct trie_node *node = &root;
+
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char byte = (unsigned char)prefix[i];
+		struct trie_node *child = find_child(node, byte);
+
+		if (child == NULL) {
+			child = allocate_node(byte);
+			child->sibling = node->child;
+			__atomic_store_n(&node->child, child,
+					__ATOMIC_RELEASE);
+		}
+
+		node = child;
+	}
+
+	__atomic_store_n(&node->is_prefix_end, true, __ATOMIC_RELEASE);
+
+	if (!__atomic_load_n(&intercept_path_filter_on, __ATOMIC_RELAXED)) {
+		collect_path_args();
+		__atomic_store_n(&intercept_path_filter_on, true,
+				__ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&trie_lock, 0, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * intercept_path_filter_add - add a prefix to the filter, enabling it
+ * the first time
+ */
+__attribute__((visibility("default")))
+int
+intercept_path_filter_add(const char *prefix)
+{
+	if (prefix == NULL)
+		return -1;
+
+	return add_prefix(prefix, strlen(prefix));
+}
+
+void
+intercept_setup_path_filter(const char *list)
+{
+	if (list == NULL)
+		return;
+
+	while (*list != '\0') {
+		const char *end = strchr(list, ':');
+
+		if (end == NULL)
+			end = list + strlen(list);
+
+		if (end != list && add_prefix(list, (size_t)(end - list)) != 0)
+			xabort("invalid INTERCEPT_PATH_FILTER");
+
+		list = (*end == ':') ? end + 1 : end;
+	}
+}
+
+/*
+ * read_path - copy the path at addr to the buffer, using the kernel, thus
+ * an invalid pointer is an error here as well, instead of a crash.
+ * Returns false if the path can not be read, or it is not shorter than
+ * size bytes -- at most a page.
+ */
+static bool
+read_path(long addr, char *buffer, size_t size)
+{
+	uintptr_t page_end = ((uintptr_t)addr & ~(PAGE_SIZE - 1)) + PAGE_SIZE;
+	size_t first = (size_t)(page_end - (uintptr_t)addr);
+	struct iovec local;
+	struct iovec remote[2];
+	unsigned long count = 1;
+
+	if (first > size)
+		first = size;
+
+	local.iov_base = buffer;
+	local.iov_len = size;
+
+	/*
+	 * Only whole iovec elements are copied, the path might end right
+	 * before an unmapped page.
+	 */
+	remote[0].iov_base = (void *)(uintptr_t)addr;
+	remote[0].iov_len = first;
+	if (first < size) {
+		remote[1].iov_base = (void *)page_end;
+		remote[1].iov_len = size - first;
+		count = 2;
+	}
+
+	long copied = syscall_no_intercept(SYS_process_vm_readv,
+			syscall_no_intercept(SYS_getpid),
+			&local, 1, remote, count, 0);
+
+	for (long i = 0; i < copied; ++i) {
+		if (buffer[i] == '\0')
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * is_path_matched - is the normalized path under any of the prefixes
+ */
+static bool
+is_path_matched(const char *path)
+{
+	const struct trie_node *node = &root;
+
+	for (; *path != '\0'; ++path) {
+		if (*path == '/' &&
+		    __atomic_load_n(&node->is_prefix_end, __ATOMIC_ACQUIRE))
+			return true;
+
+		node = find_child(node, (unsigned char)*path);
+		if (node == NULL)
+			return false;
+	}
+
+	return __atomic_load_n(&node->is_prefix_end, __ATOMIC_ACQUIRE);
+}
+
+bool
+intercept_path_filter_rejects(const struct syscall_desc *desc)
+{
+	if (desc->nr < 0 || desc->nr >= INTERCEPT_HOOK_TABLE_SIZE)
+		return false;
+
+	unsigned mask = path_args[desc->nr];
+
+	if (mask == 0)
+		return false;
+
+	for (unsigned i = 0; i < ARRAY_SIZE(desc->args); ++i) {
+		if ((mask & (1u << i)) == 0)
+			continue;
+
+		char path[PATH_MAX];
+
+		if (desc->args[i] == 0 ||
+		    !read_path(desc->args[i], path, sizeof(path)))
+			return false;
+
+		if (path[0] != '/' || !normalize_path(path) ||
+		    is_path_matched(path))
+			return false;
+	}
+
+	return true;
+}
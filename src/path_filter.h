@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * path_filter.h -- passing only the syscalls on some paths to the hooks,
+ * see intercept_path_filter_add in libsyscall_intercept_hook_point.h
+ */
+
+#ifndef INTERCEPT_PATH_FILTER_H
+#define INTERCEPT_PATH_FILTER_H
+
+#include <stdbool.h>
+
+#include "intercept.h"
+
+extern bool intercept_path_filter_on;
+
+/*
+ * intercept_setup_path_filter - add the prefixes listed in the
+ * INTERCEPT_PATH_FILTER environment variable, separated by colons
+ */
+void intercept_setup_path_filter(const char *list);
+
+/*
+ * intercept_path_filter_rejects - is this a syscall with path arguments,
+ * none of them under any of the prefixes -- such a syscall is not passed
+ * to the hooks
+ */
+bool intercept_path_filter_rejects(const struct syscall_desc *desc);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * startup_times.c -- measuring the phases of patching the objects at
+ * startup, enabled by the INTERCEPT_STARTUP_TIMES environment variable.
+ *
+ * When the variable is set to "log", the times are written to the log
+ * set up via INTERCEPT_LOG, with any other value they are written
+ * to stderr. A line is printed for each object patched, containing
+ * the number of instructions decoded, the number of syscalls found, the
+ * number of syscalls patched, the number of mprotect syscalls used for
+ * activating the patches, and the time spent in each phase in
+ * nanoseconds:
+ *
+ * startup_times /lib/libc.so.6 instructions 412345 syscalls 500 ...
+ *
+ * These are followed by a line containing the time spent in
+ * dl_iterate_phdr, and in the constructor of the library in total.
+ * The instruction count is zero for objects found in the disasm cache.
+ */
+
+#include "startup_times.h"
+#include "intercept_log.h"
+#include "intercept_util.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+bool startup_times_on;
+
+static bool startup_times_to_log;
+
+static const char *const phase_names[STARTUP_PHASE_COUNT] = {
+	[PHASE_FIND_SYSCALLS] = "find_syscalls",
+	[PHASE_FIND_SECTIONS] = "find_sections",
+	[PHASE_FIND_JUMPS_SYMS] = "find_jumps_in_section_syms",
+	[PHASE_FIND_JUMPS_RELA] = "find_jumps_in_section_rela",
+	[PHASE_CRAWL_TEXT] = "crawl_text",
+	[PHASE_DISASM_CACHE] = "disasm_cache",
+	[PHASE_TRAMPOLINE_TABLE] = "allocate_trampoline_table",
+	[PHASE_PATCH_WRAPPERS] = "create_patch_wrappers",
+	[PHASE_MPROTECT_WRAPPERS] = "mprotect_asm_wrappers",
+	[PHASE_ACTIVATE_PATCHES] = "activate_patches",
+};
+
+void
+intercept_setup_startup_times(const char *where)
+{
+	if (where == NULL || where[0] == '\0')
+		return;
+
+	startup_times_on = true;
+	startup_times_to_log = (strcmp(where, "log") == 0);
+}
+
+static void
+print_line(const char *line, size_t len)
+{
+	if (startup_times_to_log)
+		intercept_log(line, len);
+	else
+		syscall_no_intercept(SYS_write, 2, line, len);
+}
+
+/*
+ * print_object - print the line describing an object
+ */
+static void
+print_object(const struct intercept_desc *obj)
+{
+	char line[0x1000 + 0x400];
+	unsigned patched = 0;
+	int len;
+
+	for (unsigned i = 0; i < obj->count; ++i) {
+		if (!obj->items[i].is_skipped)
+			++patched;
+	}
+
+	len = snprintf(line, sizeof(line),
+		"startup_times %s instructions %lu syscalls %u patched %u "
+		"mprotect_calls %lu",
+		obj->path, obj->instruction_count, obj->count, patched,
+		obj->activation_mprotect_count);
+
+	for (int i = 0; i < STARTUP_PHASE_COUNT; ++i) {
+		if (len >= (int)sizeof(line))
+			break;
+
+		len += snprintf(line + len, sizeof(line) - (size_t)len,
+				" %s %lu", phase_names[i],
+				(unsigned long)obj->phase_ns[i]);
+	}
+
+	if (len >= (int)sizeof(line) - 1)
+		len = (int)sizeof(line) - 2;
+
+	line[len++] = '\n';
+	print_line(line, (size_t)len);
+}
+
+void
+intercept_startup_times_report(const struct intercept_desc *objs,
+			unsigned count, uint64_t iterate_ns, uint64_t total_ns)
+{
+	char line[0x100];
+
+	for (unsigned i = 0; i < count; ++i)
+		print_object(objs + i);
+
+	int len = snprintf(line, sizeof(line),
+		"startup_times total dl_iterate_phdr %lu intercept %lu\n",
+		(unsigned long)iterate_ns, (unsigned long)total_ns);
+
+	print_line(line, (size_t)len);
+}
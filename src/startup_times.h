@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * startup_times.h -- measuring the phases of patching the objects
+ * at startup
+ */
+
+#ifndef INTERCEPT_STARTUP_TIMES_H
+#define INTERCEPT_STARTUP_TIMES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "intercept.h"
+
+extern bool startup_times_on;
+
+void intercept_setup_startup_times(const char *where);
+
+/*
+ * intercept_startup_times_report - print the time spent in each phase
+ * for each object, the time spent in dl_iterate_phdr, and the time
+ * spent in the constructor of the library
+ */
+void intercept_startup_times_report(const struct intercept_desc *objs,
+			unsigned count, uint64_t iterate_ns, uint64_t total_ns);
+
+static inline uint64_t
+startup_phase_start(void)
+{
+	struct timespec ts;
+
+	if (!startup_times_on)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * startup_phase_end - account the time since start in the given phase
+ * of processing the object
+ */
+static inline void
+startup_phase_end(struct intercept_desc *desc, enum startup_phase phase,
+		uint64_t start)
+{
+	if (startup_times_on)
+		desc->phase_ns[phase] += startup_phase_start() - start;
+}
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_dispatch.c -- catching the syscalls made outside of the patched
+ * code, enabled by the INTERCEPT_SYSCALL_DISPATCH environment variable.
+ *
+ * Syscalls made from JIT generated code, from objects not patched, or at
+ * syscall instructions which could not be patched, are not seen by the
+ * hooks. With Syscall User Dispatch (Linux 5.11) enabled, the kernel
+ * sends a SIGSYS instead of executing a syscall, unless the syscall is
+ * made from the text of this library, or the selector byte of the thread
+ * is set to allow syscalls. The SIGSYS handler passes the syscall to
+ * intercept_routine, the same way the patched code does.
+ *
+ * The syscall instructions of the wrapper stubs are outside the text of
+ * this library, so the shared asm wrapper code sets the selector to allow
+ * syscalls before jumping to such an instruction, and each stub sets it
+ * back to block syscalls right after it -- see create_wrapper in
+ * patcher.c. The patched syscalls thus take no detour through a signal
+ * handler.
+ *
+ * The handler is installed using a raw rt_sigaction syscall, with a
+ * restorer in this library, as the rt_sigreturn syscall in the restorer of
+ * libc would be caught as well. Syscalls that can not be made from a
+ * signal handler, e.g. vfork, or clone with a new stack, are executed at
+ * their original place, with the selector left to allow syscalls until
+ * the next patched syscall.
+ *
+ * A syscall caught while the thread blocks SIGSYS would terminate the
+ * process, thus SIGSYS is unblocked after each rt_sigprocmask syscall, and
+ * it is removed from the mask of each signal handler installed by an
+ * rt_sigaction syscall -- the program can not block it. A handler for
+ * SIGSYS installed by the program replaces the one installed here.
+ *
+ * While the patches are removed by intercept_patches_enable, no syscall is
+ * caught: each thread is left to allow syscalls, by the signal handler
+ * stopping it in patch_toggle.c. The selector is set to block syscalls
+ * again only by the wrapper stubs, once a patch is used again.
+ */
+
+#include "syscall_dispatch.h"
+#include "intercept_log.h"
+#include "intercept_util.h"
+
+#include <link.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/ucontext.h>
+#include <syscall.h>
+
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+#define PR_SET_SYSCALL_USER_DISPATCH 59
+#define PR_SYS_DISPATCH_OFF 0
+#define PR_SYS_DISPATCH_ON 1
+#define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+
+#ifndef SYS_USER_DISPATCH
+#define SYS_USER_DISPATCH 2
+#endif
+
+#ifndef SA_RESTORER
+#define SA_RESTORER 0x04000000
+#endif
+
+bool intercept_dispatch_on;
+
+int intercept_dispatch_selector_offset;
+
+/*
+ * intercept_dispatch_selector - the selector byte of the thread, read by
+ * the kernel before each syscall, also written by intercept_template.S
+ */
+__thread unsigned char intercept_dispatch_selector
+	__attribute__((tls_model("initial-exec")));
+
+/* The text of this library, where syscalls are always allowed */
+static uintptr_t allowed_start;
+static uintptr_t allowed_size;
+
+/* The signals blocked in the SIGSYS handler, see intercept_setup_dispatch */
+static unsigned long stop_mask;
+
+/* Is Syscall User Dispatch supported by the kernel? */
+static bool is_supported = true;
+
+/* defined in util.S */
+extern void intercept_dispatch_restorer(void);
+
+/*
+ * The layout of the struct sigaction expected by the rt_sigaction
+ * syscall, which is different from the one in libc.
+ */
+struct kernel_sigaction {
+	void (*handler)(int, siginfo_t *, void *);
+	unsigned long flags;
+	void (*restorer)(void);
+	unsigned long mask;
+};
+
+/*
+ * find_allowed_range - a callback for dl_iterate_phdr, looks for the
+ * executable segment of this library
+ */
+static int
+find_allowed_range(struct dl_phdr_info *info, size_t size, void *data)
+{
+	(void) size;
+	(void) data;
+
+	uintptr_t self = (uintptr_t)&intercept_dispatch_restorer;
+
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) *phdr = info->dlpi_phdr + i;
+
+		if (phdr->p_type != PT_LOAD || (phdr->p_flags & PF_X) == 0)
+			continue;
+
+		uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+		if (self >= start && self < start + phdr->p_memsz) {
+			allowed_start = start;
+			allowed_size = phdr->p_memsz;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * handle_sigsys - the handler of the SIGSYS sent for a syscall caught
+ */
+static void
+handle_sigsys(int sig, siginfo_t *info, void *context)
+{
+	(void) sig;
+
+	ucontext_t *uc = context;
+	greg_t *regs = uc->uc_mcontext.gregs;
+
+	if (info->si_code != SYS_USER_DISPATCH)
+		return; /* not caught by the kernel, e.g. sent by kill */
+
+	/*
+	 * The syscall is logged, and counted in the statistics, as if it
+	 * was made at a patched syscall instruction in an object
+	 * named "[dispatch]", at the absolute address of the instruction.
+	 */
+	struct patch_desc patch;
+
+	zero_bytes(&patch, sizeof(patch));
+	patch.containing_lib_path = "[dispatch]";
+	patch.syscall_offset =
+	    (unsigned long)info->si_call_addr - SYSCALL_INS_SIZE;
+
+	long args[6] = {
+		regs[REG_RDI], regs[REG_RSI], regs[REG_RDX],
+		regs[REG_R10], regs[REG_R8], regs[REG_R9]
+	};
+	long result;
+	bool is_handled;
+
+	/*
+	 * The signal mask is restored from the context on returning from
+	 * the handler, thus a change made to it in the handler would be
+	 * lost. An rt_sigprocmask syscall is made using the mask of the
+	 * code around the syscall, which is then copied to the context.
+	 */
+	unsigned long mask = stop_mask;
+	bool is_mask_syscall = (info->si_syscall == SYS_rt_sigprocmask);
+
+	if (is_mask_syscall)
+		syscall_no_intercept(SYS_rt_sigprocmask, SIG_SETMASK,
+		    &uc->uc_sigmask, NULL, sizeof(mask));
+
+	is_handled = intercept_routine_dispatched(&patch, info->si_syscall,
+			args, &result);
+
+	if (is_mask_syscall) {
+		syscall_no_intercept(SYS_rt_sigprocmask, SIG_BLOCK,
+		    &mask, &uc->uc_sigmask, sizeof(mask));
+		sigdelset(&uc->uc_sigmask, SIGSYS);
+	}
+
+	if (is_handled) {
+		regs[REG_RAX] = result;
+		return;
+	}
+
+	intercept_dispatch_selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+	regs[REG_RAX] = info->si_syscall;
+	regs[REG_RIP] -= SYSCALL_INS_SIZE;
+}
+
+void
+intercept_setup_dispatch(const char *value)
+{
+	if (value == NULL || value[0] == '\0')
+		return;
+
+	dl_iterate_phdr(find_allowed_range, NULL);
+	if (allowed_size == 0)
+		xabort("INTERCEPT_SYSCALL_DISPATCH: text not found");
+
+	uintptr_t thread_pointer;
+
+	__asm__("movq %%fs:0, %0" : "=r" (thread_pointer));
+	intercept_dispatch_selector_offset = (int)
+	    ((uintptr_t)&intercept_dispatch_selector - thread_pointer);
+
+	/*
+	 * The signal used by intercept_patches_enable is blocked in the
+	 * handler, so a thread stopped while handling a syscall caught, is
+	 * stopped after returning to the code around the syscall, where
+	 * it can be moved to the right place -- see patch_toggle.c
+	 */
+	stop_mask = 1UL << (intercept_toggle_signal - 1);
+
+	struct kernel_sigaction action = {
+		.handler = handle_sigsys,
+		.flags = SA_SIGINFO | SA_RESTORER | SA_NODEFER | SA_ONSTACK,
+		.restorer = intercept_dispatch_restorer,
+		.mask = stop_mask
+	};
+
+	xabort_on_syserror(syscall_no_intercept(SYS_rt_sigaction, SIGSYS,
+	    &action, NULL, sizeof(action.mask)), "rt_sigaction");
+
+	intercept_dispatch_on = true;
+}
+
+void
+intercept_dispatch_allow(void)
+{
+	if (intercept_dispatch_on)
+		intercept_dispatch_selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+}
+
+long
+dispatch_rt_sigaction(const long args[6])
+{
+	const struct kernel_sigaction *action = (const void *)args[1];
+	struct kernel_sigaction copy;
+
+	if (action != NULL && args[3] == sizeof(copy.mask)) {
+		copy = *action;
+		copy.mask &= ~(1UL << (SIGSYS - 1));
+		action = &copy;
+	}
+
+	return syscall_no_intercept(SYS_rt_sigaction, args[0], action,
+					args[2], args[3]);
+}
+
+void
+intercept_dispatch_unblock(void)
+{
+	unsigned long mask = 1UL << (SIGSYS - 1);
+
+	if (intercept_dispatch_on)
+		syscall_no_intercept(SYS_rt_sigprocmask, SIG_UNBLOCK,
+		    &mask, NULL, sizeof(mask));
+}
+
+void
+intercept_dispatch_thread_start(void)
+{
+	if (!intercept_dispatch_on || !is_supported)
+		return;
+
+	intercept_dispatch_selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+
+	long ret = syscall_no_intercept(SYS_prctl,
+	    PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+	    allowed_start, allowed_size, &intercept_dispatch_selector);
+
+	if (ret != 0) {
+		static const char msg[] =
+		    "INTERCEPT_SYSCALL_DISPATCH: not supported by the kernel\n";
+
+		intercept_dispatch_selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+		is_supported = false;
+		intercept_log(msg, sizeof(msg) - 1);
+	}
+}
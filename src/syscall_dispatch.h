@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_dispatch.h -- catching the syscalls made outside of the patched
+ * code, using Syscall User Dispatch
+ */
+
+#ifndef INTERCEPT_SYSCALL_DISPATCH_H
+#define INTERCEPT_SYSCALL_DISPATCH_H
+
+#include <stdbool.h>
+
+#include "intercept.h"
+
+extern bool intercept_dispatch_on;
+
+/*
+ * The offset of the intercept_dispatch_selector thread local variable
+ * from the thread pointer, used in the code generated by create_wrapper.
+ */
+extern int intercept_dispatch_selector_offset;
+
+void intercept_setup_dispatch(const char *value);
+
+/*
+ * intercept_dispatch_thread_start - start catching the syscalls of the
+ * calling thread, called once the patches are active, and in each new
+ * thread, or process created -- Syscall User Dispatch is not inherited.
+ */
+void intercept_dispatch_thread_start(void);
+
+/*
+ * intercept_dispatch_allow - stop catching the syscalls of the calling
+ * thread, until the next patched syscall it makes
+ */
+void intercept_dispatch_allow(void);
+
+/*
+ * dispatch_rt_sigaction - execute an rt_sigaction syscall, with
+ * SIGSYS removed from the mask of the new action
+ */
+long dispatch_rt_sigaction(const long args[6]);
+
+/*
+ * intercept_dispatch_unblock - unblock SIGSYS, called after each
+ * rt_sigprocmask syscall, as a syscall caught while SIGSYS is blocked
+ * would terminate the process
+ */
+void intercept_dispatch_unblock(void);
+
+/*
+ * intercept_routine_dispatched - see intercept.c
+ */
+bool intercept_routine_dispatched(struct patch_desc *patch, long nr,
+			const long args[6], long *result);
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_format_list.h - the formats of syscall arguments, as they should
+ * appear in logs, described in a single list. This file has no include
+ * guard, it is meant to be included after defining the macros:
+ *
+ * SYSCALL_FORMAT(name, return_type, args...)
+ *  the format of the syscall SYS_name
+ *
+ * SYSCALL_FORMAT_VARIANT(variant, name, return_type, args...)
+ *  a different format of the same syscall, selected based on the values
+ *  of its arguments in get_syscall_format
+ *
+ * The table of formats in syscall_formats.c, and the printers of
+ * arguments in intercept_log.c are both generated from this list.
+ */
+
+/* Linux syscalls on X86_64 */
+/* BEGIN CSTYLED */
+	SYSCALL_FORMAT(read, rdec, arg_fd, arg_buf_out, arg_dec)
+	SYSCALL_FORMAT(write, rdec, arg_fd, arg_buf_in, arg_dec)
+	SYSCALL_FORMAT(open, rdec, arg_cstr, arg_open_flags)
+	SYSCALL_FORMAT(close, rdec, arg_fd)
+	SYSCALL_FORMAT(stat, rdec, arg_cstr, arg_pointer)
+	SYSCALL_FORMAT(fstat, rdec, arg_fd, arg_pointer)
+	SYSCALL_FORMAT(lstat, rdec, arg_cstr, arg_pointer)
+	SYSCALL_FORMAT(poll, rdec, arg_pointer, arg_, arg_)
+	SYSCALL_FORMAT(lseek, rdec, arg_fd, arg_dec, arg_seek_whence)
+	SYSCALL_FORMAT(mmap, rpointer, arg_pointer, arg_, arg_, arg_, arg_fd, arg_)
+	SYSCALL_FORMAT(mprotect, rdec, arg_pointer, arg_, arg_)
+	SYSCALL_FORMAT(munmap, rdec, arg_pointer, arg_)
+	SYSCALL_FORMAT(brk, rdec, arg_dec)
+	SYSCALL_FORMAT(rt_sigaction, rdec, arg_dec32, arg_pointer, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(rt_sigprocmask, rdec, arg_, arg_pointer, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(rt_sigreturn, rnoreturn, arg_none)
+	SYSCALL_FORMAT(ioctl, rdec, arg_fd, arg_, arg_pointer)
+	SYSCALL_FORMAT(pread64, rdec, arg_fd, arg_buf_out, arg_dec, arg_dec)
+	SYSCALL_FORMAT(pwrite64, rdec, arg_fd, arg_buf_in, arg_dec, arg_dec)
+	SYSCALL_FORMAT(readv, rdec, arg_fd, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(writev, rdec, arg_fd, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(access, rdec, arg_cstr, arg_access_mode)
+	SYSCALL_FORMAT(pipe, rdec, arg_2fds)
+	SYSCALL_FORMAT(select, rdec, arg_dec32, arg_pointer, arg_pointer, arg_pointer, arg_pointer)
+	SYSCALL_FORMAT(sched_yield, rdec, arg_none)
+	SYSCALL_FORMAT(mremap, rpointer, arg_pointer, arg_dec, arg_dec, arg_dec32, arg_)
+	SYSCALL_FORMAT(msync, rdec, arg_pointer, arg_dec, arg_dec32)
+	SYSCALL_FORMAT(mincore, rdec, arg_pointer, arg_dec, arg_pointer)
+	SYSCALL_FORMAT(madvise, rdec, arg_pointer, arg_dec, arg_dec32)
+	SYSCALL_FORMAT(shmget, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(shmat, rhex, arg_, arg_, arg_)
+	SYSCALL_FORMAT(shmctl, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(dup, rdec, arg_fd)
+	SYSCALL_FORMAT(dup2, rdec, arg_fd, arg_fd)
+	SYSCALL_FORMAT(pause, rdec, arg_none)
+	SYSCALL_FORMAT(nanosleep, rdec, arg_, arg_)
+	SYSCALL_FORMAT(getitimer, rdec, arg_, arg_)
+	SYSCALL_FORMAT(alarm, rdec, arg_)
+	SYSCALL_FORMAT(setitimer, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getpid, rdec, arg_none)
+	SYSCALL_FORMAT(sendfile, rdec, arg_fd, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(socket, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(connect, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(accept, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(sendto, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(recvfrom, rdec, arg_fd, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sendmsg, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(recvmsg, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(shutdown, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(bind, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(listen, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(getsockname, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(getpeername, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(socketpair, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(setsockopt, rdec, arg_fd, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getsockopt, rdec, arg_fd, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(clone, rdec, arg_clone_flags, arg_pointer, arg_pointer, arg_pointer, arg_)
+	SYSCALL_FORMAT(fork, rdec, arg_none)
+	SYSCALL_FORMAT(vfork, rdec, arg_none)
+	SYSCALL_FORMAT(execve, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(exit, rnoreturn, arg_)
+	SYSCALL_FORMAT(wait4, rdec, arg_dec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(kill, rdec, arg_, arg_)
+	SYSCALL_FORMAT(uname, rdec, arg_)
+	SYSCALL_FORMAT(semget, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(semop, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(semctl, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(shmdt, rdec, arg_)
+	SYSCALL_FORMAT(msgget, rdec, arg_, arg_)
+	SYSCALL_FORMAT(msgsnd, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(msgrcv, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(msgctl, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(fcntl, rdec, arg_fd, arg_fcntl_cmd, arg_)
+	SYSCALL_FORMAT(flock, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(fsync, rdec, arg_fd)
+	SYSCALL_FORMAT(fdatasync, rdec, arg_fd)
+	SYSCALL_FORMAT(truncate, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(ftruncate, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(getdents, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(getcwd, rdec, arg_, arg_)
+	SYSCALL_FORMAT(chdir, rdec, arg_cstr)
+	SYSCALL_FORMAT(fchdir, rdec, arg_fd)
+	SYSCALL_FORMAT(rename, rdec, arg_cstr, arg_cstr)
+	SYSCALL_FORMAT(mkdir, rdec, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(rmdir, rdec, arg_cstr)
+	SYSCALL_FORMAT(creat, rdec, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(link, rdec, arg_cstr, arg_cstr)
+	SYSCALL_FORMAT(unlink, rdec, arg_cstr)
+	SYSCALL_FORMAT(symlink, rdec, arg_cstr, arg_cstr)
+	SYSCALL_FORMAT(readlink, rdec, arg_cstr, arg_buf_out, arg_dec)
+	SYSCALL_FORMAT(chmod, rdec, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(fchmod, rdec, arg_fd, arg_oct_mode)
+	SYSCALL_FORMAT(chown, rdec, arg_cstr, arg_, arg_)
+	SYSCALL_FORMAT(fchown, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(lchown, rdec, arg_cstr, arg_, arg_)
+	SYSCALL_FORMAT(umask, rmode, arg_oct_mode)
+	SYSCALL_FORMAT(gettimeofday, rdec, arg_, arg_)
+	SYSCALL_FORMAT(getrlimit, rdec, arg_, arg_)
+	SYSCALL_FORMAT(getrusage, rdec, arg_, arg_)
+	SYSCALL_FORMAT(sysinfo, rdec, arg_, arg_)
+	SYSCALL_FORMAT(times, rdec, arg_)
+	SYSCALL_FORMAT(ptrace, rhex, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getuid, rdec, arg_none)
+	SYSCALL_FORMAT(syslog, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getgid, rdec, arg_none)
+	SYSCALL_FORMAT(setuid, rdec, arg_)
+	SYSCALL_FORMAT(setgid, rdec, arg_)
+	SYSCALL_FORMAT(geteuid, rdec, arg_none)
+	SYSCALL_FORMAT(getegid, rdec, arg_none)
+	SYSCALL_FORMAT(setpgid, rdec, arg_none)
+	SYSCALL_FORMAT(getppid, rdec, arg_none)
+	SYSCALL_FORMAT(getpgrp, rdec, arg_none)
+	SYSCALL_FORMAT(setsid, rdec, arg_none)
+	SYSCALL_FORMAT(setreuid, rdec, arg_, arg_)
+	SYSCALL_FORMAT(setregid, rdec, arg_, arg_)
+	SYSCALL_FORMAT(getgroups, rdec, arg_, arg_)
+	SYSCALL_FORMAT(setgroups, rdec, arg_, arg_)
+	SYSCALL_FORMAT(setresuid, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getresuid, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(setresgid, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getresgid, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getpgid, rdec, arg_)
+	SYSCALL_FORMAT(setfsuid, rdec, arg_)
+	SYSCALL_FORMAT(setfsgid, rdec, arg_)
+	SYSCALL_FORMAT(getsid, rdec, arg_)
+	SYSCALL_FORMAT(capget, rdec, arg_, arg_)
+	SYSCALL_FORMAT(capset, rdec, arg_, arg_)
+	SYSCALL_FORMAT(rt_sigpending, rdec, arg_)
+	SYSCALL_FORMAT(rt_sigtimedwait, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(rt_sigqueueinfo, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(rt_sigsuspend, rdec, arg_, arg_)
+	SYSCALL_FORMAT(sigaltstack, rdec, arg_, arg_)
+	SYSCALL_FORMAT(utime, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(mknod, rdec, arg_cstr, arg_, arg_)
+	SYSCALL_FORMAT(uselib, rdec, arg_cstr)
+	SYSCALL_FORMAT(personality, rdec, arg_)
+	SYSCALL_FORMAT(ustat, rdec, arg_, arg_)
+	SYSCALL_FORMAT(statfs, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(fstatfs, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(sysfs, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(getpriority, rdec, arg_, arg_)
+	SYSCALL_FORMAT(setpriority, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sched_setparam, rdec, arg_, arg_)
+	SYSCALL_FORMAT(sched_getparam, rdec, arg_, arg_)
+	SYSCALL_FORMAT(sched_setscheduler, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sched_getscheduler, rdec, arg_)
+	SYSCALL_FORMAT(sched_get_priority_max, rdec, arg_)
+	SYSCALL_FORMAT(sched_get_priority_min, rdec, arg_)
+	SYSCALL_FORMAT(sched_rr_get_interval, rdec, arg_, arg_)
+	SYSCALL_FORMAT(mlock, rdec, arg_, arg_)
+	SYSCALL_FORMAT(munlock, rdec, arg_, arg_)
+	SYSCALL_FORMAT(mlockall, rdec, arg_)
+	SYSCALL_FORMAT(munlockall, rdec, arg_none)
+	SYSCALL_FORMAT(vhangup, rdec, arg_none)
+	SYSCALL_FORMAT(modify_ldt, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(pivot_root, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(_sysctl, rdec, arg_)
+	SYSCALL_FORMAT(prctl, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(arch_prctl, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(adjtimex, rdec, arg_)
+	SYSCALL_FORMAT(setrlimit, rdec, arg_, arg_)
+	SYSCALL_FORMAT(chroot, rdec, arg_cstr)
+	SYSCALL_FORMAT(sync, rdec, arg_none)
+	SYSCALL_FORMAT(acct, rdec, arg_cstr)
+	SYSCALL_FORMAT(settimeofday, rdec, arg_, arg_)
+	SYSCALL_FORMAT(mount, rdec, arg_cstr, arg_cstr, arg_, arg_, arg_)
+	SYSCALL_FORMAT(umount2, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(swapon, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(swapoff, rdec, arg_cstr)
+	SYSCALL_FORMAT(reboot, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sethostname, rdec, arg_, arg_)
+	SYSCALL_FORMAT(setdomainname, rdec, arg_, arg_)
+	SYSCALL_FORMAT(iopl, rdec, arg_)
+	SYSCALL_FORMAT(ioperm, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(init_module, rdec, arg_, arg_dec, arg_)
+	SYSCALL_FORMAT(delete_module, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(quotactl, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(gettid, rdec, arg_none)
+	SYSCALL_FORMAT(readahead, rdec, arg_fd, arg_dec, arg_dec)
+	SYSCALL_FORMAT(setxattr, rdec, arg_cstr, arg_cstr, arg_buf_in, arg_dec, arg_)
+	SYSCALL_FORMAT(lsetxattr, rdec, arg_cstr, arg_cstr, arg_buf_in, arg_dec, arg_)
+	SYSCALL_FORMAT(fsetxattr, rdec, arg_fd, arg_cstr, arg_buf_in, arg_dec, arg_)
+	SYSCALL_FORMAT(getxattr, rdec, arg_cstr, arg_cstr, arg_dec, arg_)
+	SYSCALL_FORMAT(lgetxattr, rdec, arg_cstr, arg_cstr, arg_dec, arg_)
+	SYSCALL_FORMAT(fgetxattr, rdec, arg_fd, arg_cstr, arg_dec, arg_)
+	SYSCALL_FORMAT(listxattr, rdec, arg_cstr, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(llistxattr, rdec, arg_cstr, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(flistxattr, rdec, arg_fd, arg_pointer, arg_dec)
+	SYSCALL_FORMAT(removexattr, rdec, arg_cstr, arg_cstr)
+	SYSCALL_FORMAT(lremovexattr, rdec, arg_cstr, arg_cstr)
+	SYSCALL_FORMAT(fremovexattr, rdec, arg_fd, arg_cstr)
+	SYSCALL_FORMAT(tkill, rdec, arg_, arg_)
+	SYSCALL_FORMAT(time, rdec, arg_)
+	SYSCALL_FORMAT(futex, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sched_setaffinity, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(sched_getaffinity, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(set_thread_area, rdec, arg_)
+	SYSCALL_FORMAT(io_setup, rdec, arg_, arg_)
+	SYSCALL_FORMAT(io_destroy, rdec, arg_)
+	SYSCALL_FORMAT(io_getevents, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(io_submit, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(io_cancel, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(get_thread_area, rdec, arg_)
+	SYSCALL_FORMAT(lookup_dcookie, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(epoll_create, rdec, arg_)
+	SYSCALL_FORMAT(remap_file_pages, rdec, arg_pointer, arg_dec, arg_, arg_dec, arg_)
+	SYSCALL_FORMAT(getdents64, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(set_tid_address, rdec, arg_)
+	SYSCALL_FORMAT(restart_syscall, rdec, arg_none)
+	SYSCALL_FORMAT(semtimedop, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(fadvise64, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(timer_create, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(timer_settime, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(timer_gettime, rdec, arg_, arg_)
+	SYSCALL_FORMAT(timer_getoverrun, rdec, arg_)
+	SYSCALL_FORMAT(timer_delete, rdec, arg_)
+	SYSCALL_FORMAT(clock_settime, rdec, arg_, arg_)
+	SYSCALL_FORMAT(clock_gettime, rdec, arg_, arg_)
+	SYSCALL_FORMAT(clock_getres, rdec, arg_, arg_)
+	SYSCALL_FORMAT(clock_nanosleep, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(exit_group, rnoreturn, arg_)
+	SYSCALL_FORMAT(epoll_wait, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(epoll_ctl, rdec, arg_fd, arg_, arg_fd, arg_)
+	SYSCALL_FORMAT(tgkill, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(utimes, rdec, arg_cstr, arg_)
+	SYSCALL_FORMAT(mbind, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(set_mempolicy, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(get_mempolicy, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(mq_open, rdec, arg_cstr, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(mq_unlink, rdec, arg_cstr)
+	SYSCALL_FORMAT(mq_timedsend, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(mq_timedreceive, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(mq_notify, rdec, arg_, arg_)
+	SYSCALL_FORMAT(mq_getsetattr, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(kexec_load, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(waitid, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(add_key, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(request_key, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(keyctl, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(ioprio_set, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(ioprio_get, rdec, arg_, arg_)
+	SYSCALL_FORMAT(inotify_init, rdec, arg_none)
+	SYSCALL_FORMAT(inotify_add_watch, rdec, arg_fd, arg_cstr, arg_)
+	SYSCALL_FORMAT(inotify_rm_watch, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(migrate_pages, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(openat, rdec, arg_atfd, arg_cstr, arg_open_flags)
+	SYSCALL_FORMAT(mkdirat, rdec, arg_atfd, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(mknodat, rdec, arg_atfd, arg_cstr, arg_oct_mode, arg_)
+	SYSCALL_FORMAT(fchownat, rdec, arg_atfd, arg_cstr, arg_, arg_, arg_)
+	SYSCALL_FORMAT(futimesat, rdec, arg_atfd, arg_cstr, arg_)
+	SYSCALL_FORMAT(newfstatat, rdec, arg_atfd, arg_cstr, arg_, arg_)
+	SYSCALL_FORMAT(unlinkat, rdec, arg_atfd, arg_cstr, arg_)
+	SYSCALL_FORMAT(renameat, rdec, arg_atfd, arg_cstr, arg_atfd, arg_cstr)
+	SYSCALL_FORMAT(linkat, rdec, arg_atfd, arg_cstr, arg_atfd, arg_cstr, arg_)
+	SYSCALL_FORMAT(symlinkat, rdec, arg_cstr, arg_atfd, arg_cstr)
+	SYSCALL_FORMAT(readlinkat, rdec, arg_atfd, arg_cstr, arg_buf_out, arg_dec)
+	SYSCALL_FORMAT(fchmodat, rdec, arg_atfd, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(faccessat, rdec, arg_atfd, arg_cstr, arg_oct_mode)
+	SYSCALL_FORMAT(pselect6, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(ppoll, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(unshare, rdec, arg_)
+	SYSCALL_FORMAT(set_robust_list, rdec, arg_, arg_)
+	SYSCALL_FORMAT(get_robust_list, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(splice, rdec, arg_fd, arg_, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(tee, rdec, arg_fd, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(sync_file_range, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(vmsplice, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(move_pages, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(utimensat, rdec, arg_atfd, arg_cstr, arg_, arg_)
+	SYSCALL_FORMAT(epoll_pwait, rdec, arg_fd, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(signalfd, rdec, arg_fd, arg_, arg_)
+	SYSCALL_FORMAT(timerfd_create, rdec, arg_, arg_)
+	SYSCALL_FORMAT(eventfd, rdec, arg_)
+	SYSCALL_FORMAT(fallocate, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(timerfd_settime, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(timerfd_gettime, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(accept4, rdec, arg_fd, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(signalfd4, rdec, arg_fd, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(eventfd2, rdec, arg_, arg_)
+	SYSCALL_FORMAT(epoll_create1, rdec, arg_)
+	SYSCALL_FORMAT(dup3, rdec, arg_fd, arg_fd, arg_)
+	SYSCALL_FORMAT(pipe2, rdec, arg_2fds, arg_pipe2_flags)
+	SYSCALL_FORMAT(inotify_init1, rdec, arg_)
+	SYSCALL_FORMAT(preadv, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(pwritev, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(rt_tgsigqueueinfo, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(perf_event_open, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(recvmmsg, rdec, arg_fd, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(fanotify_init, rdec, arg_, arg_)
+	SYSCALL_FORMAT(fanotify_mark, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(prlimit64, rdec, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(name_to_handle_at, rdec, arg_atfd, arg_cstr, arg_, arg_, arg_)
+	SYSCALL_FORMAT(open_by_handle_at, rdec, arg_fd, arg_pointer, arg_dec32)
+	SYSCALL_FORMAT(clock_adjtime, rdec, arg_, arg_)
+	SYSCALL_FORMAT(syncfs, rdec, arg_fd)
+	SYSCALL_FORMAT(sendmmsg, rdec, arg_fd, arg_, arg_, arg_)
+	SYSCALL_FORMAT(setns, rdec, arg_fd, arg_)
+	SYSCALL_FORMAT(getcpu, rdec, arg_, arg_, arg_)
+	SYSCALL_FORMAT(process_vm_readv, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(process_vm_writev, rdec, arg_, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(kcmp, rdec, arg_, arg_, arg_, arg_, arg_)
+	SYSCALL_FORMAT(finit_module, rdec, arg_fd, arg_, arg_)
+#ifdef SYS_sched_setattr
+	SYSCALL_FORMAT(sched_setattr, rdec, arg_, arg_, arg_)
+#endif
+#ifdef SYS_sched_getattr
+	SYSCALL_FORMAT(sched_getattr, rdec, arg_, arg_, arg_, arg_)
+#endif
+#ifdef SYS_renameat2
+	SYSCALL_FORMAT(renameat2, rdec, arg_atfd, arg_cstr, arg_atfd, arg_cstr, arg_)
+#endif
+#ifdef SYS_seccomp
+	SYSCALL_FORMAT(seccomp, rdec, arg_, arg_, arg_)
+#endif
+#ifdef SYS_getrandom
+	SYSCALL_FORMAT(getrandom, rdec, arg_, arg_, arg_)
+#endif
+#ifdef SYS_memfd_create
+	SYSCALL_FORMAT(memfd_create, rdec, arg_cstr, arg_)
+#endif
+#ifdef SYS_kexec_file_load
+	SYSCALL_FORMAT(kexec_file_load, rdec, arg_, arg_, arg_, arg_, arg_)
+#endif
+#ifdef SYS_bpf
+	SYSCALL_FORMAT(bpf, rdec, arg_, arg_, arg_)
+#endif
+#ifdef SYS_execveat
+	SYSCALL_FORMAT(execveat, rdec, arg_atfd, arg_cstr, arg_, arg_, arg_)
+#endif
+#ifdef SYS_userfaultfd
+	SYSCALL_FORMAT(userfaultfd, rdec, arg_)
+#endif
+#ifdef SYS_membarrier
+	SYSCALL_FORMAT(membarrier, rdec, arg_, arg_)
+#endif
+#ifdef SYS_mlock2
+	SYSCALL_FORMAT(mlock2, rdec, arg_, arg_, arg_)
+#endif
+#ifdef SYS_copy_file_range
+	SYSCALL_FORMAT(copy_file_range, rdec, arg_fd, arg_, arg_fd, arg_, arg_, arg_)
+#endif
+#ifdef SYS_preadv2
+	SYSCALL_FORMAT(preadv2, rdec, arg_fd, arg_, arg_, arg_, arg_)
+#endif
+#ifdef SYS_pwritev2
+	SYSCALL_FORMAT(pwritev2, rdec, arg_fd, arg_, arg_, arg_, arg_)
+#endif
+#ifdef SYS_pkey_mprotect
+	SYSCALL_FORMAT(pkey_mprotect, rdec, arg_, arg_, arg_, arg_)
+#endif
+#ifdef SYS_pkey_alloc
+	SYSCALL_FORMAT(pkey_alloc, rdec, arg_, arg_)
+#endif
+#ifdef SYS_pkey_free
+	SYSCALL_FORMAT(pkey_free, rdec, arg_)
+#endif
+#ifdef SYS_statx
+	SYSCALL_FORMAT(statx, rdec, arg_atfd, arg_cstr, arg_, arg_, arg_pointer)
+#endif
+#ifdef SYS_io_pgetevents
+	SYSCALL_FORMAT(io_pgetevents, rdec, arg_, arg_dec, arg_dec, arg_pointer, arg_pointer, arg_pointer)
+#endif
+#ifdef SYS_rseq
+	SYSCALL_FORMAT(rseq, rdec, arg_pointer, arg_dec, arg_, arg_)
+#endif
+#ifdef SYS_pidfd_send_signal
+	SYSCALL_FORMAT(pidfd_send_signal, rdec, arg_fd, arg_dec32, arg_pointer, arg_)
+#endif
+#ifdef SYS_io_uring_setup
+	SYSCALL_FORMAT(io_uring_setup, rdec, arg_dec, arg_pointer)
+#endif
+#ifdef SYS_io_uring_enter
+	SYSCALL_FORMAT(io_uring_enter, rdec, arg_fd, arg_dec, arg_dec, arg_, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_io_uring_register
+	SYSCALL_FORMAT(io_uring_register, rdec, arg_fd, arg_dec32, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_open_tree
+	SYSCALL_FORMAT(open_tree, rdec, arg_atfd, arg_cstr, arg_)
+#endif
+#ifdef SYS_move_mount
+	SYSCALL_FORMAT(move_mount, rdec, arg_atfd, arg_cstr, arg_atfd, arg_cstr, arg_)
+#endif
+#ifdef SYS_fsopen
+	SYSCALL_FORMAT(fsopen, rdec, arg_cstr, arg_)
+#endif
+#ifdef SYS_fsconfig
+	SYSCALL_FORMAT(fsconfig, rdec, arg_fd, arg_dec32, arg_, arg_, arg_dec32)
+#endif
+#ifdef SYS_fsmount
+	SYSCALL_FORMAT(fsmount, rdec, arg_fd, arg_, arg_)
+#endif
+#ifdef SYS_fspick
+	SYSCALL_FORMAT(fspick, rdec, arg_atfd, arg_cstr, arg_)
+#endif
+#ifdef SYS_pidfd_open
+	SYSCALL_FORMAT(pidfd_open, rdec, arg_dec, arg_)
+#endif
+#ifdef SYS_clone3
+	SYSCALL_FORMAT(clone3, rdec, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_close_range
+	SYSCALL_FORMAT(close_range, rdec, arg_fd, arg_fd, arg_)
+#endif
+#ifdef SYS_openat2
+	SYSCALL_FORMAT(openat2, rdec, arg_atfd, arg_cstr, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_pidfd_getfd
+	SYSCALL_FORMAT(pidfd_getfd, rdec, arg_fd, arg_fd, arg_)
+#endif
+#ifdef SYS_faccessat2
+	SYSCALL_FORMAT(faccessat2, rdec, arg_atfd, arg_cstr, arg_access_mode, arg_)
+#endif
+#ifdef SYS_process_madvise
+	SYSCALL_FORMAT(process_madvise, rdec, arg_fd, arg_pointer, arg_dec, arg_dec32, arg_)
+#endif
+#ifdef SYS_epoll_pwait2
+	SYSCALL_FORMAT(epoll_pwait2, rdec, arg_fd, arg_pointer, arg_dec32, arg_pointer, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_mount_setattr
+	SYSCALL_FORMAT(mount_setattr, rdec, arg_atfd, arg_cstr, arg_, arg_pointer, arg_dec)
+#endif
+#ifdef SYS_quotactl_fd
+	SYSCALL_FORMAT(quotactl_fd, rdec, arg_fd, arg_, arg_, arg_pointer)
+#endif
+#ifdef SYS_landlock_create_ruleset
+	SYSCALL_FORMAT(landlock_create_ruleset, rdec, arg_pointer, arg_dec, arg_)
+#endif
+#ifdef SYS_landlock_add_rule
+	SYSCALL_FORMAT(landlock_add_rule, rdec, arg_fd, arg_dec32, arg_pointer, arg_)
+#endif
+#ifdef SYS_landlock_restrict_self
+	SYSCALL_FORMAT(landlock_restrict_self, rdec, arg_fd, arg_)
+#endif
+#ifdef SYS_memfd_secret
+	SYSCALL_FORMAT(memfd_secret, rdec, arg_)
+#endif
+#ifdef SYS_process_mrelease
+	SYSCALL_FORMAT(process_mrelease, rdec, arg_fd, arg_)
+#endif
+#ifdef SYS_futex_waitv
+	SYSCALL_FORMAT(futex_waitv, rdec, arg_pointer, arg_dec, arg_, arg_pointer, arg_dec32)
+#endif
+#ifdef SYS_set_mempolicy_home_node
+	SYSCALL_FORMAT(set_mempolicy_home_node, rdec, arg_pointer, arg_dec, arg_dec, arg_)
+#endif
+
+	SYSCALL_FORMAT_VARIANT(open_with_o_creat, open, rdec, arg_cstr, arg_open_flags, arg_oct_mode)
+	SYSCALL_FORMAT_VARIANT(openat_with_o_creat, openat, rdec, arg_atfd, arg_cstr, arg_open_flags, arg_oct_mode)
+	SYSCALL_FORMAT_VARIANT(fcntl_with_flock, fcntl, rdec, arg_fd, arg_fcntl_cmd, arg_flock)
+/* END CSTYLED */
@@ -80,13 +80,36 @@ enum return_type {
 	rnoreturn /* syscall does not return, e.g. exit */
 };
 
+/* All syscall numbers in syscall_format_list.h are below this limit */
+enum { SYSCALL_NR_LIMIT = 0x200 };
+
+/*
+ * The variants of formats in syscall_format_list.h, they are indexed
+ * starting at SYSCALL_NR_LIMIT, following the syscall numbers.
+ */
+enum syscall_format_variant {
+#define SYSCALL_FORMAT(name, ...)
+#define SYSCALL_FORMAT_VARIANT(variant, ...) variant_##variant,
+#include "syscall_format_list.h"
+#undef SYSCALL_FORMAT
+#undef SYSCALL_FORMAT_VARIANT
+	syscall_format_variant_count
+};
+
 struct syscall_format {
 	const char *name;
 	enum return_type return_type;
 	const enum arg_format args[7];
+	/*
+	 * The syscall number, or SYSCALL_NR_LIMIT plus the variant, or -1
+	 * for unknown syscalls.
+	 */
+	int index;
 };
 
 const struct syscall_format *
 get_syscall_format(const struct syscall_desc *desc);
 
+long get_syscall_number(const char *name, size_t name_len);
+
 #endif
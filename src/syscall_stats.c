@@ -0,0 +1,549 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_stats.c -- per syscall counters, and latency histograms
+ *
+ * When the INTERCEPT_STATS environment variable is set, each thread
+ * counts the syscalls it makes, and collects a histogram of their
+ * durations, measured in TSC cycles. The histogram bucket i counts the
+ * syscalls taking at least 2^i, and less than 2^(i+1) cycles.
+ * The statistics of each thread are kept in memory allocated on the first
+ * syscall of the thread, these are linked into a list, which is traversed
+ * when dumping the statistics. When a thread exits, its counts are moved
+ * to the totals of the exited threads, and its memory is put on a free
+ * list, to be reused by a thread started later. When dumping, the
+ * statistics of all threads -- including the exited ones -- are summed,
+ * and appended to the file named in INTERCEPT_STATS, as lines of the form:
+ *
+ * name count cycles bucket:count bucket:count ...
+ *
+ * such as:
+ *
+ * write 1200 3400000 11:900 12:280 14:20
+ *
+ * When INTERCEPT_STATS_SITES is set to a number N, the syscalls made at each
+ * patched syscall instruction are also counted, and the N instructions
+ * with the highest counts are listed after the syscalls, as lines of the
+ * form:
+ *
+ * site path offset count cycles
+ *
+ * where the offset can be passed to addr2line along with the path.
+ *
+ * The statistics are dumped before the process exits (at an exit_group
+ * syscall), on a magic syscall, or when the process receives the signal
+ * specified in INTERCEPT_STATS_SIGNAL.
+ */
+
+#include "syscall_stats.h"
+#include "syscall_formats.h"
+#include "intercept.h"
+#include "intercept_log.h"
+#include "intercept_util.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Syscalls with numbers not less than this are counted together */
+#define STATS_SYSCALL_COUNT 512
+
+#define STATS_BUCKET_COUNT 40
+
+struct syscall_stats {
+	uint64_t count;
+	uint64_t cycles;
+	uint64_t buckets[STATS_BUCKET_COUNT];
+};
+
+struct thread_stats {
+	struct thread_stats *next;
+	struct thread_stats *next_free;
+	long tid;
+	struct syscall_stats syscalls[STATS_SYSCALL_COUNT + 1];
+};
+
+bool intercept_stats_on;
+
+static int stats_fd = -1;
+
+/* The number of patched syscall instructions listed */
+static unsigned long site_count;
+
+static struct thread_stats *all_thread_stats;
+
+/* The blocks of exited threads, protected by free_stats_lock */
+static struct thread_stats *free_thread_stats;
+static int free_stats_lock;
+
+/* The counts of the exited threads */
+static struct syscall_stats exited_stats[STATS_SYSCALL_COUNT + 1];
+
+static __thread struct thread_stats *thread_stats
+	__attribute__((tls_model("initial-exec")));
+
+/* Set while the statistics are being dumped */
+static bool is_dumping;
+
+static void
+stats_signal_handler(int signal)
+{
+	(void) signal;
+
+	intercept_stats_dump();
+}
+
+/*
+ * intercept_setup_stats - open the file the statistics are written to.
+ * If the path ends with a '-' character, the pid is appended to it.
+ */
+void
+intercept_setup_stats(const char *path, const char *signal,
+			const char *sites)
+{
+	char full_path[PATH_MAX];
+
+	if (path == NULL || path[0] == '\0')
+		return;
+
+	if (sites != NULL) {
+		char *end;
+
+		site_count = strtoul(sites, &end, 10);
+		if (*sites == '\0' || *end != '\0')
+			xabort("invalid INTERCEPT_STATS_SITES value");
+	}
+
+	if (!print_log_path(full_path, path))
+		return;
+
+	stats_fd = (int)syscall_no_intercept(SYS_open, full_path,
+				O_CREAT | O_WRONLY | O_APPEND, 0700);
+
+	xabort_on_syserror(stats_fd, "opening stats file");
+
+	intercept_stats_on = true;
+
+	if (signal == NULL)
+		return;
+
+	char *end;
+	long signo = strtol(signal, &end, 10);
+	struct sigaction sa;
+
+	if (*signal == '\0' || *end != '\0' || signo <= 0 || signo >= NSIG)
+		xabort("invalid INTERCEPT_STATS_SIGNAL value");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stats_signal_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction((int)signo, &sa, NULL) != 0)
+		xabort("sigaction for INTERCEPT_STATS_SIGNAL");
+}
+
+/*
+ * reuse_thread_stats - take a block from the free list, if there is any.
+ * This does not wait for the lock, since it might be held by the same
+ * thread interrupted by a signal.
+ */
+static struct thread_stats *
+reuse_thread_stats(void)
+{
+	struct thread_stats *stats;
+
+	if (__atomic_exchange_n(&free_stats_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		return NULL;
+
+	stats = free_thread_stats;
+	if (stats != NULL)
+		free_thread_stats = stats->next_free;
+
+	__atomic_store_n(&free_stats_lock, 0, __ATOMIC_RELEASE);
+
+	return stats;
+}
+
+/*
+ * get_thread_stats - the statistics of the current thread, allocated
+ * on the first call in each thread, unless a block left by an exited
+ * thread can be reused
+ */
+static struct thread_stats *
+get_thread_stats(void)
+{
+	if (thread_stats != NULL)
+		return thread_stats;
+
+	struct thread_stats *stats = reuse_thread_stats();
+
+	if (stats == NULL) {
+		stats = xmmap_anon(sizeof(*stats));
+
+		stats->next = __atomic_load_n(&all_thread_stats,
+						__ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&all_thread_stats,
+		    &stats->next, stats, true,
+		    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+
+	stats->tid = syscall_no_intercept(SYS_gettid);
+	thread_stats = stats;
+
+	return stats;
+}
+
+/*
+ * intercept_stats_thread_exit - move the counts of the calling thread to
+ * the totals of the exited threads, and put its block on the free list.
+ * A child sharing the memory -- and the thread local variables -- of its
+ * parent, without being a thread of its own, leaves the block alone.
+ */
+void
+intercept_stats_thread_exit(void)
+{
+	struct thread_stats *stats = thread_stats;
+
+	if (stats == NULL || stats->tid != syscall_no_intercept(SYS_gettid))
+		return;
+
+	uint64_t *src = (uint64_t *)stats->syscalls;
+	uint64_t *dst = (uint64_t *)exited_stats;
+	size_t size = sizeof(exited_stats);
+	size_t n = size / sizeof(uint64_t);
+
+	/*
+	 * Each counter is moved on its own, a dump made meanwhile sees it
+	 * either in the block, or in the totals.
+	 */
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t value = __atomic_load_n(src + i, __ATOMIC_RELAXED);
+
+		if (value == 0)
+			continue;
+
+		__atomic_fetch_add(dst + i, value, __ATOMIC_RELAXED);
+		__atomic_store_n(src + i, 0, __ATOMIC_RELAXED);
+	}
+
+	while (__atomic_exchange_n(&free_stats_lock, 1, __ATOMIC_ACQUIRE) != 0)
+		;
+
+	stats->next_free = free_thread_stats;
+	free_thread_stats = stats;
+
+	__atomic_store_n(&free_stats_lock, 0, __ATOMIC_RELEASE);
+
+	thread_stats = NULL;
+}
+
+void
+intercept_stats_record(struct patch_desc *patch, long syscall_number,
+			uint64_t cycles)
+{
+	struct thread_stats *stats = get_thread_stats();
+	struct syscall_stats *s;
+	unsigned bucket = 0;
+
+	if (syscall_number >= 0 && syscall_number < STATS_SYSCALL_COUNT)
+		s = stats->syscalls + syscall_number;
+	else
+		s = stats->syscalls + STATS_SYSCALL_COUNT;
+
+	if (cycles > 1)
+		bucket = 63 - (unsigned)__builtin_clzll(cycles);
+	if (bucket >= STATS_BUCKET_COUNT)
+		bucket = STATS_BUCKET_COUNT - 1;
+
+	/*
+	 * Only the owner thread writes these counters, other threads might
+	 * read them while dumping.
+	 */
+	__atomic_store_n(&s->count, s->count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->cycles, s->cycles + cycles, __ATOMIC_RELAXED);
+	__atomic_store_n(&s->buckets[bucket], s->buckets[bucket] + 1,
+			__ATOMIC_RELAXED);
+
+	if (site_count != 0) {
+		__atomic_fetch_add(&patch->call_count, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&patch->call_cycles, cycles,
+				__ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * sum_stats - the statistics of a syscall, summed over all threads
+ */
+static void
+sum_stats(unsigned index, struct syscall_stats *sum)
+{
+	const struct syscall_stats *exited = exited_stats + index;
+
+	sum->count = __atomic_load_n(&exited->count, __ATOMIC_RELAXED);
+	sum->cycles = __atomic_load_n(&exited->cycles, __ATOMIC_RELAXED);
+	for (unsigned i = 0; i < STATS_BUCKET_COUNT; ++i)
+		sum->buckets[i] = __atomic_load_n(&exited->buckets[i],
+						__ATOMIC_RELAXED);
+
+	for (struct thread_stats *t = __atomic_load_n(&all_thread_stats,
+	    __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+		const struct syscall_stats *s = t->syscalls + index;
+
+		sum->count += __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+		sum->cycles += __atomic_load_n(&s->cycles, __ATOMIC_RELAXED);
+		for (unsigned i = 0; i < STATS_BUCKET_COUNT; ++i)
+			sum->buckets[i] += __atomic_load_n(&s->buckets[i],
+							__ATOMIC_RELAXED);
+	}
+}
+
+static char *
+print_cstr(char *dst, const char *src)
+{
+	while (*src != '\0')
+		*dst++ = *src++;
+
+	return dst;
+}
+
+/*
+ * print_stats_line - print the statistics of one syscall, as a line
+ * in the format described at the top of this file
+ */
+static char *
+print_stats_line(char *c, unsigned index, const struct syscall_stats *s)
+{
+	if (index < STATS_SYSCALL_COUNT) {
+		struct syscall_desc desc = { .nr = (int)index };
+		const char *name = get_syscall_format(&desc)->name;
+
+		if (name == NULL)
+			c = print_number(c, index, 10, 0);
+		else
+			c = print_cstr(c, name);
+	} else {
+		c = print_cstr(c, "other");
+	}
+
+	*c++ = ' ';
+	c = print_number(c, s->count, 10, 0);
+	*c++ = ' ';
+	c = print_number(c, s->cycles, 10, 0);
+
+	for (unsigned i = 0; i < STATS_BUCKET_COUNT; ++i) {
+		if (s->buckets[i] == 0)
+			continue;
+
+		*c++ = ' ';
+		c = print_number(c, i, 10, 0);
+		*c++ = ':';
+		c = print_number(c, s->buckets[i], 10, 0);
+	}
+
+	*c++ = '\n';
+
+	return c;
+}
+
+/*
+ * is_site_before - order of the sites in the list, by count, then address
+ */
+static bool
+is_site_before(const struct patch_desc *a, uint64_t a_count,
+		const struct patch_desc *b, uint64_t b_count)
+{
+	if (a_count != b_count)
+		return a_count > b_count;
+
+	return a < b;
+}
+
+/*
+ * next_site - find the busiest site listed after the previous one
+ */
+static const struct patch_desc *
+next_site(const struct patch_desc *prev, uint64_t prev_count)
+{
+	const struct patch_desc *best = NULL;
+	uint64_t best_count = 0;
+	unsigned obj_count;
+	const struct intercept_desc *objs = get_patched_objects(&obj_count);
+
+	for (unsigned i = 0; i < obj_count; ++i) {
+		for (unsigned j = 0; j < objs[i].count; ++j) {
+			const struct patch_desc *p = objs[i].items + j;
+			uint64_t count = __atomic_load_n(&p->call_count,
+							__ATOMIC_RELAXED);
+
+			if (count == 0)
+				continue;
+
+			if (prev != NULL &&
+			    !is_site_before(prev, prev_count, p, count))
+				continue;
+
+			if (best == NULL ||
+			    is_site_before(p, count, best, best_count)) {
+				best = p;
+				best_count = count;
+			}
+		}
+	}
+
+	return best;
+}
+
+/*
+ * print_sites - print the busiest site_count sites, using the buffer
+ * for printing lines -- it is written to the file when it is almost full
+ */
+static char *
+print_sites(char *buffer, size_t size, char *c)
+{
+	const struct patch_desc *site = NULL;
+	uint64_t count = 0;
+
+	if ((size_t)(c - buffer) > size - 0x40) {
+		syscall_no_intercept(SYS_write, stats_fd, buffer, c - buffer);
+		c = buffer;
+	}
+
+	c = print_cstr(c, "# site path offset count cycles\n");
+
+	for (unsigned long i = 0; i < site_count; ++i) {
+		site = next_site(site, count);
+		if (site == NULL)
+			break;
+
+		count = __atomic_load_n(&site->call_count, __ATOMIC_RELAXED);
+
+		/* a line is at most PATH_MAX bytes, plus the numbers */
+		if ((size_t)(c - buffer) > size - PATH_MAX - 0x80) {
+			syscall_no_intercept(SYS_write, stats_fd, buffer,
+					c - buffer);
+			c = buffer;
+		}
+
+		c = print_cstr(c, "site ");
+		c = print_cstr(c, site->containing_lib_path);
+		c = print_cstr(c, " 0x");
+		c = print_number(c, site->syscall_offset, 16, 0);
+		*c++ = ' ';
+		c = print_number(c, count, 10, 0);
+		*c++ = ' ';
+		c = print_number(c, __atomic_load_n(&site->call_cycles,
+				__ATOMIC_RELAXED), 10, 0);
+		*c++ = '\n';
+	}
+
+	return c;
+}
+
+/*
+ * intercept_stats_dump - append the statistics to the stats file.
+ * This does not call libc, as it can be called from a signal handler.
+ */
+void
+intercept_stats_dump(void)
+{
+	bool busy = false;
+	char buffer[0x2000];
+	char *c = buffer;
+
+	if (!intercept_stats_on)
+		return;
+
+	if (!__atomic_compare_exchange_n(&is_dumping, &busy, true, false,
+	    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	c = print_cstr(c, "# syscall_intercept stats, pid ");
+	c = print_number(c, (unsigned long)syscall_no_intercept(SYS_getpid),
+			10, 0);
+	c = print_cstr(c, "\n# name count cycles log2(cycles):count ...\n");
+
+	for (unsigned i = 0; i <= STATS_SYSCALL_COUNT; ++i) {
+		struct syscall_stats sum;
+
+		sum_stats(i, &sum);
+		if (sum.count == 0)
+			continue;
+
+		/* a line is at most about 0x400 bytes long */
+		if ((size_t)(c - buffer) > sizeof(buffer) - 0x400) {
+			syscall_no_intercept(SYS_write, stats_fd, buffer,
+					c - buffer);
+			c = buffer;
+		}
+
+		c = print_stats_line(c, i, &sum);
+	}
+
+	if (site_count != 0)
+		c = print_sites(buffer, sizeof(buffer), c);
+
+	syscall_no_intercept(SYS_write, stats_fd, buffer, c - buffer);
+
+	__atomic_store_n(&is_dumping, false, __ATOMIC_RELEASE);
+}
+
+/*
+ * intercept_stats_reset - clear the statistics inherited by a child
+ * process from its parent
+ */
+void
+intercept_stats_reset(void)
+{
+	for (struct thread_stats *t = all_thread_stats; t != NULL; t = t->next)
+		zero_bytes(t->syscalls, sizeof(t->syscalls));
+
+	zero_bytes(exited_stats, sizeof(exited_stats));
+
+	/* the lock might have been held by another thread of the parent */
+	free_stats_lock = 0;
+
+	unsigned obj_count;
+	const struct intercept_desc *objs = get_patched_objects(&obj_count);
+
+	for (unsigned i = 0; i < obj_count && site_count != 0; ++i) {
+		for (unsigned j = 0; j < objs[i].count; ++j) {
+			objs[i].items[j].call_count = 0;
+			objs[i].items[j].call_cycles = 0;
+		}
+	}
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_stats.h -- per syscall counters, and latency histograms
+ */
+
+#ifndef INTERCEPT_SYSCALL_STATS_H
+#define INTERCEPT_SYSCALL_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern bool intercept_stats_on;
+
+struct patch_desc;
+
+void intercept_setup_stats(const char *path, const char *signal,
+			const char *sites);
+
+/*
+ * intercept_stats_record - account for a syscall handled by
+ * intercept_routine, made at the patched syscall instruction described
+ * by patch, which took the given number of TSC cycles, including the
+ * time spent in the hook function.
+ */
+void intercept_stats_record(struct patch_desc *patch, long syscall_number,
+			uint64_t cycles);
+
+void intercept_stats_dump(void);
+void intercept_stats_reset(void);
+
+/*
+ * intercept_stats_thread_exit - release the statistics of the calling
+ * thread, called right before it exits
+ */
+void intercept_stats_thread_exit(void);
+
+static inline uint64_t
+intercept_stats_timestamp(void)
+{
+	return intercept_stats_on ? __builtin_ia32_rdtsc() : 0;
+}
+
+#endif
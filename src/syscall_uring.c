@@ -0,0 +1,525 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_uring.c -- executing some syscalls as io_uring submissions,
+ * see syscall_uring_setup in libsyscall_intercept_hook_point.h
+ *
+ * All threads share a single ring. A thread queues its request in the
+ * submission queue, and then waits for its completion. Only one thread
+ * at a time -- the one holding cq_lock -- reaps completions, publishing
+ * the results to the requests of all threads, and only this thread waits
+ * in the kernel for completions. Requests queued by other threads
+ * meanwhile are submitted in the same io_uring_enter syscall, or by the
+ * kernel thread polling the submission queue, if there is one.
+ *
+ * The state of the ring is kept in a page mapped with MADV_WIPEONFORK,
+ * and the rings are mapped with MADV_DONTFORK, thus a child process
+ * created by fork does not use the ring of its parent, the syscalls
+ * in the child are executed using syscall_no_intercept.
+ */
+
+#include "libsyscall_intercept_hook_point.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <sys/mman.h>
+
+#if defined(HAS_IO_URING_H) && defined(SYS_io_uring_setup)
+
+#include <linux/io_uring.h>
+
+struct uring {
+	bool ready;
+	bool sqpoll;
+	int fd;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_flags;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	struct io_uring_sqe *sqes;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	unsigned cq_entries;
+	struct io_uring_cqe *cqes;
+
+	int sq_lock;
+	int cq_lock;
+	unsigned in_flight;
+};
+
+/*
+ * struct uring_request - the request of a waiting thread, the user_data
+ * field of a submission points to such an instance on the stack of the
+ * thread.
+ */
+struct uring_request {
+	long result;
+	int done;
+};
+
+static struct uring *ring;
+
+/* How many times to check the completion queue before waiting */
+#define URING_POLL_SPINS 0x4000
+
+/* Set in a thread while it uses the ring, e.g. before a signal handler */
+static __thread bool is_using_ring
+	__attribute__((tls_model("initial-exec")));
+
+static bool
+try_lock(int *lock)
+{
+	return __atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
+static void
+unlock(int *lock)
+{
+	__atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+static long
+uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall_no_intercept(SYS_io_uring_enter, ring->fd,
+			to_submit, min_complete, flags, NULL, (size_t)0);
+}
+
+/*
+ * queue_request - place a request in the submission queue.
+ * Returns false if the queue is full, or there would be more requests in
+ * flight than what the completion queue can hold.
+ */
+static bool
+queue_request(long syscall_number, long fd, long buf, long len,
+		long offset, struct uring_request *request)
+{
+	if (__atomic_add_fetch(&ring->in_flight, 1, __ATOMIC_RELAXED) >
+	    ring->cq_entries) {
+		__atomic_sub_fetch(&ring->in_flight, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	if (!try_lock(&ring->sq_lock)) {
+		__atomic_sub_fetch(&ring->in_flight, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	unsigned tail = *ring->sq_tail;
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= ring->sq_entries) {
+		unlock(&ring->sq_lock);
+		__atomic_sub_fetch(&ring->in_flight, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	unsigned index = tail & ring->sq_mask;
+	struct io_uring_sqe *sqe = ring->sqes + index;
+
+	zero_bytes(sqe, sizeof(*sqe));
+
+	switch (syscall_number) {
+		case SYS_read:
+		case SYS_pread64:
+			sqe->opcode = IORING_OP_READ;
+			break;
+		case SYS_write:
+		case SYS_pwrite64:
+			sqe->opcode = IORING_OP_WRITE;
+			break;
+		case SYS_fsync:
+			sqe->opcode = IORING_OP_FSYNC;
+			break;
+	}
+
+	sqe->fd = (int)fd;
+	sqe->addr = (uint64_t)buf;
+	sqe->len = (uint32_t)len;
+	sqe->off = (uint64_t)offset;
+	sqe->user_data = (uint64_t)(uintptr_t)request;
+
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	unlock(&ring->sq_lock);
+
+	return true;
+}
+
+/*
+ * reap_completions - publish the results of all completed requests
+ * Called while holding cq_lock.
+ */
+static void
+reap_completions(void)
+{
+	unsigned head = *ring->cq_head;
+	unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned count = tail - head;
+
+	for (; head != tail; ++head) {
+		struct io_uring_cqe *cqe = ring->cqes + (head & ring->cq_mask);
+		struct uring_request *request =
+		    (struct uring_request *)(uintptr_t)cqe->user_data;
+
+		request->result = cqe->res;
+		__atomic_store_n(&request->done, 1, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(ring->cq_head, tail, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&ring->in_flight, count, __ATOMIC_RELAXED);
+}
+
+/*
+ * submit_pending - make sure the requests queued are seen by the kernel
+ */
+static void
+submit_pending(void)
+{
+	if (ring->sqpoll) {
+		unsigned flags = __atomic_load_n(ring->sq_flags,
+						__ATOMIC_ACQUIRE);
+
+		if (flags & IORING_SQ_NEED_WAKEUP)
+			uring_enter(0, 0, IORING_ENTER_SQ_WAKEUP);
+	} else {
+		unsigned tail = __atomic_load_n(ring->sq_tail,
+						__ATOMIC_ACQUIRE);
+		unsigned head = __atomic_load_n(ring->sq_head,
+						__ATOMIC_ACQUIRE);
+
+		if (tail != head)
+			uring_enter(tail - head, 0, 0);
+	}
+}
+
+/*
+ * wait_completions - submit the requests queued, and wait until at least
+ * one of them completes. Called while holding cq_lock.
+ */
+static void
+wait_completions(void)
+{
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	unsigned to_submit = 0;
+
+	/*
+	 * With a kernel thread polling the submission queue, the completion
+	 * queue is also polled for a while, before entering the kernel.
+	 */
+	for (unsigned i = 0; ring->sqpoll && i < URING_POLL_SPINS; ++i) {
+		if (__atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) !=
+		    *ring->cq_head) {
+			reap_completions();
+			return;
+		}
+		__builtin_ia32_pause();
+	}
+
+	if (!ring->sqpoll)
+		to_submit = ring->sq_entries;
+	else if (__atomic_load_n(ring->sq_flags, __ATOMIC_ACQUIRE) &
+	    IORING_SQ_NEED_WAKEUP)
+		flags |= IORING_ENTER_SQ_WAKEUP;
+
+	uring_enter(to_submit, 1, flags);
+	reap_completions();
+}
+
+/*
+ * wait_request - wait for the completion of a request queued
+ */
+static long
+wait_request(struct uring_request *request)
+{
+	unsigned spins = 0;
+
+	while (!__atomic_load_n(&request->done, __ATOMIC_ACQUIRE)) {
+		if (try_lock(&ring->cq_lock)) {
+			reap_completions();
+
+			if (!__atomic_load_n(&request->done, __ATOMIC_RELAXED))
+				wait_completions();
+
+			unlock(&ring->cq_lock);
+		} else if (++spins < 0x100) {
+			__builtin_ia32_pause();
+		} else {
+			/*
+			 * Another thread is reaping completions, make sure
+			 * this request does not wait for that thread to
+			 * return from the kernel before being submitted.
+			 */
+			submit_pending();
+			syscall_no_intercept(SYS_sched_yield);
+			spins = 0;
+		}
+	}
+
+	return request->result;
+}
+
+static bool
+is_ring_used(void)
+{
+	return ring != NULL && __atomic_load_n(&ring->ready, __ATOMIC_ACQUIRE);
+}
+
+__attribute__((visibility("default")))
+long
+syscall_uring(long syscall_number, long arg0, long arg1, long arg2,
+		long arg3)
+{
+	long offset;
+
+	long buf = arg1;
+	long len = arg2;
+
+	switch (syscall_number) {
+		case SYS_read:
+		case SYS_write:
+			offset = -1; /* use the file position */
+			break;
+		case SYS_pread64:
+		case SYS_pwrite64:
+			offset = arg3;
+			break;
+		case SYS_fsync:
+			buf = len = offset = 0;
+			break;
+		default:
+			goto no_ring;
+	}
+
+	if ((unsigned long)len > UINT32_MAX)
+		goto no_ring;
+
+	if (!is_ring_used() || is_using_ring)
+		goto no_ring;
+
+	struct uring_request request = { .result = 0, .done = 0 };
+
+	is_using_ring = true;
+
+	if (!queue_request(syscall_number, arg0, buf, len, offset,
+	    &request)) {
+		is_using_ring = false;
+		goto no_ring;
+	}
+
+	long result = wait_request(&request);
+
+	is_using_ring = false;
+
+	return result;
+
+no_ring:
+	return syscall_no_intercept(syscall_number, arg0, arg1, arg2, arg3);
+}
+
+/*
+ * map_ring - map a part of the ring, not to be inherited by child processes
+ */
+static void *
+map_ring(int fd, size_t size, uint64_t offset)
+{
+	long addr = syscall_no_intercept(SYS_mmap, NULL, size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, offset);
+
+	if (syscall_error_code(addr) != 0)
+		return NULL;
+
+	syscall_no_intercept(SYS_madvise, addr, size, MADV_DONTFORK);
+
+	return (void *)addr;
+}
+
+__attribute__((visibility("default")))
+int
+syscall_uring_setup(unsigned entries, int sqpoll)
+{
+	static int setup_lock;
+	struct io_uring_params params;
+	struct uring *state;
+	long r;
+
+	if (!try_lock(&setup_lock))
+		return -EBUSY;
+
+	state = xmmap_anon(PAGE_SIZE);
+	r = syscall_no_intercept(SYS_madvise, state, PAGE_SIZE,
+				MADV_WIPEONFORK);
+	if (syscall_error_code(r) != 0)
+		goto fail;
+
+	zero_bytes(&params, sizeof(params));
+	if (sqpoll)
+		params.flags |= IORING_SETUP_SQPOLL;
+
+	r = syscall_no_intercept(SYS_io_uring_setup, entries, &params);
+	if (syscall_error_code(r) != 0)
+		goto fail;
+
+	int fd = (int)r;
+
+	size_t sq_size = params.sq_off.array +
+				params.sq_entries * sizeof(unsigned);
+	size_t cq_size = params.cq_off.cqes +
+				params.cq_entries * sizeof(struct io_uring_cqe);
+	unsigned char *sq_ring;
+	unsigned char *cq_ring;
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+		sq_ring = cq_ring = map_ring(fd, sq_size, IORING_OFF_SQ_RING);
+	} else {
+		sq_ring = map_ring(fd, sq_size, IORING_OFF_SQ_RING);
+		cq_ring = map_ring(fd, cq_size, IORING_OFF_CQ_RING);
+	}
+
+	struct io_uring_sqe *sqes = map_ring(fd,
+			params.sq_entries * sizeof(struct io_uring_sqe),
+			IORING_OFF_SQES);
+
+	if (sq_ring == NULL || cq_ring == NULL || sqes == NULL) {
+		r = -ENOMEM;
+		syscall_no_intercept(SYS_close, fd);
+		goto fail;
+	}
+
+	/* Reading, and writing at the current file position */
+	if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+		r = -ENOSYS;
+		syscall_no_intercept(SYS_close, fd);
+		goto fail;
+	}
+
+	state->sqpoll = (sqpoll != 0);
+	state->fd = fd;
+	state->sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+	state->sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+	state->sq_flags = (unsigned *)(sq_ring + params.sq_off.flags);
+	state->sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+	state->sq_mask = *(unsigned *)(sq_ring + params.sq_off.ring_mask);
+	state->sq_entries = params.sq_entries;
+	state->sqes = sqes;
+	state->cq_head = (unsigned *)(cq_ring + params.cq_off.head);
+	state->cq_tail = (unsigned *)(cq_ring + params.cq_off.tail);
+	state->cq_mask = *(unsigned *)(cq_ring + params.cq_off.ring_mask);
+	state->cq_entries = params.cq_entries;
+	state->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+	ring = state;
+	__atomic_store_n(&state->ready, true, __ATOMIC_RELEASE);
+
+	return 0;
+
+fail:
+	xmunmap(state, PAGE_SIZE);
+	unlock(&setup_lock);
+	return (int)r;
+}
+
+#else
+
+static bool
+is_ring_used(void)
+{
+	return false;
+}
+
+__attribute__((visibility("default")))
+long
+syscall_uring(long syscall_number, long arg0, long arg1, long arg2,
+		long arg3)
+{
+	return syscall_no_intercept(syscall_number, arg0, arg1, arg2, arg3);
+}
+
+__attribute__((visibility("default")))
+int
+syscall_uring_setup(unsigned entries, int sqpoll)
+{
+	(void) entries;
+	(void) sqpoll;
+
+	return -ENOSYS;
+}
+
+#endif
+
+/*
+ * syscall_uring_hook - a hook function executing the syscalls supported by
+ * syscall_uring using the ring
+ */
+__attribute__((visibility("default")))
+int
+syscall_uring_hook(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result)
+{
+	(void) arg4;
+	(void) arg5;
+
+	switch (syscall_number) {
+		case SYS_read:
+		case SYS_write:
+		case SYS_pread64:
+		case SYS_pwrite64:
+		case SYS_fsync:
+			break;
+		default:
+			return 1;
+	}
+
+	if (!is_ring_used())
+		return 1;
+
+	*result = syscall_uring(syscall_number, arg0, arg1, arg2, arg3);
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * thread_context.c -- the per-thread context of the hooks.
+ *
+ * The contexts are allocated using mmap, and the pointer to the context
+ * of each thread is stored in a thread local variable of this library.
+ * The library uses the initial-exec TLS model, thus finding the context is
+ * a single load relative to the thread pointer, while a hook in another
+ * preloaded library accessing its own thread local variables might need
+ * to call __tls_get_addr.
+ * The context of a thread is allocated when the thread is created by an
+ * intercepted clone syscall, or when it is first asked for, and is
+ * released when the thread exits using an intercepted exit syscall.
+ */
+
+#include "thread_context.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "libsyscall_intercept_hook_point.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sched.h>
+#include <syscall.h>
+
+/* None of these are expected to be large, this only catches typos */
+#define THREAD_CONTEXT_MAX_SIZE 0x100000
+
+static size_t context_size;
+static void (*context_init)(void *context);
+
+static __thread void *context
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * The thread the context was allocated for -- a thread created without
+ * CLONE_SETTLS shares the thread local variables of its parent.
+ */
+static __thread long context_tid
+	__attribute__((tls_model("initial-exec")));
+
+/*
+ * intercept_hook_point_thread_context_setup - set the size of the context
+ * allocated for each thread, and the function called to initialize it
+ */
+__attribute__((visibility("default")))
+int
+intercept_hook_point_thread_context_setup(size_t size,
+			void (*init)(void *context))
+{
+	size_t expected = 0;
+
+	if (size == 0 || size > THREAD_CONTEXT_MAX_SIZE)
+		return -1;
+
+	size = (size + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1);
+
+	if (!__atomic_compare_exchange_n(&context_size, &expected, size,
+	    false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return -1;
+
+	/*
+	 * Only the caller that won the context_size slot sets the init
+	 * function, a failed second call must not replace it.
+	 */
+	__atomic_store_n(&context_init, init, __ATOMIC_RELEASE);
+
+	/* The init function might use the SIMD registers in a new thread */
+	if (init != NULL)
+		__atomic_store_n(&intercept_clone_child_lean, false,
+				__ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static void *
+allocate_context(size_t size)
+{
+	void *c = xmmap_anon(size);
+	void (*init)(void *context) =
+		__atomic_load_n(&context_init, __ATOMIC_ACQUIRE);
+
+	if (init != NULL)
+		init(c);
+
+	context = c;
+	context_tid = syscall_no_intercept(SYS_gettid);
+
+	return c;
+}
+
+/*
+ * intercept_hook_point_thread_context - the context of the calling thread,
+ * allocated on first use.
+ */
+__attribute__((visibility("default")))
+void *
+intercept_hook_point_thread_context(void)
+{
+	if (context != NULL)
+		return context;
+
+	size_t size = __atomic_load_n(&context_size, __ATOMIC_ACQUIRE);
+
+	if (size == 0)
+		return NULL;
+
+	return allocate_context(size);
+}
+
+void
+intercept_thread_context_child(long clone_flags)
+{
+	size_t size = __atomic_load_n(&context_size, __ATOMIC_ACQUIRE);
+
+	/*
+	 * Only a thread with thread local variables of its own gets a new
+	 * context, a child process keeps its copy of the parent's context.
+	 */
+	if ((clone_flags & CLONE_VM) == 0 || (clone_flags & CLONE_SETTLS) == 0)
+		return;
+
+	if (size != 0)
+		(void) allocate_context(size);
+}
+
+void
+intercept_thread_context_release(void)
+{
+	size_t size = __atomic_load_n(&context_size, __ATOMIC_ACQUIRE);
+
+	if (context == NULL ||
+	    context_tid != syscall_no_intercept(SYS_gettid))
+		return;
+
+	xmunmap(context, size);
+	context = NULL;
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vdso.c -- intercepting the functions glibc calls in the vDSO
+ *
+ * The vDSO functions are not syscalls, so they can not be patched like
+ * syscall instructions. Instead, the pointers to these functions that
+ * glibc stores in memory -- the ones the dynamic loader resolved for its
+ * own use in _rtld_global_ro, and the GOT entries of the gettimeofday,
+ * and time IFUNCs -- are replaced with pointers to the functions below.
+ * These are plain C functions, called with the usual calling convention,
+ * they call the intercept_hook_point_vdso hook with no registers saved,
+ * or forward the call to the original vDSO function.
+ * This is only done when the INTERCEPT_VDSO environment variable is set.
+ */
+
+#include "libsyscall_intercept_hook_point.h"
+#include "intercept.h"
+#include "intercept_util.h"
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+
+int (*intercept_hook_point_vdso)(long syscall_number,
+			long arg0, long arg1, long arg2,
+			long *result)
+	__attribute__((visibility("default")));
+
+enum {
+	VDSO_CLOCK_GETTIME,
+	VDSO_CLOCK_GETRES,
+	VDSO_GETTIMEOFDAY,
+	VDSO_TIME,
+	VDSO_GETCPU,
+	VDSO_FUNCTION_COUNT
+};
+
+static int hooked_clock_gettime(clockid_t clock, struct timespec *ts);
+static int hooked_clock_getres(clockid_t clock, struct timespec *ts);
+static int hooked_gettimeofday(struct timeval *tv, void *tz);
+static time_t hooked_time(time_t *t);
+static int hooked_getcpu(unsigned *cpu, unsigned *node, void *cache);
+
+/*
+ * The address of each vDSO function is looked up at startup, the
+ * replacement is the function the pointers to the vDSO function are
+ * replaced with.
+ */
+static struct vdso_function {
+	const char *name;
+	long syscall_number;
+	uintptr_t address;
+	uintptr_t replacement;
+} vdso_functions[VDSO_FUNCTION_COUNT] = {
+	[VDSO_CLOCK_GETTIME] = { "__vdso_clock_gettime", SYS_clock_gettime,
+				0, (uintptr_t)hooked_clock_gettime },
+	[VDSO_CLOCK_GETRES] = { "__vdso_clock_getres", SYS_clock_getres,
+				0, (uintptr_t)hooked_clock_getres },
+	[VDSO_GETTIMEOFDAY] = { "__vdso_gettimeofday", SYS_gettimeofday,
+				0, (uintptr_t)hooked_gettimeofday },
+	[VDSO_TIME] = { "__vdso_time", SYS_time,
+				0, (uintptr_t)hooked_time },
+	[VDSO_GETCPU] = { "__vdso_getcpu", SYS_getcpu,
+				0, (uintptr_t)hooked_getcpu }
+};
+
+static bool vdso_hooks_on;
+
+/*
+ * call_vdso_hook - call intercept_hook_point_vdso, if it is set.
+ * Returns true if the hook handled the call, and stored its result.
+ */
+static bool
+call_vdso_hook(long syscall_number, long arg0, long arg1, long arg2,
+		long *result)
+{
+	int (*hook)(long, long, long, long, long *);
+
+	hook = __atomic_load_n(&intercept_hook_point_vdso, __ATOMIC_ACQUIRE);
+
+	return hook != NULL &&
+		hook(syscall_number, arg0, arg1, arg2, result) == 0;
+}
+
+static int
+hooked_clock_gettime(clockid_t clock, struct timespec *ts)
+{
+	long result;
+
+	if (call_vdso_hook(SYS_clock_gettime, clock, (long)ts, 0, &result))
+		return (int)result;
+
+	return (int)syscall_vdso_no_intercept(SYS_clock_gettime,
+					clock, (long)ts, 0);
+}
+
+static int
+hooked_clock_getres(clockid_t clock, struct timespec *ts)
+{
+	long result;
+
+	if (call_vdso_hook(SYS_clock_getres, clock, (long)ts, 0, &result))
+		return (int)result;
+
+	return (int)syscall_vdso_no_intercept(SYS_clock_getres,
+					clock, (long)ts, 0);
+}
+
+static int
+hooked_gettimeofday(struct timeval *tv, void *tz)
+{
+	long result;
+
+	if (call_vdso_hook(SYS_gettimeofday, (long)tv, (long)tz, 0, &result))
+		return (int)result;
+
+	return (int)syscall_vdso_no_intercept(SYS_gettimeofday,
+					(long)tv, (long)tz, 0);
+}
+
+static time_t
+hooked_time(time_t *t)
+{
+	long result;
+
+	if (call_vdso_hook(SYS_time, (long)t, 0, 0, &result))
+		return (time_t)result;
+
+	return (time_t)syscall_vdso_no_intercept(SYS_time, (long)t, 0, 0);
+}
+
+static int
+hooked_getcpu(unsigned *cpu, unsigned *node, void *cache)
+{
+	long result;
+
+	if (call_vdso_hook(SYS_getcpu, (long)cpu, (long)node, (long)cache,
+	    &result))
+		return (int)result;
+
+	return (int)syscall_vdso_no_intercept(SYS_getcpu,
+					(long)cpu, (long)node, (long)cache);
+}
+
+/*
+ * syscall_vdso_no_intercept - call the original vDSO function, or make
+ * the syscall if the function was not found in the vDSO
+ */
+__attribute__((visibility("default")))
+long
+syscall_vdso_no_intercept(long syscall_number, long arg0, long arg1,
+			long arg2)
+{
+	for (unsigned i = 0; i < VDSO_FUNCTION_COUNT; ++i) {
+		const struct vdso_function *f = vdso_functions + i;
+
+		if (f->syscall_number != syscall_number)
+			continue;
+
+		if (f->address == 0)
+			break;
+
+		return ((long (*)(long, long, long))f->address)(arg0,
+								arg1, arg2);
+	}
+
+	return syscall_no_intercept(syscall_number, arg0, arg1, arg2);
+}
+
+/*
+ * replace_pointers - replace the pointers to vDSO functions found in the
+ * words between begin and end
+ */
+static void
+replace_pointers(uintptr_t *begin, uintptr_t *end, bool is_read_only)
+{
+	for (uintptr_t *word = begin; word < end; ++word) {
+		for (unsigned i = 0; i < VDSO_FUNCTION_COUNT; ++i) {
+			const struct vdso_function *f = vdso_functions + i;
+
+			if (f->address == 0 || *word != f->address)
+				continue;
+
+			debug_dump("replacing %s pointer at %p\n",
+					f->name, (void *)word);
+
+			unsigned char *page =
+			    round_down_address((unsigned char *)word);
+
+			if (is_read_only)
+				mprotect_no_intercept(page, PAGE_SIZE,
+				    PROT_READ | PROT_WRITE,
+				    "mprotect of vDSO pointer");
+
+			__atomic_store_n(word, f->replacement,
+					__ATOMIC_RELAXED);
+
+			if (is_read_only)
+				mprotect_no_intercept(page, PAGE_SIZE,
+				    PROT_READ, "mprotect of vDSO pointer");
+		}
+	}
+}
+
+/*
+ * is_self - is the object the syscall_intercept library itself?
+ */
+static bool
+is_self(const struct dl_phdr_info *info)
+{
+	uintptr_t self = (uintptr_t)vdso_functions;
+
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) *phdr = info->dlpi_phdr + i;
+		uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+		if (phdr->p_type == PT_LOAD &&
+		    self >= start && self < start + phdr->p_memsz)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * replace_object_pointers - look for pointers to vDSO functions in the
+ * relocated data of an object: in its RELRO segment, and in the file
+ * backed part of its writable segments, where the GOT is.
+ */
+static int
+replace_object_pointers(struct dl_phdr_info *info, size_t size, void *data)
+{
+	(void) size;
+	(void) data;
+
+	if (is_self(info))
+		return 0;
+
+	uintptr_t relro_start = 0;
+	uintptr_t relro_end = 0;
+
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) *phdr = info->dlpi_phdr + i;
+
+		if (phdr->p_type == PT_GNU_RELRO) {
+			relro_start = info->dlpi_addr + phdr->p_vaddr;
+			relro_end = relro_start + phdr->p_memsz;
+			replace_pointers((uintptr_t *)relro_start,
+					(uintptr_t *)relro_end, true);
+		}
+	}
+
+	for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+		const ElfW(Phdr) *phdr = info->dlpi_phdr + i;
+
+		if (phdr->p_type != PT_LOAD || (phdr->p_flags & PF_W) == 0)
+			continue;
+
+		uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+		uintptr_t end = start + phdr->p_filesz;
+
+		start = (start + sizeof(uintptr_t) - 1) &
+				~(sizeof(uintptr_t) - 1);
+
+		if (start >= relro_start && start < relro_end)
+			start = relro_end;
+
+		if (start < end)
+			replace_pointers((uintptr_t *)start,
+					(uintptr_t *)end, false);
+	}
+
+	return 0;
+}
+
+/*
+ * init_vdso_hooks - look up the vDSO functions, and replace the pointers
+ * to them in the objects loaded
+ */
+void
+init_vdso_hooks(void)
+{
+	void *vdso = dlopen("linux-vdso.so.1", RTLD_LAZY | RTLD_NOLOAD);
+
+	if (vdso == NULL) {
+		debug_dump("vDSO not found\n");
+		return;
+	}
+
+	for (unsigned i = 0; i < VDSO_FUNCTION_COUNT; ++i) {
+		vdso_functions[i].address =
+		    (uintptr_t)dlsym(vdso, vdso_functions[i].name);
+	}
+
+	/* The handle of the vDSO is never really closed */
+	dlclose(vdso);
+
+	vdso_hooks_on = true;
+	dl_iterate_phdr(replace_object_pointers, NULL);
+}
+
+/*
+ * replace_new_vdso_pointers - replace the pointers to vDSO functions in
+ * objects loaded after startup
+ */
+void
+replace_new_vdso_pointers(void)
+{
+	if (vdso_hooks_on)
+		dl_iterate_phdr(replace_object_pointers, NULL);
+}
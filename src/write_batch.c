@@ -0,0 +1,426 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * write_batch.c -- coalescing small write syscalls in hooks, see
+ * intercept_write_batch_setup in libsyscall_intercept_hook_point.h
+ *
+ * The data of small writes to an fd with batching enabled is copied to
+ * a buffer, and the write syscalls return without entering the kernel.
+ * The buffered data is written out with a single writev syscall, when
+ * the buffer is full, when the oldest data in it is too old, or before
+ * any syscall referring to the same fd is forwarded to the kernel.
+ */
+
+#include "libsyscall_intercept_hook_point.h"
+#include "intercept.h"
+#include "intercept_util.h"
+#include "syscall_formats.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+/*
+ * struct write_batch - the buffered data of one fd.
+ * All fields except the lock are accessed only while holding the lock.
+ * The buffer is kept when batching is disabled, to be reused if it is
+ * enabled again for the same fd.
+ */
+struct write_batch {
+	uintptr_t lock; /* the lock_owner_id of the thread holding it */
+	char *buffer;
+	size_t buffer_size; /* the size of the mapping */
+	size_t capacity; /* zero while batching is disabled */
+	size_t used;
+	long max_delay_ns;
+	long first_write_ns; /* when the oldest buffered data was written */
+};
+
+static struct write_batch batches[INTERCEPT_WRITE_BATCH_FD_LIMIT];
+
+/* Set once batching is enabled for any fd, never cleared */
+static bool batching_used;
+
+/* The address of this variable identifies a thread holding a lock */
+static __thread char lock_owner_id
+	__attribute__((tls_model("initial-exec")));
+
+static bool
+try_lock(struct write_batch *batch)
+{
+	uintptr_t expected = 0;
+
+	return __atomic_compare_exchange_n(&batch->lock, &expected,
+			(uintptr_t)&lock_owner_id, false,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/*
+ * lock_unless_interrupted - waits for the lock, unless it is held by the
+ * calling thread itself, i.e. a syscall in a signal handler interrupted
+ * the thread while holding the lock. Waiting for the lock in that case
+ * would never end. Returns false in that case, without taking the lock.
+ */
+static bool
+lock_unless_interrupted(struct write_batch *batch)
+{
+	while (!try_lock(batch)) {
+		if (__atomic_load_n(&batch->lock, __ATOMIC_RELAXED) ==
+		    (uintptr_t)&lock_owner_id)
+			return false;
+
+		__builtin_ia32_pause();
+	}
+
+	return true;
+}
+
+static void
+unlock(struct write_batch *batch)
+{
+	__atomic_store_n(&batch->lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct write_batch *
+find_batch(long fd)
+{
+	if (fd < 0 || fd >= INTERCEPT_WRITE_BATCH_FD_LIMIT)
+		return NULL;
+
+	return batches + fd;
+}
+
+/*
+ * flush_locked - write out the buffered data, followed by len bytes
+ * at data, using a single writev syscall if possible.
+ * The buffered data was already reported as written to the application,
+ * so it is written in a loop, until all of it reaches the kernel, or
+ * an error occurs -- in that case it is dropped.
+ * Returns the number of bytes written from data, or a negative error code.
+ */
+static long
+flush_locked(long fd, struct write_batch *batch, const char *data, size_t len)
+{
+	struct iovec iov[2] = {
+		{ .iov_base = batch->buffer, .iov_len = batch->used },
+		{ .iov_base = (void *)data, .iov_len = len }
+	};
+	int iov_count = (len == 0) ? 1 : 2;
+
+	batch->used = 0;
+
+	while (iov[0].iov_len > 0) {
+		long r = syscall_no_intercept(SYS_writev, fd, iov, iov_count);
+
+		if (r == -EINTR)
+			continue;
+
+		if (r <= 0)
+			return (r == 0) ? -EIO : r;
+
+		if ((size_t)r >= iov[0].iov_len)
+			return r - (long)iov[0].iov_len;
+
+		iov[0].iov_base = (char *)iov[0].iov_base + r;
+		iov[0].iov_len -= (size_t)r;
+	}
+
+	if (len == 0)
+		return 0;
+
+	return syscall_no_intercept(SYS_write, fd, data, len);
+}
+
+/*
+ * batch_write - handle a write syscall to an fd with batching enabled.
+ * Returns false, if the syscall should be forwarded to the kernel.
+ */
+static bool
+batch_write(long fd, struct write_batch *batch,
+		const char *data, size_t len, long *result)
+{
+	if (batch->capacity == 0 || len == 0)
+		return false;
+
+	if (len > batch->capacity - batch->used) {
+		*result = flush_locked(fd, batch, data, len);
+		return true;
+	}
+
+	long now = 0;
+
+	if (batch->max_delay_ns != 0) {
+		now = now_ns();
+		if (batch->used == 0)
+			batch->first_write_ns = now;
+	}
+
+	copy_bytes(batch->buffer + batch->used, data, len);
+	batch->used += len;
+	*result = (long)len;
+
+	if (batch->used == batch->capacity ||
+	    (batch->max_delay_ns != 0 &&
+	    now - batch->first_write_ns >= batch->max_delay_ns))
+		(void) flush_locked(fd, batch, NULL, 0);
+
+	return true;
+}
+
+/*
+ * flush_fd - write out the data buffered for an fd, and optionally
+ * disable batching for it. In a signal handler interrupting the thread
+ * writing to the same fd, nothing is done, and -EAGAIN is returned: the
+ * syscall in the handler is executed directly, and the data buffered so
+ * far is written after it.
+ */
+static long
+flush_fd(long fd, bool disable)
+{
+	struct write_batch *batch = find_batch(fd);
+	long r = 0;
+
+	if (batch == NULL)
+		return 0;
+
+	if (!lock_unless_interrupted(batch))
+		return -EAGAIN;
+
+	if (batch->used > 0)
+		r = flush_locked(fd, batch, NULL, 0);
+
+	if (disable)
+		batch->capacity = 0;
+
+	unlock(batch);
+
+	return r;
+}
+
+/*
+ * is_flush_all_syscall - syscalls before which all fds must be flushed:
+ * the process might terminate, or might be duplicated
+ */
+static bool
+is_flush_all_syscall(long syscall_number)
+{
+	switch (syscall_number) {
+		case SYS_exit:
+		case SYS_exit_group:
+		case SYS_execve:
+#ifdef SYS_execveat
+		case SYS_execveat:
+#endif
+		case SYS_fork:
+		case SYS_vfork:
+		case SYS_clone:
+#ifdef SYS_clone3
+		case SYS_clone3:
+#endif
+		case SYS_sync:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * intercept_write_batch_setup - enable, or disable batching for an fd.
+ * A buffer is allocated when batching is first enabled with a given
+ * size, using syscall_no_intercept, as this might be called from a hook.
+ */
+__attribute__((visibility("default")))
+int
+intercept_write_batch_setup(int fd, size_t size, long max_delay_ns)
+{
+	struct write_batch *batch = find_batch(fd);
+	char *old_buffer = NULL;
+	size_t old_size = 0;
+
+	if (batch == NULL || max_delay_ns < 0)
+		return -1;
+
+	if (size == 0)
+		return flush_fd(fd, true) < 0 ? -1 : 0;
+
+	size_t map_size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	long new_buffer = 0;
+
+	if (map_size > batch->buffer_size) {
+		new_buffer = syscall_no_intercept(SYS_mmap, NULL, map_size,
+					PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_ANON, -1, (off_t)0);
+
+		if (syscall_error_code(new_buffer) != 0)
+			return -1;
+	}
+
+	if (!lock_unless_interrupted(batch)) {
+		if (new_buffer != 0)
+			syscall_no_intercept(SYS_munmap, new_buffer, map_size);
+		return -1;
+	}
+
+	if (batch->used > 0)
+		(void) flush_locked(fd, batch, NULL, 0);
+
+	if (new_buffer != 0 && map_size > batch->buffer_size) {
+		old_buffer = batch->buffer;
+		old_size = batch->buffer_size;
+		__atomic_store_n(&batch->buffer, (char *)new_buffer,
+				__ATOMIC_RELAXED);
+		batch->buffer_size = map_size;
+	} else if (new_buffer != 0) {
+		/* another thread allocated a large enough buffer meanwhile */
+		old_buffer = (char *)new_buffer;
+		old_size = map_size;
+	}
+
+	batch->capacity = size;
+	batch->max_delay_ns = max_delay_ns;
+	__atomic_store_n(&batching_used, true, __ATOMIC_RELAXED);
+
+	unlock(batch);
+
+	if (old_buffer != NULL)
+		syscall_no_intercept(SYS_munmap, old_buffer, old_size);
+
+	return 0;
+}
+
+/*
+ * intercept_write_batch_flush - write out the buffered data of an fd,
+ * or of all fds
+ */
+__attribute__((visibility("default")))
+int
+intercept_write_batch_flush(int fd)
+{
+	int r = 0;
+
+	if (fd >= 0)
+		return flush_fd(fd, false) < 0 ? -1 : 0;
+
+	if (!__atomic_load_n(&batching_used, __ATOMIC_RELAXED))
+		return 0;
+
+	for (int i = 0; i < INTERCEPT_WRITE_BATCH_FD_LIMIT; ++i) {
+		char *buffer = __atomic_load_n(&batches[i].buffer,
+						__ATOMIC_RELAXED);
+
+		if (buffer != NULL && flush_fd(i, false) < 0)
+			r = -1;
+	}
+
+	return r;
+}
+
+/*
+ * intercept_write_batch_hook - the hook function doing the batching,
+ * with the same interface as intercept_hook_point.
+ */
+__attribute__((visibility("default")))
+int
+intercept_write_batch_hook(long syscall_number,
+			long arg0, long arg1,
+			long arg2, long arg3,
+			long arg4, long arg5,
+			long *result)
+{
+	if (!__atomic_load_n(&batching_used, __ATOMIC_RELAXED))
+		return 1;
+
+	if (syscall_number == SYS_write) {
+		struct write_batch *batch = find_batch(arg0);
+		bool done;
+
+		/*
+		 * A write syscall from a signal handler interrupting a thread
+		 * holding the lock must not wait for the lock.
+		 */
+		if (batch == NULL || !try_lock(batch))
+			return 1;
+
+		done = batch_write(arg0, batch,
+				(const char *)(uintptr_t)arg1, (size_t)arg2,
+				result);
+
+		if (!done && batch->used > 0)
+			(void) flush_locked(arg0, batch, NULL, 0);
+
+		unlock(batch);
+
+		return done ? 0 : 1;
+	}
+
+	if (is_flush_all_syscall(syscall_number)) {
+		(void) intercept_write_batch_flush(-1);
+		return 1;
+	}
+
+	/*
+	 * Any other syscall referring to an fd with buffered data is a
+	 * barrier, the data must be written before the syscall is executed.
+	 * An fd closed, or replaced by dup2 or dup3 is no longer batched.
+	 */
+	struct syscall_desc desc = {
+		.nr = (int)syscall_number,
+		.args = { arg0, arg1, arg2, arg3, arg4, arg5 }
+	};
+	const struct syscall_format *format = get_syscall_format(&desc);
+
+	for (unsigned i = 0; i < ARRAY_SIZE(desc.args); ++i) {
+		if (format->args[i] == arg_none)
+			break;
+
+		if (format->args[i] != arg_fd && format->args[i] != arg_atfd)
+			continue;
+
+		struct write_batch *batch = find_batch(desc.args[i]);
+
+		if (batch == NULL ||
+		    __atomic_load_n(&batch->buffer, __ATOMIC_RELAXED) == NULL)
+			continue;
+
+		bool disable = (syscall_number == SYS_close) ||
+			(i == 1 && (syscall_number == SYS_dup2 ||
+				syscall_number == SYS_dup3));
+
+		(void) flush_fd(desc.args[i], disable);
+	}
+
+	return 1;
+}
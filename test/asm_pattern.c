@@ -191,8 +191,6 @@ main(int argc, char **argv)
 	 * file.
 	 */
 	struct intercept_desc patches;
-	static unsigned char builtin_wrapper_space[0x10000];
-	unsigned char *asm_wrapper_address = builtin_wrapper_space;
 	init_patcher();
 
 	/*
@@ -208,8 +206,8 @@ main(int argc, char **argv)
 
 	/* perform the actually patching */
 	find_syscalls(&patches);
-	create_patch_wrappers(&patches, &asm_wrapper_address);
-	mprotect_asm_wrappers();
+	create_patch_wrappers(&patches);
+	mprotect_asm_wrappers(&patches);
 	activate_patches(&patches);
 
 	int exit_code = EXIT_SUCCESS;
@@ -223,10 +221,10 @@ main(int argc, char **argv)
 	}
 
 	if (lib_out.asm_wrapper_start != NULL &&
-		memcmp(builtin_wrapper_space, lib_out.asm_wrapper_start,
+		memcmp(patches.items[0].asm_wrapper, lib_out.asm_wrapper_start,
 		lib_out.asm_wrapper_end - lib_out.asm_wrapper_start) != 0) {
 		fputs("Invalid asm wrapper\n", stderr);
-		print_hex_diff(builtin_wrapper_space,
+		print_hex_diff(patches.items[0].asm_wrapper,
 			lib_out.asm_wrapper_start,
 			lib_out.asm_wrapper_end - lib_out.asm_wrapper_start);
 		exit_code = EXIT_FAILURE;
@@ -47,14 +47,91 @@ else()
 endif()
 endif()
 
-endif()
-
 if(INTERCEPT_ALL)
 	set(ENV{INTERCEPT_ALL_OBJS} 1)
 else()
 	unset(ENV{INTERCEPT_ALL_OBJS})
 endif()
 
+if(PATCH_DLOPEN)
+	set(ENV{INTERCEPT_PATCH_DLOPEN} 1)
+else()
+	unset(ENV{INTERCEPT_PATCH_DLOPEN})
+endif()
+
+if(PATCH_OBJS)
+	set(ENV{INTERCEPT_PATCH_OBJS} ${PATCH_OBJS})
+else()
+	unset(ENV{INTERCEPT_PATCH_OBJS})
+endif()
+
+if(SKIP_OBJS)
+	set(ENV{INTERCEPT_SKIP_OBJS} ${SKIP_OBJS})
+else()
+	unset(ENV{INTERCEPT_SKIP_OBJS})
+endif()
+
+if(STATS_FILE)
+	set(ENV{INTERCEPT_STATS} ${STATS_FILE})
+	set(ENV{INTERCEPT_STATS_SIGNAL} ${STATS_SIGNAL})
+	file(REMOVE ${STATS_FILE})
+else()
+	unset(ENV{INTERCEPT_STATS})
+	unset(ENV{INTERCEPT_STATS_SIGNAL})
+endif()
+
+if(STATS_SITES)
+	set(ENV{INTERCEPT_STATS_SITES} ${STATS_SITES})
+else()
+	unset(ENV{INTERCEPT_STATS_SITES})
+endif()
+
+if(STARTUP_TIMES_LOG)
+	set(ENV{INTERCEPT_STARTUP_TIMES} log)
+	set(ENV{INTERCEPT_LOG} ${STARTUP_TIMES_LOG})
+	file(REMOVE ${STARTUP_TIMES_LOG})
+else()
+	unset(ENV{INTERCEPT_STARTUP_TIMES})
+endif()
+
+if(TOGGLE_SIGNAL)
+	set(ENV{INTERCEPT_TOGGLE_SIGNAL} ${TOGGLE_SIGNAL})
+else()
+	unset(ENV{INTERCEPT_TOGGLE_SIGNAL})
+endif()
+
+if(SYSCALL_DISPATCH)
+	set(ENV{INTERCEPT_SYSCALL_DISPATCH} 1)
+else()
+	unset(ENV{INTERCEPT_SYSCALL_DISPATCH})
+endif()
+
+if(PATCH_SYSCALLS)
+	set(ENV{INTERCEPT_PATCH_SYSCALLS} ${PATCH_SYSCALLS})
+else()
+	unset(ENV{INTERCEPT_PATCH_SYSCALLS})
+endif()
+
+if(PATCH_COVERAGE_LOG)
+	set(ENV{INTERCEPT_PATCH_COVERAGE} log)
+	set(ENV{INTERCEPT_LOG} ${PATCH_COVERAGE_LOG})
+	file(REMOVE ${PATCH_COVERAGE_LOG})
+else()
+	unset(ENV{INTERCEPT_PATCH_COVERAGE})
+endif()
+
+if(PATH_FILTER)
+	set(ENV{INTERCEPT_PATH_FILTER} ${PATH_FILTER})
+else()
+	unset(ENV{INTERCEPT_PATH_FILTER})
+endif()
+
+if(HOOK_VDSO)
+	set(ENV{INTERCEPT_VDSO} 1)
+else()
+	unset(ENV{INTERCEPT_VDSO})
+endif()
+
 execute_process(COMMAND ${TEST_PROG} ${TEST_PROG_ARGS} RESULT_VARIABLE HAD_ERROR)
 
 unset(ENV{LD_PRELOAD})
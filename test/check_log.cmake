@@ -37,6 +37,59 @@ execute_process(COMMAND ${CMAKE_COMMAND} -E remove -f ${LOG_OUTPUT})
 
 set(ENV{INTERCEPT_ALL_OBJS} 1)
 
+if(PATCH_SYSCALLS)
+	set(ENV{INTERCEPT_PATCH_SYSCALLS} ${PATCH_SYSCALLS})
+endif()
+
+if(LOG_BUFFERED)
+	set(ENV{INTERCEPT_LOG_BUFFERED} 1)
+endif()
+
+if(DISASM_THREADS)
+	set(ENV{INTERCEPT_DISASM_THREADS} ${DISASM_THREADS})
+endif()
+
+if(LOG_FORMAT)
+	set(ENV{INTERCEPT_LOG_FORMAT} ${LOG_FORMAT})
+endif()
+
+if(HUGE_PAGES)
+	set(ENV{INTERCEPT_HUGE_PAGES} 1)
+endif()
+
+if(LOG_BUFFERS)
+	set(ENV{INTERCEPT_LOG_BUFFERS} ${LOG_BUFFERS})
+endif()
+
+if(SHM_READER)
+	set(SHM_OUTPUT ${LOG_OUTPUT}.shm)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E remove -f ${SHM_OUTPUT})
+	set(ENV{INTERCEPT_LOG_SHM} ${SHM_OUTPUT})
+endif()
+
+if(DISASM_CACHE)
+	# a first run of the program, to fill the cache used by the second one
+	set(CACHE_DIR ${LOG_OUTPUT}.cache)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E remove_directory ${CACHE_DIR})
+	execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory ${CACHE_DIR})
+	set(ENV{INTERCEPT_DISASM_CACHE} ${CACHE_DIR})
+	if(TEST_EXTRA_PRELOAD)
+		set(ENV{LD_PRELOAD} ${TEST_EXTRA_PRELOAD}:${LIB_FILE})
+	else()
+		set(ENV{LD_PRELOAD} ${LIB_FILE})
+	endif()
+	execute_process(COMMAND ${TEST_PROG} ${TEST_PROG_ARG} ${LOG_OUTPUT}
+		RESULT_VARIABLE HAD_ERROR)
+	unset(ENV{LD_PRELOAD})
+	if(HAD_ERROR)
+		message(FATAL_ERROR "Test failed while filling the cache: ${HAD_ERROR}")
+	endif()
+	file(GLOB CACHE_FILES ${CACHE_DIR}/*.disasm)
+	if(NOT CACHE_FILES)
+		message(FATAL_ERROR "No disasm cache files created in ${CACHE_DIR}")
+	endif()
+endif()
+
 if(HAS_SECOND_LOG)
 	set(SECOND_LOG_OUTPUT .log.2.${TEST_NAME})
 	execute_process(COMMAND ${CMAKE_COMMAND} -E remove -f ${SECOND_LOG_OUTPUT})
@@ -73,6 +126,29 @@ if(HAD_ERROR)
 	message(FATAL_ERROR "Test failed: ${HAD_ERROR}")
 endif()
 
+if(SHM_READER)
+	# the contents of the ring buffer are expected to be the same as
+	# those of a log file
+	execute_process(COMMAND ${SHM_READER} -n ${SHM_OUTPUT} ${LOG_OUTPUT}
+		RESULT_VARIABLE READER_ERROR)
+
+	if(READER_ERROR)
+		message(FATAL_ERROR "Reading the ring buffer failed: ${READER_ERROR}")
+	endif()
+endif()
+
+if(LOG_DECODER)
+	# the binary log is converted to text, and that is matched
+	execute_process(COMMAND ${LOG_DECODER} ${LOG_OUTPUT} ${LOG_OUTPUT}.txt
+		RESULT_VARIABLE DECODER_ERROR)
+
+	if(DECODER_ERROR)
+		message(FATAL_ERROR "Decoding the log failed: ${DECODER_ERROR}")
+	endif()
+
+	set(LOG_OUTPUT ${LOG_OUTPUT}.txt)
+endif()
+
 if(NOT EXPECT_SPURIOUS_SYSCALLS)
 	execute_process(COMMAND
 		${MATCH_SCRIPT} -o ${LOG_OUTPUT} ${MATCH_FILE}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * clone3.c -- checks that clone3 syscalls reach the hook, that a clone3
+ * creating a child process without a new stack is executed, and that
+ * a clone3 asking for a new stack is answered with ENOSYS.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define CHILD_STATUS 7
+
+/*
+ * struct clone_args as an array of 64 bit fields: flags, pidfd, child_tid,
+ * parent_tid, exit_signal, stack, stack_size, tls, ...
+ */
+#define CLONE_ARGS_COUNT 8
+#define CLONE_ARGS_EXIT_SIGNAL 4
+#define CLONE_ARGS_STACK 5
+#define CLONE_ARGS_STACK_SIZE 6
+
+static volatile int clone3_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+#ifdef SYS_clone3
+	if (syscall_number == SYS_clone3)
+		++clone3_count;
+#else
+	(void) syscall_number;
+#endif
+
+	return 1;
+}
+
+int
+main(void)
+{
+#ifdef SYS_clone3
+	static char stack[0x10000];
+	uint64_t args[CLONE_ARGS_COUNT];
+	int status;
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = hook;
+
+	memset(args, 0, sizeof(args));
+	args[CLONE_ARGS_EXIT_SIGNAL] = SIGCHLD;
+
+	long pid = syscall(SYS_clone3, args, sizeof(args));
+
+	assert(pid >= 0);
+	if (pid == 0)
+		_exit(CHILD_STATUS);
+
+	assert(clone3_count == 1);
+	assert(waitpid((pid_t)pid, &status, 0) == (pid_t)pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == CHILD_STATUS);
+
+	args[CLONE_ARGS_STACK] = (uintptr_t)stack;
+	args[CLONE_ARGS_STACK_SIZE] = sizeof(stack);
+
+	errno = 0;
+	assert(syscall(SYS_clone3, args, sizeof(args)) == -1);
+	assert(errno == ENOSYS);
+	assert(clone3_count == 2);
+#endif
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fd_owner.c -- checks the table of fds owned by hooks, and that only
+ * the syscalls referring to owned fds are passed to the hook, among the
+ * syscalls with fd arguments, while the filter is enabled.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static int hook_counts[INTERCEPT_HOOK_TABLE_SIZE];
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number >= 0 && syscall_number < INTERCEPT_HOOK_TABLE_SIZE)
+		++hook_counts[syscall_number];
+
+	return 1;
+}
+
+int
+main(void)
+{
+	int fds[2];
+	char c;
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	assert(intercept_fd_owner_get(3) == 0);
+	assert(intercept_fd_owner_set(-1, 1) == -1);
+	assert(intercept_fd_owner_set(INTERCEPT_FD_OWNER_LIMIT, 1) == -1);
+	assert(intercept_fd_owner_set(3, -1) == -1);
+	assert(intercept_fd_owner_get(INTERCEPT_FD_OWNER_LIMIT) == 0);
+
+	assert(pipe(fds) == 0);
+	assert(intercept_fd_owner_set(fds[0], 7) == 0);
+	assert(intercept_fd_owner_get(fds[0]) == 7);
+	assert(intercept_fd_owner_get(fds[1]) == 0);
+
+	intercept_hook_point = hook;
+
+	/* without the filter, every syscall is passed to the hook */
+	assert(write(fds[1], "x", 1) == 1);
+	assert(hook_counts[SYS_write] == 1);
+
+	assert(intercept_fd_owner_filter(1) == 0);
+
+	assert(write(fds[1], "x", 1) == 1);
+	assert(hook_counts[SYS_write] == 1);
+
+	assert(read(fds[0], &c, 1) == 1);
+	assert(hook_counts[SYS_read] == 1);
+
+	(void) getppid();
+	assert(hook_counts[SYS_getppid] == 1);
+
+	int fd = open("/dev/null", O_RDONLY);
+
+	assert(fd >= 0);
+	assert(hook_counts[SYS_open] + hook_counts[SYS_openat] == 1);
+
+	assert(close(fd) == 0);
+	assert(hook_counts[SYS_close] == 0);
+
+	/* the path of an *at syscall is not read by the filter */
+	int dir = open("/", O_RDONLY | O_DIRECTORY);
+
+	assert(dir >= 0);
+	errno = 0;
+	assert(syscall(SYS_openat, dir, (const char *)8, O_RDONLY) == -1);
+	assert(errno == EFAULT);
+	assert(hook_counts[SYS_open] + hook_counts[SYS_openat] == 3);
+	assert(close(dir) == 0);
+
+	assert(intercept_fd_owner_set(fds[0], 0) == 0);
+	assert(read(fds[0], &c, 1) == 1);
+	assert(hook_counts[SYS_read] == 1);
+
+	assert(intercept_fd_owner_filter(0) == 1);
+
+	assert(close(fds[0]) == 0);
+	assert(hook_counts[SYS_close] == 1);
+
+	return EXIT_SUCCESS;
+}
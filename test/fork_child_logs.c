@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fork_child_logs.c - a child process is expected to switch to a log of
+ * its own, when the path of the log ends with a '-' character. Each process
+ * writes a marker to an invalid fd, and only that processes log is expected
+ * to contain its marker.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "magic_syscalls.h"
+
+static const char parent_marker[] = "fork_child_logs_parent";
+static const char child_marker[] = "fork_child_logs_child";
+
+static char log_contents[0x10000];
+
+static void
+read_log(const char *prefix, pid_t pid)
+{
+	char path[0x1000];
+
+	snprintf(path, sizeof(path), "%s%d", prefix, (int)pid);
+
+	int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+
+	ssize_t size = read(fd, log_contents, sizeof(log_contents) - 1);
+	assert(size > 0);
+	log_contents[size] = '\0';
+
+	close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		return EXIT_FAILURE;
+
+	magic_syscall_start_log(argv[1], "1");
+
+	pid_t child = fork();
+	assert(child >= 0);
+
+	if (child == 0) {
+		assert(write(-1, child_marker, sizeof(child_marker)) < 0);
+		exit(EXIT_SUCCESS);
+	}
+
+	int status;
+	assert(waitpid(child, &status, 0) == child);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	assert(write(-1, parent_marker, sizeof(parent_marker)) < 0);
+
+	magic_syscall_stop_log();
+
+	read_log(argv[1], getpid());
+	assert(strstr(log_contents, parent_marker) != NULL);
+	assert(strstr(log_contents, child_marker) == NULL);
+
+	read_log(argv[1], child);
+	assert(strstr(log_contents, child_marker) != NULL);
+	assert(strstr(log_contents, parent_marker) == NULL);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hook_chain.c -- checks the order in which the hooks in the chain are
+ * called, that each one is only called for the syscalls in its mask, and
+ * that no hook is called after one emulating a syscall. The post hooks are
+ * expected to be called only for the hooks asking for them.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define FAKE_UID 4242
+
+static volatile char calls[16];
+static volatile int call_count;
+
+static void
+record_call(char hook_name, long syscall_number)
+{
+	if (syscall_number != SYS_getppid && syscall_number != SYS_getuid)
+		return;
+
+	assert(call_count < (int)sizeof(calls) - 1);
+	calls[call_count++] = hook_name;
+}
+
+static void
+reset_calls(void)
+{
+	for (int i = 0; i < (int)sizeof(calls); ++i)
+		calls[i] = '\0';
+	call_count = 0;
+}
+
+/* emulates getuid, only asks for getppid and getuid */
+static int
+hook_b(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('b', syscall_number);
+	if (syscall_number == SYS_getuid) {
+		*result = FAKE_UID;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* only asks for getppid */
+static int
+hook_a(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('a', syscall_number);
+	assert(syscall_number == SYS_getppid);
+
+	return 1;
+}
+
+/* asks for every syscall */
+static int
+hook_c(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('c', syscall_number);
+	return 1;
+}
+
+/* the catch-all hook */
+static int
+hook_l(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('l', syscall_number);
+	return 1;
+}
+
+/* asks for the result of getppid, for its own post hook */
+static int
+hook_p(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('p', syscall_number);
+	return INTERCEPT_HOOK_FORWARD_POST;
+}
+
+static void
+post_p(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+
+	record_call('P', syscall_number);
+	assert(*result == syscall_no_intercept(SYS_getppid));
+}
+
+/* has a post hook, but does not ask for it */
+static void
+post_c(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('C', syscall_number);
+}
+
+/* intercept_hook_point_post, asked for by hook_p without a post hook */
+static void
+post_global(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	record_call('G', syscall_number);
+}
+
+static void
+set_mask_bit(unsigned long *mask, long syscall_number)
+{
+	mask[syscall_number / 64] |= 1UL << (syscall_number % 64);
+}
+
+static int
+compare(const volatile char *a, const char *b)
+{
+	while (*a != '\0' && *a == *b) {
+		++a;
+		++b;
+	}
+
+	return *a - *b;
+}
+
+int
+main(void)
+{
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	long ppid = syscall_no_intercept(SYS_getppid);
+	long uid = syscall_no_intercept(SYS_getuid);
+	unsigned long mask_a[INTERCEPT_HOOK_MASK_WORDS] = {0, };
+	unsigned long mask_b[INTERCEPT_HOOK_MASK_WORDS] = {0, };
+
+	set_mask_bit(mask_a, SYS_getppid);
+	set_mask_bit(mask_b, SYS_getppid);
+	set_mask_bit(mask_b, SYS_getuid);
+
+	assert(intercept_hook_point_chain_add(0, NULL, NULL) == -1);
+	assert(intercept_hook_point_chain_remove(hook_a) == -1);
+
+	intercept_hook_point = hook_l;
+	assert(intercept_hook_point_chain_add(10, mask_a, hook_a) == 0);
+	assert(intercept_hook_point_chain_add(10, NULL, hook_c) == 0);
+	assert(intercept_hook_point_chain_add(20, mask_b, hook_b) == 0);
+
+	/* ordered by priority, then by the order of adding them */
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "bacl") == 0);
+
+	/* hook_b emulates getuid, hook_a doesn't ask for it */
+	reset_calls();
+	assert(getuid() == FAKE_UID);
+	assert(compare(calls, "b") == 0);
+
+	assert(intercept_hook_point_chain_remove(hook_b) == 0);
+	assert(intercept_hook_point_chain_remove(hook_b) == -1);
+
+	reset_calls();
+	assert(getuid() == uid);
+	assert(compare(calls, "cl") == 0);
+
+	/* a hook registered for a single syscall replaces the chain */
+	assert(intercept_hook_point_register(SYS_getppid, hook_b) == 0);
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "b") == 0);
+	assert(intercept_hook_point_register(SYS_getppid, NULL) == 0);
+
+	assert(intercept_hook_point_chain_remove(hook_a) == 0);
+	assert(intercept_hook_point_chain_remove(hook_c) == 0);
+
+	/* only the catch-all hook is left */
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "l") == 0);
+
+	/* the post hooks, in reverse order */
+	intercept_hook_point_post = post_global;
+	assert(intercept_hook_point_chain_add_post(30, mask_a,
+				hook_p, post_p) == 0);
+	assert(intercept_hook_point_chain_add_post(10, NULL,
+				hook_c, post_c) == 0);
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "pclP") == 0);
+
+	/* added without a post hook, asking for intercept_hook_point_post */
+	assert(intercept_hook_point_chain_add(20, mask_a, hook_p) == 0);
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "ppclGP") == 0);
+
+	assert(intercept_hook_point_chain_remove(hook_p) == 0);
+	assert(intercept_hook_point_chain_remove(hook_p) == 0);
+	reset_calls();
+	assert(getppid() == ppid);
+	assert(compare(calls, "cl") == 0);
+	assert(intercept_hook_point_chain_remove(hook_c) == 0);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * hook_post.c -- checks that intercept_hook_point_post is called with the
+ * result of a syscall, when the hook called before the syscall returns
+ * INTERCEPT_HOOK_FORWARD_POST, and only then.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define FAKE_PPID 12345
+
+static volatile int post_count;
+static volatile long post_result;
+static bool replace_result;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		return INTERCEPT_HOOK_FORWARD_POST;
+
+	return 1;
+}
+
+static void
+post_hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+
+	assert(syscall_number == SYS_getppid);
+
+	++post_count;
+	post_result = *result;
+
+	if (replace_result)
+		*result = FAKE_PPID;
+}
+
+int
+main(void)
+{
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	long ppid = syscall_no_intercept(SYS_getppid);
+
+	intercept_hook_point = hook;
+
+	/* no post hook set yet */
+	assert(getppid() == ppid);
+
+	intercept_hook_point_post = post_hook;
+
+	(void) getpid();
+	assert(post_count == 0);
+
+	assert(getppid() == ppid);
+	assert(post_count == 1);
+	assert(post_result == ppid);
+
+	replace_result = true;
+	assert(getppid() == FAKE_PPID);
+	assert(post_count == 2);
+	assert(post_result == ppid);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * patch_coverage.c -- checks the patch coverage report written to the log,
+ * with INTERCEPT_PATCH_COVERAGE set to "log". The path of the log is
+ * expected in argv[1]. The library built from pattern_double_syscall.in.S
+ * is expected to be preloaded and patched, its syscalls can not be patched.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char buffer[0x10000];
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		return EXIT_FAILURE;
+
+	int fd = open(argv[1], O_RDONLY);
+	assert(fd >= 0);
+
+	ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+	assert(size > 0);
+	buffer[size] = '\0';
+	close(fd);
+
+	char path[0x100];
+	unsigned syscalls;
+	unsigned unselected;
+	unsigned nop;
+	unsigned surrounding;
+	unsigned prev_ins;
+	unsigned prev_ins_2;
+	unsigned next_ins;
+	unsigned unpatchable;
+	unsigned long code_bytes;
+	bool libc_seen = false;
+	bool pattern_seen = false;
+
+	for (char *line = strstr(buffer, "patch_coverage /"); line != NULL;
+	    line = strstr(line + 1, "patch_coverage /")) {
+		assert(sscanf(line, "patch_coverage %255s syscalls %u "
+			"unselected %u nop %u surrounding %u prev_ins %u "
+			"prev_ins_2 %u next_ins %u unpatchable %u "
+			"code_bytes %lu",
+			path, &syscalls, &unselected, &nop, &surrounding,
+			&prev_ins, &prev_ins_2, &next_ins, &unpatchable,
+			&code_bytes) == 10);
+		assert(syscalls ==
+		    unselected + nop + surrounding + unpatchable);
+		assert(prev_ins <= surrounding);
+		assert(prev_ins_2 <= prev_ins);
+		assert(next_ins <= surrounding);
+		assert(code_bytes >= 7 * nop);
+
+		if (strstr(path, "/libc.") != NULL) {
+			libc_seen = true;
+			assert(unselected > 0);
+			assert(nop + surrounding > 0);
+			assert(unpatchable == 0);
+		}
+
+		if (strstr(path, "pattern_double_syscall") != NULL) {
+			pattern_seen = true;
+			assert(syscalls == 2);
+			assert(unpatchable == 2);
+		}
+	}
+
+	assert(libc_seen);
+	assert(pattern_seen);
+
+	unsigned count = 0;
+	unsigned long offset;
+	char status[3][0x20];
+
+	for (char *line = strstr(buffer, "patch_coverage unpatchable ");
+	    line != NULL;
+	    line = strstr(line + 1, "patch_coverage unpatchable ")) {
+		assert(sscanf(line, "patch_coverage unpatchable %255s 0x%lx "
+			"prev_ins_2 %31s prev_ins %31s next_ins %31s",
+			path, &offset, status[0], status[1], status[2]) == 5);
+		assert(strstr(path, "pattern_double_syscall") != NULL);
+		++count;
+	}
+
+	assert(count == 2);
+
+	return EXIT_SUCCESS;
+}
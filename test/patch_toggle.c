@@ -0,0 +1,221 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * patch_toggle.c -- checks that no syscall is intercepted while the
+ * patches are disabled using intercept_patches_enable, and that the
+ * patches can be toggled while other threads are making syscalls, or are
+ * blocked in a syscall. The application's own SIGTRAP handler must keep
+ * working. When the path of library_with_syscall is passed in argv[1], and
+ * INTERCEPT_PATCH_DLOPEN is set, the library is loaded while the patches
+ * are disabled, and its syscall is expected to be intercepted only after
+ * the patches are enabled.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define THREAD_COUNT 4
+#define TOGGLE_COUNT 200
+
+static long getppid_count;
+static bool is_done;
+static int pipe_fds[2];
+static volatile int trap_count;
+static long dlopen_write_count;
+
+static const char dlopen_msg[] = "write_with_syscall\n";
+
+static void
+trap_handler(int sig)
+{
+	(void) sig;
+	++trap_count;
+}
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+
+	if (syscall_number == SYS_getppid)
+		__atomic_add_fetch(&getppid_count, 1, __ATOMIC_RELAXED);
+
+	if (syscall_number == SYS_write && arg1 == (long)dlopen_msg) {
+		__atomic_add_fetch(&dlopen_write_count, 1, __ATOMIC_RELAXED);
+		*result = arg2;
+		return 0;
+	}
+
+	return 1;
+}
+
+static void *
+getppid_loop(void *arg)
+{
+	(void) arg;
+
+	while (!__atomic_load_n(&is_done, __ATOMIC_RELAXED))
+		assert(getppid() == getppid());
+
+	return NULL;
+}
+
+static void *
+blocking_read(void *arg)
+{
+	char c;
+
+	(void) arg;
+
+	assert(read(pipe_fds[0], &c, 1) == 1);
+	assert(c == 'x');
+
+	return NULL;
+}
+
+static long
+count_getppid(void)
+{
+	long before = __atomic_load_n(&getppid_count, __ATOMIC_RELAXED);
+
+	(void) getppid();
+
+	return __atomic_load_n(&getppid_count, __ATOMIC_RELAXED) - before;
+}
+
+static void
+check_dlopen(const char *path)
+{
+	void (*write_with_syscall)(const char *, size_t);
+
+	assert(intercept_patches_enable(0) == 1);
+
+	void *lib = dlopen(path, RTLD_NOW);
+	assert(lib != NULL);
+
+	*(void **)&write_with_syscall = dlsym(lib, "write_with_syscall");
+	assert(write_with_syscall != NULL);
+
+	write_with_syscall(dlopen_msg, sizeof(dlopen_msg) - 1);
+	assert(__atomic_load_n(&dlopen_write_count, __ATOMIC_RELAXED) == 0);
+
+	assert(intercept_patches_enable(1) == 0);
+
+	write_with_syscall(dlopen_msg, sizeof(dlopen_msg) - 1);
+	assert(__atomic_load_n(&dlopen_write_count, __ATOMIC_RELAXED) == 1);
+
+	assert(intercept_patches_enable(0) == 1);
+
+	write_with_syscall(dlopen_msg, sizeof(dlopen_msg) - 1);
+	assert(__atomic_load_n(&dlopen_write_count, __ATOMIC_RELAXED) == 1);
+
+	assert(intercept_patches_enable(1) == 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	pthread_t threads[THREAD_COUNT];
+	pthread_t reader;
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = hook;
+
+	assert(signal(SIGTRAP, trap_handler) != SIG_ERR);
+
+	assert(count_getppid() == 1);
+
+	assert(intercept_patches_enable(0) == 1);
+	assert(intercept_patches_enable(0) == 0);
+	assert(count_getppid() == 0);
+
+	assert(intercept_patches_enable(1) == 0);
+	assert(intercept_patches_enable(1) == 1);
+	assert(count_getppid() == 1);
+
+	if (argc > 1)
+		check_dlopen(argv[1]);
+
+	/* enable the patches while a thread is blocked in unpatched code */
+	assert(pipe(pipe_fds) == 0);
+	assert(intercept_patches_enable(0) == 1);
+	assert(pthread_create(&reader, NULL, blocking_read, NULL) == 0);
+	usleep(100000);
+	assert(intercept_patches_enable(1) == 0);
+	assert(write(pipe_fds[1], "x", 1) == 1);
+	assert(pthread_join(reader, NULL) == 0);
+
+	for (int i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_create(threads + i, NULL,
+					getppid_loop, NULL) == 0);
+
+	for (int i = 0; i < TOGGLE_COUNT; ++i) {
+		assert(intercept_patches_enable(i % 2) == (i + 1) % 2);
+		usleep(100);
+	}
+
+	__atomic_store_n(&is_done, true, __ATOMIC_RELAXED);
+
+	for (int i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_join(threads[i], NULL) == 0);
+
+	assert(count_getppid() == 1);
+
+	assert(signal(SIGTRAP, trap_handler) == trap_handler);
+	assert(raise(SIGTRAP) == 0);
+	assert(trap_count == 1);
+
+	return EXIT_SUCCESS;
+}
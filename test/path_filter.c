@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * path_filter.c -- checks that only the syscalls on paths under the
+ * prefixes added to the filter are passed to the hook, and the syscalls
+ * with relative paths. The paths are compared in normalized form, and an
+ * invalid path pointer must be reported as EFAULT. The prefix /proc/self
+ * is expected to be listed in the INTERCEPT_PATH_FILTER environment
+ * variable.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static volatile int path_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) syscall_number;
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	++path_count;
+
+	return 1;
+}
+
+/*
+ * count_hooks - the number of syscalls passed to the hook, while checking
+ * whether the path exists
+ */
+static int
+count_hooks(const char *path)
+{
+	int before = path_count;
+
+	(void) access(path, F_OK);
+
+	return path_count - before;
+}
+
+int
+main(void)
+{
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = hook;
+
+	assert(count_hooks("/proc/self") == 1);
+	assert(count_hooks("/proc/self/maps") == 1);
+	assert(count_hooks("/proc/selfish") == 0);
+	assert(count_hooks("/proc") == 0);
+	assert(count_hooks("/dev/null") == 0);
+	assert(count_hooks("relative/path") == 1);
+
+	assert(count_hooks("/proc//self") == 1);
+	assert(count_hooks("/proc/./self/") == 1);
+	assert(count_hooks("//proc/self/./maps") == 1);
+	assert(count_hooks("/proc//selfish/") == 0);
+
+	/* can not be judged without resolving the path */
+	assert(count_hooks("/proc/self/..") == 1);
+
+	errno = 0;
+	assert(syscall(SYS_access, (const char *)8, F_OK) == -1);
+	assert(errno == EFAULT);
+
+	assert(intercept_path_filter_add("relative") == -1);
+	assert(intercept_path_filter_add("/dev/../sys") == -1);
+	assert(intercept_path_filter_add("/dev/") == 0);
+	assert(intercept_path_filter_add("/sys//./kernel/") == 0);
+
+	assert(count_hooks("/dev/null") == 1);
+	assert(count_hooks("/dev") == 1);
+	assert(count_hooks("/devices") == 0);
+	assert(count_hooks("/proc/self/maps") == 1);
+	assert(count_hooks("/sys/kernel/mm") == 1);
+	assert(count_hooks("/sys") == 0);
+
+	/* without path arguments */
+	(void) getppid();
+	assert(path_count == 13);
+
+	return EXIT_SUCCESS;
+}
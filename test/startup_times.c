@@ -0,0 +1,106 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * startup_times.c -- checks the times of the startup phases written to
+ * the log, with INTERCEPT_STARTUP_TIMES set to "log". The path of the log
+ * is expected in argv[1].
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char buffer[0x10000];
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		return EXIT_FAILURE;
+
+	int fd = open(argv[1], O_RDONLY);
+	assert(fd >= 0);
+
+	ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+	assert(size > 0);
+	buffer[size] = '\0';
+	close(fd);
+
+	char path[0x100];
+	unsigned long instructions;
+	unsigned syscalls;
+	unsigned patched;
+	unsigned long mprotect_calls;
+	unsigned long find_syscalls;
+	bool libc_seen = false;
+
+	for (char *line = strstr(buffer, "startup_times /"); line != NULL;
+	    line = strstr(line + 1, "startup_times /")) {
+		assert(sscanf(line, "startup_times %255s instructions %lu "
+			"syscalls %u patched %u mprotect_calls %lu "
+			"find_syscalls %lu",
+			path, &instructions, &syscalls, &patched,
+			&mprotect_calls, &find_syscalls) == 6);
+		assert(patched <= syscalls);
+		/* one range of pages made writable, then read-only */
+		assert(mprotect_calls == (patched > 0 ? 2 : 0));
+
+		if (strstr(path, "libc") != NULL) {
+			libc_seen = true;
+			assert(instructions > 0);
+			assert(syscalls > 0);
+			assert(mprotect_calls > 0);
+			assert(find_syscalls > 0);
+		}
+	}
+
+	assert(libc_seen);
+
+	unsigned long iterate_ns;
+	unsigned long total_ns;
+	char *total = strstr(buffer, "startup_times total ");
+	assert(total != NULL);
+	assert(sscanf(total, "startup_times total dl_iterate_phdr %lu "
+		"intercept %lu", &iterate_ns, &total_ns) == 2);
+	assert(iterate_ns > 0 && iterate_ns <= total_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_dispatch.c -- checks the syscalls caught by Syscall User Dispatch,
+ * made outside of the patched code: in the main thread, in a new thread, in
+ * a forked child, while the program blocks all signals, in a signal handler
+ * installed with all signals in its mask, and while the patches are removed.
+ * Run with INTERCEPT_SYSCALL_DISPATCH set. The text of this executable is
+ * not patched, each inline syscall instruction below is caught by the
+ * kernel.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static int getppid_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		__atomic_add_fetch(&getppid_count, 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+static int
+count(void)
+{
+	return __atomic_load_n(&getppid_count, __ATOMIC_RELAXED);
+}
+
+/*
+ * raw_getppid - a getppid syscall made outside of libc
+ */
+static long
+raw_getppid(void)
+{
+	long result;
+
+	__asm__ volatile("syscall"
+		: "=a" (result)
+		: "0" ((long)SYS_getppid)
+		: "rcx", "r11", "memory");
+
+	return result;
+}
+
+static void *
+thread_func(void *arg)
+{
+	(void) arg;
+
+	(void) raw_getppid();
+
+	return NULL;
+}
+
+static void
+run_thread(void)
+{
+	pthread_t thread;
+
+	assert(pthread_create(&thread, NULL, thread_func, NULL) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+}
+
+static void
+handler(int sig)
+{
+	(void) sig;
+
+	(void) raw_getppid();
+}
+
+static void
+check_signal_masks(void)
+{
+	sigset_t all;
+	sigset_t old;
+	int before = count();
+
+	sigfillset(&all);
+
+	/* SIGSYS stays unblocked */
+	assert(sigprocmask(SIG_BLOCK, &all, &old) == 0);
+	(void) raw_getppid();
+	assert(sigprocmask(SIG_SETMASK, &old, NULL) == 0);
+	assert(count() == before + 1);
+
+	/* SIGSYS is removed from the mask of the handler */
+	struct sigaction action;
+	struct sigaction current;
+
+	action.sa_handler = handler;
+	action.sa_mask = all;
+	action.sa_flags = 0;
+	assert(sigaction(SIGUSR1, &action, NULL) == 0);
+	assert(sigaction(SIGUSR1, NULL, &current) == 0);
+	assert(!sigismember(&current.sa_mask, SIGSYS));
+	assert(sigismember(&current.sa_mask, SIGUSR2));
+
+	assert(raise(SIGUSR1) == 0);
+	assert(count() == before + 2);
+}
+
+static void
+check_fork(void)
+{
+	int status;
+	int before = count();
+	pid_t pid = fork();
+
+	assert(pid >= 0);
+
+	if (pid == 0) {
+		(void) raw_getppid();
+		_exit(count() == before + 1 ? 0 : 1);
+	}
+
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int
+main(void)
+{
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = hook;
+
+	(void) raw_getppid();
+	assert(count() == 1);
+
+	run_thread();
+	assert(count() == 2);
+
+	check_signal_masks();
+	assert(count() == 4);
+
+	check_fork();
+
+	/* no syscall is caught while the patches are removed */
+	assert(intercept_patches_enable(0) == 1);
+	(void) raw_getppid();
+	(void) getppid();
+	run_thread();
+	assert(count() == 4);
+
+	/* caught again after the next patched syscall */
+	assert(intercept_patches_enable(1) == 0);
+	(void) getppid();
+	(void) raw_getppid();
+	assert(count() == 6);
+
+	return EXIT_SUCCESS;
+}
@@ -302,22 +302,23 @@ main(int argc, char **argv)
 	close(9);
 
 	/* stat */
-	stat(NULL, NULL);
-	stat("/", NULL);
-	stat(NULL, &statbuf);
-	stat("/", &statbuf);
-	fstat(0, NULL);
-	fstat(-1, NULL);
-	fstat(AT_FDCWD, &statbuf);
-	fstat(2, &statbuf);
-	lstat(NULL, NULL);
-	lstat("/", NULL);
-	lstat(NULL, &statbuf);
-	lstat("/", &statbuf);
-	fstatat(AT_FDCWD, input[0], NULL, 0);
-	fstatat(AT_FDCWD, NULL, NULL, 0);
-	fstatat(-1000, "", &statbuf, 0);
-	fstatat(AT_FDCWD, input[1], &statbuf, AT_SYMLINK_NOFOLLOW);
+	syscall(SYS_stat, NULL, NULL);
+	syscall(SYS_stat, "/", NULL);
+	syscall(SYS_stat, NULL, &statbuf);
+	syscall(SYS_stat, "/", &statbuf);
+	syscall(SYS_fstat, 0, NULL);
+	syscall(SYS_fstat, -1, NULL);
+	syscall(SYS_fstat, AT_FDCWD, &statbuf);
+	syscall(SYS_fstat, 2, &statbuf);
+	syscall(SYS_lstat, NULL, NULL);
+	syscall(SYS_lstat, "/", NULL);
+	syscall(SYS_lstat, NULL, &statbuf);
+	syscall(SYS_lstat, "/", &statbuf);
+	syscall(SYS_newfstatat, AT_FDCWD, input[0], NULL, 0);
+	syscall(SYS_newfstatat, AT_FDCWD, NULL, NULL, 0);
+	syscall(SYS_newfstatat, -1000, "", &statbuf, 0);
+	syscall(SYS_newfstatat, AT_FDCWD, input[1], &statbuf,
+	    AT_SYMLINK_NOFOLLOW);
 
 	poll(NULL, 0, 7);
 	poll(pfds, 3, 7);
@@ -380,15 +381,15 @@ main(int argc, char **argv)
 	access(input[0], X_OK);
 	access("", R_OK | W_OK);
 	access(input[0], X_OK | R_OK | W_OK);
-	faccessat(AT_FDCWD, NULL, F_OK, 0);
-	faccessat(AT_FDCWD, input[0], X_OK, 0);
-	faccessat(AT_FDCWD, "", R_OK | W_OK, 0);
-	faccessat(9, input[0], X_OK | R_OK | W_OK, 0);
+	syscall(SYS_faccessat, AT_FDCWD, NULL, F_OK, 0);
+	syscall(SYS_faccessat, AT_FDCWD, input[0], X_OK, 0);
+	syscall(SYS_faccessat, AT_FDCWD, "", R_OK | W_OK, 0);
+	syscall(SYS_faccessat, 9, input[0], X_OK | R_OK | W_OK, 0);
 
-	pipe(fd2);
+	syscall(SYS_pipe, fd2);
 	pipe2(fd2, 0);
 
-	select(2, p0, p1, p2, p3);
+	syscall(SYS_select, 2, p0, p1, p2, p3);
 	syscall(SYS_pselect6, 2, p0, p1, p0, p1, p0);
 
 	sched_yield();
@@ -406,7 +407,7 @@ main(int argc, char **argv)
 
 	pause();
 
-	nanosleep(p0, p1);
+	syscall(SYS_nanosleep, p0, p1);
 
 	getitimer(3, p0);
 
@@ -447,7 +448,7 @@ main(int argc, char **argv)
 
 	/* semaphores */
 	semget(4, 1, IPC_CREAT);
-	semop(4, p0, 1);
+	syscall(SYS_semop, 4, p0, 1);
 	semtimedop(4, p0, 1, p1);
 	semctl(1, 2, 3);
 
@@ -576,11 +577,11 @@ main(int argc, char **argv)
 	syscall(SYS_rt_sigsuspend, p0, 3);
 	syscall(SYS_sigaltstack, p0, p1);
 
-	utime(input[0], p0);
-	utimes(input[0], p0);
-	futimesat(4, input[0], p0);
+	syscall(SYS_utime, input[0], p0);
+	syscall(SYS_utimes, input[0], p0);
+	syscall(SYS_futimesat, 4, input[0], p0);
 
-	mknod(input[0], 1, 2);
+	syscall(SYS_mknod, input[0], 1, 2);
 	mknodat(1, input[0], 1, 2);
 	mknodat(AT_FDCWD, input[0], 1, 2);
 
@@ -613,7 +614,7 @@ main(int argc, char **argv)
 	prctl(PR_CAPBSET_DROP, 1, 2, 3, 4);
 	syscall(SYS_arch_prctl, ARCH_SET_FS, p0);
 
-	adjtimex(p0);
+	syscall(SYS_adjtimex, p0);
 
 	chroot(input[0]);
 
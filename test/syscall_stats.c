@@ -0,0 +1,178 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_stats.c -- checks the statistics dumped on a magic syscall,
+ * on a signal, and at the exit of a child process. The path of the
+ * statistics file is expected in argv[1], INTERCEPT_STATS_SIGNAL is
+ * expected to be SIGUSR1. When INTERCEPT_STATS_SITES is set, the busiest
+ * syscall instruction listed is also checked. The syscalls of threads
+ * already exited are expected to be counted as well.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "magic_syscalls.h"
+
+static char buffer[0x10000];
+
+/*
+ * count_lines - count the lines in the stats file, starting with prefix
+ */
+static int
+count_lines(const char *path, const char *prefix)
+{
+	int fd = open(path, O_RDONLY);
+	assert(fd >= 0);
+
+	ssize_t size = read(fd, buffer, sizeof(buffer) - 1);
+	assert(size > 0);
+	buffer[size] = '\0';
+	close(fd);
+
+	int count = 0;
+	for (char *line = buffer; line != NULL; line = strchr(line, '\n')) {
+		if (*line == '\n')
+			++line;
+		if (strncmp(line, prefix, strlen(prefix)) == 0)
+			++count;
+	}
+
+	return count;
+}
+
+/*
+ * check_sites - check the first line listing a syscall instruction,
+ * expected to be the one in the syscall function of libc
+ */
+static void
+check_sites(const char *path)
+{
+	assert(count_lines(path, "# site path offset count cycles") == 1);
+	assert(count_lines(path, "site ") >= 1);
+
+	char *line = strstr(buffer, "\nsite ");
+	assert(line != NULL);
+
+	char lib[0x100];
+	unsigned long offset;
+	unsigned long count;
+	unsigned long cycles;
+
+	assert(sscanf(line + 1, "site %255s 0x%lx %lu %lu",
+			lib, &offset, &count, &cycles) == 4);
+	assert(strstr(lib, "libc") != NULL);
+	assert(offset != 0);
+	assert(count >= 100);
+	assert(cycles > 0);
+}
+
+static void *
+thread_func(void *arg)
+{
+	(void) arg;
+
+	for (int i = 0; i < 7; ++i)
+		syscall(SYS_getppid);
+
+	return NULL;
+}
+
+/*
+ * check_threads - the counts of the exited threads are kept, while
+ * threads started later are reusing their memory
+ */
+static void
+check_threads(const char *path)
+{
+	for (int i = 0; i < 20; ++i) {
+		pthread_t thread;
+
+		assert(pthread_create(&thread, NULL, thread_func, NULL) == 0);
+		assert(pthread_join(thread, NULL) == 0);
+	}
+
+	magic_syscall_dump_stats();
+	assert(count_lines(path, "getppid 140 ") == 1);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc < 2)
+		return EXIT_FAILURE;
+
+	for (int i = 0; i < 100; ++i)
+		syscall(SYS_getuid);
+
+	magic_syscall_dump_stats();
+	assert(count_lines(argv[1], "# syscall_intercept stats") == 1);
+	assert(count_lines(argv[1], "getuid 100 ") == 1);
+
+	if (getenv("INTERCEPT_STATS_SITES") != NULL)
+		check_sites(argv[1]);
+	else
+		assert(count_lines(argv[1], "site ") == 0);
+
+	assert(raise(SIGUSR1) == 0);
+	assert(count_lines(argv[1], "getuid 100 ") == 2);
+
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		for (int i = 0; i < 5; ++i)
+			syscall(SYS_getuid);
+		_exit(0);
+	}
+
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(count_lines(argv[1], "getuid 5 ") == 1);
+
+	check_threads(argv[1]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * syscall_uring.c -- checks the syscalls executed by syscall_uring_hook,
+ * using a temporary file, from multiple threads, and in a child process.
+ * The test passes without checking anything, if io_uring is not available.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define THREAD_COUNT 4
+#define ITERATIONS 0x100
+
+static int fd;
+static int ring_hook_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	if (syscall_uring_hook(syscall_number, arg0, arg1, arg2, arg3,
+	    arg4, arg5, result) != 0)
+		return 1;
+
+	__atomic_add_fetch(&ring_hook_count, 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static void *
+thread_func(void *arg)
+{
+	long id = (long)arg;
+
+	for (long i = 0; i < ITERATIONS; ++i) {
+		long value = id * ITERATIONS + i;
+		long check;
+		off_t offset = (off_t)(value * sizeof(value));
+
+		assert(pwrite(fd, &value, sizeof(value), offset) ==
+		    sizeof(value));
+		assert(pread(fd, &check, sizeof(check), offset) ==
+		    sizeof(check));
+		assert(check == value);
+	}
+
+	return NULL;
+}
+
+int
+main(void)
+{
+	char path[] = "/tmp/syscall_uring_XXXXXX";
+	char buf[8];
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	assert(syscall_uring(SYS_getpid, 0, 0, 0, 0) == getpid());
+
+	int r = syscall_uring_setup(32, 0);
+	if (r == -ENOSYS || r == -EPERM) {
+		puts("io_uring not available");
+		return EXIT_SUCCESS;
+	}
+	assert(r == 0);
+	assert(syscall_uring_setup(32, 0) == -EBUSY);
+
+	intercept_hook_point = hook;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	assert(unlink(path) == 0);
+
+	/* write and read use the file position */
+	assert(write(fd, "abcd", 4) == 4);
+	assert(write(fd, "efgh", 4) == 4);
+	assert(fsync(fd) == 0);
+	assert(lseek(fd, 2, SEEK_SET) == 2);
+	assert(read(fd, buf, 4) == 4);
+	assert(memcmp(buf, "cdef", 4) == 0);
+	assert(read(fd, buf, 4) == 2);
+	assert(read(fd, buf, 4) == 0);
+	assert(read(-1, buf, 4) == -1 && errno == EBADF);
+	assert(ring_hook_count > 0);
+
+	pthread_t threads[THREAD_COUNT];
+
+	for (long i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_create(threads + i, NULL,
+		    thread_func, (void *)i) == 0);
+
+	for (long i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_join(threads[i], NULL) == 0);
+
+	/* a child process does not use the ring of the parent */
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		assert(pwrite(fd, "x", 1, 0) == 1);
+		_exit(0);
+	}
+
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	assert(pread(fd, buf, 1, 0) == 1 && buf[0] == 'x');
+
+	assert(close(fd) == 0);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * thread_bypass.c -- checks that the syscalls of a thread are not
+ * intercepted while intercept_hook_point_thread_bypass is enabled in
+ * the thread, and that the setting does not affect other threads.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static int getppid_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid)
+		__atomic_add_fetch(&getppid_count, 1, __ATOMIC_RELAXED);
+
+	return 1;
+}
+
+static void *
+thread_func(void *arg)
+{
+	(void) arg;
+
+	(void) getppid();
+
+	return NULL;
+}
+
+int
+main(void)
+{
+	pthread_t thread;
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = hook;
+
+	(void) getppid();
+	assert(getppid_count == 1);
+
+	assert(intercept_hook_point_thread_bypass(1) == 0);
+	assert(intercept_hook_point_thread_bypass(1) == 1);
+
+	(void) getppid();
+	assert(getppid_count == 1);
+
+	assert(pthread_create(&thread, NULL, thread_func, NULL) == 0);
+	assert(pthread_join(thread, NULL) == 0);
+	assert(getppid_count == 2);
+
+	assert(intercept_hook_point_thread_bypass(0) == 1);
+
+	(void) getppid();
+	assert(getppid_count == 3);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * thread_context.c -- checks that each thread gets a context of its own
+ * from intercept_hook_point_thread_context, initialized once, both in
+ * the main thread, and in threads created with pthread_create.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define THREAD_COUNT 4
+#define CALL_COUNT 100
+#define CONTEXT_MAGIC 0x51c0ffee
+
+struct context {
+	long magic;
+	long getppid_count;
+};
+
+static int init_count;
+
+static void
+init_context(void *arg)
+{
+	struct context *c = arg;
+
+	assert(c->magic == 0);
+	assert(c->getppid_count == 0);
+
+	c->magic = CONTEXT_MAGIC;
+	__atomic_add_fetch(&init_count, 1, __ATOMIC_RELAXED);
+}
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1,
+	long arg2, long arg3,
+	long arg4, long arg5,
+	long *result)
+{
+	(void) arg0;
+	(void) arg1;
+	(void) arg2;
+	(void) arg3;
+	(void) arg4;
+	(void) arg5;
+	(void) result;
+
+	if (syscall_number == SYS_getppid) {
+		struct context *c = intercept_hook_point_thread_context();
+
+		assert(c->magic == CONTEXT_MAGIC);
+		++c->getppid_count;
+	}
+
+	return 1;
+}
+
+static void
+check_calls(void)
+{
+	struct context *c = intercept_hook_point_thread_context();
+
+	assert(c != NULL);
+
+	for (int i = 0; i < CALL_COUNT; ++i)
+		(void) getppid();
+
+	assert(c == intercept_hook_point_thread_context());
+	assert(c->getppid_count == CALL_COUNT);
+}
+
+static void *
+thread_func(void *arg)
+{
+	(void) arg;
+
+	check_calls();
+
+	return NULL;
+}
+
+int
+main(void)
+{
+	pthread_t threads[THREAD_COUNT];
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	assert(intercept_hook_point_thread_context() == NULL);
+	assert(intercept_hook_point_thread_context_setup(0, NULL) == -1);
+	assert(intercept_hook_point_thread_context_setup(
+			sizeof(struct context), init_context) == 0);
+	assert(intercept_hook_point_thread_context_setup(
+			sizeof(struct context), init_context) == -1);
+
+	intercept_hook_point = hook;
+
+	check_calls();
+	assert(init_count == 1);
+
+	for (int i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_create(threads + i, NULL,
+					thread_func, NULL) == 0);
+
+	for (int i = 0; i < THREAD_COUNT; ++i)
+		assert(pthread_join(threads[i], NULL) == 0);
+
+	assert(init_count == 1 + THREAD_COUNT);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * vdso_hook.c -- checks intercept_hook_point_vdso, by returning fake
+ * time from clock_gettime, gettimeofday, and time.
+ * The program is linked with -z now, so the GOT entries of the time, and
+ * gettimeofday IFUNCs point to the vDSO by the time the library
+ * initializes.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+#define FAKE_TIME 12345
+
+static int hook_count;
+
+static int
+hook(long syscall_number,
+	long arg0, long arg1, long arg2,
+	long *result)
+{
+	(void) arg2;
+
+	++hook_count;
+
+	switch (syscall_number) {
+		case SYS_clock_gettime:
+			if (arg0 != CLOCK_REALTIME)
+				return 1;
+			((struct timespec *)arg1)->tv_sec = FAKE_TIME;
+			((struct timespec *)arg1)->tv_nsec = 0;
+			*result = 0;
+			return 0;
+		case SYS_gettimeofday:
+			((struct timeval *)arg0)->tv_sec = FAKE_TIME;
+			((struct timeval *)arg0)->tv_usec = 0;
+			*result = 0;
+			return 0;
+		case SYS_time:
+			if (arg0 != 0)
+				*(time_t *)arg0 = FAKE_TIME;
+			*result = FAKE_TIME;
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+int
+main(void)
+{
+	struct timespec ts;
+	struct timeval tv;
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point_vdso = hook;
+
+	assert(clock_gettime(CLOCK_REALTIME, &ts) == 0);
+	assert(ts.tv_sec == FAKE_TIME && ts.tv_nsec == 0);
+
+	assert(gettimeofday(&tv, NULL) == 0);
+	assert(tv.tv_sec == FAKE_TIME);
+
+	assert(time(NULL) == FAKE_TIME);
+
+	/* other clocks are forwarded to the vDSO */
+	assert(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+
+	int count = hook_count;
+
+	assert(syscall_vdso_no_intercept(SYS_clock_gettime, CLOCK_REALTIME,
+	    (long)&ts, 0) == 0);
+	assert(ts.tv_sec > FAKE_TIME);
+	assert(hook_count == count);
+
+	intercept_hook_point_vdso = NULL;
+	assert(time(NULL) > FAKE_TIME);
+
+	return EXIT_SUCCESS;
+}
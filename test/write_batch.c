@@ -0,0 +1,225 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * write_batch.c -- checks the coalescing of small writes done by
+ * intercept_write_batch_hook, using a pipe: data that is buffered can not
+ * yet be read from the other end of the pipe.
+ */
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libsyscall_intercept_hook_point.h"
+
+static int fds[2];
+
+/* A blocking pipe, filled up before the signal handler is triggered */
+static int full_fds[2];
+static size_t full_size;
+static volatile int handler_done;
+
+static void
+expect_data(const char *expected)
+{
+	char buf[0x100];
+	ssize_t r = read(fds[0], buf, sizeof(buf));
+
+	if (expected == NULL) {
+		assert(r == -1 && errno == EAGAIN);
+	} else {
+		assert(r == (ssize_t)strlen(expected));
+		assert(memcmp(buf, expected, (size_t)r) == 0);
+	}
+}
+
+/*
+ * Interrupts a write blocked while flushing the buffer of full_fds[1].
+ * The fsync syscall refers to the same fd, it must not wait for the
+ * interrupted thread to finish the flush.
+ */
+static void
+handler(int sig)
+{
+	char buf[0x1000];
+
+	(void) sig;
+
+	for (size_t done = 0; done < full_size; ) {
+		size_t len = full_size - done;
+
+		if (len > sizeof(buf))
+			len = sizeof(buf);
+
+		ssize_t r = read(full_fds[0], buf, len);
+
+		assert(r > 0);
+		done += (size_t)r;
+	}
+
+	assert(fsync(full_fds[1]) == -1);
+	handler_done = 1;
+}
+
+/*
+ * fill_pipe - writes to a pipe until it can't take more data
+ */
+static size_t
+fill_pipe(int fd)
+{
+	char buf[0x1000];
+	size_t size = 0;
+	ssize_t r;
+
+	memset(buf, 'z', sizeof(buf));
+	assert(fcntl(fd, F_SETFL, O_NONBLOCK) == 0);
+	while ((r = write(fd, buf, sizeof(buf))) > 0)
+		size += (size_t)r;
+	assert(errno == EAGAIN);
+	assert(fcntl(fd, F_SETFL, 0) == 0);
+
+	return size;
+}
+
+static void
+check_signal_during_flush(void)
+{
+	char large[100];
+	char buf[sizeof(large) + 1];
+	struct sigaction sa;
+	struct itimerval timer;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handler;
+	assert(sigaction(SIGALRM, &sa, NULL) == 0);
+
+	assert(pipe(full_fds) == 0);
+	full_size = fill_pipe(full_fds[1]);
+
+	assert(intercept_write_batch_setup(full_fds[1], 64, 0) == 0);
+	assert(write(full_fds[1], "k", 1) == 1);
+
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_usec = 50000;
+	assert(setitimer(ITIMER_REAL, &timer, NULL) == 0);
+
+	/* blocks in the flush, until the handler empties the pipe */
+	memset(large, 'l', sizeof(large));
+	assert(write(full_fds[1], large, sizeof(large)) == sizeof(large));
+	assert(handler_done);
+
+	assert(read(full_fds[0], buf, sizeof(buf)) == sizeof(buf));
+	assert(buf[0] == 'k' && memcmp(buf + 1, large, sizeof(large)) == 0);
+}
+
+int
+main(void)
+{
+	char large[100];
+
+	if (!syscall_hook_in_process_allowed())
+		return EXIT_FAILURE;
+
+	intercept_hook_point = intercept_write_batch_hook;
+
+	assert(pipe2(fds, O_NONBLOCK) == 0);
+
+	assert(intercept_write_batch_setup(-1, 64, 0) == -1);
+	assert(intercept_write_batch_setup(INTERCEPT_WRITE_BATCH_FD_LIMIT,
+	    64, 0) == -1);
+	assert(intercept_write_batch_setup(fds[1], 64, 0) == 0);
+
+	/* small writes are buffered, until a syscall refers to the fd */
+	assert(write(fds[1], "a", 1) == 1);
+	assert(write(fds[1], "bc", 2) == 2);
+	expect_data(NULL);
+	assert(fsync(fds[1]) == -1);
+	expect_data("abc");
+
+	/* a write not fitting into the buffer is written with the data */
+	assert(write(fds[1], "d", 1) == 1);
+	memset(large, 'x', sizeof(large));
+	assert(write(fds[1], large, sizeof(large)) == sizeof(large));
+	char *buf = malloc(sizeof(large) + 1);
+	assert(read(fds[0], buf, sizeof(large) + 1) == sizeof(large) + 1);
+	assert(buf[0] == 'd' && memcmp(buf + 1, large, sizeof(large)) == 0);
+	free(buf);
+
+	/* explicit flush */
+	assert(write(fds[1], "e", 1) == 1);
+	expect_data(NULL);
+	assert(intercept_write_batch_flush(fds[1]) == 0);
+	expect_data("e");
+
+	/* time limit, the second write finds the first one too old */
+	assert(intercept_write_batch_setup(fds[1], 64, 1) == 0);
+	assert(write(fds[1], "f", 1) == 1);
+	usleep(1000);
+	assert(write(fds[1], "g", 1) == 1);
+	expect_data("fg");
+
+	/* the buffered data is written when a child process exits */
+	assert(intercept_write_batch_setup(fds[1], 64, 0) == 0);
+	pid_t pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		assert(write(fds[1], "h", 1) == 1);
+		_exit(0);
+	}
+	int status;
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	expect_data("h");
+
+	/* closing the fd disables batching */
+	assert(write(fds[1], "i", 1) == 1);
+	assert(close(fds[1]) == 0);
+	expect_data("i");
+	assert(pipe2(fds, O_NONBLOCK) == 0);
+	assert(write(fds[1], "j", 1) == 1);
+	expect_data("j");
+
+	check_signal_during_flush();
+
+	return EXIT_SUCCESS;
+}
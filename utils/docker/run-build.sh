@@ -67,6 +67,7 @@ mkdir build
 cd build
 cmake .. -DCMAKE_INSTALL_PREFIX=/tmp/${PROJECT} \
 		-DCMAKE_BUILD_TYPE=Release \
+		-DUSE_BUILTIN_DISASM=ON \
 
 make -j2
 ldd ./libsyscall_intercept.so
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * log_decoder.c -- convert a binary log of syscall_intercept to text
+ *
+ * Usage: log_decoder [-t] binary_log [output]
+ *
+ * Each syscall record is printed in the same format as used in a text log,
+ * optionally prefixed by the id of the thread, and the timestamp taken when
+ * logging the syscall (-t option).
+ */
+
+#include "intercept_log.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+enum { MAX_OBJECTS = 0x10000, LINE_MAX_SIZE = 0x1000 };
+
+static const char *objects[MAX_OBJECTS];
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-t] binary_log [output]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+static void
+corrupt_log(long offset)
+{
+	fprintf(stderr, "invalid record at offset %ld\n", offset);
+	exit(EXIT_FAILURE);
+}
+
+static char *
+read_log(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	size_t capacity = 0x10000;
+	char *data = malloc(capacity);
+	*size = 0;
+
+	while (data != NULL) {
+		*size += fread(data + *size, 1, capacity - *size, f);
+		if (*size < capacity)
+			break;
+
+		capacity *= 2;
+		data = realloc(data, capacity);
+	}
+
+	if (data == NULL || ferror(f)) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	fclose(f);
+
+	return data;
+}
+
+static void
+print_syscall_record(FILE *out, const struct binary_log_syscall *record,
+			bool print_timestamps)
+{
+	char line[LINE_MAX_SIZE];
+	const char *path = objects[record->header.object_id];
+
+	if (path == NULL)
+		path = "(unknown)";
+
+	char *end = intercept_log_print_binary_syscall(line, record, path);
+
+	if (print_timestamps)
+		fprintf(out, "%" PRIi32 " %" PRIu64 " ",
+			record->tid, record->timestamp);
+
+	fwrite(line, 1, (size_t)(end - line), out);
+}
+
+static bool
+is_valid_syscall_record(const struct binary_log_syscall *record)
+{
+	size_t size = sizeof(*record);
+
+	if (record->header.size < size)
+		return false;
+
+	/*
+	 * A capture size can't exceed BINARY_LOG_CAPTURE_LIMIT, as that is
+	 * the largest value an uint8_t can hold.
+	 */
+	for (int i = 0; i < 6; ++i)
+		size += record->capture_sizes[i];
+
+	return size <= record->header.size;
+}
+
+int
+main(int argc, char **argv)
+{
+	bool print_timestamps = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t")) != -1) {
+		if (opt == 't')
+			print_timestamps = true;
+		else
+			usage(argv[0]);
+	}
+
+	if (optind >= argc || argc - optind > 2)
+		usage(argv[0]);
+
+	intercept_setup_log_buffers(getenv("INTERCEPT_LOG_BUFFERS"));
+
+	FILE *out = stdout;
+	if (argc - optind == 2) {
+		out = fopen(argv[optind + 1], "w");
+		if (out == NULL) {
+			perror(argv[optind + 1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	size_t size;
+	char *data = read_log(argv[optind], &size);
+	size_t offset = 0;
+
+	while (offset + sizeof(struct binary_log_header) <= size) {
+		const struct binary_log_header *header =
+		    (const struct binary_log_header *)(data + offset);
+
+		if (header->size < sizeof(*header) ||
+		    header->size % 8 != 0 ||
+		    header->size > size - offset)
+			corrupt_log((long)offset);
+
+		if (offset == 0 && header->type != blog_file) {
+			fprintf(stderr, "%s is not a binary log\n",
+				argv[optind]);
+			return EXIT_FAILURE;
+		}
+
+		const char *payload = (const char *)(header + 1);
+		size_t payload_size = header->size - sizeof(*header);
+
+		switch (header->type) {
+		case blog_file:
+			if (strncmp(payload, BINARY_LOG_MAGIC,
+			    payload_size) != 0)
+				corrupt_log((long)offset);
+			break;
+		case blog_object:
+			if (strnlen(payload, payload_size) == payload_size)
+				corrupt_log((long)offset);
+			objects[header->object_id] = payload;
+			break;
+		case blog_syscall:
+			if (!is_valid_syscall_record((const void *)header))
+				corrupt_log((long)offset);
+			print_syscall_record(out, (const void *)header,
+					print_timestamps);
+			break;
+		default:
+			/* unknown record types are skipped */
+			break;
+		}
+
+		offset += header->size;
+	}
+
+	if (offset != size)
+		corrupt_log((long)offset);
+
+	if (out != stdout)
+		fclose(out);
+
+	free(data);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * syscall_hook_in_process_allowed - this symbol must be provided to
+ * be able to link with syscall_intercept's objects (other then the one
+ * created from cmdline_filter.c). Returning zero here also makes sure
+ * the library constructor does not try to hotpatch anything in the
+ * decoder process.
+ */
+int
+syscall_hook_in_process_allowed(void)
+{
+	return 0;
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright 2017, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *
+ *     * Neither the name of the copyright holder nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * shm_log_reader.c -- drain the shared memory ring buffer of syscall_intercept
+ *
+ * Usage: shm_log_reader [-n] ring_file [output]
+ *
+ * The data published in the ring buffer by the processes using the
+ * INTERCEPT_LOG_SHM environment variable is written to the output (stdout
+ * by default), which thus contains the same as a log file would. By default
+ * the reader keeps polling the ring buffer for new records, until it is
+ * interrupted by SIGINT or SIGTERM, waiting for the ring buffer to be
+ * created if needed. With the -n option, it exits after consuming all the
+ * records already available.
+ */
+
+#include "intercept_log.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t interrupted;
+
+static void
+handle_signal(int signum)
+{
+	(void) signum;
+
+	interrupted = 1;
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n] ring_file [output]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * map_ring - map the file containing the ring buffer to memory. Returns
+ * NULL if the file doesn't exist, or the ring buffer in it is not
+ * initialized yet.
+ */
+static struct shm_log_ring *
+map_ring(const char *path)
+{
+	struct stat st;
+	int fd = open(path, O_RDWR);
+
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 ||
+	    (size_t)st.st_size < sizeof(struct shm_log_ring)) {
+		close(fd);
+		return NULL;
+	}
+
+	struct shm_log_ring *ring = mmap(NULL, (size_t)st.st_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (strncmp(ring->magic, SHM_LOG_MAGIC, sizeof(ring->magic)) != 0 ||
+	    ring->size == 0 || (ring->size & (ring->size - 1)) != 0 ||
+	    ring->size > (uint64_t)st.st_size - sizeof(*ring)) {
+		munmap(ring, (size_t)st.st_size);
+		return NULL;
+	}
+
+	return ring;
+}
+
+/*
+ * ring_bytes - return a pointer to a position in the ring buffer, and
+ * the number of bytes available there before wrapping around
+ */
+static char *
+ring_bytes(struct shm_log_ring *ring, uint64_t position, size_t *available)
+{
+	size_t offset = (size_t)(position & (ring->size - 1));
+
+	*available = (size_t)ring->size - offset;
+
+	return ring->data + offset;
+}
+
+/*
+ * consume_record - write the data from the record at the tail of the ring
+ * buffer to the output, and release the space used by the record.
+ * Returns false if there is no committed record at the tail.
+ */
+static bool
+consume_record(struct shm_log_ring *ring, FILE *out)
+{
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	size_t available;
+	struct shm_log_record *record =
+	    (struct shm_log_record *)ring_bytes(ring, tail, &available);
+
+	if (__atomic_load_n(&record->is_committed, __ATOMIC_ACQUIRE) == 0)
+		return false;
+
+	size_t size = record->size;
+	uint64_t record_size = (sizeof(*record) + size + 7) & ~7;
+	uint64_t position = tail + sizeof(*record);
+
+	while (size > 0) {
+		char *data = ring_bytes(ring, position, &available);
+		if (available > size)
+			available = size;
+
+		fwrite(data, 1, available, out);
+		size -= available;
+		position += available;
+	}
+
+	for (position = tail; position < tail + record_size; ) {
+		char *data = ring_bytes(ring, position, &available);
+		if (available > tail + record_size - position)
+			available = (size_t)(tail + record_size - position);
+
+		memset(data, 0, available);
+		position += available;
+	}
+
+	__atomic_store_n(&ring->tail, tail + record_size, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+int
+main(int argc, char **argv)
+{
+	bool follow = true;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n")) != -1) {
+		if (opt == 'n')
+			follow = false;
+		else
+			usage(argv[0]);
+	}
+
+	if (optind >= argc || argc - optind > 2)
+		usage(argv[0]);
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	const struct timespec poll_interval = { .tv_nsec = 1000000 };
+	struct shm_log_ring *ring;
+
+	/* when following the log, wait for the ring buffer to be created */
+	while ((ring = map_ring(argv[optind])) == NULL) {
+		if (!follow || interrupted) {
+			fprintf(stderr, "%s is not a ring buffer\n",
+				argv[optind]);
+			return EXIT_FAILURE;
+		}
+
+		nanosleep(&poll_interval, NULL);
+	}
+
+	FILE *out = stdout;
+	if (argc - optind == 2) {
+		out = fopen(argv[optind + 1], "w");
+		if (out == NULL) {
+			perror(argv[optind + 1]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (;;) {
+		if (consume_record(ring, out))
+			continue;
+
+		if (!follow || interrupted)
+			break;
+
+		fflush(out);
+		nanosleep(&poll_interval, NULL);
+	}
+
+	uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	if (dropped > 0)
+		fprintf(stderr, "%" PRIu64 " records dropped\n", dropped);
+
+	if (out != stdout)
+		fclose(out);
+
+	return EXIT_SUCCESS;
+}